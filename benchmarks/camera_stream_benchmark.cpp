@@ -0,0 +1,240 @@
+// The gRPC camera stream server with clients on loopback: synthetic frames are published into the frame storage at the
+// camera rate, and every client streams them in the same format. Reports the frames each client received, the
+// publish-to-receive latency and how many encodings the server made for them. Needs no Pylon, RMP or camera.
+// Run with --help for the options.
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <grpcpp/grpcpp.h>
+
+#include "camera_stream_server.h"
+#include "camera_streaming.grpc.pb.h"
+#include "frame.h"
+#include "synthetic_frames.h"
+
+namespace
+{
+  struct Options
+  {
+    double seconds = 5.0;
+    double rateHz = 60.0; // Publish rate, like the camera
+    int clients = 4;
+    int maxFps = 0;       // max_fps of every stream, 0 for every frame
+    int quality = 80;     // compression_quality of every stream
+    rsi::camera::ImageFormat format = rsi::camera::FORMAT_JPEG;
+  };
+
+  void PrintUsage(const char *program)
+  {
+    std::printf("Usage: %s [--seconds S] [--rate HZ] [--clients N] [--max-fps FPS] [--quality Q] "
+                "[--format jpeg|yuyv|rgb|png|grayscale]\n", program);
+  }
+
+  bool ParseOptions(int argc, char **argv, Options &options)
+  {
+    for (int i = 1; i < argc; ++i)
+    {
+      const std::string arg = argv[i];
+      if (arg == "--help" || i + 1 >= argc)
+        return false;
+
+      const std::string value = argv[++i];
+      if (arg == "--seconds")
+        options.seconds = std::max(0.5, std::strtod(value.c_str(), nullptr));
+      else if (arg == "--rate")
+        options.rateHz = std::clamp(std::strtod(value.c_str(), nullptr), 1.0, 1000.0);
+      else if (arg == "--clients")
+        options.clients = std::clamp(std::atoi(value.c_str()), 1, 64);
+      else if (arg == "--max-fps")
+        options.maxFps = std::max(0, std::atoi(value.c_str()));
+      else if (arg == "--quality")
+        options.quality = std::clamp(std::atoi(value.c_str()), 1, 100);
+      else if (arg == "--format")
+      {
+        std::string name = "FORMAT_" + value;
+        std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c) { return std::toupper(c); });
+        if (!rsi::camera::ImageFormat_Parse(name, &options.format) || options.format == rsi::camera::FORMAT_UNKNOWN)
+          return false;
+      }
+      else
+        return false;
+    }
+    return true;
+  }
+
+  int64_t NowUs()
+  {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+  // Prints min, median, p99 and max of samples in milliseconds
+  void PrintSamples(const char *name, std::vector<double> &samples)
+  {
+    if (samples.empty())
+    {
+      std::printf("%-28s %10s\n", name, "-");
+      return;
+    }
+    std::sort(samples.begin(), samples.end());
+    const double p99 = samples[std::min<size_t>(samples.size() - 1, static_cast<size_t>(samples.size() * 0.99))];
+    std::printf("%-28s %10.2f %10.2f %10.2f %10.2f\n", name, samples.front(), samples[samples.size() / 2], p99, samples.back());
+  }
+
+  struct ClientResult
+  {
+    std::vector<double> latencyMs; // Publish to receive
+    int64_t bytes = 0;
+    int64_t badFrames = 0; // Wrong format, size or frame number order
+    grpc::Status status;
+  };
+
+  // Expected size of a raw image, 0 for the compressed formats
+  size_t RawImageSize(rsi::camera::ImageFormat format)
+  {
+    const size_t pixels = static_cast<size_t>(CameraHelpers::IMAGE_WIDTH) * CameraHelpers::IMAGE_HEIGHT;
+    switch (format)
+    {
+    case rsi::camera::FORMAT_YUYV:
+      return pixels * 2;
+    case rsi::camera::FORMAT_RGB:
+      return pixels * 3;
+    case rsi::camera::FORMAT_GRAYSCALE:
+      return pixels;
+    default:
+      return 0;
+    }
+  }
+
+  // Streams until the context is cancelled
+  void RunClient(rsi::camera::CameraStreamService::Stub &stub, grpc::ClientContext &context, const Options &options,
+                 ClientResult &result)
+  {
+    rsi::camera::StreamRequest request;
+    request.set_max_fps(options.maxFps);
+    request.set_format(options.format);
+    request.set_compression_quality(options.quality);
+
+    const size_t rawSize = RawImageSize(options.format);
+    std::unique_ptr<grpc::ClientReader<rsi::camera::CameraFrame>> reader = stub.StreamCameraFrames(&context, request);
+    rsi::camera::CameraFrame frame;
+    int32_t lastFrameNumber = 0;
+    while (reader->Read(&frame))
+    {
+      result.latencyMs.push_back((NowUs() - frame.timestamp_us()) / 1000.0);
+      result.bytes += static_cast<int64_t>(frame.image_data().size());
+      if (frame.format() != options.format || frame.frame_number() <= lastFrameNumber ||
+          (rawSize != 0 ? frame.image_data().size() != rawSize : frame.image_data().empty()))
+        ++result.badFrames;
+      lastFrameNumber = frame.frame_number();
+    }
+    result.status = reader->Finish();
+  }
+}
+
+int main(int argc, char **argv)
+{
+  Options options;
+  if (!ParseOptions(argc, argv, options))
+  {
+    PrintUsage(argv[0]);
+    return 1;
+  }
+
+  // Frames of a ball moving in a circle, rendered up front so publishing costs only the copy
+  constexpr int SCENE_FRAMES = 32;
+  CameraHelpers::SyntheticFrameGenerator generator;
+  std::vector<std::vector<uint8_t>> scene(SCENE_FRAMES, std::vector<uint8_t>(CameraHelpers::IMAGE_SIZE_YUYV));
+  for (int i = 0; i < SCENE_FRAMES; ++i)
+  {
+    const float angle = 6.2831853f * i / SCENE_FRAMES;
+    generator.Render(scene[i].data(), CameraHelpers::IMAGE_WIDTH * (0.5f + 0.3f * std::cos(angle)),
+                     CameraHelpers::IMAGE_HEIGHT * (0.5f + 0.3f * std::sin(angle)));
+  }
+
+  auto storage = std::make_shared<FrameStorage>();
+  PreviewHelpers::CameraStreamServer server("127.0.0.1:0", options.clients, options.quality, storage);
+  const std::string address = "127.0.0.1:" + std::to_string(server.Port());
+  std::printf("Server on %s, %d clients streaming %s at quality %d, max_fps %d, %.0f frames/s published for %.1f s\n",
+              address.c_str(), options.clients, rsi::camera::ImageFormat_Name(options.format).c_str(), options.quality,
+              options.maxFps, options.rateHz, options.seconds);
+
+  std::unique_ptr<rsi::camera::CameraStreamService::Stub> stub = rsi::camera::CameraStreamService::NewStub(
+      grpc::CreateChannel(address, grpc::InsecureChannelCredentials()));
+
+  std::vector<std::unique_ptr<grpc::ClientContext>> contexts;
+  std::vector<ClientResult> results(options.clients);
+  std::vector<std::thread> clients;
+  for (int i = 0; i < options.clients; ++i)
+  {
+    contexts.push_back(std::make_unique<grpc::ClientContext>());
+    clients.emplace_back([&, i, context = contexts.back().get()] { RunClient(*stub, *context, options, results[i]); });
+  }
+  const auto connectDeadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  while (server.Clients() < options.clients && std::chrono::steady_clock::now() < connectDeadline)
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+  // Publish like DetectBall does, info.timestamp holds the publish time in us
+  SharedDataHelpers::SPMCStorageWriter writer(storage);
+  const auto period = std::chrono::nanoseconds(static_cast<int64_t>(1e9 / options.rateHz));
+  const int frames = static_cast<int>(options.seconds * options.rateHz);
+  auto next = std::chrono::steady_clock::now();
+  for (int i = 1; i <= frames; ++i)
+  {
+    next += period;
+    std::this_thread::sleep_until(next);
+    Frame &frame = writer.data();
+    std::copy(scene[i % SCENE_FRAMES].begin(), scene[i % SCENE_FRAMES].end(), frame.imageData);
+    frame.info = FrameInfo{};
+    frame.info.frameNumber = i;
+    frame.info.pixelFormat = static_cast<int>(CameraHelpers::PixelFormat::YUYV);
+    frame.info.timestamp = static_cast<double>(NowUs());
+    writer.publish();
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(200)); // Let the last frame reach the clients
+
+  // GetLatestFrame of the same encoding shares the last one
+  rsi::camera::FrameRequest latestRequest;
+  latestRequest.set_format(options.format);
+  latestRequest.set_compression_quality(options.quality);
+  rsi::camera::CameraFrame latest;
+  grpc::ClientContext latestContext;
+  const grpc::Status latestStatus = stub->GetLatestFrame(&latestContext, latestRequest, &latest);
+
+  for (std::unique_ptr<grpc::ClientContext> &context : contexts)
+    context->TryCancel();
+  for (std::thread &client : clients)
+    client.join();
+
+  std::printf("%-28s %10s %10s %10s %10s   (ms)\n", "", "min", "median", "p99", "max");
+  bool ok = latestStatus.ok() && latest.frame_number() == frames;
+  int64_t badFrames = 0;
+  for (int i = 0; i < options.clients; ++i)
+  {
+    ClientResult &result = results[i];
+    const std::string label = "publish to receive, client " + std::to_string(i);
+    const size_t received = result.latencyMs.size();
+    PrintSamples(label.c_str(), result.latencyMs);
+    std::printf("%-28s %10zu (%.1f%%), %.0f KB each\n", "  frames received", received, 100.0 * received / frames,
+                received > 0 ? result.bytes / 1024.0 / received : 0.0);
+    badFrames += result.badFrames;
+    ok = ok && received > 0 && result.status.error_code() == grpc::StatusCode::CANCELLED;
+  }
+
+  // Every client asked for the same encoding, so no frame should have been encoded twice
+  const uint64_t encoded = server.EncodedFrames();
+  std::printf("\nFrames published %d, encoded %llu, sent %llu, latest frame %d (%s)\n", frames,
+              static_cast<unsigned long long>(encoded), static_cast<unsigned long long>(server.SentFrames()),
+              latest.frame_number(), latestStatus.ok() ? "ok" : latestStatus.error_message().c_str());
+  std::printf("Bad frames: %lld\n", static_cast<long long>(badFrames));
+  ok = ok && badFrames == 0 && encoded <= static_cast<uint64_t>(frames);
+  return ok ? 0 : 1;
+}
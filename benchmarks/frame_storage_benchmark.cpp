@@ -0,0 +1,253 @@
+// Throughput and latency of the storage DetectBall hands copied frames to OutputImage through: the SPSC triple buffer
+// against the SPMC latest-frame storage with one or more readers. Needs no OpenCV, Pylon, RMP or camera.
+// Run with --help for the options.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "camera_helpers.h"
+#include "frame.h"
+#include "shared_data_helpers.h"
+
+namespace
+{
+  constexpr uint32_t MAX_READERS = 8;
+
+  struct Options
+  {
+    int frames = 20000;   // Frames the writer publishes per run
+    int readers = 3;      // Readers of the SPMC storage, the triple buffer always has one
+    double holdUs = 50.0; // Time a reader keeps each frame, like OutputImage encoding it
+  };
+
+  void PrintUsage(const char *program)
+  {
+    std::printf("Usage: %s [--frames N] [--readers N] [--hold-us MICROSECONDS]\n", program);
+  }
+
+  bool ParseOptions(int argc, char **argv, Options &options)
+  {
+    for (int i = 1; i < argc; ++i)
+    {
+      const std::string arg = argv[i];
+      if (arg == "--help" || i + 1 >= argc)
+        return false;
+
+      const char *value = argv[++i];
+      if (arg == "--frames")
+        options.frames = std::max(1, std::atoi(value));
+      else if (arg == "--readers")
+        options.readers = std::clamp(std::atoi(value), 1, static_cast<int>(MAX_READERS));
+      else if (arg == "--hold-us")
+        options.holdUs = std::max(0.0, std::strtod(value, nullptr));
+      else
+        return false;
+    }
+    return true;
+  }
+
+  int64_t NowNs()
+  {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+  // Prints min, median, p99 and max of samples in microseconds
+  void PrintSamples(const char *name, std::vector<double> &samples)
+  {
+    if (samples.empty())
+    {
+      std::printf("%-28s %10s\n", name, "-");
+      return;
+    }
+    std::sort(samples.begin(), samples.end());
+    const double p99 = samples[std::min<size_t>(samples.size() - 1, static_cast<size_t>(samples.size() * 0.99))];
+    std::printf("%-28s %10.2f %10.2f %10.2f %10.2f\n", name, samples.front(), samples[samples.size() / 2], p99, samples.back());
+  }
+
+  // The image copy of DetectBall, with the frame number at both ends of the image so a reader can tell a torn frame.
+  // info.timestamp holds the publish time in ns.
+  void FillFrame(Frame &frame, const std::vector<uint8_t> &image, int frameNumber)
+  {
+    std::memcpy(frame.imageData, image.data(), image.size());
+    std::memcpy(frame.imageData, &frameNumber, sizeof(frameNumber));
+    std::memcpy(frame.imageData + image.size() - sizeof(frameNumber), &frameNumber, sizeof(frameNumber));
+    frame.info.frameNumber = frameNumber;
+  }
+
+  bool IsTorn(const Frame &frame, size_t imageSize)
+  {
+    int first = 0, last = 0;
+    std::memcpy(&first, frame.imageData, sizeof(first));
+    std::memcpy(&last, frame.imageData + imageSize - sizeof(last), sizeof(last));
+    return first != frame.info.frameNumber || last != frame.info.frameNumber;
+  }
+
+  void Hold(double us)
+  {
+    const int64_t end = NowNs() + static_cast<int64_t>(us * 1000.0);
+    while (NowNs() < end)
+    {
+    }
+  }
+
+  struct RunResult
+  {
+    std::vector<double> publishUs;              // Copy and publish time of every frame
+    std::vector<std::vector<double>> latencyUs; // Publish to take, of every frame each reader took
+    int64_t tornFrames = 0;
+    double seconds = 0.0;
+  };
+
+  // One writer publishes options.frames frames as fast as it can while readerCount readers take the newest one.
+  // publish(frameNumber) fills and publishes a frame. take(reader) returns the newly taken frame or nullptr, the frame
+  // stays the reader's until its next take.
+  RunResult Run(const Options &options, int readerCount, const std::function<void(int)> &publish,
+                const std::function<const Frame *(int)> &take)
+  {
+    RunResult result;
+    result.publishUs.resize(options.frames);
+    result.latencyUs.resize(readerCount);
+    std::atomic<bool> done{false};
+    std::atomic<int64_t> torn{0};
+    const size_t imageSize = CameraHelpers::FrameBytes(CameraHelpers::PixelFormat::YUYV);
+
+    std::vector<std::thread> readers;
+    for (int reader = 0; reader < readerCount; ++reader)
+    {
+      readers.emplace_back([&, reader]
+      {
+        std::vector<double> &latencies = result.latencyUs[reader];
+        latencies.reserve(options.frames);
+        while (true)
+        {
+          const bool last = done.load(std::memory_order_acquire);
+          const Frame *frame = take(reader);
+          if (frame == nullptr)
+          {
+            if (last)
+              break;
+            std::this_thread::yield();
+            continue;
+          }
+          latencies.push_back((NowNs() - frame->info.timestamp) / 1000.0);
+          Hold(options.holdUs);
+          if (IsTorn(*frame, imageSize))
+            torn.fetch_add(1, std::memory_order_relaxed);
+        }
+      });
+    }
+
+    const int64_t start = NowNs();
+    for (int i = 0; i < options.frames; ++i)
+    {
+      const int64_t publishStart = NowNs();
+      publish(i);
+      result.publishUs[i] = (NowNs() - publishStart) / 1000.0;
+      if (readerCount > 0)
+        std::this_thread::yield(); // Let readers on the same core run
+    }
+    result.seconds = (NowNs() - start) / 1e9;
+    done.store(true, std::memory_order_release);
+    for (std::thread &reader : readers)
+      reader.join();
+
+    result.tornFrames = torn.load();
+    return result;
+  }
+
+  void PrintResult(const char *name, RunResult &result, int frames)
+  {
+    std::printf("\n%s: %.0f frames/s published\n", name, frames / result.seconds);
+    PrintSamples("copy + publish", result.publishUs);
+    for (size_t reader = 0; reader < result.latencyUs.size(); ++reader)
+    {
+      const std::string label = "publish to take, reader " + std::to_string(reader);
+      const size_t taken = result.latencyUs[reader].size();
+      PrintSamples(label.c_str(), result.latencyUs[reader]);
+      std::printf("%-28s %10zu (%.1f%%)\n", "  frames taken", taken, 100.0 * taken / frames);
+    }
+  }
+}
+
+int main(int argc, char **argv)
+{
+  Options options;
+  if (!ParseOptions(argc, argv, options))
+  {
+    PrintUsage(argv[0]);
+    return 1;
+  }
+
+  std::vector<uint8_t> image(CameraHelpers::FrameBytes(CameraHelpers::PixelFormat::YUYV));
+  for (size_t i = 0; i < image.size(); ++i)
+    image[i] = static_cast<uint8_t>(i * 31);
+
+  std::printf("Frames: %d of %zu bytes, readers hold each frame %.0f us\n", options.frames, sizeof(Frame), options.holdUs);
+  std::printf("%-28s %10s %10s %10s %10s   (us)\n", "", "min", "median", "p99", "max");
+
+  // The triple buffer, one reader
+  auto tripleBuffer = std::make_shared<SharedDataHelpers::SPSCStorage<Frame>>();
+  RunResult triple;
+  {
+    SharedDataHelpers::SPSCStorageManager writer(tripleBuffer, true);
+    SharedDataHelpers::SPSCStorageManager reader(tripleBuffer, false);
+    triple = Run(options, 1,
+      [&](int frameNumber)
+      {
+        FillFrame(writer.data(), image, frameNumber);
+        writer.data().info.timestamp = static_cast<double>(NowNs());
+        writer.flags() = 1;
+        writer.exchange();
+      },
+      [&](int) -> const Frame *
+      {
+        reader.exchange();
+        if (reader.flags() == 0)
+          return nullptr;
+        reader.flags() = 0;
+        return &reader.data();
+      });
+  }
+  PrintResult("SPSCStorage (triple buffer)", triple, options.frames);
+
+  // The latest-frame storage, with one reader and with options.readers
+  using Storage = SharedDataHelpers::SPMCStorage<Frame, MAX_READERS>;
+  int64_t tornFrames = triple.tornFrames;
+  for (int readerCount : {1, options.readers})
+  {
+    auto storage = std::make_shared<Storage>();
+    SharedDataHelpers::SPMCStorageWriter writer(storage);
+    std::vector<std::unique_ptr<SharedDataHelpers::SPMCStorageReader<std::shared_ptr<Storage>>>> readers;
+    for (int i = 0; i < readerCount; ++i)
+      readers.push_back(std::make_unique<SharedDataHelpers::SPMCStorageReader<std::shared_ptr<Storage>>>(storage));
+
+    RunResult latest = Run(options, readerCount,
+      [&](int frameNumber)
+      {
+        FillFrame(writer.data(), image, frameNumber);
+        writer.data().info.timestamp = static_cast<double>(NowNs());
+        writer.publish();
+      },
+      [&](int reader) -> const Frame *
+      {
+        return readers[reader]->acquire() ? &readers[reader]->data() : nullptr;
+      });
+    const std::string name = "SPMCStorage, " + std::to_string(readerCount) + (readerCount == 1 ? " reader" : " readers");
+    PrintResult(name.c_str(), latest, options.frames);
+    tornFrames += latest.tornFrames;
+    if (readerCount == options.readers)
+      break;
+  }
+
+  std::printf("\nTorn frames: %lld\n", static_cast<long long>(tornFrames));
+  return tornFrames == 0 ? 0 : 1;
+}
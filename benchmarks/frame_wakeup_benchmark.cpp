@@ -0,0 +1,218 @@
+// Cross-process publish-to-wake latency of a SharedMemorySPSCStorage segment: a forked reader that blocks in wait()
+// against one that polls on a fixed period, like a consumer of the frame transport. Also times the writer's exchange(),
+// which wakes the reader. Needs no OpenCV, Pylon, RMP or camera. Run with --help for the options.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "shared_data_helpers.h"
+
+namespace
+{
+  const char *const SEGMENT_NAME = "/laser_demo_wakeup_benchmark";
+
+  struct Options
+  {
+    int frames = 2000;
+    double rateHz = 500.0;   // Publish rate of the writer
+    double pollUs = 1000.0;  // Period of the polling reader
+  };
+
+  // One published sample, the reader measures its latency from publishNs
+  struct WakeupSample
+  {
+    int64_t publishNs;
+    int64_t number; // -1 ends the run
+  };
+
+  void PrintUsage(const char *program)
+  {
+    std::printf("Usage: %s [--frames N] [--rate HZ] [--poll-us MICROSECONDS]\n", program);
+  }
+
+  bool ParseOptions(int argc, char **argv, Options &options)
+  {
+    for (int i = 1; i < argc; ++i)
+    {
+      const std::string arg = argv[i];
+      if (arg == "--help" || i + 1 >= argc)
+        return false;
+
+      const char *value = argv[++i];
+      if (arg == "--frames")
+        options.frames = std::max(1, std::atoi(value));
+      else if (arg == "--rate")
+        options.rateHz = std::clamp(std::strtod(value, nullptr), 1.0, 100000.0);
+      else if (arg == "--poll-us")
+        options.pollUs = std::max(1.0, std::strtod(value, nullptr));
+      else
+        return false;
+    }
+    return true;
+  }
+
+  int64_t NowNs()
+  {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+  // Prints min, median, p99 and max of samples in microseconds
+  void PrintSamples(const char *name, std::vector<double> &samples)
+  {
+    if (samples.empty())
+    {
+      std::printf("%-28s %10s\n", name, "-");
+      return;
+    }
+    std::sort(samples.begin(), samples.end());
+    const double p99 = samples[std::min<size_t>(samples.size() - 1, static_cast<size_t>(samples.size() * 0.99))];
+    std::printf("%-28s %10.2f %10.2f %10.2f %10.2f\n", name, samples.front(), samples[samples.size() / 2], p99, samples.back());
+  }
+
+  // The reader process: takes every sample it can until the last one and writes the latencies to fd
+  void RunReader(bool useWait, double pollUs, int fd)
+  {
+    std::unique_ptr<SharedDataHelpers::SharedMemorySPSCStorage<WakeupSample>> reader;
+    while (!reader)
+    {
+      try
+      {
+        reader = std::make_unique<SharedDataHelpers::SharedMemorySPSCStorage<WakeupSample>>(SEGMENT_NAME, false);
+      }
+      catch (const std::exception &)
+      {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+    }
+
+    std::vector<double> latencies;
+    while (true)
+    {
+      reader->exchange();
+      if (reader->flags() != 0)
+      {
+        reader->flags() = 0;
+        const WakeupSample sample = reader->data();
+        if (sample.number < 0)
+          break;
+        latencies.push_back((NowNs() - sample.publishNs) / 1000.0);
+        continue;
+      }
+
+      if (useWait)
+        reader->wait(100);
+      else
+        std::this_thread::sleep_for(std::chrono::nanoseconds(static_cast<int64_t>(pollUs * 1000.0)));
+    }
+
+    const size_t count = latencies.size();
+    if (write(fd, &count, sizeof(count)) != sizeof(count) ||
+        write(fd, latencies.data(), count * sizeof(double)) != static_cast<ssize_t>(count * sizeof(double)))
+      std::_Exit(1);
+    std::_Exit(0);
+  }
+
+  bool ReadAll(int fd, void *buffer, size_t size)
+  {
+    uint8_t *bytes = static_cast<uint8_t *>(buffer);
+    while (size > 0)
+    {
+      const ssize_t n = read(fd, bytes, size);
+      if (n <= 0)
+        return false;
+      bytes += n;
+      size -= static_cast<size_t>(n);
+    }
+    return true;
+  }
+
+  // Publishes options.frames samples at options.rateHz to a forked reader. Returns false if the reader failed.
+  bool Run(const char *name, bool useWait, const Options &options)
+  {
+    SharedDataHelpers::SharedMemorySPSCStorage<WakeupSample> writer(SEGMENT_NAME, true);
+
+    int pipeFds[2];
+    if (pipe(pipeFds) != 0)
+      return false;
+    const pid_t child = fork();
+    if (child == 0)
+    {
+      close(pipeFds[0]);
+      RunReader(useWait, options.pollUs, pipeFds[1]);
+    }
+    close(pipeFds[1]);
+    if (child < 0)
+    {
+      close(pipeFds[0]);
+      return false;
+    }
+
+    // Start once the reader is attached
+    while (std::atomic_ref<int32_t>(const_cast<SharedMemorySPSCHeader *>(writer.header())->readerPid).load() == 0)
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+    std::vector<double> exchangeUs(options.frames);
+    const auto period = std::chrono::nanoseconds(static_cast<int64_t>(1e9 / options.rateHz));
+    auto next = std::chrono::steady_clock::now();
+    for (int i = 0; i < options.frames; ++i)
+    {
+      next += period;
+      std::this_thread::sleep_until(next);
+
+      writer.data() = WakeupSample{NowNs(), i};
+      writer.flags() = 1;
+      const int64_t start = NowNs();
+      writer.exchange();
+      exchangeUs[i] = (NowNs() - start) / 1000.0;
+    }
+    std::this_thread::sleep_for(period);
+    writer.data() = WakeupSample{NowNs(), -1};
+    writer.flags() = 1;
+    writer.exchange();
+
+    size_t count = 0;
+    std::vector<double> latencies;
+    bool ok = ReadAll(pipeFds[0], &count, sizeof(count));
+    if (ok)
+    {
+      latencies.resize(count);
+      ok = ReadAll(pipeFds[0], latencies.data(), count * sizeof(double));
+    }
+    close(pipeFds[0]);
+    int status = 0;
+    waitpid(child, &status, 0);
+    ok = ok && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+
+    std::printf("\n%s\n", name);
+    PrintSamples("publish to take", latencies);
+    PrintSamples("writer exchange()", exchangeUs);
+    std::printf("%-28s %10zu (%.1f%%)\n", "samples taken", count, 100.0 * count / options.frames);
+    return ok;
+  }
+}
+
+int main(int argc, char **argv)
+{
+  Options options;
+  if (!ParseOptions(argc, argv, options))
+  {
+    PrintUsage(argv[0]);
+    return 1;
+  }
+
+  std::printf("Samples: %d at %.0f Hz, polling reader every %.0f us\n", options.frames, options.rateHz, options.pollUs);
+  std::printf("%-28s %10s %10s %10s %10s   (us)\n", "", "min", "median", "p99", "max");
+
+  const bool waitOk = Run("Reader blocked in wait() (futex)", true, options);
+  const std::string pollName = "Reader polling every " + std::to_string(static_cast<int>(options.pollUs)) + " us";
+  const bool pollOk = Run(pollName.c_str(), false, options);
+  return waitOk && pollOk ? 0 : 1;
+}
@@ -0,0 +1,595 @@
+// Microbenchmarks for the image_processing kernels on synthetic YUYV and BayerRG8 frames.
+// Needs only OpenCV, no Pylon, RMP or camera. Run with --help for the scene and iteration options.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iomanip>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include "blob_extractor.h"
+#include "camera_aoi.h"
+#include "camera_helpers.h"
+#include "frame_serializer.h"
+#include "image_kernels.h"
+#include "image_processing.h"
+#include "jpeg_encoder.h"
+#include "memory_helpers.h"
+#include "stripe_workers.h"
+#include "synthetic_frames.h"
+
+using namespace ImageProcessing;
+
+namespace
+{
+  struct Options
+  {
+    CameraHelpers::SyntheticSceneSettings scene;
+    int iterations = 2000;
+    int frameCount = 16;
+    int workers = 0; // Stripe workers for the parallel full-frame search, pinned to cores 1..workers
+  };
+
+  void PrintUsage(const char *program)
+  {
+    std::printf("Usage: %s [--radius PIXELS] [--noise LEVELS] [--clutter COUNT] [--seed N] [--iterations N] [--frames N] [--workers N]\n", program);
+  }
+
+  bool ParseOptions(int argc, char **argv, Options &options)
+  {
+    for (int i = 1; i < argc; ++i)
+    {
+      const std::string arg = argv[i];
+      if (arg == "--help" || i + 1 >= argc)
+        return false;
+
+      const char *value = argv[++i];
+      if (arg == "--radius")
+        options.scene.ballRadius = std::strtof(value, nullptr);
+      else if (arg == "--noise")
+        options.scene.noiseAmplitude = std::atoi(value);
+      else if (arg == "--clutter")
+        options.scene.clutterCount = std::atoi(value);
+      else if (arg == "--seed")
+        options.scene.seed = static_cast<uint32_t>(std::strtoul(value, nullptr, 10));
+      else if (arg == "--iterations")
+        options.iterations = std::max(1, std::atoi(value));
+      else if (arg == "--frames")
+        options.frameCount = std::max(1, std::atoi(value));
+      else if (arg == "--workers")
+        options.workers = std::clamp(std::atoi(value), 0, StripeWorkers::MAX_WORKERS);
+      else
+        return false;
+    }
+    return true;
+  }
+
+  // Times fn once per iteration and prints min, median, p99 and max in microseconds
+  void TimeStage(const char *name, int iterations, const std::function<void(int)> &fn)
+  {
+    std::vector<double> samples(iterations);
+
+    // Warm up caches and any lazily initialized statics
+    for (int i = 0; i < std::min(iterations, 10); ++i)
+      fn(i);
+
+    for (int i = 0; i < iterations; ++i)
+    {
+      auto start = std::chrono::steady_clock::now();
+      fn(i);
+      auto end = std::chrono::steady_clock::now();
+      samples[i] = std::chrono::duration<double, std::micro>(end - start).count();
+    }
+
+    std::sort(samples.begin(), samples.end());
+    const double p99 = samples[std::min<size_t>(samples.size() - 1, static_cast<size_t>(samples.size() * 0.99))];
+    std::printf("%-28s %10.2f %10.2f %10.2f %10.2f\n", name, samples.front(), samples[samples.size() / 2], p99, samples.back());
+  }
+
+  // The frame JSON as PreviewPublisher wrote it before SerializeFrameJson, the reference for its output and speed
+  std::string StreamFrameJson(const FrameInfo &info, int width, int height, const uint8_t *jpeg, size_t jpegSize)
+  {
+    static const std::string chars = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    std::string base64Image;
+    int val = 0, valb = -6;
+    for (size_t i = 0; i < jpegSize; ++i)
+    {
+      val = (val << 8) + jpeg[i];
+      valb += 8;
+      while (valb >= 0)
+      {
+        base64Image.push_back(chars[(val >> valb) & 0x3F]);
+        valb -= 6;
+      }
+    }
+    if (valb > -6)
+      base64Image.push_back(chars[((val << 8) >> (valb + 8)) & 0x3F]);
+    while (base64Image.size() % 4)
+      base64Image.push_back('=');
+
+    std::ostringstream json;
+    json << "{\n";
+    json << "  \"timestamp\": " << std::fixed << std::setprecision(0) << info.timestamp << ",\n";
+    json << "  \"frameNumber\": " << info.frameNumber << ",\n";
+    json << "  \"width\": " << width << ",\n";
+    json << "  \"height\": " << height << ",\n";
+    json << "  \"format\": \"jpeg\",\n";
+    json << "  \"imageData\": \"data:image/jpeg;base64," << base64Image << "\",\n";
+    json << "  \"imageSize\": " << jpegSize << ",\n";
+    json << "  \"ballDetected\": " << (info.ballDetected ? "true" : "false") << ",\n";
+    json << "  \"centerX\": " << std::fixed << std::setprecision(2) << info.centerX << ",\n";
+    json << "  \"centerY\": " << std::fixed << std::setprecision(2) << info.centerY << ",\n";
+    json << "  \"radius\": " << std::fixed << std::setprecision(2) << info.radius << ",\n";
+    json << "  \"targetX\": " << std::fixed << std::setprecision(2) << info.targetX << ",\n";
+    json << "  \"targetY\": " << std::fixed << std::setprecision(2) << info.targetY << ",\n";
+    json << "  \"rtTaskRunning\": true\n";
+    json << "}";
+    return json.str();
+  }
+
+  // Byte-exact checks of every base64 implementation and of SerializeFrameJson against StreamFrameJson
+  bool CheckSerializer(const std::vector<uint8_t> &jpeg, std::mt19937 &random)
+  {
+    struct Base64Encoder
+    {
+      const char *name;
+      PreviewHelpers::EncodeBase64Fn fn;
+    };
+    std::vector<Base64Encoder> encoders = {{"scalar", PreviewHelpers::EncodeBase64Scalar}};
+#if defined(__x86_64__) || defined(__i386__)
+    if (__builtin_cpu_supports("ssse3"))
+      encoders.push_back({"ssse3", PreviewHelpers::EncodeBase64SSSE3});
+    if (__builtin_cpu_supports("avx2"))
+      encoders.push_back({"avx2", PreviewHelpers::EncodeBase64AVX2});
+#endif
+
+    bool ok = true;
+    std::vector<char> json(PreviewHelpers::FrameJsonSizeBound(jpeg.size()));
+    std::uniform_real_distribution<double> coordinate(-1000.0, 1000.0);
+    FrameInfo info = {};
+    info.timestamp = 1.7e15;
+
+    // Every tail length of the vector loops, then the whole JPEG
+    for (size_t size = 0; size <= jpeg.size(); size = size < 100 ? size + 1 : jpeg.size())
+    {
+      info.frameNumber = static_cast<int>(random()) - (1 << 30);
+      info.timestamp += 66666.5;
+      info.ballDetected = (size & 1) != 0;
+      info.centerX = coordinate(random);
+      info.centerY = coordinate(random);
+      info.radius = coordinate(random) / 1000.0;
+      info.targetX = coordinate(random);
+      info.targetY = -0.0;
+
+      const std::string reference = StreamFrameJson(info, 640, 480, jpeg.data(), size);
+      const size_t jsonSize = PreviewHelpers::SerializeFrameJson(info, 640, 480, jpeg.data(), size, json.data(), json.size());
+      if (reference.compare(0, std::string::npos, json.data(), jsonSize) != 0)
+      {
+        std::printf("check SerializeFrameJson != ostringstream JSON (%zu bytes)\n", size);
+        ok = false;
+      }
+
+      // The base64 text sits between the data URL prefix and the closing quote
+      const size_t base64Begin = reference.find("base64,") + 7;
+      const size_t base64Size = reference.find('"', base64Begin) - base64Begin;
+      for (const Base64Encoder &encoder : encoders)
+      {
+        if (encoder.fn(jpeg.data(), size, json.data()) != base64Size ||
+            reference.compare(base64Begin, base64Size, json.data(), base64Size) != 0)
+        {
+          std::printf("check EncodeBase64 (%s) != reference (%zu bytes)\n", encoder.name, size);
+          ok = false;
+        }
+      }
+
+      if (size == jpeg.size())
+        break;
+    }
+    return ok;
+  }
+
+  // The half-resolution search TryDetectBall ran before the coarse-to-fine pipeline, the reference for its accuracy
+  bool DetectHalfResolution(const cv::Mat &frame, cv::Vec3f &ball)
+  {
+    static cv::Mat mask(CameraHelpers::IMAGE_HEIGHT / 2, CameraHelpers::IMAGE_WIDTH / 2, CV_8UC1);
+    ExtractMaskV(frame, mask);
+    CloseOpenMask(mask);
+    const bool found = FindBall(mask, ball);
+    ball *= 2.0f;
+    return found;
+  }
+
+  // Center error in full-resolution pixels of a detector over the frames, against the rendered ball positions
+  void ReportAccuracy(const char *name, const std::vector<cv::Mat> &frames, const std::vector<cv::Point2f> &truth,
+                      const std::function<bool(const cv::Mat &, cv::Vec3f &)> &detect)
+  {
+    int found = 0;
+    double sumError = 0.0, maxError = 0.0;
+    for (size_t i = 0; i < frames.size(); ++i)
+    {
+      cv::Vec3f ball(0.0f, 0.0f, 0.0f);
+      if (!detect(frames[i], ball))
+        continue;
+      const double error = cv::norm(cv::Point2f(ball[0], ball[1]) - truth[i]);
+      sumError += error;
+      maxError = std::max(maxError, error);
+      found++;
+    }
+    std::printf("%-28s %10d %10.3f %10.3f\n", name, found, found ? sumError / found : 0.0, maxError);
+  }
+
+  bool SameMask(const cv::Mat &a, const cv::Mat &b)
+  {
+    for (int y = 0; y < a.rows; ++y)
+    {
+      if (std::memcmp(a.ptr<uchar>(y), b.ptr<uchar>(y), a.cols) != 0)
+        return false;
+    }
+    return true;
+  }
+
+  // Bit-exact checks of the optimized kernels against the OpenCV reference stages
+  bool CheckKernels(const std::vector<cv::Mat> &frames)
+  {
+    constexpr int MASK_WIDTH = CameraHelpers::IMAGE_WIDTH / 2;
+    constexpr int MASK_HEIGHT = CameraHelpers::IMAGE_HEIGHT / 2;
+    constexpr uint8_t THRESHOLD = static_cast<uint8_t>(RED_THRESHOLD);
+
+    struct RowKernel
+    {
+      const char *name;
+      Kernels::ExtractMaskVRowFn fn;
+    };
+    std::vector<RowKernel> rowKernels = {{"scalar", Kernels::ExtractMaskVRowScalar}};
+#if defined(__x86_64__) || defined(__i386__)
+    if (__builtin_cpu_supports("sse2"))
+      rowKernels.push_back({"sse2", Kernels::ExtractMaskVRowSSE2});
+    if (__builtin_cpu_supports("avx2"))
+      rowKernels.push_back({"avx2", Kernels::ExtractMaskVRowAVX2});
+#endif
+
+    const cv::Mat coarseKernel = cv::getStructuringElement(cv::MORPH_ELLIPSE, cv::Size(3, 3)); // CloseOpenCoarseMask's
+
+    bool ok = true;
+    cv::Mat v(MASK_HEIGHT, MASK_WIDTH, CV_8UC1);
+    cv::Mat reference(MASK_HEIGHT, MASK_WIDTH, CV_8UC1);
+    cv::Mat fused(MASK_HEIGHT, MASK_WIDTH, CV_8UC1);
+    for (const cv::Mat &frame : frames)
+    {
+      ExtractV(frame, v);
+      cv::threshold(v, reference, RED_THRESHOLD, 255, cv::THRESH_BINARY);
+      for (const RowKernel &kernel : rowKernels)
+      {
+        for (int y = 0; y < MASK_HEIGHT; ++y)
+          kernel.fn(frame.ptr<uchar>(2 * y + 1), fused.ptr<uchar>(y), MASK_WIDTH, THRESHOLD);
+        if (!SameMask(reference, fused))
+        {
+          std::printf("check ExtractMaskV (%s) != ExtractV + threshold\n", kernel.name);
+          ok = false;
+        }
+      }
+
+      // The coarse mask of the detector samples every second V of every second row of the half-resolution plane
+      cv::Mat thresholded = reference.clone();
+      cv::Mat coarseReference(COARSE_MASK_HEIGHT, COARSE_MASK_WIDTH, CV_8UC1);
+      for (int y = 0; y < COARSE_MASK_HEIGHT; ++y)
+      {
+        for (int x = 0; x < COARSE_MASK_WIDTH; ++x)
+          coarseReference.at<uchar>(y, x) = thresholded.at<uchar>(2 * y, 2 * x);
+      }
+      cv::Mat coarse(COARSE_MASK_HEIGHT, COARSE_MASK_WIDTH, CV_8UC1);
+      ExtractCoarseMaskV(frame, coarse, cv::Rect(0, 0, COARSE_MASK_WIDTH, COARSE_MASK_HEIGHT));
+      if (!SameMask(coarseReference, coarse))
+      {
+        std::printf("check ExtractCoarseMaskV != subsampled ExtractV + threshold\n");
+        ok = false;
+      }
+
+      cv::morphologyEx(coarseReference, coarseReference, cv::MORPH_CLOSE, coarseKernel);
+      cv::morphologyEx(coarseReference, coarseReference, cv::MORPH_OPEN, coarseKernel);
+      CloseOpenCoarseMask(coarse);
+      if (!SameMask(coarseReference, coarse))
+      {
+        std::printf("check CloseOpenCoarseMask != OpenCV close + open\n");
+        ok = false;
+      }
+
+      MaskV(v, reference);
+      ExtractMaskV(frame, fused);
+      CloseOpenMask(fused);
+      if (!SameMask(reference, fused))
+      {
+        std::printf("check ExtractMaskV + CloseOpenMask != MaskV\n");
+        ok = false;
+      }
+    }
+    return ok;
+  }
+
+  // Detection on the frame of an AOI around the ball, as the camera delivers it with AOI tracking, has to find the same
+  // circle as on the full frame with the AOI in place
+  bool CheckAoiDetection(const std::vector<cv::Mat> &frames, const std::vector<cv::Point2f> &truth, CameraHelpers::PixelFormat format)
+  {
+    static MemoryHelpers::FrameArena<16 * 1024> arena;
+    const Detector &detector = GetDetector(CameraHelpers::CameraModeInfo{CameraHelpers::IMAGE_WIDTH, CameraHelpers::IMAGE_HEIGHT, format});
+    std::vector<uint8_t> aoiFrame(CameraHelpers::FrameBytes(format));
+    std::vector<uint8_t> expanded(CameraHelpers::FrameBytes(format));
+
+    bool ok = true;
+    for (size_t i = 0; i < frames.size(); ++i)
+    {
+      for (int tier = 1; tier < static_cast<int>(CameraHelpers::AOI_TIERS.size()); ++tier)
+      {
+        const CameraHelpers::CameraAoi aoi = CameraHelpers::CenterAoi(tier, truth[i].x, truth[i].y);
+        std::memcpy(aoiFrame.data(), frames[i].data, aoiFrame.size());
+        CameraHelpers::CropToAoi(aoiFrame.data(), aoi, format);
+        CameraHelpers::ExpandAoiFrame(expanded.data(), aoiFrame.data(), aoi, format);
+
+        cv::Vec3f inAoi(0.0f, 0.0f, 0.0f), inFull(0.0f, 0.0f, 0.0f);
+        arena.Reset();
+        const bool foundInAoi = detector.detectFullFrame(aoiFrame.data(), aoi, inAoi, arena);
+        arena.Reset();
+        const bool foundInFull = detector.detectFullFrame(expanded.data(), CameraHelpers::CameraAoi(), inFull, arena);
+        if (foundInAoi != foundInFull || inAoi != inFull)
+        {
+          std::printf("check %s detection in a %ux%u AOI at (%u, %u) != in the full frame\n",
+                      format == CameraHelpers::PixelFormat::BayerRG8 ? "BayerRG8" : "YUYV", aoi.width, aoi.height, aoi.offsetX, aoi.offsetY);
+          ok = false;
+        }
+      }
+    }
+    return ok;
+  }
+}
+
+int main(int argc, char **argv)
+{
+  Options options;
+  if (!ParseOptions(argc, argv, options))
+  {
+    PrintUsage(argv[0]);
+    return 2;
+  }
+
+  constexpr int MASK_WIDTH = CameraHelpers::IMAGE_WIDTH / 2;
+  constexpr int MASK_HEIGHT = CameraHelpers::IMAGE_HEIGHT / 2;
+
+  // Frames with the ball at random positions that keep it fully in view
+  CameraHelpers::SyntheticFrameGenerator generator(options.scene);
+  std::mt19937 random(options.scene.seed);
+  const float margin = options.scene.ballRadius + 2.0f;
+  std::uniform_real_distribution<float> ballX(margin, CameraHelpers::IMAGE_WIDTH - margin);
+  std::uniform_real_distribution<float> ballY(margin, CameraHelpers::IMAGE_HEIGHT - margin);
+
+  std::vector<cv::Mat> frames, bayerFrames;
+  std::vector<cv::Point2f> truth;
+  for (int i = 0; i < options.frameCount; ++i)
+  {
+    frames.push_back(CreateYUYVMat(CameraHelpers::IMAGE_WIDTH, CameraHelpers::IMAGE_HEIGHT));
+    truth.emplace_back(ballX(random), ballY(random));
+    generator.Render(frames.back().data, truth.back().x, truth.back().y);
+  }
+  for (int i = 0; i < options.frameCount; ++i)
+  {
+    bayerFrames.push_back(CreateBayerMat(CameraHelpers::IMAGE_WIDTH, CameraHelpers::IMAGE_HEIGHT));
+    generator.RenderBayer(bayerFrames.back().data, truth[i].x, truth[i].y);
+  }
+
+  std::printf("Scene: radius %.1f px, noise +/-%d, clutter %d, %d frames, %d iterations\n",
+              options.scene.ballRadius, options.scene.noiseAmplitude, options.scene.clutterCount,
+              options.frameCount, options.iterations);
+  std::printf("ExtractMaskV row kernel: %s\n\n", Kernels::ExtractMaskVRowName());
+
+  const bool checksPassed = CheckKernels(frames);
+  std::printf("Kernel checks: %s\n", checksPassed ? "bit-exact" : "FAILED");
+  const bool aoiPassed = CheckAoiDetection(frames, truth, CameraHelpers::PixelFormat::YUYV) &&
+                         CheckAoiDetection(bayerFrames, truth, CameraHelpers::PixelFormat::BayerRG8);
+  std::printf("AOI detection: %s\n\n", aoiPassed ? "same circles as in the full frame" : "FAILED");
+
+  // Inputs for the later stages, computed once per frame
+  std::vector<cv::Mat> vPlanes, masks;
+  for (const cv::Mat &frame : frames)
+  {
+    vPlanes.emplace_back(MASK_HEIGHT, MASK_WIDTH, CV_8UC1);
+    ExtractV(frame, vPlanes.back());
+    masks.emplace_back(MASK_HEIGHT, MASK_WIDTH, CV_8UC1);
+    MaskV(vPlanes.back(), masks.back());
+  }
+
+  // Boundary samples of the ball in the first frame, for the circle fits
+  static BlobExtractor blobs;
+  std::vector<cv::Point> boundary;
+  if (blobs.Extract(masks.front(), static_cast<int>(MIN_CONTOUR_AREA / 4.0)) > 0)
+  {
+    int largest = 0;
+    for (int i = 1; i < blobs.Count(); ++i)
+    {
+      if (blobs[i].area > blobs[largest].area)
+        largest = i;
+    }
+    boundary.assign(blobs[largest].Boundary().begin(), blobs[largest].Boundary().end());
+  }
+  std::printf("Ball boundary samples: %zu\n\n", boundary.size());
+
+  static MemoryHelpers::FrameArena<16 * 1024> arena; // The size DetectBall uses
+  cv::Mat v(MASK_HEIGHT, MASK_WIDTH, CV_8UC1);
+  cv::Mat mask(MASK_HEIGHT, MASK_WIDTH, CV_8UC1);
+  const int n = options.frameCount;
+
+  std::printf("%-28s %10s %10s %10s %10s   (us)\n", "stage", "min", "median", "p99", "max");
+  TimeStage("ExtractV", options.iterations, [&](int i) { ExtractV(frames[i % n], v); });
+  TimeStage("MaskV", options.iterations, [&](int i) { MaskV(vPlanes[i % n], mask); });
+  TimeStage("ExtractMaskV", options.iterations, [&](int i) { ExtractMaskV(frames[i % n], mask); });
+  TimeStage("CloseOpenMask", options.iterations, [&](int i) {
+    ExtractMaskV(frames[i % n], mask);
+    CloseOpenMask(mask);
+  });
+  TimeStage("FindBall", options.iterations, [&](int i) {
+    cv::Vec3f ball;
+    FindBall(masks[i % n], ball);
+  });
+
+  if (boundary.size() >= 3)
+  {
+    cv::Point2f center;
+    float radius = 0.0f;
+    TimeStage("FitCircleTaubin", options.iterations, [&](int) { FitCircleTaubin(boundary, center, radius); });
+    TimeStage("FitCircleLeastSquares", options.iterations, [&](int) { FitCircleLeastSquares(boundary, center, radius); });
+    FitCircleTaubin(boundary, center, radius);
+    TimeStage("CircleFitError", options.iterations, [&](int) {
+      volatile double error = CircleFitError(boundary, center, radius);
+      (void)error;
+    });
+  }
+
+  // Coarse-to-fine stages: the quarter-resolution mask, its candidate and the sub-pixel refinement
+  cv::Mat coarseMask(COARSE_MASK_HEIGHT, COARSE_MASK_WIDTH, CV_8UC1);
+  const cv::Rect coarseFrame(0, 0, COARSE_MASK_WIDTH, COARSE_MASK_HEIGHT);
+  TimeStage("ExtractCoarseMaskV", options.iterations, [&](int i) { ExtractCoarseMaskV(frames[i % n], coarseMask, coarseFrame); });
+  TimeStage("CloseOpenCoarseMask", options.iterations, [&](int i) {
+    ExtractCoarseMaskV(frames[i % n], coarseMask, coarseFrame);
+    CloseOpenCoarseMask(coarseMask);
+  });
+  TimeStage("FindBall (coarse)", options.iterations, [&](int i) {
+    ExtractCoarseMaskV(frames[i % n], coarseMask, coarseFrame);
+    CloseOpenCoarseMask(coarseMask);
+    cv::Vec3f ball;
+    FindBall(coarseMask, ball, MIN_CONTOUR_AREA / (COARSE_SCALE * COARSE_SCALE));
+  });
+  const cv::Vec3f candidate(truth.front().x + 2.0f, truth.front().y - 2.0f, options.scene.ballRadius + 2.0f);
+  TimeStage("RefineBall", options.iterations, [&](int) {
+    arena.Reset();
+    cv::Vec3f ball;
+    RefineBall(frames.front(), candidate, ball, arena);
+  });
+
+  TimeStage("half-res detection (old)", options.iterations, [&](int i) {
+    cv::Vec3f ball;
+    DetectHalfResolution(frames[i % n], ball);
+  });
+
+  int detections = 0;
+  TimeStage("TryDetectBall (full frame)", options.iterations, [&](int i) {
+    arena.Reset();
+    cv::Vec3f ball(0.0f, 0.0f, 0.0f);
+    detections += TryDetectBall(frames[i % n], ball, arena);
+  });
+
+  // The full-frame search split over stripe workers, which has to find exactly the circles of the serial search
+  bool stripesPassed = true;
+  if (options.workers > 0)
+  {
+    std::vector<int> cores;
+    for (int core = 1; core <= options.workers; ++core)
+      cores.push_back(core);
+    StripeWorkers workers(cores, 0);
+
+    for (const cv::Mat &frame : frames)
+    {
+      cv::Vec3f serialBall(0.0f, 0.0f, 0.0f), stripedBall(0.0f, 0.0f, 0.0f);
+      arena.Reset();
+      const bool serialFound = TryDetectBall(frame, serialBall, arena);
+      UseStripeWorkers(&workers);
+      arena.Reset();
+      const bool stripedFound = TryDetectBall(frame, stripedBall, arena);
+      UseStripeWorkers(nullptr);
+      stripesPassed = stripesPassed && serialFound == stripedFound && serialBall == stripedBall;
+    }
+
+    char name[32];
+    std::snprintf(name, sizeof(name), "TryDetectBall (%d stripes)", workers.StripeCount());
+    UseStripeWorkers(&workers);
+    TimeStage(name, options.iterations, [&](int i) {
+      arena.Reset();
+      cv::Vec3f ball(0.0f, 0.0f, 0.0f);
+      TryDetectBall(frames[i % n], ball, arena);
+    });
+    UseStripeWorkers(nullptr);
+  }
+
+  // The same search on the raw mosaic of the BayerRG8 mode, without demosaicing
+  TimeStage("ExtractCoarseMaskBayer", options.iterations, [&](int i) { ExtractCoarseMaskBayer(bayerFrames[i % n], coarseMask, coarseFrame); });
+  TimeStage("RefineBall (Bayer)", options.iterations, [&](int) {
+    arena.Reset();
+    cv::Vec3f ball;
+    RefineBall(bayerFrames.front(), candidate, ball, arena);
+  });
+  TimeStage("TryDetectBall (Bayer)", options.iterations, [&](int i) {
+    arena.Reset();
+    cv::Vec3f ball(0.0f, 0.0f, 0.0f);
+    TryDetectBall(bayerFrames[i % n], ball, arena);
+  });
+
+  // Tracking mode on a steady ball, the window stays locked after the first frame
+  TrackingState tracking;
+  TimeStage("TryDetectBall (tracking)", options.iterations, [&](int) {
+    arena.Reset();
+    cv::Vec3f ball(0.0f, 0.0f, 0.0f);
+    DetectionMode mode = DetectionMode::None;
+    TryDetectBall(frames.front(), ball, tracking, mode, arena);
+  });
+
+  // Preview encoding in OutputImage: the RGB conversion and imencode it used to do, against the raw YUYV encoder
+  std::vector<uint8_t> jpeg;
+  const std::vector<int> jpegParams = {cv::IMWRITE_JPEG_QUALITY, 80};
+  TimeStage("cvtColor + imencode", options.iterations, [&](int i) {
+    cv::Mat rgb;
+    cv::cvtColor(frames[i % n], rgb, cv::COLOR_YUV2RGB_YUYV);
+    cv::imencode(".jpg", rgb, jpeg, jpegParams);
+  });
+  PreviewHelpers::JpegEncoder jpegEncoder(80, false);
+  PreviewHelpers::JpegEncoder halfJpegEncoder(80, true);
+  TimeStage("JpegEncoder", options.iterations, [&](int i) { jpegEncoder.Encode(frames[i % n].data); });
+  TimeStage("JpegEncoder (2x downscale)", options.iterations, [&](int i) { halfJpegEncoder.Encode(frames[i % n].data); });
+  std::vector<uint8_t> demosaiced(CameraHelpers::IMAGE_SIZE_YUYV);
+  TimeStage("BayerToYUYV", options.iterations, [&](int i) {
+    Kernels::BayerToYUYV(bayerFrames[i % n].data, demosaiced.data(), CameraHelpers::IMAGE_WIDTH, CameraHelpers::IMAGE_HEIGHT);
+  });
+
+  // Frame JSON of the json_file preview transport: ostringstream and push_back base64 against the preallocated
+  // serializer, on the JPEG of the first frame
+  const std::vector<uint8_t> frameJpeg(jpegEncoder.Data(), jpegEncoder.Data() + jpegEncoder.Encode(frames.front().data));
+  const bool serializerPassed = CheckSerializer(frameJpeg, random);
+  std::vector<char> json(PreviewHelpers::FrameJsonSizeBound(frameJpeg.size()));
+  FrameInfo frameInfo = {1, 1.7e15, true, 320.25, 240.5, 30.0, 1, 0, 1.5, -2.5};
+  size_t jsonBytes = 0;
+  TimeStage("ostringstream JSON", options.iterations, [&](int i) {
+    frameInfo.frameNumber = i;
+    jsonBytes += StreamFrameJson(frameInfo, 640, 480, frameJpeg.data(), frameJpeg.size()).size();
+  });
+  TimeStage("SerializeFrameJson", options.iterations, [&](int i) {
+    frameInfo.frameNumber = i;
+    jsonBytes += PreviewHelpers::SerializeFrameJson(frameInfo, 640, 480, frameJpeg.data(), frameJpeg.size(), json.data(), json.size());
+  });
+
+  std::printf("\n%-28s %10s %10s %10s   (px)\n", "center accuracy", "found", "mean", "max");
+  ReportAccuracy("half-res detection (old)", frames, truth, [&](const cv::Mat &frame, cv::Vec3f &ball) {
+    return DetectHalfResolution(frame, ball);
+  });
+  ReportAccuracy("TryDetectBall", frames, truth, [&](const cv::Mat &frame, cv::Vec3f &ball) {
+    arena.Reset();
+    return TryDetectBall(frame, ball, arena);
+  });
+  ReportAccuracy("TryDetectBall (Bayer)", bayerFrames, truth, [&](const cv::Mat &frame, cv::Vec3f &ball) {
+    arena.Reset();
+    return TryDetectBall(frame, ball, arena);
+  });
+
+  std::printf("\nFull-frame detection rate: %.1f%%\n", 100.0 * detections / (options.iterations + std::min(options.iterations, 10)));
+  std::printf("Arena peak use: %zu of %zu bytes, %llu allocations failed\n", arena.Peak(), arena.Capacity(),
+              static_cast<unsigned long long>(arena.Exhaustions()));
+  if (options.workers > 0)
+    std::printf("Stripe-parallel search: %s\n", stripesPassed ? "same circles as serial" : "FAILED");
+  std::printf("Frame JSON: %zu bytes per %zu byte JPEG, base64 %s, checks %s\n", jsonBytes / (2 * (options.iterations + std::min(options.iterations, 10))),
+              frameJpeg.size(), PreviewHelpers::EncodeBase64Name(), serializerPassed ? "byte-exact" : "FAILED");
+
+  return checksPassed && aoiPassed && serializerPassed && stripesPassed ? 0 : 1;
+}
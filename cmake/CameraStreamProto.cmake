@@ -0,0 +1,48 @@
+# Include guard
+if (CAMERA_STREAM_PROTO_CMAKE_INCLUDED)
+  return()
+endif()
+set(CAMERA_STREAM_PROTO_CMAKE_INCLUDED TRUE)
+
+# -----------------------------------------------------------------------------
+# CameraStreamProto.cmake
+#
+# Purpose:
+#   - Generates the C++ messages and gRPC service of the UI's
+#     camera_streaming.proto with protoc and grpc_cpp_plugin.
+#   - Builds them into the static CameraStreamProto library. It is position
+#     independent, so it can be linked into the task library, and brings the
+#     generated headers and gRPC along to whatever links it.
+# -----------------------------------------------------------------------------
+
+find_package(Protobuf REQUIRED)
+find_package(gRPC CONFIG REQUIRED)
+find_package(Threads REQUIRED)
+
+get_filename_component(CAMERA_STREAM_PROTO "${CMAKE_CURRENT_LIST_DIR}/../ui/RapidLaser/Assets/protos/camera_streaming.proto" ABSOLUTE)
+get_filename_component(CAMERA_STREAM_PROTO_DIR "${CAMERA_STREAM_PROTO}" DIRECTORY)
+set(CAMERA_STREAM_GENERATED_DIR "${CMAKE_CURRENT_BINARY_DIR}/generated")
+set(CAMERA_STREAM_GENERATED_FILES
+  "${CAMERA_STREAM_GENERATED_DIR}/camera_streaming.pb.cc"
+  "${CAMERA_STREAM_GENERATED_DIR}/camera_streaming.pb.h"
+  "${CAMERA_STREAM_GENERATED_DIR}/camera_streaming.grpc.pb.cc"
+  "${CAMERA_STREAM_GENERATED_DIR}/camera_streaming.grpc.pb.h"
+)
+
+add_custom_command(
+  OUTPUT ${CAMERA_STREAM_GENERATED_FILES}
+  COMMAND ${CMAKE_COMMAND} -E make_directory "${CAMERA_STREAM_GENERATED_DIR}"
+  COMMAND protobuf::protoc
+    --proto_path "${CAMERA_STREAM_PROTO_DIR}"
+    --cpp_out "${CAMERA_STREAM_GENERATED_DIR}"
+    --grpc_out "${CAMERA_STREAM_GENERATED_DIR}"
+    --plugin=protoc-gen-grpc=$<TARGET_FILE:gRPC::grpc_cpp_plugin>
+    "${CAMERA_STREAM_PROTO}"
+  DEPENDS "${CAMERA_STREAM_PROTO}"
+  COMMENT "Generating the camera stream gRPC code"
+)
+
+add_library(CameraStreamProto STATIC ${CAMERA_STREAM_GENERATED_FILES})
+target_include_directories(CameraStreamProto PUBLIC "${CAMERA_STREAM_GENERATED_DIR}")
+target_link_libraries(CameraStreamProto PUBLIC gRPC::grpc++ protobuf::libprotobuf Threads::Threads)
+set_target_properties(CameraStreamProto PROPERTIES POSITION_INDEPENDENT_CODE ON)
@@ -0,0 +1,105 @@
+#ifndef BLOB_EXTRACTOR_H
+#define BLOB_EXTRACTOR_H
+
+#include <array>
+#include <cstdint>
+#include <span>
+
+#include <opencv2/opencv.hpp>
+
+#include "camera_helpers.h" // For image constants
+
+namespace ImageProcessing
+{
+  // A connected group of set pixels in a binary mask
+  struct Blob
+  {
+    static constexpr int MAX_BOUNDARY_SAMPLES = 512;
+
+    int area = 0;    // Number of set pixels (m00)
+    cv::Rect bounds; // Bounding box, in mask coordinates
+
+    // Raw spatial moments
+    int64_t m10 = 0, m01 = 0;
+    int64_t m20 = 0, m11 = 0, m02 = 0;
+
+    // Boundary samples on the outer contour: the first and last pixel of each row of the blob, evenly decimated when
+    // the blob has more rows than fit. Hole edges are left out. These are pixel positions, the same convention
+    // findContours uses.
+    int boundaryCount = 0;
+    std::array<cv::Point, MAX_BOUNDARY_SAMPLES> boundary;
+
+    std::span<const cv::Point> Boundary() const { return std::span<const cv::Point>(boundary.data(), boundaryCount); }
+    cv::Point2f Centroid() const { return cv::Point2f(static_cast<float>(double(m10) / area), static_cast<float>(double(m01) / area)); }
+  };
+
+  // Run-length based connected-component labeler (8-connectivity) for binary masks.
+  // All storage is fixed-capacity and lives inside the object, so Extract never touches the heap. The object is large,
+  // keep it in static storage.
+  class BlobExtractor
+  {
+  public:
+    // Capacities, sized for the half-resolution mask. Runs are at most every other pixel of a row.
+    static constexpr int MAX_MASK_WIDTH = CameraHelpers::IMAGE_WIDTH / 2;
+    static constexpr int MAX_MASK_HEIGHT = CameraHelpers::IMAGE_HEIGHT / 2;
+    static constexpr int MAX_RUNS = (MAX_MASK_WIDTH + 1) / 2 * MAX_MASK_HEIGHT;
+    static constexpr int MAX_COMPONENTS = 1024; // Connected components tracked before blob filtering
+    static constexpr int MAX_BLOBS = 32;        // Blobs reported after filtering, the largest are kept
+    static constexpr int MAX_STRIPES = 8;       // Horizontal stripes labeled separately by ExtractStripe
+
+    // Labels the mask in a single scan and collects every blob of at least minArea pixels.
+    // Returns the number of blobs found. Anything that does not fit the capacities is dropped and reported by Overflowed().
+    int Extract(const cv::Mat &mask, int minArea);
+
+    // Extract split over horizontal stripes for several threads. ExtractStripe labels rows [firstRow, endRow) of the
+    // mask as stripe number stripe, and may run concurrently for different stripes. The stripes must cover the mask in
+    // order. MergeStripes then joins the blobs crossing stripe seams and collects them like Extract, with the same
+    // result.
+    void ExtractStripe(const cv::Mat &mask, int stripe, int firstRow, int endRow);
+    int MergeStripes(int stripeCount, int minArea);
+
+    int Count() const { return blobCount_; }
+    const Blob &operator[](int index) const { return blobs_[index]; }
+    bool Overflowed() const { return overflowed_; }
+
+  private:
+    struct Run
+    {
+      int16_t y;
+      int16_t xStart;
+      int16_t xEnd; // Inclusive
+    };
+
+    struct Component
+    {
+      int area;
+      int16_t minX, minY, maxX, maxY;
+      int64_t m10, m01, m20, m11, m02;
+      int blobIndex; // Index into blobs_, or -1 when filtered out
+    };
+
+    // Runs of one stripe, stored in the part of runs_ its rows can fill
+    struct Stripe
+    {
+      int firstRow;
+      int endRow;
+      int32_t runBegin;
+      int32_t runEnd;
+      bool overflowed;
+    };
+
+    int32_t FindRoot(int32_t run);
+    void Union(int32_t a, int32_t b);
+
+    std::array<Run, MAX_RUNS> runs_;
+    std::array<int32_t, MAX_RUNS> parent_;    // Union-find forest over runs
+    std::array<int32_t, MAX_RUNS> component_; // Component index of each root run
+    std::array<Component, MAX_COMPONENTS> components_;
+    std::array<Blob, MAX_BLOBS> blobs_;
+    std::array<Stripe, MAX_STRIPES> stripes_;
+    int blobCount_ = 0;
+    bool overflowed_ = false;
+  };
+}
+
+#endif // BLOB_EXTRACTOR_H
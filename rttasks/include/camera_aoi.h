@@ -0,0 +1,82 @@
+#ifndef CAMERA_AOI_H
+#define CAMERA_AOI_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include "camera_helpers.h" // For IMAGE_WIDTH, IMAGE_HEIGHT
+
+namespace CameraHelpers
+{
+  // Area of interest read out by the camera, in full-frame pixels
+  struct CameraAoi
+  {
+    uint32_t offsetX = 0;
+    uint32_t offsetY = 0;
+    uint32_t width = IMAGE_WIDTH;
+    uint32_t height = IMAGE_HEIGHT;
+
+    bool operator==(const CameraAoi &) const = default;
+  };
+
+  // Offsets and sizes are multiples of this, which every Basler model accepts and keeps YUYV pixel pairs and RGGB cells
+  // whole
+  inline constexpr uint32_t AOI_ALIGNMENT = 16;
+
+  // Sizes the AOI switches between, full frame first. The sensor reads out fewer rows for a smaller one, so frames
+  // come faster as long as the exposure time and AcquisitionFrameRate allow it.
+  struct AoiSize
+  {
+    uint32_t width;
+    uint32_t height;
+  };
+  inline constexpr std::array<AoiSize, 3> AOI_TIERS = {{{IMAGE_WIDTH, IMAGE_HEIGHT}, {320, 240}, {192, 144}}};
+
+  // Frames a smaller tier has to fit the ball before the AOI shrinks to it. Growing is immediate.
+  inline constexpr int AOI_SHRINK_FRAMES = 30;
+
+  // Blank YUYV pixel pair (black) that fills a full-size frame outside the AOI (ExpandAoiFrame). BayerRG8 frames are blanked with 0.
+  inline constexpr std::array<uint8_t, 4> AOI_BLANK_YUYV = {16, 128, 16, 128};
+
+  // An AOI of the given tier centered on (x, y), aligned and clamped to the sensor
+  CameraAoi CenterAoi(int tier, float x, float y);
+
+  // Picks the AOI for the next frames from the detected ball: the smallest tier that holds the ball and margin pixels
+  // around it on every side, centered on the ball. A miss goes straight back to the full frame, where the full-frame
+  // search can find the ball again.
+  class AoiTracker
+  {
+  public:
+    explicit AoiTracker(float margin) : margin_(margin) {}
+
+    // Returns the AOI for the next frames. ball is (x, y, radius) in full-frame pixels.
+    const CameraAoi &Update(bool ballDetected, float x, float y, float radius);
+
+    const CameraAoi &Current() const { return current_; }
+    int Tier() const { return tier_; }
+
+  private:
+    float margin_;
+    int tier_ = 0;
+    int shrinkFrames_ = 0; // Consecutive frames the ball fit in the next smaller tier
+    CameraAoi current_;
+  };
+
+  // Frames for an AOI hold only its image, aoi.width x aoi.height pixels with rows back to back, as the camera reads it
+  // out. The full-frame AOI is a full-size frame.
+  inline constexpr size_t AoiFrameBytes(const CameraAoi &aoi, PixelFormat format)
+  {
+    return static_cast<size_t>(aoi.width) * aoi.height * BytesPerPixel(format);
+  }
+
+  // Copies the frame of an AOI into place in a full-size frame and blanks the rest, for what takes full-size frames
+  // (shared memory, preview, recordings). The full-frame AOI is a plain copy.
+  void ExpandAoiFrame(uint8_t *frame, const uint8_t *aoiFrame, const CameraAoi &aoi, PixelFormat format = PixelFormat::YUYV);
+
+  // Moves the image of aoi in a full-size frame to the start of the frame, so it holds the frame of the AOI. For
+  // sources that render the full frame.
+  void CropToAoi(uint8_t *frame, const CameraAoi &aoi, PixelFormat format = PixelFormat::YUYV);
+}
+
+#endif // CAMERA_AOI_H
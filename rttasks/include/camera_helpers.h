@@ -15,6 +15,8 @@ namespace Pylon {
 #endif
 
 namespace CameraHelpers {
+  struct CameraAoi;
+
   // Camera constants
   inline constexpr unsigned int IMAGE_WIDTH = 640;
   inline constexpr unsigned int IMAGE_HEIGHT = 480;
@@ -26,6 +28,24 @@ namespace CameraHelpers {
   inline constexpr unsigned int IMAGE_SIZE_BAYER = IMAGE_WIDTH * IMAGE_HEIGHT; // Bayer format has 1 byte per pixel
   using BayerFrame = uint8_t[IMAGE_SIZE_BAYER];
 
+  // Pixel format of the frames, written to the camera's PixelFormat after the pfs file. BayerRG8 halves the bandwidth
+  // of YUYV and leaves the camera's color conversion out.
+  enum class PixelFormat : int32_t
+  {
+    YUYV = 0,
+    BayerRG8 = 1,
+  };
+
+  inline constexpr unsigned int BytesPerPixel(PixelFormat format)
+  {
+    return format == PixelFormat::BayerRG8 ? 1 : 2;
+  }
+
+  inline constexpr unsigned int FrameBytes(PixelFormat format)
+  {
+    return IMAGE_SIZE * BytesPerPixel(format);
+  }
+
   inline constexpr double PIXEL_SIZE = 4.8e-3; //mm
   inline constexpr double FOCAL_LENGTH = 4.09; //mm
   inline constexpr double RADIANS_PER_PIXEL = 2.0 * std::atan(PIXEL_SIZE / (2.0 * FOCAL_LENGTH));
@@ -37,11 +57,24 @@ namespace CameraHelpers {
   // Configure the camera with predefined settings
   void ConfigureCamera(Pylon::CInstantCamera &camera);
 
+  // Sets the camera's PixelFormat, overriding the pfs file. Throws std::runtime_error if the camera lacks the format.
+  void SetPixelFormat(Pylon::CInstantCamera &camera, PixelFormat format);
+
   // Try to grab a frame. Returns true on success, false on timeout or incomplete grab. Throws only for fatal/unrecoverable errors.
   bool TryGrabFrame(Pylon::CInstantCamera &camera, Pylon::CGrabResultPtr &grabResult, unsigned int timeoutMs = TIMEOUT_MS);
 
   // Throws std::runtime_error if fails after maxRetries
   void PrimeCamera(Pylon::CInstantCamera &camera, Pylon::CGrabResultPtr &grabResult, unsigned int maxRetries = MAX_RETRIES);
+
+  // Latches and reads the camera's timestamp counter, the clock of the grab result timestamps.
+  // Returns false if the camera has no latchable timestamp.
+  bool TryLatchTimestamp(Pylon::CInstantCamera &camera, int64_t &timestampTicks, double &tickFrequencyHz);
+
+  // Programs the camera's AOI (OffsetX, OffsetY, Width, Height). applied is the AOI the camera has now and becomes aoi.
+  // New offsets are written while grabbing; a new size stops grabbing for the write, since cameras only take Width and
+  // Height while idle, and starts it again. A zero-size applied AOI stands for unknown and writes every node. Throws
+  // std::runtime_error on Pylon errors.
+  void ApplyAoi(Pylon::CInstantCamera &camera, CameraAoi &applied, const CameraAoi &aoi);
 }
 
 #endif // CAMERA_HELPERS_H
@@ -0,0 +1,48 @@
+#ifndef CAMERA_MODE_H
+#define CAMERA_MODE_H
+
+#include <cstdint>
+
+#include "camera_helpers.h" // For PixelFormat, IMAGE_SIZE_YUYV
+
+namespace CameraHelpers
+{
+  // A camera mode fixed at compile time: the frame size, the pixel format and the decimation of the coarse mask the
+  // detection searches. The vision kernels are instantiated per mode, so their loop bounds and row strides are
+  // constants. IMAGE_WIDTH x IMAGE_HEIGHT stays the largest frame, which Frame and the frame source buffers hold.
+  template <unsigned int Width, unsigned int Height, PixelFormat Format, unsigned int Decimation>
+  struct CameraMode
+  {
+    static constexpr unsigned int WIDTH = Width;
+    static constexpr unsigned int HEIGHT = Height;
+    static constexpr PixelFormat FORMAT = Format;
+    static constexpr unsigned int DECIMATION = Decimation; // Full-resolution pixels per coarse mask pixel
+
+    static constexpr unsigned int ROW_BYTES = Width * BytesPerPixel(Format);
+    static constexpr unsigned int FRAME_BYTES = Height * ROW_BYTES;
+    static constexpr int COARSE_WIDTH = static_cast<int>(Width / Decimation);
+    static constexpr int COARSE_HEIGHT = static_cast<int>(Height / Decimation);
+
+    static_assert(Decimation >= 2 && Decimation % 2 == 0, "Coarse pixels are whole YUYV pairs and RGGB cells");
+    static_assert(Width % Decimation == 0 && Height % Decimation == 0, "The coarse mask covers the whole frame");
+    static_assert(Width <= IMAGE_WIDTH && Height <= IMAGE_HEIGHT, "Frames are stored in IMAGE_WIDTH x IMAGE_HEIGHT buffers");
+  };
+
+  // A camera mode as the frame source reports it at run time, to pick the matching instantiation
+  struct CameraModeInfo
+  {
+    uint32_t width = IMAGE_WIDTH;
+    uint32_t height = IMAGE_HEIGHT;
+    PixelFormat format = PixelFormat::YUYV;
+
+    bool operator==(const CameraModeInfo &) const = default;
+  };
+
+  template <typename Mode>
+  constexpr CameraModeInfo ModeInfo()
+  {
+    return CameraModeInfo{Mode::WIDTH, Mode::HEIGHT, Mode::FORMAT};
+  }
+}
+
+#endif // CAMERA_MODE_H
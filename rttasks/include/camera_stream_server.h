@@ -0,0 +1,52 @@
+#ifndef CAMERA_STREAM_SERVER_H
+#define CAMERA_STREAM_SERVER_H
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+#include "frame.h"
+
+namespace PreviewHelpers
+{
+  // The parts of a frame's ProcessingStats that the frame storage does not hold
+  struct StreamFrameStats
+  {
+    double grabTimeMs = 0.0;    // Exposure start to grab return, 0 without an exposure timestamp
+    double processTimeMs = 0.0; // Grab return (or dequeue) to the end of the ball search
+    int32_t grabFailures = 0;
+    int32_t detectionFailures = 0;
+  };
+
+  // Called on the server threads for every frame that is encoded, possibly on several at once
+  using StreamStatsProvider = std::function<StreamFrameStats(const FrameInfo &info)>;
+
+  // Serves the CameraStreamService of ui/RapidLaser/Assets/protos/camera_streaming.proto over gRPC, straight from the
+  // frame storage of the copy handoff. Runs on threads of its own at normal priority, off the cores of the task that
+  // creates it. A frame is encoded at most once per format and quality, by the first call that needs it. Every stream
+  // and GetLatestFrame call that asks for the same encoding shares it. A stream always gets the newest frame, so a slow
+  // client skips frames without holding back the others.
+  class CameraStreamServer
+  {
+  public:
+    // Listens on address (host:port, port 0 picks a free one) and attaches a reader to storage. jpegQuality is used for
+    // requests without a compression_quality. Throws std::runtime_error if the server cannot be started.
+    CameraStreamServer(const std::string &address, int maxClients, int jpegQuality,
+                       std::shared_ptr<FrameStorage> storage, StreamStatsProvider stats = nullptr);
+    ~CameraStreamServer(); // Ends the streams and stops
+    CameraStreamServer(const CameraStreamServer &) = delete;
+    CameraStreamServer &operator=(const CameraStreamServer &) = delete;
+
+    int Port() const; // The port listened on
+    int Clients() const; // Open StreamCameraFrames calls
+    uint64_t EncodedFrames() const; // Encodings made, each is shared by every call that wants it
+    uint64_t SentFrames() const; // Frames written to streams and GetLatestFrame responses
+
+  private:
+    struct Server; // gRPC state, kept out of this header
+    std::unique_ptr<Server> server_;
+  };
+}
+
+#endif // CAMERA_STREAM_SERVER_H
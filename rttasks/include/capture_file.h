@@ -0,0 +1,111 @@
+#ifndef CAPTURE_FILE_H
+#define CAPTURE_FILE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "frame.h"
+
+namespace RecordingHelpers
+{
+  // Capture file layout, each part page aligned:
+  //   CaptureHeader | CaptureIndexEntry[slotCount] | Frame slots[slotCount]
+  // Frames are appended round-robin, so once appendCount passes slotCount the file holds the newest slotCount frames.
+  // The index holds the frame number, timestamp and byte offset of every slot, so readers can seek without touching frames.
+  inline constexpr char CAPTURE_MAGIC[8] = {'L', 'D', 'C', 'A', 'P', 'T', 'U', 'R'};
+  // Version 2 added FrameInfo::pixelFormat, version 1 files are all YUYV
+  inline constexpr uint32_t CAPTURE_VERSION = 2;
+
+  struct CaptureHeader
+  {
+    char magic[8];
+    uint32_t version;
+    uint32_t recordSize; // sizeof(Frame) of the writer
+    uint32_t imageWidth;
+    uint32_t imageHeight;
+    uint64_t slotCount;
+    uint64_t slotSize; // recordSize rounded up to a page
+    uint64_t indexOffset;
+    uint64_t dataOffset;
+    std::atomic<uint64_t> appendCount; // Frames appended since the file was created
+  };
+
+  struct CaptureIndexEntry
+  {
+    std::atomic<uint64_t> sequence; // 1-based append number of the frame in the slot, 0 while empty or being written
+    int64_t frameNumber;
+    int64_t timestampUs;
+    uint64_t offset; // Byte offset of the Frame in the file
+  };
+
+  static_assert(std::atomic<uint64_t>::is_always_lock_free, "Capture files are shared through memory mappings");
+
+  // Creates a capture file with room for slotCount frames. The file is preallocated and mapped, so Append only copies.
+  // Not for the RT tasks: the first write to every page of the mapping can fault. Throws std::runtime_error on failure.
+  class CaptureFileWriter
+  {
+  public:
+    CaptureFileWriter(const std::string &path, uint64_t slotCount);
+    ~CaptureFileWriter();
+    CaptureFileWriter(const CaptureFileWriter &) = delete;
+    CaptureFileWriter &operator=(const CaptureFileWriter &) = delete;
+
+    void Append(const Frame &frame);
+
+    // The frame with the given 1-based append number, nullptr if it was never written or has been overwritten
+    const Frame *FrameBySequence(uint64_t sequence) const;
+
+    // Flush the mapping to disk
+    void Sync();
+
+    uint64_t AppendCount() const { return header_->appendCount.load(std::memory_order_relaxed); }
+    uint64_t SlotCount() const { return header_->slotCount; }
+
+  private:
+    CaptureIndexEntry &Entry(uint64_t slot) const;
+
+    uint8_t *mapping_ = nullptr;
+    size_t mappingSize_ = 0;
+    CaptureHeader *header_ = nullptr;
+  };
+
+  // Read-only view of a capture file, frames ordered oldest first. Throws std::runtime_error for invalid files.
+  class CaptureFileReader
+  {
+  public:
+    explicit CaptureFileReader(const std::string &path);
+    ~CaptureFileReader();
+    CaptureFileReader(const CaptureFileReader &) = delete;
+    CaptureFileReader &operator=(const CaptureFileReader &) = delete;
+
+    // Whether the file starts with the capture file magic (raw recordings do not)
+    static bool IsCaptureFile(const std::string &path);
+
+    // Pixel format of the frames. Throws std::runtime_error at construction if the file mixes formats.
+    CameraHelpers::PixelFormat Format() const { return format_; }
+
+    size_t FrameCount() const { return frameCount_; }
+    const Frame &FrameAt(size_t index) const;
+    int64_t FrameNumberAt(size_t index) const { return Entry(index).frameNumber; }
+    int64_t TimestampAt(size_t index) const { return Entry(index).timestampUs; }
+
+    // Index of the first frame at or after the timestamp (or frame number), FrameCount() if there is none.
+    // Binary searches the index, no frame data is read.
+    size_t FindTimestamp(int64_t timestampUs) const;
+    size_t FindFrameNumber(int64_t frameNumber) const;
+
+  private:
+    const CaptureIndexEntry &Entry(size_t index) const;
+
+    const uint8_t *mapping_ = nullptr;
+    size_t mappingSize_ = 0;
+    const CaptureHeader *header_ = nullptr;
+    uint64_t firstSlot_ = 0;
+    size_t frameCount_ = 0;
+    CameraHelpers::PixelFormat format_ = CameraHelpers::PixelFormat::YUYV;
+  };
+}
+
+#endif // CAPTURE_FILE_H
@@ -0,0 +1,44 @@
+#ifndef FRAME_H
+#define FRAME_H
+
+#include <cstdint>
+#include <type_traits>
+
+#include "camera_helpers.h" // For YUYVFrame, PixelFormat
+#include "shared_data_helpers.h"
+
+// Detection results and target of a camera frame
+struct FrameInfo
+{
+  int frameNumber;
+  double timestamp;
+  bool ballDetected;
+  double centerX;
+  double centerY;
+  double radius;
+  int detectionMode;
+  int pixelFormat; // CameraHelpers::PixelFormat of the image
+  double targetX;
+  double targetY;
+};
+
+// A camera frame with its detection results, shared between the RT tasks and stored by the frame recorder
+struct Frame
+{
+  CameraHelpers::YUYVFrame imageData; // YUYV, or BayerRG8 in the first IMAGE_SIZE_BAYER bytes
+  FrameInfo info;
+};
+
+static_assert(std::is_trivially_copyable_v<Frame>, "Frame is copied into shared and file-backed memory");
+
+// Shared storage for camera frames, copy handoff only. Any task or thread can attach a reader and take the newest
+// frame, up to FRAME_STORAGE_READERS at a time. Every reader costs a frame slot, so there is one for each reader that
+// exists: OutputImage, and the stream server when it is built. A new reader needs its slot added here.
+#if defined(RTTASKS_CAMERA_STREAM_SERVER)
+inline constexpr uint32_t FRAME_STORAGE_READERS = 2;
+#else
+inline constexpr uint32_t FRAME_STORAGE_READERS = 1;
+#endif
+using FrameStorage = SharedDataHelpers::SPMCStorage<Frame, FRAME_STORAGE_READERS>;
+
+#endif // FRAME_H
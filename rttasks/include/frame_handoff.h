@@ -0,0 +1,59 @@
+#ifndef FRAME_HANDOFF_H
+#define FRAME_HANDOFF_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+#include "frame.h"
+#include "frame_source.h"
+
+namespace CameraHelpers
+{
+  // Hands the newest leased frame from DetectBall to OutputImage without copying the image. Lock-free, one producer and
+  // one consumer. A frame that was not taken before the next one is published goes back to the source right away, so
+  // the producer holds at most the frame being grabbed and the one waiting here.
+  class FrameHandoff
+  {
+  public:
+    // aoi is the AOI the leased frame holds, see FrameSource::LastAoi
+    void Publish(FrameLease &&lease, const FrameInfo &info, const CameraAoi &aoi)
+    {
+      // The slot belongs to the lease, so nobody else touches it until the lease is released
+      const uint32_t slot = lease.Slot();
+      slots_[slot].lease = std::move(lease);
+      slots_[slot].info = info;
+      slots_[slot].aoi = aoi;
+
+      const uint32_t skipped = pending_.exchange(slot + 1, std::memory_order_acq_rel);
+      if (skipped != 0)
+        slots_[skipped - 1].lease.Release();
+    }
+
+    // Takes the newest published frame, if there is one the consumer has not taken yet
+    bool TryTake(FrameLease &lease, FrameInfo &info, CameraAoi &aoi)
+    {
+      const uint32_t taken = pending_.exchange(0, std::memory_order_acq_rel);
+      if (taken == 0)
+        return false;
+
+      lease = std::move(slots_[taken - 1].lease);
+      info = slots_[taken - 1].info;
+      aoi = slots_[taken - 1].aoi;
+      return true;
+    }
+
+  private:
+    struct Slot
+    {
+      FrameLease lease;
+      FrameInfo info;
+      CameraAoi aoi;
+    };
+
+    std::array<Slot, FrameSource::MAX_LEASES> slots_; // Indexed by lease slot
+    std::atomic<uint32_t> pending_{0};                // Lease slot + 1 of the published frame, 0 when there is none
+  };
+}
+
+#endif // FRAME_HANDOFF_H
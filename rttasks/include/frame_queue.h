@@ -0,0 +1,76 @@
+#ifndef FRAME_QUEUE_H
+#define FRAME_QUEUE_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <utility>
+
+#include "frame_source.h"
+
+namespace CameraHelpers
+{
+  // A leased frame with what was known when it was grabbed
+  struct GrabbedFrame
+  {
+    FrameLease lease;
+    uint32_t frameNumber = 0;
+    int64_t exposureNs = 0;  // TimingHelpers::NowNs clock, 0 if the source has no exposure timestamp
+    int64_t grabbedNs = 0;   // TimingHelpers::NowNs clock
+    int64_t timestampUs = 0; // Wall clock, for the frame info
+    CameraAoi aoi;           // Part of the full frame the camera read out, all the lease holds
+  };
+
+  // Queue of grabbed frames from the GrabFrame thread to DetectBall. Lock-free ring, one producer and one consumer.
+  // The consumer takes the newest frame and returns the older ones to the source, so a slow frame delays at most the
+  // next one. While the queue is full the producer leaves new frames with the source.
+  class FrameQueue
+  {
+  public:
+    static constexpr uint32_t CAPACITY = 2;
+
+    // Moves frame into the queue. Returns false, leaving frame alone, when the queue is full.
+    bool TryPush(GrabbedFrame &frame)
+    {
+      const uint64_t head = head_.load(std::memory_order_relaxed);
+      if (head - tail_.load(std::memory_order_acquire) == CAPACITY)
+        return false;
+
+      slots_[head % CAPACITY] = std::move(frame);
+      head_.store(head + 1, std::memory_order_release);
+      return true;
+    }
+
+    // Takes the newest frame and releases the older ones. skipped receives the number released.
+    bool TryPopNewest(GrabbedFrame &frame, uint32_t &skipped)
+    {
+      const uint64_t tail = tail_.load(std::memory_order_relaxed);
+      const uint64_t head = head_.load(std::memory_order_acquire);
+      skipped = 0;
+      if (head == tail)
+        return false;
+
+      for (uint64_t older = tail; older + 1 < head; ++older)
+      {
+        slots_[older % CAPACITY].lease.Release();
+        skipped++;
+      }
+      frame = std::move(slots_[(head - 1) % CAPACITY]);
+      tail_.store(head, std::memory_order_release);
+      return true;
+    }
+
+    // Frames waiting, may be stale by the time it returns
+    uint32_t Depth() const
+    {
+      return static_cast<uint32_t>(head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_acquire));
+    }
+
+  private:
+    std::array<GrabbedFrame, CAPACITY> slots_;
+    alignas(64) std::atomic<uint64_t> head_{0}; // Frames pushed, written by the producer
+    alignas(64) std::atomic<uint64_t> tail_{0}; // Frames taken, written by the consumer
+  };
+}
+
+#endif // FRAME_QUEUE_H
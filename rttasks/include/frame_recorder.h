@@ -0,0 +1,81 @@
+#ifndef FRAME_RECORDER_H
+#define FRAME_RECORDER_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "camera_aoi.h"
+#include "capture_file.h"
+#include "frame.h"
+
+#ifndef RECORDER_CONFIG_FILE
+#define RECORDER_CONFIG_FILE ""
+#endif
+
+namespace RecordingHelpers
+{
+  // Loaded from RECORDER_CONFIG_FILE at Initialize
+  struct RecorderSettings
+  {
+    bool enabled = false;
+    std::string ringFile = "/var/lib/laser_demo/frames.ldcap";
+    uint64_t ringFrames = 600; // About 370 MB, 10 s at 60 fps
+
+    // Trigger mode: when the ball is lost, save the frames of the last triggerSeconds from the ring to their own file
+    bool trigger = false;
+    double triggerSeconds = 5.0;
+    std::string triggerDirectory = "/var/lib/laser_demo";
+  };
+
+  // Reads key=value lines ('#' starts a comment). A missing file leaves the recorder disabled.
+  // Throws std::runtime_error for unknown keys or bad values.
+  RecorderSettings LoadRecorderSettings(const char *path);
+
+  // Records Frames into a capture ring file. Append runs in the RT task: it copies the frame into a small locked staging
+  // ring and never blocks, allocates or makes a syscall. When the staging ring is full the frame is dropped and counted.
+  // A background thread at normal priority moves staged frames into the ring file and writes trigger files.
+  class FrameRecorder
+  {
+  public:
+    static constexpr uint64_t STAGING_SLOTS = 16;
+
+    // Creates the ring file and starts the background thread. Throws std::runtime_error on failure.
+    explicit FrameRecorder(const RecorderSettings &settings);
+    ~FrameRecorder(); // Records what is still staged, then stops
+    FrameRecorder(const FrameRecorder &) = delete;
+    FrameRecorder &operator=(const FrameRecorder &) = delete;
+
+    // Copies the image in the format info.pixelFormat names, the frame of aoi, into place in a full-size frame
+    void Append(const FrameInfo &info, const uint8_t *image, const CameraHelpers::CameraAoi &aoi = CameraHelpers::CameraAoi());
+
+    uint64_t RecordedFrames() const { return stagedHead_.load(std::memory_order_relaxed); }
+    uint64_t DroppedFrames() const { return droppedFrames_.load(std::memory_order_relaxed); }
+
+  private:
+    void Run();
+    bool Drain();
+    void SaveTriggerFile(uint64_t lossSequence);
+
+    RecorderSettings settings_;
+    CaptureFileWriter ring_;
+
+    // Staging ring, written by Append and read by the background thread
+    std::unique_ptr<Frame[]> staging_;
+    alignas(64) std::atomic<uint64_t> stagedHead_{0};
+    alignas(64) std::atomic<uint64_t> stagedTail_{0};
+    std::atomic<uint64_t> droppedFrames_{0};
+
+    // Append number of the newest frame that lost the ball, 0 for none. Only used in trigger mode.
+    std::atomic<uint64_t> lossSequence_{0};
+    bool lastBallDetected_ = false;
+    int64_t lastTriggerTimestampUs_ = 0;
+
+    std::atomic<bool> stop_{false};
+    std::thread thread_;
+  };
+}
+
+#endif // FRAME_RECORDER_H
@@ -0,0 +1,43 @@
+#ifndef FRAME_SERIALIZER_H
+#define FRAME_SERIALIZER_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "frame.h"
+
+// Serializes preview frames for the JSON file contract of the camera server into caller-provided buffers, so
+// publishing a frame never allocates. No locale-aware streams are involved.
+namespace PreviewHelpers
+{
+  // Characters of the padded base64 (RFC 4648) encoding of size bytes
+  constexpr size_t Base64EncodedSize(size_t size) { return (size + 2) / 3 * 4; }
+
+  // Writes the padded base64 encoding of data to out, which must hold Base64EncodedSize(size) characters.
+  // Returns the number of characters written. The output is not NUL-terminated.
+  using EncodeBase64Fn = size_t (*)(const uint8_t *data, size_t size, char *out);
+
+  size_t EncodeBase64Scalar(const uint8_t *data, size_t size, char *out);
+
+#if defined(__x86_64__) || defined(__i386__)
+  // Lookup-table encoders: 12 (SSSE3) or 24 (AVX2) input bytes per iteration, the tail goes through the scalar code
+  size_t EncodeBase64SSSE3(const uint8_t *data, size_t size, char *out);
+  size_t EncodeBase64AVX2(const uint8_t *data, size_t size, char *out);
+#endif
+
+  // The fastest implementation supported by the running CPU, resolved once when the library loads
+  size_t EncodeBase64(const uint8_t *data, size_t size, char *out);
+
+  // Name of the implementation EncodeBase64 uses, for logging ("scalar", "ssse3" or "avx2")
+  const char *EncodeBase64Name();
+
+  // Capacity that always fits the frame JSON of a JPEG of jpegSize bytes
+  constexpr size_t FrameJsonSizeBound(size_t jpegSize) { return Base64EncodedSize(jpegSize) + 4096; }
+
+  // Writes the camera server's frame JSON: the detection results of info and the JPEG as a base64 data URL.
+  // Returns the number of characters written, 0 if they do not fit capacity. The output is not NUL-terminated.
+  size_t SerializeFrameJson(const FrameInfo &info, int width, int height, const uint8_t *jpeg, size_t jpegSize,
+                            char *out, size_t capacity);
+}
+
+#endif // FRAME_SERIALIZER_H
@@ -0,0 +1,160 @@
+#ifndef FRAME_SOURCE_H
+#define FRAME_SOURCE_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+
+#include "camera_aoi.h"
+#include "camera_mode.h"
+#include "synthetic_frames.h"
+
+#ifndef FRAME_SOURCE_CONFIG_FILE
+#define FRAME_SOURCE_CONFIG_FILE ""
+#endif
+
+namespace CameraHelpers
+{
+  enum class FrameSourceType : int32_t
+  {
+    Pylon = 0,     // Basler camera through Pylon
+    Replay = 1,    // Recording mapped from a file
+    Synthetic = 2, // Rendered by SyntheticFrameGenerator
+  };
+
+  // Selects and configures the frame source, loaded from FRAME_SOURCE_CONFIG_FILE at Initialize
+  struct FrameSourceSettings
+  {
+    FrameSourceType type = FrameSourceType::Pylon;
+    bool zeroCopyHandoff = false; // Hand the grab buffer itself to OutputImage (FrameHandoff) instead of copying the image
+    bool grabThread = false;      // Grab on the GrabFrame thread, which queues the frames for DetectBall (FrameQueue)
+    int grabCore = -1;            // Core of the GrabFrame thread, negative leaves it on the cores of the Initialize task
+    int grabPriority = 0;         // SCHED_FIFO priority of the GrabFrame thread, 0 runs it at normal priority
+    bool trackAoi = false;        // Move the camera AOI with the ball (AoiTracker), Pylon and synthetic only
+    float aoiMargin = 48.0f;      // Pixels the AOI keeps around the ball on every side
+    PixelFormat pixelFormat = PixelFormat::YUYV; // Format grabbed or rendered. Capture files replay in their own format.
+
+    // Replay
+    std::string replayFile;   // Capture file from the frame recorder, or IMAGE_WIDTH x IMAGE_HEIGHT frames of
+                              // pixelFormat back to back
+    double replayFPS = -1.0;  // Forced rate, 0 delivers a frame on every grab. Negative plays at the recorded rate
+                              // (capture file timestamps, 30 fps for raw files).
+    bool replayLoop = true;   // Start over at the end of the recording, otherwise keep returning no frame
+
+    // Synthetic
+    double syntheticFPS = 0.0; // 0 delivers a frame on every grab
+    float syntheticAmplitudeX = 200.0f; // Ball path: a Lissajous figure around the image center, in full-resolution pixels
+    float syntheticAmplitudeY = 150.0f;
+    float syntheticPeriodSeconds = 4.0f;
+    SyntheticSceneSettings syntheticScene;
+  };
+
+  // Reads key=value lines ('#' starts a comment). A missing file gives the defaults, which use the Pylon camera.
+  // Throws std::runtime_error for unknown keys or bad values.
+  FrameSourceSettings LoadFrameSourceSettings(const char *path);
+
+  class FrameSource;
+
+  // A frame buffer on loan from a FrameSource. The buffer stays valid until the lease is released, which returns it to
+  // the source (for the camera, to the Pylon buffer pool). Move-only, released when destroyed. Can be released from
+  // another thread than the one that leased it.
+  class FrameLease
+  {
+  public:
+    FrameLease() = default;
+    ~FrameLease() { Release(); }
+    FrameLease(FrameLease &&other) noexcept { *this = std::move(other); }
+    FrameLease &operator=(FrameLease &&other) noexcept;
+    FrameLease(const FrameLease &) = delete;
+    FrameLease &operator=(const FrameLease &) = delete;
+
+    void Release();
+
+    const uint8_t *Data() const { return data_; }
+    uint32_t Slot() const { return slot_; }
+    explicit operator bool() const { return source_ != nullptr; }
+
+  private:
+    friend class FrameSource;
+
+    FrameSource *source_ = nullptr;
+    uint32_t slot_ = 0;
+    const uint8_t *data_ = nullptr;
+  };
+
+  // A source of frames (IMAGE_WIDTH x IMAGE_HEIGHT or the AOI of one, YUYV or BayerRG8) for DetectBall
+  class FrameSource
+  {
+  public:
+    // Queued for DetectBall (FrameQueue::CAPACITY), being detected, handed off, being read, and one spare
+    static constexpr uint32_t MAX_LEASES = 6;
+
+    virtual ~FrameSource() = default;
+
+    // Prepare the source and wait for the first frame. Throws std::runtime_error on failure.
+    virtual void Open() = 0;
+
+    // Try to get the next frame. Returns true on success, false if no frame is ready within timeoutMs.
+    // frame stays valid until the next call. Throws only for fatal/unrecoverable errors.
+    virtual bool TryGrabFrame(const uint8_t *&frame, unsigned int timeoutMs) = 0;
+
+    // Like TryGrabFrame, but the frame's buffer stays valid until the lease is released.
+    // Also returns false while all MAX_LEASES buffers are out. Only one thread may lease.
+    bool TryLeaseFrame(FrameLease &lease, unsigned int timeoutMs);
+
+    virtual FrameSourceType Type() const = 0;
+
+    // Pixel format of every frame, known after Open
+    virtual PixelFormat Format() const = 0;
+
+    // Size and pixel format the camera reports, known after Open. The detection is picked for it.
+    virtual CameraModeInfo Mode() const { return CameraModeInfo{IMAGE_WIDTH, IMAGE_HEIGHT, Format()}; }
+
+    // Host time (TimingHelpers::NowNs clock) at which the exposure of the last grabbed or leased frame started, 0 if the
+    // source cannot tell
+    virtual int64_t LastExposureNs() const { return 0; }
+
+    // AOI of the last grabbed or leased frame. The frame holds only its image, see AoiFrameBytes.
+    virtual CameraAoi LastAoi() const { return CameraAoi(); }
+
+    // Asks for a new AOI, which later frames come with. Can be called from another thread than the one that grabs, and
+    // never waits for the camera: the Pylon source programs it on a thread of its own. Sources without an AOI ignore it.
+    void RequestAoi(const CameraAoi &aoi) { requestedAoi_.store(PackAoi(aoi), std::memory_order_relaxed); }
+
+    // AOI the camera was last given, and how often giving it one failed
+    virtual CameraAoi ProgrammedAoi() const { return RequestedAoi(); }
+    virtual uint64_t AoiFailures() const { return 0; }
+
+  protected:
+    // Grab the next frame into the given lease slot and keep its buffer until ReleaseLeased(slot)
+    virtual bool TryGrabLeased(uint32_t slot, const uint8_t *&frame, unsigned int timeoutMs) = 0;
+    virtual void ReleaseLeased(uint32_t /*slot*/) {}
+
+    CameraAoi RequestedAoi() const { return UnpackAoi(requestedAoi_.load(std::memory_order_relaxed)); }
+
+    // An AOI in one word, 16 bits per field, so it changes atomically
+    static constexpr uint64_t PackAoi(const CameraAoi &aoi)
+    {
+      return uint64_t{aoi.offsetX} | uint64_t{aoi.offsetY} << 16 | uint64_t{aoi.width} << 32 | uint64_t{aoi.height} << 48;
+    }
+    static constexpr CameraAoi UnpackAoi(uint64_t packed)
+    {
+      return CameraAoi{static_cast<uint32_t>(packed & 0xffff), static_cast<uint32_t>(packed >> 16 & 0xffff),
+                       static_cast<uint32_t>(packed >> 32 & 0xffff), static_cast<uint32_t>(packed >> 48)};
+    }
+
+  private:
+    friend class FrameLease;
+
+    void ReleaseLease(uint32_t slot);
+
+    std::atomic<uint32_t> leasedSlots_{0}; // Bit per lease slot
+    std::atomic<uint64_t> requestedAoi_{PackAoi(CameraAoi())};
+  };
+
+  std::unique_ptr<FrameSource> CreateFrameSource(const FrameSourceSettings &settings);
+}
+
+#endif // FRAME_SOURCE_H
@@ -0,0 +1,135 @@
+#ifndef FRAME_TRACE_H
+#define FRAME_TRACE_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+namespace TimingHelpers
+{
+  // Clock of every stage timestamp: steady_clock in nanoseconds
+  inline int64_t NowNs()
+  {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+  // Points in the life of a camera frame
+  enum class FrameStage : int32_t
+  {
+    Exposure = 0,      // Exposure start, from the camera's own timestamp when the frame source has one
+    Grabbed = 1,       // The grab returned the frame, in DetectBall or GrabFrame
+    MaskDone = 2,      // Red mask extracted and cleaned up
+    FitDone = 3,       // Ball search and circle fit finished
+    TargetWritten = 4, // New target handed to MoveMotors
+    MoveIssued = 5,    // MoveSCurve returned in MoveMotors
+    Published = 6,     // Preview published by OutputImage
+    Dequeued = 7,      // DetectBall took the frame from the GrabFrame queue, only with grab = thread
+    Count = 8,
+  };
+
+  // Stage pairs with a latency histogram
+  enum class LatencySpan : int32_t
+  {
+    ExposureToGrab = 0,
+    GrabToMask = 1,
+    MaskToFit = 2,
+    FitToTarget = 3,
+    TargetToMove = 4,
+    GrabToMove = 5,     // Camera to motion, as far as the host clock sees it
+    ExposureToMove = 6, // Camera to motion, including exposure and transfer
+    GrabToPublish = 7,
+    GrabToDequeue = 8,   // Wait in the GrabFrame queue
+    DequeueToTarget = 9, // DetectBall's work on a queued frame
+    Count = 10,
+  };
+
+  // Name of a span for logs, such as "grab_to_move"
+  const char *LatencySpanName(LatencySpan span);
+
+  // Log-linear (HDR) histogram of nanosecond latencies. Values up to 2^SUB_BUCKET_BITS ns are exact, larger ones are
+  // kept to within 2^-(SUB_BUCKET_BITS - 1) (under 1%). Record is lock-free and allocation-free, reads may run
+  // concurrently with it and see a slightly stale distribution.
+  class LatencyHistogram
+  {
+  public:
+    static constexpr int SUB_BUCKET_BITS = 8;
+    static constexpr int MAX_EXPONENT = 34; // Values from 2^35 ns (about 34 s) on share the last bucket
+    static constexpr size_t BUCKET_COUNT = (size_t(1) << SUB_BUCKET_BITS) + (MAX_EXPONENT - SUB_BUCKET_BITS + 1) * (size_t(1) << (SUB_BUCKET_BITS - 1));
+
+    // Negative values are recorded as 0
+    void Record(int64_t valueNs);
+
+    // Not safe against concurrent Record calls, only for Initialize
+    void Reset();
+
+    // Takes out the samples of another histogram that were also recorded here, for windows built from slices. MaxNs
+    // stays the largest value ever recorded. Safe against concurrent reads, not against concurrent Record calls.
+    void Subtract(const LatencyHistogram &other);
+
+    uint64_t Count() const { return count_.load(std::memory_order_relaxed); }
+    int64_t MaxNs() const { return max_.load(std::memory_order_relaxed); }
+
+    // Smallest recorded value that percentile (0-100) percent of the samples are at or below, within the bucket
+    // resolution. 0 without samples.
+    int64_t PercentileNs(double percentile) const;
+
+    static size_t BucketIndex(uint64_t value);
+    static uint64_t BucketHighestValue(size_t index); // Largest value that falls into the bucket
+
+  private:
+    std::array<std::atomic<uint64_t>, BUCKET_COUNT> buckets_{};
+    std::atomic<uint64_t> count_{0};
+    std::atomic<int64_t> max_{0};
+  };
+
+  // Stage timestamps of one frame, 0 for stages the frame has not reached
+  struct FrameTrace
+  {
+    uint32_t frameNumber = 0;
+    std::array<int64_t, static_cast<size_t>(FrameStage::Count)> stageNs{};
+  };
+
+  // Collects the stage timestamps of the newest frames and feeds a LatencyHistogram per LatencySpan as stages complete.
+  // Each task stamps the stages it owns, so Stamp may be called from several threads, but each stage of a frame from
+  // only one. Everything is preallocated, nothing blocks.
+  class FrameTracer
+  {
+  public:
+    static constexpr uint32_t TRACE_SLOTS = 64; // Frames kept, older ones are overwritten by frame number
+
+    // Starts the trace of a new frame. exposureNs is 0 if the frame source has no exposure timestamp.
+    void Begin(uint32_t frameNumber, int64_t exposureNs, int64_t grabbedNs);
+
+    // Stamps a stage of a frame that is still traced, once. Returns false for frames already overwritten.
+    bool Stamp(uint32_t frameNumber, FrameStage stage, int64_t timeNs = NowNs());
+
+    // Stamps TargetWritten and remembers the frame, so MoveMotors can attribute its move
+    void TargetWritten(uint32_t frameNumber, int64_t timeNs = NowNs());
+
+    // Frame of the newest target, 0 if none
+    uint32_t TargetFrame() const { return targetFrame_.load(std::memory_order_acquire); }
+
+    // Copy of a frame's stage timestamps. Returns false if the frame is not traced (any more).
+    bool TryGetTrace(uint32_t frameNumber, FrameTrace &trace) const;
+
+    const LatencyHistogram &Histogram(LatencySpan span) const { return histograms_[static_cast<size_t>(span)]; }
+
+    // Not safe against concurrent stamps, only for Initialize
+    void Reset();
+
+  private:
+    struct Slot
+    {
+      std::atomic<uint32_t> frameNumber{0};
+      std::array<std::atomic<int64_t>, static_cast<size_t>(FrameStage::Count)> stageNs{};
+    };
+
+    std::array<Slot, TRACE_SLOTS> slots_;
+    std::array<LatencyHistogram, static_cast<size_t>(LatencySpan::Count)> histograms_;
+    std::atomic<uint32_t> targetFrame_{0};
+  };
+}
+
+#endif // FRAME_TRACE_H
@@ -0,0 +1,83 @@
+#ifndef FRAME_TRANSPORT_H
+#define FRAME_TRANSPORT_H
+
+/*
+ * Preview frames published by OutputImage through a SharedMemorySPSCStorage segment (see shared_memory_layout.h), and
+ * a small C API for reading them from another process. Plain C so the camera server can load the reader library.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "shared_memory_layout.h"
+
+#define FRAME_TRANSPORT_NAME "/laser_demo_frames"
+#define FRAME_TRANSPORT_VERSION 1u                    /* payloadVersion of the segment */
+#define FRAME_TRANSPORT_MAX_IMAGE_SIZE (640 * 480 * 2) /* Room for an uncompressed YUYV frame */
+
+enum FrameTransportFormat
+{
+  FRAME_TRANSPORT_FORMAT_JPEG = 1,
+};
+
+/* One slot of the segment. The metadata is a fixed 64-byte block, the image starts right after it. */
+typedef struct FrameTransportFrame
+{
+  int64_t frameNumber;
+  int64_t timestampUs;
+  double targetX;
+  double targetY;
+  float centerX;
+  float centerY;
+  float radius;
+  int32_t ballDetected;
+  int32_t detectionMode;
+  uint32_t format; /* FrameTransportFormat */
+  uint32_t imageSize;
+  uint16_t width;
+  uint16_t height;
+  uint8_t image[FRAME_TRANSPORT_MAX_IMAGE_SIZE];
+} FrameTransportFrame;
+
+#ifdef __cplusplus
+static_assert(offsetof(FrameTransportFrame, image) == 64, "Frame transport metadata must stay 64 bytes");
+#else
+_Static_assert(offsetof(FrameTransportFrame, image) == 64, "Frame transport metadata must stay 64 bytes");
+#endif
+
+/* ----------- Reader API (libFrameTransportReader) ----------- */
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+  typedef struct FrameTransportReader FrameTransportReader;
+
+  enum FrameTransportResult
+  {
+    FRAME_TRANSPORT_CLOSED = -1,   /* The writer closed or replaced the segment, close the reader and open it again */
+    FRAME_TRANSPORT_NO_FRAME = 0,  /* Nothing new since the last take */
+    FRAME_TRANSPORT_NEW_FRAME = 1,
+  };
+
+  /* Maps the segment and attaches as its reader. Returns NULL (with errno set) if the segment does not exist, has an
+   * unsupported layout or payload version, or another live process is attached as the reader. */
+  FrameTransportReader *frame_transport_open(const char *name);
+
+  /* Takes the newest frame. On FRAME_TRANSPORT_NEW_FRAME, *frame points into the segment and stays valid and unchanged
+   * until the next take or close. Never blocks. */
+  int frame_transport_take(FrameTransportReader *reader, const FrameTransportFrame **frame);
+
+  /* Blocks until the writer publishes a frame or closes the segment after the last take, or timeoutMs passes, without
+   * polling. Returns FRAME_TRANSPORT_NEW_FRAME when the next take has news (a frame or FRAME_TRANSPORT_CLOSED) and
+   * FRAME_TRANSPORT_NO_FRAME on timeout. A writer that exited without closing is only noticed by the next take. */
+  int frame_transport_wait(FrameTransportReader *reader, unsigned int timeoutMs);
+
+  void frame_transport_close(FrameTransportReader *reader);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FRAME_TRANSPORT_H */
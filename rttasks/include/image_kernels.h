@@ -0,0 +1,85 @@
+#ifndef IMAGE_KERNELS_H
+#define IMAGE_KERNELS_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Raw-pointer pixel kernels used by ImageProcessing. These have no OpenCV dependency so they can be
+// checked and benchmarked in isolation.
+namespace ImageProcessing::Kernels
+{
+  // Writes one row of the half-resolution red mask from one packed YUYV row.
+  // maskRow[x] = (V of pixel pair x > threshold) ? 255 : 0, for x in [0, maskWidth).
+  using ExtractMaskVRowFn = void (*)(const uint8_t *yuyvRow, uint8_t *maskRow, int maskWidth, uint8_t threshold);
+
+  // Scalar reference implementation, bit-exact with ExtractV followed by cv::threshold(THRESH_BINARY)
+  void ExtractMaskVRowScalar(const uint8_t *yuyvRow, uint8_t *maskRow, int maskWidth, uint8_t threshold);
+
+#if defined(__x86_64__) || defined(__i386__)
+  void ExtractMaskVRowSSE2(const uint8_t *yuyvRow, uint8_t *maskRow, int maskWidth, uint8_t threshold);
+  void ExtractMaskVRowAVX2(const uint8_t *yuyvRow, uint8_t *maskRow, int maskWidth, uint8_t threshold);
+#endif
+
+  // The fastest implementation supported by the running CPU, resolved once when the library loads
+  ExtractMaskVRowFn ExtractMaskVRow();
+
+  // Name of the implementation returned by ExtractMaskVRow(), for logging ("scalar", "sse2" or "avx2"). The coarse
+  // mask kernels below are dispatched to the same level.
+  const char *ExtractMaskVRowName();
+
+  // Writes one row of the quarter-resolution red mask (one sample per 4x4 block) from the second packed YUYV row of
+  // the blocks. maskRow[x] = (V of pixel pair 2x > threshold) ? 255 : 0, for x in [0, maskWidth). Reads 8 * maskWidth
+  // bytes of yuyvRow.
+  using ExtractCoarseMaskVRowFn = void (*)(const uint8_t *yuyvRow, uint8_t *maskRow, int maskWidth, uint8_t threshold);
+
+  void ExtractCoarseMaskVRowScalar(const uint8_t *yuyvRow, uint8_t *maskRow, int maskWidth, uint8_t threshold);
+
+#if defined(__x86_64__) || defined(__i386__)
+  void ExtractCoarseMaskVRowSSE2(const uint8_t *yuyvRow, uint8_t *maskRow, int maskWidth, uint8_t threshold);
+  void ExtractCoarseMaskVRowAVX2(const uint8_t *yuyvRow, uint8_t *maskRow, int maskWidth, uint8_t threshold);
+#endif
+
+  ExtractCoarseMaskVRowFn ExtractCoarseMaskVRow();
+
+  // Writes one row of the quarter-resolution red mask from the two rows of BayerRG8 cells at the top of the blocks,
+  // one RGGB cell per 4x4 block. maskRow[x] = (BayerV of the cell at 4x > threshold) ? 255 : 0, for x in
+  // [0, maskWidth). Reads 4 * maskWidth bytes of each row.
+  using ExtractCoarseMaskBayerRowFn = void (*)(const uint8_t *topRow, const uint8_t *bottomRow, uint8_t *maskRow, int maskWidth, uint8_t threshold);
+
+  void ExtractCoarseMaskBayerRowScalar(const uint8_t *topRow, const uint8_t *bottomRow, uint8_t *maskRow, int maskWidth, uint8_t threshold);
+
+#if defined(__x86_64__) || defined(__i386__)
+  void ExtractCoarseMaskBayerRowSSE2(const uint8_t *topRow, const uint8_t *bottomRow, uint8_t *maskRow, int maskWidth, uint8_t threshold);
+  void ExtractCoarseMaskBayerRowAVX2(const uint8_t *topRow, const uint8_t *bottomRow, uint8_t *maskRow, int maskWidth, uint8_t threshold);
+#endif
+
+  ExtractCoarseMaskBayerRowFn ExtractCoarseMaskBayerRow();
+
+  // V (BT.601 red chroma, centered on 128) of one RGGB cell of a BayerRG8 mosaic, with the two greens averaged.
+  // The BT.601 weights of the camera's YUV output, so RED_THRESHOLD works on either format.
+  inline int BayerV(int r, int g0, int g1, int b) { return 128 + ((256 * r - 107 * (g0 + g1) - 42 * b) >> 9); }
+
+  // Converts a width x height BayerRG8 mosaic to YUYV for the preview, one RGGB cell per YUYV pixel pair in each of
+  // its two rows. No interpolation across cells, so the colors have half the resolution of the frame.
+  void BayerToYUYV(const uint8_t *bayer, uint8_t *yuyv, int width, int height);
+
+  // Structuring element for binary morphology, symmetric about its center and convex along each row.
+  // It is described by the half-width of each row, -1 for an empty row.
+  inline constexpr int MAX_MORPH_RADIUS = 7;
+  struct MorphShape
+  {
+    int radius = 0;
+    int halfWidths[2 * MAX_MORPH_RADIUS + 1] = {};
+  };
+
+  // Bytes of scratch memory ErodeMask and DilateMask need for a width x height mask
+  constexpr size_t MorphScratchSize(int width, int height, int radius) { return size_t(radius + 1) * width * height; }
+
+  // Binary erosion and dilation of 0/255 masks using caller-provided scratch memory, so they never allocate.
+  // Pixels outside of the mask are ignored, which is how OpenCV's erode and dilate treat their default constant border.
+  // src and dst may be the same buffer.
+  void ErodeMask(const uint8_t *src, size_t srcStep, uint8_t *dst, size_t dstStep, int width, int height, const MorphShape &shape, uint8_t *scratch);
+  void DilateMask(const uint8_t *src, size_t srcStep, uint8_t *dst, size_t dstStep, int width, int height, const MorphShape &shape, uint8_t *scratch);
+}
+
+#endif // IMAGE_KERNELS_H
@@ -3,21 +3,146 @@
 
 #include <cstdint> // For uint8_t
 #include <numbers>
+#include <span>
 
 #include <opencv2/opencv.hpp>
 
+#include "camera_aoi.h"
+#include "camera_helpers.h" // For RADIANS_PER_PIXEL
+#include "camera_mode.h"
+#include "memory_helpers.h"
+
 namespace ImageProcessing
 {
   // Offsets under this threshold are considered negligible and are ignored
-  inline constexpr unsigned int PIXEL_THRESHOLD = 5; 
+  inline constexpr unsigned int PIXEL_THRESHOLD = 2;
+
+  // Gimbal motor units (revolutions) per pixel of ball offset from the image center, on both axes
+  inline constexpr double MOTOR_UNITS_PER_PIXEL = -CameraHelpers::RADIANS_PER_PIXEL / (2.0 * std::numbers::pi);
 
   // Constants for image processing
   inline static constexpr double RED_THRESHOLD = 150; // Threshold for red channel (v) in YUYV format
   inline static constexpr double MAX_CIRCLE_FIT_ERROR = 200; // Maximum error allowed for circle fitting to consider a contour as a valid ball
-  inline static constexpr double MIN_CONTOUR_AREA = 100; // Minimum area for a contour to be considered valid
+  // Default smallest blob, in full-resolution pixels, that can be the ball (min_blob_area in the detection settings).
+  // About the area where the 25-point contour minimum of the old findContours search let balls through.
+  inline static constexpr double MIN_CONTOUR_AREA = 800;
+
+  // Constants for the coarse-to-fine search: candidates are found in a quarter-resolution mask, then the circle is
+  // refined on the full-resolution V samples around the candidate
+  inline static constexpr int COARSE_SCALE = 4; // Full-resolution pixels per coarse mask pixel
+  inline static constexpr int COARSE_MASK_WIDTH = CameraHelpers::IMAGE_WIDTH / COARSE_SCALE;
+  inline static constexpr int COARSE_MASK_HEIGHT = CameraHelpers::IMAGE_HEIGHT / COARSE_SCALE;
+
+  // The camera modes the detection is instantiated for, picked at run time with FindDetector. Adding a mode here and to
+  // the list in image_processing.cpp is all it takes to detect on it.
+  using YUYVMode = CameraHelpers::CameraMode<CameraHelpers::IMAGE_WIDTH, CameraHelpers::IMAGE_HEIGHT, CameraHelpers::PixelFormat::YUYV, COARSE_SCALE>;
+  using BayerRG8Mode = CameraHelpers::CameraMode<CameraHelpers::IMAGE_WIDTH, CameraHelpers::IMAGE_HEIGHT, CameraHelpers::PixelFormat::BayerRG8, COARSE_SCALE>;
+
+  inline static constexpr int REFINE_RAYS = 64; // Rays cast from the candidate center for sub-pixel edge points
+  inline static constexpr int MIN_REFINE_EDGE_POINTS = 16; // Edge points needed to accept a refined circle
+
+  // Constants for the region-of-interest tracking mode
+  inline static constexpr float TRACKING_MOTION_MARGIN = 40.0f; // Pixels added around the last radius to allow for motion between frames
+  inline static constexpr int TRACKING_MAX_MISSES = 3; // Consecutive window misses before falling back to a full-frame search
+
+  // Which search produced a detection result
+  enum class DetectionMode : int32_t
+  {
+    None = 0,      // No search was run
+    FullFrame = 1, // The whole frame was searched
+    Tracking = 2,  // Only a window around the predicted ball position was searched
+  };
+
+  // State carried between frames by the tracking mode, ball coordinates are in full-resolution pixels
+  struct TrackingState
+  {
+    bool locked = false;      // Whether the next search should use a tracking window
+    bool hasPrevious = false; // Whether previous holds a detection from the frame before last
+    int misses = 0;           // Consecutive tracking window misses
+    cv::Vec3f last = cv::Vec3f(0.0f, 0.0f, 0.0f);
+    cv::Vec3f previous = cv::Vec3f(0.0f, 0.0f, 0.0f);
+  };
+
+  // Host times (TimingHelpers::NowNs) at which the detection stages of a frame finished, for the frame traces
+  struct DetectionStageTimes
+  {
+    int64_t maskDoneNs = 0; // Mask extracted and cleaned up
+    int64_t fitDoneNs = 0;  // Ball search and circle fit done, also when nothing was found
+  };
+
+  class StripeWorkers;
+
+  // Splits the full-frame search into horizontal stripes masked and labeled on workers, nullptr (the default) searches
+  // on the calling thread. The workers must outlive their use, call UseStripeWorkers(nullptr) before destroying them.
+  void UseStripeWorkers(StripeWorkers* workers);
 
-  void CalculateTargetPosition(const cv::Vec3f& ball, double &offsetX, double &offsetY);
-  bool TryDetectBall(const cv::Mat& yuyvFrame, cv::Vec3f& ball);
+  // Smallest blob, in full-resolution pixels, the searches take for the ball. MIN_CONTOUR_AREA until set.
+  void SetMinBlobArea(double area);
+
+  // Offset of the ball from the image center in motor units, sub-pixel and without the PIXEL_THRESHOLD dead band
+  void CalculateBallOffset(const cv::Vec3f& ball, double &offsetX, double &offsetY);
+
+  // The detection pipeline instantiated for one camera mode, on frames of that mode with rows back to back. The frame
+  // can be the frame of an AOI of the mode's size (see CameraHelpers::AoiFrameBytes), which is searched where it is:
+  // positions stay in full-frame pixels and nothing outside of the AOI is red. Offsets and sizes of the AOI must be
+  // multiples of CameraHelpers::AOI_ALIGNMENT.
+  struct Detector
+  {
+    CameraHelpers::CameraModeInfo mode;
+    bool (*detectFullFrame)(const uint8_t* frame, const CameraHelpers::CameraAoi& aoi, cv::Vec3f& ball,
+                            MemoryHelpers::ScratchArena& arena);
+    bool (*detect)(const uint8_t* frame, const CameraHelpers::CameraAoi& aoi, cv::Vec3f& ball, TrackingState& tracking,
+                   DetectionMode& detectionMode, MemoryHelpers::ScratchArena& arena, DetectionStageTimes* times);
+    void (*ballOffset)(const cv::Vec3f& ball, double &offsetX, double &offsetY);
+  };
+
+  // The detector of a camera mode, nullptr if the pipeline is not instantiated for it
+  const Detector* FindDetector(const CameraHelpers::CameraModeInfo& mode);
+
+  // Like FindDetector, but throws std::runtime_error for a mode without a detector
+  const Detector& GetDetector(const CameraHelpers::CameraModeInfo& mode);
+
+  // The detection functions take a YUYV frame (CV_8UC2) or a BayerRG8 frame (CV_8UC1), see WrapFrameBuffer, and run
+  // the detector of its mode. Throws std::runtime_error for a mode without a detector.
+  // Searches the full frame, coarse to fine. Per-frame scratch memory comes from arena, see RefineBall.
+  bool TryDetectBall(const cv::Mat& frame, cv::Vec3f& ball, MemoryHelpers::ScratchArena& arena);
+
+  // Searches a window around the predicted position while the ball is tracked, falling back to the full frame
+  // after TRACKING_MAX_MISSES misses or when the window touches the frame edge. mode reports which search ran.
+  // times, if given, receives when the stages of the search finished.
+  bool TryDetectBall(const cv::Mat& frame, cv::Vec3f& ball, TrackingState& tracking, DetectionMode& mode,
+                     MemoryHelpers::ScratchArena& arena, DetectionStageTimes* times = nullptr);
+
+  // -- Detection stages used by TryDetectBall, exposed for benchmarking --
+  template <typename Mode = YUYVMode>
+  void ExtractV(const cv::Mat& in, cv::Mat& out);
+  void MaskV(const cv::Mat& in, cv::Mat& out);
+  template <typename Mode = YUYVMode>
+  void ExtractMaskV(const cv::Mat& in, cv::Mat& out);
+  void ExtractMaskV(const cv::Mat& in, cv::Mat& out, const cv::Rect& roi);
+  void CloseOpenMask(cv::Mat& mask);
+  bool FindBall(const cv::Mat& mask, cv::Vec3f& ball, double minArea = MIN_CONTOUR_AREA / 4.0);
+
+  // Quarter-resolution red mask of the roi (in coarse mask coordinates). Coarse pixel (x, y) is the V sample at
+  // full-resolution (COARSE_SCALE * x + 0.5, COARSE_SCALE * y + 1).
+  void ExtractCoarseMaskV(const cv::Mat& in, cv::Mat& out, const cv::Rect& roi);
+  // The same from a BayerRG8 frame without demosaicing: coarse pixel (x, y) is the V of the RGGB cell at full-resolution
+  // (COARSE_SCALE * x, COARSE_SCALE * y).
+  void ExtractCoarseMaskBayer(const cv::Mat& in, cv::Mat& out, const cv::Rect& roi);
+  void CloseOpenCoarseMask(cv::Mat& mask);
+
+  // Sub-pixel circle from the full-resolution V samples: REFINE_RAYS rays from the center of the candidate (in
+  // full-resolution pixels) find where V crosses RED_THRESHOLD, and a circle is fitted to those edge points.
+  // Returns false, leaving ball alone, when too few edges are found, the circle moved too far from the candidate or
+  // arena has no room for the edge points. A BayerRG8 frame (CV_8UC1) is sampled on the V of its RGGB cells.
+  bool RefineBall(const cv::Mat& frame, const cv::Vec3f& candidate, cv::Vec3f& ball, MemoryHelpers::ScratchArena& arena);
+
+  // The circle fits return false, leaving center and radius alone, when the points give no circle: fewer than three,
+  // all on a line, or a fit that is not finite
+  bool FitCircleTaubin(std::span<const cv::Point> pts, cv::Point2f& center, float& radius);
+  bool FitCircleTaubin(std::span<const cv::Point2f> pts, cv::Point2f& center, float& radius);
+  bool FitCircleLeastSquares(std::span<const cv::Point> pts, cv::Point2f& center, float& radius);
+  double CircleFitError(std::span<const cv::Point> pts, const cv::Point2f& center, float radius);
 
   // -- Utility functions to create OpenCV Mat objects --
   inline cv::Mat CreateBayerMat(int width, int height)
@@ -39,6 +164,13 @@ namespace ImageProcessing
   {
     return cv::Mat(height, width, CV_8UC2, (void *)pImageBuffer);
   }
+
+  // A frame of either pixel format, as the detection functions take it
+  inline cv::Mat WrapFrameBuffer(const uint8_t *pImageBuffer, CameraHelpers::PixelFormat format, int width, int height)
+  {
+    return format == CameraHelpers::PixelFormat::BayerRG8 ? WrapBayerBuffer(pImageBuffer, width, height)
+                                                          : WrapYUYVBuffer(pImageBuffer, width, height);
+  }
 };
 
 #endif // IMAGE_PROCESSING_H
\ No newline at end of file
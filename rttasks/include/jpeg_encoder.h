@@ -0,0 +1,41 @@
+#ifndef JPEG_ENCODER_H
+#define JPEG_ENCODER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace PreviewHelpers
+{
+  // Encodes full-resolution YUYV frames to JPEG through libjpeg's raw data interface. The 4:2:2 planes go straight to
+  // the DCT, with no RGB image and no color conversion. The compressor, its tables and the output buffer are set up
+  // once and reused for every frame.
+  class JpegEncoder
+  {
+  public:
+    // quality 1-100. downscale halves both dimensions, averaging 2x2 pixels. Throws std::runtime_error on failure.
+    JpegEncoder(int quality, bool downscale);
+    ~JpegEncoder();
+    JpegEncoder(const JpegEncoder &) = delete;
+    JpegEncoder &operator=(const JpegEncoder &) = delete;
+
+    // Returns the size of the JPEG in Data(), 0 if it did not fit the output buffer.
+    // Data() stays valid until the next call. Throws std::runtime_error if libjpeg reports an error.
+    size_t Encode(const uint8_t *yuyvFrame);
+
+    // Same, but writes the JPEG to output. Returns 0 if it needs more than capacity bytes.
+    size_t Encode(const uint8_t *yuyvFrame, uint8_t *output, size_t capacity);
+
+    const uint8_t *Data() const;
+    int Width() const { return width_; }
+    int Height() const { return height_; }
+
+  private:
+    struct Compressor; // libjpeg state, kept out of this header
+    std::unique_ptr<Compressor> compressor_;
+    int width_;
+    int height_;
+  };
+}
+
+#endif // JPEG_ENCODER_H
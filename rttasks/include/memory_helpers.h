@@ -0,0 +1,115 @@
+#ifndef MEMORY_HELPERS_H
+#define MEMORY_HELPERS_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <type_traits>
+
+// Provided by the RTAllocationGuard library (tools/allocation_guard) when it is preloaded into the RTTaskManager.
+// Without it these resolve to null and the guard does nothing.
+extern "C"
+{
+  __attribute__((weak)) void RTAllocationGuardEnter();
+  __attribute__((weak)) void RTAllocationGuardExit();
+  __attribute__((weak)) uint64_t RTAllocationGuardCount();
+}
+
+namespace MemoryHelpers
+{
+  // Monotonic bump allocator over a fixed buffer for per-frame scratch memory. Reset() releases everything at once.
+  // Running out of space never throws or falls back to the heap: TryAllocate returns an empty span, which the caller
+  // has to handle, and Exhaustions() counts how often that happened.
+  class ScratchArena
+  {
+  public:
+    ScratchArena(const ScratchArena &) = delete;
+    ScratchArena &operator=(const ScratchArena &) = delete;
+
+    // count value-initialized Ts, or an empty span when the rest of the buffer is too small
+    template <typename T>
+    std::span<T> TryAllocate(std::size_t count)
+    {
+      static_assert(std::is_trivially_destructible_v<T>, "Reset() does not run destructors");
+      const std::size_t offset = (used_ + alignof(T) - 1) & ~(alignof(T) - 1);
+      if (count > (capacity_ - std::min(offset, capacity_)) / sizeof(T))
+      {
+        ++exhaustions_;
+        return {};
+      }
+
+      used_ = offset + count * sizeof(T);
+      peak_ = std::max(peak_, used_);
+      T *const items = reinterpret_cast<T *>(buffer_ + offset);
+      std::uninitialized_value_construct_n(items, count);
+      return std::span<T>(items, count);
+    }
+
+    void Reset() { used_ = 0; }
+
+    std::size_t Capacity() const { return capacity_; }
+    std::size_t Used() const { return used_; }
+    std::size_t Peak() const { return peak_; } // Highest use since construction, for sizing the buffer
+    uint64_t Exhaustions() const { return exhaustions_; } // Failed TryAllocate calls since construction
+
+  protected:
+    ScratchArena(std::byte *buffer, std::size_t capacity) : buffer_(buffer), capacity_(capacity) {}
+
+  private:
+    std::byte *buffer_;
+    std::size_t capacity_;
+    std::size_t used_ = 0;
+    std::size_t peak_ = 0;
+    uint64_t exhaustions_ = 0;
+  };
+
+  // A ScratchArena with its buffer inside, keep it in static storage on the RT path
+  template <std::size_t Bytes>
+  class FrameArena : public ScratchArena
+  {
+  public:
+    static constexpr std::size_t CAPACITY = Bytes;
+
+    FrameArena() : ScratchArena(buffer_, Bytes) {}
+
+  private:
+    alignas(64) std::byte buffer_[Bytes];
+  };
+
+  // Marks the current thread as inside code that must not allocate. Only active when built with RTTASKS_ALLOCATION_GUARD
+  // and run with the RTAllocationGuard library preloaded, which then counts (or traps) every heap allocation in scope.
+  class AllocationGuardScope
+  {
+  public:
+#if defined(RTTASKS_ALLOCATION_GUARD)
+    AllocationGuardScope()
+    {
+      if (RTAllocationGuardEnter)
+        RTAllocationGuardEnter();
+    }
+    ~AllocationGuardScope()
+    {
+      if (RTAllocationGuardExit)
+        RTAllocationGuardExit();
+    }
+#else
+    AllocationGuardScope() = default;
+#endif
+    AllocationGuardScope(const AllocationGuardScope &) = delete;
+    AllocationGuardScope &operator=(const AllocationGuardScope &) = delete;
+  };
+
+  // Heap allocations seen inside an AllocationGuardScope since the process started, 0 when the guard is not active
+  inline uint64_t GuardedAllocationCount()
+  {
+#if defined(RTTASKS_ALLOCATION_GUARD)
+    if (RTAllocationGuardCount)
+      return RTAllocationGuardCount();
+#endif
+    return 0;
+  }
+}
+
+#endif // MEMORY_HELPERS_H
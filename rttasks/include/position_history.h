@@ -0,0 +1,54 @@
+#ifndef POSITION_HISTORY_H
+#define POSITION_HISTORY_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+namespace MotionHelpers
+{
+  // Axis positions read at one controller sample
+  struct AxisSample
+  {
+    int64_t timeNs;        // Host time of the read (TimingHelpers::NowNs clock)
+    int32_t sampleCounter; // Controller sample counter
+    double x;
+    double y;
+  };
+
+  // Lock-free ring of the newest axis samples, written by one task every sample and read by others to look up the
+  // gimbal pose at an earlier time. Entries are sequence-locked, so a reader never sees a half-written sample and
+  // never blocks the writer.
+  class PositionHistory
+  {
+  public:
+    static constexpr uint32_t CAPACITY = 1024; // 256 ms at 4 kHz
+
+    // Single writer
+    void Push(const AxisSample &sample);
+
+    // Linear interpolation of the positions at timeNs between the samples around it. A time after the newest sample
+    // gives the newest positions. Returns false if the history does not reach back to timeNs.
+    bool TryInterpolate(int64_t timeNs, double &x, double &y) const;
+
+    // The sample with the given 0-based push number, false once it has been overwritten
+    bool TryRead(uint64_t index, AxisSample &sample) const;
+
+    uint64_t PushCount() const { return pushCount_.load(std::memory_order_acquire); }
+
+  private:
+    struct Entry
+    {
+      std::atomic<uint64_t> sequence{0}; // Push number + 1 once written, 0 while being written
+      std::atomic<int64_t> timeNs{0};
+      std::atomic<int32_t> sampleCounter{0};
+      std::atomic<double> x{0.0};
+      std::atomic<double> y{0.0};
+    };
+
+    std::array<Entry, CAPACITY> entries_;
+    std::atomic<uint64_t> pushCount_{0};
+  };
+}
+
+#endif // POSITION_HISTORY_H
@@ -0,0 +1,67 @@
+#ifndef PREVIEW_OUTPUT_H
+#define PREVIEW_OUTPUT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "frame.h"
+#include "frame_transport.h"
+#include "jpeg_encoder.h"
+#include "shared_data_helpers.h"
+
+#ifndef PREVIEW_CONFIG_FILE
+#define PREVIEW_CONFIG_FILE ""
+#endif
+
+namespace PreviewHelpers
+{
+  enum class PreviewTransport
+  {
+    SharedMemory, // FrameTransportFrame slots in the FRAME_TRANSPORT_NAME segment
+    JsonFile,     // /tmp/rsi_camera_data.json with a base64 image, for camera servers without the reader library
+  };
+
+  // Loaded from PREVIEW_CONFIG_FILE at Initialize
+  struct PreviewSettings
+  {
+    PreviewTransport transport = PreviewTransport::SharedMemory;
+    int jpegQuality = 80;
+    bool downscale = false; // Half-resolution preview, detection results stay in full-frame pixels
+
+    // CameraStreamService of the UI, served by CameraStreamServer from the frame storage
+    std::string streamAddress; // host:port to listen on, empty for no server
+    int streamMaxClients = 8;  // Concurrent StreamCameraFrames calls, more are refused
+  };
+
+  // Reads key=value lines ('#' starts a comment). A missing file gives the defaults.
+  // Throws std::runtime_error for unknown keys or bad values.
+  PreviewSettings LoadPreviewSettings(const char *path);
+
+  // Encodes the preview frames of OutputImage and publishes them for the camera server
+  class PreviewPublisher
+  {
+  public:
+    // Sets up the encoder, and the shared memory segment for the SharedMemory transport.
+    // Throws std::runtime_error on failure.
+    explicit PreviewPublisher(const PreviewSettings &settings);
+
+    // Encodes the frame and publishes it with its detection results. A BayerRG8 frame (info.pixelFormat) is demosaiced
+    // to YUYV first, the only place the Bayer pipeline needs a color image. Returns false if it was not published: the
+    // JPEG did not fit the encoder or a transport slot, or the file could not be written.
+    // Throws std::runtime_error if encoding fails.
+    bool Publish(const FrameInfo &info, const uint8_t *image);
+
+  private:
+    bool WriteJsonFile(const FrameInfo &info, const uint8_t *jpeg, size_t jpegSize);
+
+    PreviewSettings settings_;
+    JpegEncoder encoder_;
+    std::unique_ptr<SharedDataHelpers::SharedMemorySPSCStorage<FrameTransportFrame>> transport_;
+    std::unique_ptr<char[]> json_; // Frame JSON of the JsonFile transport, allocated once
+    std::unique_ptr<uint8_t[]> demosaiced_; // YUYV image of a BayerRG8 frame
+  };
+}
+
+#endif // PREVIEW_OUTPUT_H
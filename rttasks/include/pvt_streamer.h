@@ -0,0 +1,90 @@
+#ifndef PVT_STREAMER_H
+#define PVT_STREAMER_H
+
+#include <array>
+#include <cstdint>
+
+#ifndef MOTION_CONFIG_FILE
+#define MOTION_CONFIG_FILE ""
+#endif
+
+namespace MotionHelpers
+{
+  enum class MoveMode : int32_t
+  {
+    SCurve = 0,    // A new point-to-point MoveSCurve for every target
+    PvtStream = 1, // Position-velocity-time points streamed continuously towards the latest target
+  };
+
+  // How MoveMotors drives the gimbal, loaded from MOTION_CONFIG_FILE at Initialize
+  struct MotionSettings
+  {
+    MoveMode mode = MoveMode::SCurve;
+    double pvtPointSeconds = 0.001;  // Duration of every streamed point
+    uint32_t pvtLookaheadPoints = 4; // Points kept queued ahead of the one executing
+    double pvtMaxVelocity = 0.0;     // Limits of the streamed path in motor units per second (squared), 0 uses the axis
+    double pvtMaxAcceleration = 0.0; // default velocity and acceleration
+  };
+
+  // Reads key=value lines ('#' starts a comment). A missing file gives the defaults, which use MoveSCurve.
+  // Throws std::runtime_error for unknown keys or bad values.
+  MotionSettings LoadMotionSettings(const char *path);
+
+  struct AxisLimits
+  {
+    double minPosition;
+    double maxPosition;
+    double maxVelocity;
+    double maxAcceleration;
+  };
+
+  // The part of a multi-axis the PvtStreamer drives: RMP's MultiAxis in the tasks, a mock in the tests
+  class PvtMultiAxis
+  {
+  public:
+    virtual ~PvtMultiAxis() = default;
+
+    // Appends pointCount points, positions and velocities interleaved by axis as for RMP's MovePVT, times are the
+    // duration of each point. Starts a motion when none is executing. final ends the motion after the last point.
+    virtual void MovePVT(const double *positions, const double *velocities, const double *times, int32_t pointCount, bool final) = 0;
+
+    // Points appended to the frame buffer and not executed yet
+    virtual int32_t PointsRemaining() = 0;
+  };
+
+  // Streams a PVT path that heads for the latest target at the axis limits, instead of restarting a point-to-point
+  // profile for every target. Only pvtLookaheadPoints points are queued at a time, so a new target changes the path
+  // after at most that many points. Once the axes settle on the target the motion is ended, and a new one starts with
+  // the next target that moves them. Never allocates.
+  class PvtStreamer
+  {
+  public:
+    static constexpr int32_t AXIS_COUNT = 2;
+    static constexpr uint32_t MAX_POINTS_PER_STEP = 16;
+
+    PvtStreamer(const MotionSettings &settings, const std::array<AxisLimits, AXIS_COUNT> &limits);
+
+    // Starts idle at the given positions (the axes' command positions)
+    void Reset(const std::array<double, AXIS_COUNT> &positions);
+
+    // Call every sample with the latest target, which is clamped to the axis limits. Tops the queue up to the
+    // lookahead and returns the number of points appended.
+    uint32_t Step(PvtMultiAxis &multiAxis, const std::array<double, AXIS_COUNT> &target);
+
+    bool Streaming() const { return streaming_; }
+    const std::array<double, AXIS_COUNT> &LastPosition() const { return position_; } // Of the last point appended
+    uint64_t PointsSent() const { return pointsSent_; }
+    uint64_t Underruns() const { return underruns_; } // Times the queue ran empty while streaming
+
+  private:
+    MotionSettings settings_;
+    std::array<AxisLimits, AXIS_COUNT> limits_;
+    std::array<double, AXIS_COUNT> position_ = {};
+    std::array<double, AXIS_COUNT> velocity_ = {};
+    bool streaming_ = false;
+    uint64_t pointsSent_ = 0;
+    uint64_t underruns_ = 0;
+  };
+}
+
+#endif // PVT_STREAMER_H
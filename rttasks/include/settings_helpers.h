@@ -0,0 +1,24 @@
+#ifndef SETTINGS_HELPERS_H
+#define SETTINGS_HELPERS_H
+
+#include <string>
+#include <vector>
+
+namespace SettingsHelpers
+{
+  struct Setting
+  {
+    std::string key;
+    std::string value;
+  };
+
+  // Reads key=value lines, '#' starts a comment. A missing file gives no settings.
+  // Throws std::runtime_error for lines that are not key=value.
+  std::vector<Setting> ReadSettingsFile(const char *path);
+
+  // Throw std::runtime_error naming the key if the value does not parse
+  double ParseNumber(const Setting &setting);
+  bool ParseBool(const Setting &setting); // true/false or 1/0
+}
+
+#endif // SETTINGS_HELPERS_H
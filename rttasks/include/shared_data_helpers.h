@@ -2,14 +2,28 @@
 #define SHARED_DATA_HELPERS_H
 
 #include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <memory>
 #include <mutex>
+#include <new>
 #include <stdexcept>
 #include <string>
+#include <signal.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
 #include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
 #include <unistd.h>
 #include <type_traits>
 
+#include "shared_memory_layout.h"
+
 namespace SharedDataHelpers
 {
   // SPSC (Single Producer Single Consumer) storage for shared data
@@ -76,14 +90,197 @@ namespace SharedDataHelpers
     bool is_writer_ = false;
   };
 
-  // Shared memory SPSC storage for cross-process communication
+  // SPMC (Single Producer Multiple Consumer) storage of the latest element, for up to MaxReaders readers at a time.
+  // Each slot carries the publication it holds and the number of readers holding it. The writer fills a slot that is
+  // neither the latest nor held, so it never waits for a reader. Readers take the latest slot in place, without copying.
+  template<typename ElementType, uint32_t MaxReaders>
+  struct SPMCStorage {
+    static_assert(std::is_default_constructible<ElementType>::value, "ElementType must be default-constructible");
+    static_assert(std::is_trivially_copyable<ElementType>::value, "ElementType must be trivially copyable");
+    static_assert(MaxReaders >= 1 && MaxReaders + 2 <= 256, "Slot indices are packed in 8 bits");
+
+    using element_type = ElementType;
+
+    static constexpr uint32_t max_readers = MaxReaders;
+    static constexpr uint32_t slot_count = MaxReaders + 2; // One held by each reader, the latest and the writer's
+    static constexpr uint64_t writing = ~uint64_t{0};      // Version of a slot while the writer fills it
+
+    struct alignas(64) SlotState {
+      std::atomic<uint64_t> version{0}; // Publication the slot holds, 0 for none
+      std::atomic<uint32_t> readers{0};
+    };
+
+    std::mutex writer_mutex;
+    std::atomic<uint32_t> reader_count{0};
+    alignas(64) std::atomic<uint64_t> latest{0}; // Latest publication << 8 | its slot, 0 before the first
+    SlotState slots[slot_count];
+    element_type elements[slot_count];
+  };
+
+  // The writer of an SPMCStorage: fill data(), then publish() it. Only one writer can be attached at a time.
+  template<typename StoragePtr>
+  class SPMCStorageWriter {
+  public:
+    using storage_type = typename std::pointer_traits<StoragePtr>::element_type;
+    using value_type = typename storage_type::element_type;
+
+    explicit SPMCStorageWriter(StoragePtr storage)
+      : storage_(storage),
+        lock_(storage_->writer_mutex, std::try_to_lock)
+    {
+      if (!lock_.owns_lock()) {
+        throw std::runtime_error("Failed to acquire lock on SPMCStorage");
+      }
+
+      // Carry on from an earlier writer
+      const uint64_t latest = storage_->latest.load(std::memory_order_acquire);
+      publication_ = latest >> 8;
+      latest_index_ = latest == 0 ? storage_type::slot_count : static_cast<uint32_t>(latest & 0xff);
+      claim();
+    }
+
+    SPMCStorageWriter() = delete;
+    SPMCStorageWriter(const SPMCStorageWriter&) = delete;
+    SPMCStorageWriter& operator=(const SPMCStorageWriter&) = delete;
+
+    value_type& data() { return storage_->elements[index_]; }
+
+    // Makes data() the latest element for the readers and moves on to a free slot
+    void publish() {
+      ++publication_;
+      storage_->slots[index_].version.store(publication_, std::memory_order_release);
+      storage_->latest.store(publication_ << 8 | index_, std::memory_order_release);
+      latest_index_ = index_;
+      claim();
+    }
+
+    uint64_t publications() const { return publication_; }
+
+  private:
+    // Takes a slot that is neither the latest nor held by a reader. A reader counts itself into a slot before it checks
+    // the slot's version, and the writer marks the slot before it checks the count. With sequentially consistent
+    // operations on both sides one of them sees the other and backs off. At most max_readers slots are held, so a
+    // pass finds a slot unless a reader that started on an older publication is still backing off.
+    void claim() {
+      for (;;) {
+        for (uint32_t slot = 0; slot < storage_type::slot_count; ++slot) {
+          typename storage_type::SlotState& state = storage_->slots[slot];
+          if (slot == latest_index_ || state.readers.load(std::memory_order_relaxed) != 0) {
+            continue;
+          }
+
+          const uint64_t version = state.version.load(std::memory_order_relaxed);
+          state.version.store(storage_type::writing, std::memory_order_seq_cst);
+          if (state.readers.load(std::memory_order_seq_cst) == 0) {
+            index_ = slot;
+            return;
+          }
+          state.version.store(version, std::memory_order_relaxed);
+        }
+      }
+    }
+
+    StoragePtr storage_;
+    std::unique_lock<std::mutex> lock_;
+    uint32_t index_ = 0;
+    uint32_t latest_index_ = 0;
+    uint64_t publication_ = 0;
+  };
+
+  // A reader of an SPMCStorage. acquire() takes the latest element, which stays unchanged in data() until the next
+  // acquire() or release(). Neither waits for the writer. Up to max_readers readers can be attached, each used by one
+  // thread.
+  template<typename StoragePtr>
+  class SPMCStorageReader {
+  public:
+    using storage_type = typename std::pointer_traits<StoragePtr>::element_type;
+    using value_type = typename storage_type::element_type;
+
+    explicit SPMCStorageReader(StoragePtr storage)
+      : storage_(storage)
+    {
+      uint32_t count = storage_->reader_count.load(std::memory_order_relaxed);
+      do {
+        if (count >= storage_type::max_readers) {
+          throw std::runtime_error("SPMCStorage already has " + std::to_string(count) + " readers");
+        }
+      } while (!storage_->reader_count.compare_exchange_weak(count, count + 1, std::memory_order_relaxed));
+    }
+
+    ~SPMCStorageReader() {
+      release();
+      storage_->reader_count.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    SPMCStorageReader() = delete;
+    SPMCStorageReader(const SPMCStorageReader&) = delete;
+    SPMCStorageReader& operator=(const SPMCStorageReader&) = delete;
+
+    // Takes the latest element if it is newer than the one taken before. Returns false, keeping that one, otherwise.
+    bool acquire() {
+      for (;;) {
+        const uint64_t latest = storage_->latest.load(std::memory_order_acquire);
+        const uint64_t publication = latest >> 8;
+        if (publication == publication_) {
+          return false;
+        }
+
+        release();
+        const uint32_t slot = static_cast<uint32_t>(latest & 0xff);
+        typename storage_type::SlotState& state = storage_->slots[slot];
+        state.readers.fetch_add(1, std::memory_order_seq_cst);
+        if (state.version.load(std::memory_order_seq_cst) == publication) {
+          index_ = slot;
+          publication_ = publication;
+          return true;
+        }
+
+        // The writer has published twice since and took the slot back, try the newer one
+        state.readers.fetch_sub(1, std::memory_order_release);
+      }
+    }
+
+    // Lets the writer reuse the slot taken, data() is invalid until the next acquire()
+    void release() {
+      if (index_ != none) {
+        storage_->slots[index_].readers.fetch_sub(1, std::memory_order_release);
+        index_ = none;
+      }
+    }
+
+    const value_type& data() const { return storage_->elements[index_]; }
+
+    // Publication number of the element taken, 0 before the first
+    uint64_t publication() const { return publication_; }
+
+  private:
+    static constexpr uint32_t none = storage_type::slot_count;
+
+    StoragePtr storage_;
+    uint32_t index_ = none;
+    uint64_t publication_ = 0;
+  };
+
+  // Shared memory SPSC storage for cross-process communication. The segment has the fixed layout of
+  // shared_memory_layout.h and works like SPSCStorage: data() and flags() are this side's slot, exchange() swaps it
+  // with the spare slot. The writer creates the segment, replacing a stale one, and unlinks it when destroyed.
+  // Only one reader can be attached at a time. The reader can block in wait() until the writer publishes instead of
+  // polling; the writer never blocks for it.
   template<typename T>
   class SharedMemorySPSCStorage
   {
   public:
-    SharedMemorySPSCStorage(const std::string& name, bool is_writer = false)
+    static_assert(std::is_trivially_copyable<T>::value, "T must be trivially copyable");
+    static_assert(std::is_standard_layout<T>::value, "T must be standard layout, other processes map it");
+
+    // payload_version is stored in the header by the writer and must match for a reader
+    SharedMemorySPSCStorage(const std::string& name, bool is_writer = false, uint32_t payload_version = 0)
       : name_(name), is_writer_(is_writer)
     {
+      if (is_writer_) {
+        shm_unlink(name_.c_str()); // Left behind by a writer that did not exit cleanly
+      }
+
       int flags = is_writer_ ? (O_CREAT | O_EXCL | O_RDWR) : O_RDWR;
       fd_ = shm_open(name_.c_str(), flags, 0666);
       if (fd_ == -1) {
@@ -91,33 +288,64 @@ namespace SharedDataHelpers
         throw std::runtime_error("Failed to open shared memory segment " + name_ + ": " + std::string(strerror(err)));
       }
 
-      size_t size = sizeof(SPSCStorage<T>);
+      struct stat segment_stat;
       if (is_writer_) {
-        if (ftruncate(fd_, size) == -1) {
+        fchmod(fd_, 0666); // Readers may run as another user, do not depend on the umask
+        size_ = ElementOffset() + SHM_SPSC_SLOTS * ElementStride();
+        if (ftruncate(fd_, size_) == -1) {
           close(fd_);
+          shm_unlink(name_.c_str());
           throw std::runtime_error("Failed to set size of shared memory segment");
         }
       }
+      if (fstat(fd_, &segment_stat) == -1 || static_cast<size_t>(segment_stat.st_size) < sizeof(SharedMemorySPSCHeader)) {
+        close(fd_);
+        throw std::runtime_error("Shared memory segment " + name_ + " is too small");
+      }
+      size_ = static_cast<size_t>(segment_stat.st_size);
+      inode_ = segment_stat.st_ino;
 
-      void* ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+      void* ptr = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
       close(fd_);
+      fd_ = -1;
       if (ptr == MAP_FAILED) {
         throw std::runtime_error("Failed to map shared memory segment");
       }
 
-      storage_ = static_cast<SPSCStorage<T>*>(ptr);
+      segment_ = static_cast<uint8_t*>(ptr);
+      header_ = static_cast<SharedMemorySPSCHeader*>(ptr);
       if (is_writer_) {
-        new (storage_) SPSCStorage<T>();
+        InitializeSegment(payload_version);
+      } else {
+        AttachReader(payload_version);
       }
     }
 
     ~SharedMemorySPSCStorage()
     {
-      size_t size = sizeof(SPSCStorage<T>);
-      munmap(storage_, size);
+      if (segment_ == nullptr) {
+        return;
+      }
+
       if (is_writer_) {
-        shm_unlink(name_.c_str());
+        std::atomic_ref<uint32_t>(header_->closed).store(1, std::memory_order_release);
+        Notify();
+
+        // Unlink only our own segment, a newer writer may already have replaced it
+        int fd = shm_open(name_.c_str(), O_RDONLY, 0);
+        if (fd != -1) {
+          struct stat segment_stat;
+          bool ours = fstat(fd, &segment_stat) == 0 && segment_stat.st_ino == inode_;
+          close(fd);
+          if (ours) {
+            shm_unlink(name_.c_str());
+          }
+        }
+      } else {
+        int32_t self = static_cast<int32_t>(getpid());
+        std::atomic_ref<int32_t>(header_->readerPid).compare_exchange_strong(self, 0, std::memory_order_acq_rel);
       }
+      munmap(segment_, size_);
     }
 
     SharedMemorySPSCStorage() = delete;
@@ -128,22 +356,148 @@ namespace SharedDataHelpers
       : name_(std::move(other.name_)), 
         is_writer_(other.is_writer_), 
         fd_(other.fd_), 
-        storage_(other.storage_)
+        size_(other.size_),
+        inode_(other.inode_),
+        segment_(other.segment_),
+        header_(other.header_),
+        index_(other.index_),
+        seen_sequence_(other.seen_sequence_)
     {
       other.fd_ = -1;
-      other.storage_ = nullptr;
+      other.segment_ = nullptr;
+      other.header_ = nullptr;
     }
 
-    SPSCStorage<T>* get() { return storage_; }
+    T& data() { return *reinterpret_cast<T*>(segment_ + ElementOffset() + index_ * ElementStride()); }
+    uint32_t& flags() { return header_->flags[index_]; }
 
-    SPSCStorage<T>* operator->() { return storage_; }
-    SPSCStorage<T>& operator*()  { return *storage_; }
+    void exchange() {
+      if (!is_writer_) {
+        seen_sequence_ = std::atomic_ref<uint32_t>(header_->publishSequence).load(std::memory_order_acquire);
+      }
+      index_ = std::atomic_ref<uint32_t>(header_->spareIndex).exchange(index_, std::memory_order_acq_rel);
+      if (is_writer_) {
+        std::atomic_ref<uint32_t>(header_->writerIndex).store(index_, std::memory_order_release);
+        std::atomic_ref<uint64_t>(header_->publishCount).fetch_add(1, std::memory_order_relaxed);
+        Notify();
+      }
+    }
+
+    // Reader only: blocks until the writer publishes or closes after this side's last exchange(), or timeout_ms
+    // passes. Returns false on timeout. A writer that exited without closing is only noticed by the timeout.
+    bool wait(uint32_t timeout_ms) {
+      std::atomic_ref<uint32_t> sequence(header_->publishSequence);
+      std::atomic_ref<uint32_t> waiters(header_->waiters);
+      const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+
+      waiters.fetch_add(1, std::memory_order_seq_cst);
+      bool published = true;
+      while (sequence.load(std::memory_order_seq_cst) == seen_sequence_) {
+        const auto remaining = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline - std::chrono::steady_clock::now());
+        if (remaining.count() <= 0) {
+          published = false;
+          break;
+        }
+        const timespec timeout = {static_cast<time_t>(remaining.count() / 1000000000), static_cast<long>(remaining.count() % 1000000000)};
+        syscall(SYS_futex, &header_->publishSequence, FUTEX_WAIT, seen_sequence_, &timeout, nullptr, 0);
+      }
+      waiters.fetch_sub(1, std::memory_order_relaxed);
+      return published;
+    }
+
+    const SharedMemorySPSCHeader* header() const { return header_; }
 
     private:
+      static constexpr size_t CACHE_LINE = 64;
+      static constexpr size_t ElementOffset() { return (sizeof(SharedMemorySPSCHeader) + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE; }
+      static constexpr size_t ElementStride() { return (sizeof(T) + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE; }
+
+      // Bumps the futex word, and wakes the readers waiting on it (not the private futex ops, they are in other
+      // processes). Without waiters this is two atomic operations and no syscall.
+      void Notify()
+      {
+        std::atomic_ref<uint32_t>(header_->publishSequence).fetch_add(1, std::memory_order_seq_cst);
+        if (std::atomic_ref<uint32_t>(header_->waiters).load(std::memory_order_seq_cst) != 0) {
+          syscall(SYS_futex, &header_->publishSequence, FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+        }
+      }
+
+      void InitializeSegment(uint32_t payload_version)
+      {
+        // The new segment reads as zeros, so the flags start cleared and spareIndex at 0
+        header_->layoutVersion = SHM_SPSC_LAYOUT_VERSION;
+        header_->payloadVersion = payload_version;
+        header_->headerSize = sizeof(SharedMemorySPSCHeader);
+        header_->elementSize = sizeof(T);
+        header_->elementOffset = ElementOffset();
+        header_->elementStride = ElementStride();
+        header_->writerPid = static_cast<int32_t>(getpid());
+        header_->writerIndex = 1;
+        for (uint32_t slot = 0; slot < SHM_SPSC_SLOTS; ++slot) {
+          new (segment_ + ElementOffset() + slot * ElementStride()) T();
+        }
+        index_ = 1;
+
+        // Last, so a reader never sees a half-initialized header
+        std::atomic_thread_fence(std::memory_order_release);
+        std::memcpy(header_->magic, SHM_SPSC_MAGIC, sizeof(header_->magic));
+      }
+
+      void AttachReader(uint32_t payload_version)
+      {
+        bool valid = std::memcmp(header_->magic, SHM_SPSC_MAGIC, sizeof(header_->magic)) == 0 &&
+                     header_->layoutVersion == SHM_SPSC_LAYOUT_VERSION &&
+                     header_->payloadVersion == payload_version &&
+                     header_->headerSize == sizeof(SharedMemorySPSCHeader) &&
+                     header_->elementSize == sizeof(T) &&
+                     header_->elementOffset == ElementOffset() &&
+                     header_->elementStride == ElementStride() &&
+                     size_ >= ElementOffset() + SHM_SPSC_SLOTS * ElementStride();
+        if (!valid) {
+          munmap(segment_, size_);
+          segment_ = nullptr;
+          throw std::runtime_error("Shared memory segment " + name_ + " has an unsupported layout or version");
+        }
+
+        // Take over from a reader that exited without detaching
+        std::atomic_ref<int32_t> reader_pid(header_->readerPid);
+        int32_t expected = 0;
+        int32_t self = static_cast<int32_t>(getpid());
+        bool claimed = reader_pid.compare_exchange_strong(expected, self, std::memory_order_acq_rel) ||
+                       (kill(expected, 0) == -1 && errno == ESRCH && reader_pid.compare_exchange_strong(expected, self, std::memory_order_acq_rel));
+        if (!claimed) {
+          munmap(segment_, size_);
+          segment_ = nullptr;
+          throw std::runtime_error("Shared memory segment " + name_ + " already has a reader (pid " + std::to_string(expected) + ")");
+        }
+
+        // The reader's slot is the one the writer and spare do not hold. It only changes when the reader exchanges.
+        std::atomic_ref<uint32_t> writer_index(header_->writerIndex);
+        std::atomic_ref<uint32_t> spare_index(header_->spareIndex);
+        uint32_t writer = 0, spare = 0;
+        for (int attempt = 0; attempt < 1000 && writer == spare; ++attempt) {
+          writer = writer_index.load(std::memory_order_acquire);
+          spare = spare_index.load(std::memory_order_acquire);
+        }
+        if (writer == spare || writer >= SHM_SPSC_SLOTS || spare >= SHM_SPSC_SLOTS) {
+          reader_pid.store(0, std::memory_order_release);
+          munmap(segment_, size_);
+          segment_ = nullptr;
+          throw std::runtime_error("Shared memory segment " + name_ + " has inconsistent slot indices");
+        }
+        index_ = SHM_SPSC_SLOTS - writer - spare;
+        seen_sequence_ = std::atomic_ref<uint32_t>(header_->publishSequence).load(std::memory_order_acquire);
+      }
+
       std::string name_;
       bool is_writer_;
       int fd_;
-      SPSCStorage<T>* storage_;
+      size_t size_ = 0;
+      ino_t inode_ = 0;
+      uint8_t* segment_ = nullptr;
+      SharedMemorySPSCHeader* header_ = nullptr;
+      uint32_t index_ = 0;
+      uint32_t seen_sequence_ = 0; // publishSequence at the reader's last exchange
   };
 }
 
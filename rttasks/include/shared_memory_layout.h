@@ -0,0 +1,48 @@
+#ifndef SHARED_MEMORY_LAYOUT_H
+#define SHARED_MEMORY_LAYOUT_H
+
+/*
+ * Binary layout of a SharedDataHelpers::SharedMemorySPSCStorage segment. Plain C so readers in other processes and
+ * languages can map it without the C++ headers.
+ *
+ *   SharedMemorySPSCHeader | elements[SHM_SPSC_SLOTS], elementOffset bytes from the start, elementStride bytes apart
+ *
+ * The elements form a triple buffer. The writer owns writerIndex, spareIndex is owned by neither side and the reader
+ * owns the third slot (3 - writerIndex - spareIndex). Each side publishes or picks up a slot by atomically exchanging its
+ * own index with spareIndex. The writer stores writerIndex after its exchange; a reader that attaches and finds the two
+ * equal has hit that window and reads them again. flags[slot] travels with the slot: the writer sets it when it fills
+ * the slot, the reader clears it after reading. The shared fields are accessed with atomic operations.
+ *
+ * publishSequence is a futex word a reader can sleep on instead of polling. The writer increments it after every
+ * exchange and when it closes. It wakes the futex (FUTEX_WAKE, which never blocks) only while waiters is nonzero. A
+ * reader loads publishSequence before its exchange. If the exchange finds no new slot, it increments waiters, waits
+ * while publishSequence still holds the loaded value, and then decrements waiters.
+ */
+
+#include <stdint.h>
+
+#define SHM_SPSC_MAGIC "LDSHSPSC"
+#define SHM_SPSC_LAYOUT_VERSION 2u
+#define SHM_SPSC_SLOTS 3u
+
+typedef struct SharedMemorySPSCHeader
+{
+  char magic[8];           /* SHM_SPSC_MAGIC, written last by the writer */
+  uint32_t layoutVersion;  /* SHM_SPSC_LAYOUT_VERSION, this header and the exchange protocol */
+  uint32_t payloadVersion; /* Version of the element type, chosen by the writer */
+  uint32_t headerSize;     /* sizeof(SharedMemorySPSCHeader) */
+  uint32_t elementSize;    /* sizeof the element type */
+  uint64_t elementOffset;
+  uint64_t elementStride;
+  int32_t writerPid;
+  int32_t readerPid;       /* 0 while no reader is attached */
+  uint32_t spareIndex;
+  uint32_t writerIndex;
+  uint32_t flags[SHM_SPSC_SLOTS];
+  uint32_t closed;         /* Set to 1 when the writer unlinks the segment */
+  uint64_t publishCount;   /* Slots published by the writer */
+  uint32_t publishSequence; /* Futex word, incremented after every publish and on close */
+  uint32_t waiters;         /* Readers waiting on publishSequence */
+} SharedMemorySPSCHeader;
+
+#endif /* SHARED_MEMORY_LAYOUT_H */
@@ -0,0 +1,83 @@
+#ifndef STRIPE_WORKERS_H
+#define STRIPE_WORKERS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <latch>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "blob_extractor.h" // For MAX_STRIPES
+#include "image_processing.h" // For MIN_CONTOUR_AREA
+
+#ifndef DETECTION_CONFIG_FILE
+#define DETECTION_CONFIG_FILE ""
+#endif
+
+namespace ImageProcessing
+{
+  // Threads and blob filter of the ball detection, loaded from DETECTION_CONFIG_FILE at Initialize
+  struct DetectionSettings
+  {
+    std::vector<int> workerCores; // One stripe worker pinned to each core, empty detects on the DetectBall task alone
+    int workerPriority = 0;       // SCHED_FIFO priority of the workers, 0 runs them at normal priority
+    int opencvThreads = 0;        // For cv::setNumThreads, 0 runs OpenCV's parallel loops on the calling thread
+    double minBlobArea = MIN_CONTOUR_AREA; // Smallest blob that can be the ball, in full-resolution pixels
+  };
+
+  // Reads key=value lines ('#' starts a comment). A missing file gives the defaults, without stripe workers.
+  // Throws std::runtime_error for unknown keys or bad values.
+  DetectionSettings LoadDetectionSettings(const char *path);
+
+  // Persistent threads that work through the stripes of a frame together with the calling thread. Each worker is
+  // pinned to its core and spins on the next job, so starting one costs no syscall; Run spins until every stripe is
+  // done. Meant for cores isolated for vision: a worker keeps its core busy while frames arrive, and sleeps on a futex
+  // once no job came for SPIN_BEFORE_SLEEP (the next Run then wakes it with one syscall).
+  class StripeWorkers
+  {
+  public:
+    static constexpr int MAX_WORKERS = BlobExtractor::MAX_STRIPES - 1;
+    static constexpr std::chrono::milliseconds SPIN_BEFORE_SLEEP{100}; // Several frame periods
+
+    // Processes stripe stripe of stripeCount for the given context
+    using Job = void (*)(void *context, int stripe, int stripeCount);
+
+    // Starts one worker per core and waits until each is pinned. Throws std::runtime_error for more than MAX_WORKERS
+    // cores, or when a worker could not be given its core or priority (the workers are stopped again).
+    StripeWorkers(const std::vector<int> &cores, int priority);
+    ~StripeWorkers(); // Stops
+
+    StripeWorkers(const StripeWorkers &) = delete;
+    StripeWorkers &operator=(const StripeWorkers &) = delete;
+
+    int StripeCount() const { return stripeCount_; }
+
+    // Runs job on every stripe, stripe 0 on the calling thread, and returns once all of them are done.
+    // Only one thread may call Run at a time.
+    void Run(Job job, void *context);
+
+    // Wakes the workers, lets them finish their stripe and joins them. Run must not be called after this.
+    void Stop();
+
+  private:
+    void Work(int stripe, int core, int priority, std::string &error, std::latch &pinned);
+    void WaitForJob(uint32_t seen);
+    void Wake();
+
+    int stripeCount_;
+    Job job_ = nullptr;
+    void *context_ = nullptr;
+
+    // The caller publishes a job by bumping generation_ (also the futex word of sleeping workers), every worker
+    // decrements pending_ when its stripe is done
+    alignas(64) std::atomic<uint32_t> generation_{0};
+    std::atomic<uint32_t> sleepers_{0};
+    alignas(64) std::atomic<int> pending_{0};
+    std::atomic<bool> stop_{false};
+    std::vector<std::thread> threads_;
+  };
+}
+
+#endif // STRIPE_WORKERS_H
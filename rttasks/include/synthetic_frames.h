@@ -0,0 +1,55 @@
+#ifndef SYNTHETIC_FRAMES_H
+#define SYNTHETIC_FRAMES_H
+
+#include <array>
+#include <cstdint>
+
+namespace CameraHelpers
+{
+  // Scene rendered by SyntheticFrameGenerator
+  struct SyntheticSceneSettings
+  {
+    float ballRadius = 40.0f; // Full-resolution pixels
+    int noiseAmplitude = 8;   // Uniform noise of +/- this many levels added to every Y and V sample
+    int clutterCount = 0;     // Red, non-circular distractors placed at random
+    uint32_t seed = 1;        // Seed for the clutter layout and the noise
+  };
+
+  // Renders YUYV or BayerRG8 frames (IMAGE_WIDTH x IMAGE_HEIGHT) of a red ball on a neutral background with noise and
+  // clutter, for running the detection pipeline without a camera. Rendering does not allocate.
+  class SyntheticFrameGenerator
+  {
+  public:
+    static constexpr int MAX_CLUTTER = 64;
+
+    explicit SyntheticFrameGenerator(const SyntheticSceneSettings &settings = SyntheticSceneSettings());
+
+    // Renders one frame with the ball centered at (ballX, ballY), in full-resolution pixels
+    void Render(uint8_t *yuyvFrame, float ballX, float ballY);
+
+    // The same scene as an RGGB mosaic, noise is added to every site
+    void RenderBayer(uint8_t *bayerFrame, float ballX, float ballY);
+
+    const SyntheticSceneSettings &Settings() const { return settings_; }
+
+  private:
+    struct ClutterRect
+    {
+      int x, y, width, height;
+    };
+
+    uint32_t NextRandom();
+
+    // Calls fill(y, firstX, lastX) for each run of pixels of a row covered by the clutter, then by the ball. pairs
+    // rounds the ball to whole YUYV pixel pairs, each inside when its center is.
+    template <typename Fill>
+    void ForEachRedRun(float ballX, float ballY, bool pairs, Fill fill) const;
+
+    SyntheticSceneSettings settings_;
+    std::array<ClutterRect, MAX_CLUTTER> clutter_;
+    int clutterCount_ = 0;
+    uint32_t randomState_;
+  };
+}
+
+#endif // SYNTHETIC_FRAMES_H
@@ -0,0 +1,66 @@
+#ifndef TARGET_TRACKER_H
+#define TARGET_TRACKER_H
+
+#include <cstdint>
+
+namespace MotionHelpers
+{
+  // Tuning of the TargetTracker. Positions are in motor units (gimbal revolutions), times in seconds.
+  struct TrackerSettings
+  {
+    double measurementNoise = 2.0e-4;  // Standard deviation of a ball direction measurement, about one pixel
+    double accelerationNoise = 2.0;    // Spectral density of the ball's random acceleration, units^2 / s^3
+    double motionLeadSeconds = 0.015;  // Time from issuing a move until the gimbal gets there
+    double maxPredictionSeconds = 0.1; // Longest extrapolation, past it the velocity is not trusted
+    double resetAfterSeconds = 0.25;   // A gap without measurements this long starts a new track
+    double gateSigma = 6.0;            // Measurements further off than this many standard deviations start a new track
+  };
+
+  // Estimate of one axis: position and velocity with their covariance
+  struct AxisEstimate
+  {
+    double position = 0.0;
+    double velocity = 0.0;
+    double covariance[2][2] = {}; // [position, velocity] x [position, velocity]
+  };
+
+  // Fixed-size state of the tracker, plain data so it can be copied into globals or logs
+  struct TrackerState
+  {
+    bool initialized = false;
+    int64_t timeNs = 0; // Time of the last measurement (TimingHelpers::NowNs clock)
+    AxisEstimate axes[2];
+  };
+
+  // Constant-velocity Kalman filter of the ball direction in motor units, one independent filter per axis. It takes the
+  // absolute ball direction of every detection (axis position at exposure plus the pixel offset) and predicts where
+  // the ball will be when a move issued now completes. Never allocates.
+  class TargetTracker
+  {
+  public:
+    explicit TargetTracker(const TrackerSettings &settings = TrackerSettings()) : settings_(settings) {}
+
+    // Adds a measurement taken at timeNs. The first one, one after a long gap or one far outside the prediction starts
+    // a new track at rest.
+    void Update(int64_t timeNs, double x, double y);
+
+    // Position expected at timeNs, extrapolated at most maxPredictionSeconds past the last measurement.
+    // Returns false without a track.
+    bool Predict(int64_t timeNs, double &x, double &y) const;
+
+    // Where the ball will be when a move issued at nowNs completes
+    bool PredictTarget(int64_t nowNs, double &x, double &y) const { return Predict(nowNs + LeadNs(), x, y); }
+
+    void Reset() { state_ = TrackerState(); }
+
+    const TrackerState &State() const { return state_; }
+
+  private:
+    int64_t LeadNs() const { return static_cast<int64_t>(settings_.motionLeadSeconds * 1e9); }
+
+    TrackerSettings settings_;
+    TrackerState state_;
+  };
+}
+
+#endif // TARGET_TRACKER_H
@@ -0,0 +1,47 @@
+#ifndef THREAD_HELPERS_H
+#define THREAD_HELPERS_H
+
+#include <atomic>
+#include <functional>
+#include <string>
+#include <thread>
+
+#include <sched.h>
+
+namespace ThreadHelpers
+{
+  // Moves the calling thread to core (left on the cores it has when negative), with SCHED_FIFO at priority or
+  // SCHED_OTHER for 0. Threads started from a task inherit its policy and core otherwise. Returns what failed, empty
+  // when the thread runs where it was asked to.
+  std::string PinCurrentThread(int core, int priority);
+
+  // For helper threads created from an RT task, which would inherit its policy and core: moves the calling thread to
+  // normal priority and off rtCores (the cores of the creating task), when there are others. Best effort.
+  void MoveToBackground(const cpu_set_t &rtCores);
+
+  // The cores the calling thread may run on, for MoveToBackground
+  cpu_set_t CurrentCores();
+
+  // Calls step in a loop on a thread of its own, pinned with PinCurrentThread, until stopped. Stands in for an RT task
+  // that has to run next to the others: the tasks of one RT task manager run one after the other. step should return
+  // within a few milliseconds, so Stop is prompt.
+  class LoopThread
+  {
+  public:
+    // Starts the thread and waits until it is pinned. Throws std::runtime_error, without having called step, when it
+    // could not be given its core or priority.
+    LoopThread(int core, int priority, std::function<void()> step);
+    ~LoopThread(); // Stops
+    LoopThread(const LoopThread &) = delete;
+    LoopThread &operator=(const LoopThread &) = delete;
+
+    // Lets the step in progress finish and joins the thread
+    void Stop();
+
+  private:
+    std::atomic<bool> stop_{false};
+    std::thread thread_;
+  };
+}
+
+#endif // THREAD_HELPERS_H
@@ -0,0 +1,115 @@
+#ifndef TIMING_METRICS_H
+#define TIMING_METRICS_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+#include "frame_trace.h" // For NowNs
+
+namespace TimingHelpers
+{
+  // Controller timing deltas sampled by RecordTimingMetrics, in the units the firmware reports them
+  enum class TimingMetric : int32_t
+  {
+    FirmwareTimingDelta = 0,
+    NetworkTimingDelta = 1,
+    NetworkTimingReceiveDelta = 2,
+    Count = 3,
+  };
+
+  // Windows of a WindowedHistogram, relative to its newest sample
+  enum class HistogramWindow : int32_t
+  {
+    LastSecond = 0, // The last full second
+    LastMinute = 1, // The last 60 full seconds and the current one
+    Lifetime = 2,   // Since Initialize
+    Count = 3,
+  };
+
+  // Name of a metric for logs, such as "firmware_timing_delta"
+  const char *TimingMetricName(TimingMetric metric);
+
+  // Histogram of the 32-bit timing deltas, bucketed like a LatencyHistogram but sized for their range: exact below
+  // 2^SUB_BUCKET_BITS, then 16 buckets per power of two (about 6% wide) up to 2^31. A tenth of the buckets of a
+  // LatencyHistogram, so a WindowedHistogram of them stays small and retiring one of its slices is cheap.
+  class DeltaHistogram
+  {
+  public:
+    static constexpr int SUB_BUCKET_BITS = 5;
+    static constexpr int MAX_EXPONENT = 30;
+    static constexpr size_t BUCKET_COUNT = (size_t(1) << SUB_BUCKET_BITS) + (MAX_EXPONENT - SUB_BUCKET_BITS + 1) * (size_t(1) << (SUB_BUCKET_BITS - 1));
+
+    // Negative values are recorded as 0
+    void Record(int64_t value);
+
+    // Not safe against concurrent Record calls, only for Initialize
+    void Reset();
+
+    // Takes the samples in buckets [first, last) of this histogram out of sum, where they were also recorded, and
+    // clears them here. The maximum is cleared with the last bucket. Safe against concurrent reads of both, not against
+    // concurrent Record calls.
+    void Retire(DeltaHistogram &sum, size_t first, size_t last);
+
+    uint64_t Count() const { return count_.load(std::memory_order_relaxed); }
+    int64_t Max() const { return max_.load(std::memory_order_relaxed); }
+
+    // Smallest recorded value that percentile (0-100) percent of the samples are at or below, within the bucket
+    // resolution. 0 without samples.
+    int64_t Percentile(double percentile) const;
+
+    static size_t BucketIndex(uint64_t value);
+    static uint64_t BucketHighestValue(size_t index); // Largest value that falls into the bucket
+
+  private:
+    std::array<std::atomic<uint64_t>, BUCKET_COUNT> buckets_{};
+    std::atomic<uint64_t> count_{0};
+    std::atomic<int64_t> max_{0};
+  };
+
+  // DeltaHistograms of a value over rolling windows, built from one-second slices. The minute is kept as a running
+  // sum of the slices, so reading it costs no more than reading one slice. The slice that leaves the minute is taken
+  // out of it a few buckets per Record call during the next second, so no call pays for a whole slice. Record is
+  // lock-free and allocation-free and must be called from one thread. Reads may run concurrently on others and see a
+  // slightly stale distribution.
+  class WindowedHistogram
+  {
+  public:
+    static constexpr int64_t SLICE_NS = 1'000'000'000;
+    static constexpr int SLICES = 62;           // 60 full seconds, the one being recorded and the one retiring
+    static constexpr size_t RETIRE_BUCKETS = 8; // Buckets of the retiring slice taken out per Record call
+
+    // Negative values are recorded as 0
+    void Record(int64_t value, int64_t nowNs = NowNs());
+
+    // Smallest value that percentile (0-100) percent of the window's samples are at or below, 0 without samples
+    int64_t Percentile(HistogramWindow window, double percentile) const;
+    uint64_t Count(HistogramWindow window) const;
+    int64_t Max(HistogramWindow window) const;
+
+    // Not safe against concurrent Record calls, only for Initialize
+    void Reset();
+
+  private:
+    struct Slice
+    {
+      std::atomic<int64_t> second{-1}; // Second since the clock's epoch the slice holds, -1 while empty or cleared
+      DeltaHistogram histogram;
+    };
+
+    // The slice of the last full second, nullptr if no sample was recorded in it
+    const Slice *LastSecond() const;
+
+    // Takes up to buckets more buckets of the retiring slice out of the minute
+    void Retire(size_t buckets);
+
+    std::array<Slice, SLICES> slices_;
+    DeltaHistogram minute_; // Sum of the slices
+    DeltaHistogram lifetime_;
+    std::atomic<int64_t> currentSecond_{-1};
+    Slice *retiring_ = nullptr; // Left the minute and not all taken out of it yet, only used by Record
+    size_t retired_ = 0;        // Its buckets taken out so far
+  };
+}
+
+#endif // TIMING_METRICS_H
@@ -4,18 +4,35 @@
 
 // src
 #include "rttaskglobals.h"
+#include "camera_aoi.h"
 #include "camera_helpers.h"
+#if defined(RTTASKS_CAMERA_STREAM_SERVER)
+#include "camera_stream_server.h"
+#endif
+#include "frame.h"
+#include "frame_handoff.h"
+#include "frame_queue.h"
+#include "frame_recorder.h"
+#include "frame_source.h"
+#include "frame_trace.h"
 #include "image_processing.h"
+#include "memory_helpers.h"
+#include "position_history.h"
+#include "preview_output.h"
+#include "pvt_streamer.h"
 #include "shared_data_helpers.h"
+#include "stripe_workers.h"
+#include "target_tracker.h"
+#include "thread_helpers.h"
+#include "timing_metrics.h"
 
 // system
+#include <atomic>
 #include <iostream>
 #include <string>
 #include <chrono>
-#include <fstream>
-#include <sstream>
+#include <thread>
 #include <vector>
-#include <iomanip>
 
 using namespace Pylon;
 using namespace RSI::RapidCode;
@@ -23,24 +40,76 @@ using namespace RSI::RapidCode::RealTimeTasks;
 
 // Global variable (different from RTTASK_GLOBAL)
 PylonAutoInitTerm g_PylonAutoInitTerm;
-CInstantCamera g_camera;
-CGrabResultPtr g_ptrGrabResult;
-
-// Shared storage for camera frames
-struct Frame
+std::unique_ptr<CameraHelpers::FrameSource> g_frameSource; // Pylon camera, replay or synthetic, see FRAME_SOURCE_CONFIG_FILE
+std::unique_ptr<CameraHelpers::FrameHandoff> g_frameHandoff; // Zero-copy handoff only, holds leases of g_frameSource
+std::unique_ptr<CameraHelpers::FrameQueue> g_frameQueue; // Grabbing in GrabFrame only, holds leases of g_frameSource
+std::atomic<bool> g_detecting{false}; // DetectBall is working on a queued frame, for framesGrabbedDuringDetect
+std::unique_ptr<CameraHelpers::AoiTracker> g_aoiTracker; // Only with aoi = track in FRAME_SOURCE_CONFIG_FILE
+std::unique_ptr<RecordingHelpers::FrameRecorder> g_frameRecorder; // Only when enabled in RECORDER_CONFIG_FILE
+std::unique_ptr<PreviewHelpers::PreviewPublisher> g_previewPublisher; // Preview frames for the camera server
+TimingHelpers::FrameTracer g_frameTracer; // Stage timestamps and latency histograms of every frame
+std::array<TimingHelpers::WindowedHistogram, static_cast<size_t>(TimingHelpers::TimingMetric::Count)> g_timingHistograms; // From RecordTimingMetrics
+MotionHelpers::PositionHistory g_positionHistory; // Axis positions of the last CAPACITY samples, from RecordAxisPositions
+MotionHelpers::MotionSettings g_motionSettings; // How MoveMotors drives the gimbal, see MOTION_CONFIG_FILE
+std::unique_ptr<MotionHelpers::PvtStreamer> g_pvtStreamer; // PVT streaming mode only
+const ImageProcessing::Detector* g_detector = nullptr; // Detection instantiated for the camera mode of g_frameSource
+
+// No task stops the threads below, the task manager runs no task at shutdown. Globals are destroyed in reverse order
+// when it unloads the library, so these are defined last to stop and join before anything they use.
+std::unique_ptr<ThreadHelpers::LoopThread> g_grabThread; // Runs GrabFrame with grab = thread
+std::unique_ptr<ImageProcessing::StripeWorkers> g_stripeWorkers; // Only with worker cores in DETECTION_CONFIG_FILE
+
+// Limits for the target positions
+static constexpr double NEG_X_LIMIT = -0.19;
+static constexpr double POS_X_LIMIT = 0.19;
+static constexpr double NEG_Y_LIMIT = -0.14;
+static constexpr double POS_Y_LIMIT = 0.14;
+
+// Streams the PvtStreamer's points to the multi-axis of the tasks
+class RmpPvtMultiAxis : public MotionHelpers::PvtMultiAxis
 {
-  CameraHelpers::YUYVFrame yuyvData;
-  int frameNumber;
-  double timestamp;
-  bool ballDetected;
-  double centerX;
-  double centerY;
-  double radius;
-  double targetX;
-  double targetY;
+public:
+  void MovePVT(const double *positions, const double *velocities, const double *times, int32_t pointCount, bool final) override
+  {
+    RTMultiAxisGet(0)->MovePVT(positions, velocities, times, pointCount, -1, false, final);
+  }
+
+  int32_t PointsRemaining() override { return RTAxisGet(0)->FramesToExecuteGet(); }
 };
 
-inline std::shared_ptr g_frameStorage = std::make_shared<SharedDataHelpers::SPSCStorage<Frame>>();
+std::shared_ptr<FrameStorage> g_frameStorage; // Copy handoff only, see FrameStorage
+
+#if defined(RTTASKS_CAMERA_STREAM_SERVER)
+// Defined after the globals its threads read, so it is destroyed first
+std::unique_ptr<PreviewHelpers::CameraStreamServer> g_streamServer; // Only with stream_address in PREVIEW_CONFIG_FILE
+
+// ProcessingStats of the frames g_streamServer sends: stage times from the frame trace, failures from the globals.
+// Runs on the stream server threads.
+PreviewHelpers::StreamFrameStats StreamStats(GlobalData *data, const FrameInfo &info)
+{
+  constexpr double NS_PER_MS = 1e6;
+  PreviewHelpers::StreamFrameStats stats;
+  stats.grabFailures = data->frameGrabFailures;
+  stats.detectionFailures = data->ballDetectionFailures;
+
+  TimingHelpers::FrameTrace trace;
+  if (!g_frameTracer.TryGetTrace(static_cast<uint32_t>(info.frameNumber), trace))
+    return stats;
+  auto stageNs = [&trace](TimingHelpers::FrameStage stage) { return trace.stageNs[static_cast<size_t>(stage)]; };
+  const int64_t exposureNs = stageNs(TimingHelpers::FrameStage::Exposure);
+  const int64_t grabbedNs = stageNs(TimingHelpers::FrameStage::Grabbed);
+  const int64_t dequeuedNs = stageNs(TimingHelpers::FrameStage::Dequeued);
+  const int64_t fitDoneNs = stageNs(TimingHelpers::FrameStage::FitDone);
+  if (exposureNs != 0 && grabbedNs != 0)
+    stats.grabTimeMs = (grabbedNs - exposureNs) / NS_PER_MS;
+  const int64_t processStartNs = dequeuedNs != 0 ? dequeuedNs : grabbedNs;
+  if (processStartNs != 0 && fitDoneNs != 0)
+    stats.processTimeMs = (fitDoneNs - processStartNs) / NS_PER_MS;
+  return stats;
+}
+#endif
+
+void GrabFrame(GlobalData *data);
 
 // Initializes the global data structure and sets up the camera and multi-axis.
 RSI_TASK(Initialize)
@@ -49,28 +118,40 @@ RSI_TASK(Initialize)
   data->initialized = false;
 
   data->cameraReady = false;
+  data->frameSource = static_cast<int32_t>(CameraHelpers::FrameSourceType::Pylon);
   data->cameraGrabbing = false;
   data->frameGrabFailures = 0;
   data->cameraFPS = 0.0;
+  data->frameQueueDepthMax = 0;
+  data->framesSkipped = 0;
+  data->cameraAoiWidth = CameraHelpers::IMAGE_WIDTH;
+  data->cameraAoiHeight = CameraHelpers::IMAGE_HEIGHT;
+  data->cameraAoiResizes = 0;
+  data->cameraAoiFailures = 0;
 
   data->ballDetected = false;
   data->ballDetectionFailures = 0;
   data->ballCenterX = 0.0;
   data->ballCenterY = 0.0;
   data->ballRadius = 0.0;
+  data->detectionMode = static_cast<int32_t>(ImageProcessing::DetectionMode::None);
+  data->detectionStripes = 1;
 
   data->newImageAvailable = false;
   data->frameTimestamp = 0;
-  data->imageWidth = CameraHelpers::IMAGE_WIDTH;
+  data->imageWidth = CameraHelpers::IMAGE_WIDTH; // Set with the frame source
   data->imageHeight = CameraHelpers::IMAGE_HEIGHT;
   data->imageSequenceNumber = 0;
-  data->imageDataSize = sizeof(CameraHelpers::YUYVFrame);
+  data->imageDataSize = 0; // Set with the frame source
 
   data->multiAxisReady = false;
   data->motionEnabled = false;
   data->newTarget = false;
   data->targetX = 0.0;
   data->targetY = 0.0;
+  data->moveMode = static_cast<int32_t>(MotionHelpers::MoveMode::SCurve);
+  data->pvtPointsSent = 0;
+  data->pvtUnderruns = 0;
 
   data->firmwareTimingDeltaMax = 0;
   data->firmwareTimingDeltaMaxSampleCount = 0;
@@ -78,15 +159,130 @@ RSI_TASK(Initialize)
   data->networkTimingDeltaMaxSampleCount = 0;
   data->networkTimingReceiveDeltaMax = 0;
   data->networkTimingReceiveDeltaMaxSampleCount = 0;
+  data->firmwareTimingDeltaP99Second = 0;
+  data->firmwareTimingDeltaP99Minute = 0;
+  data->networkTimingDeltaP99Second = 0;
+  data->networkTimingDeltaP99Minute = 0;
+  data->networkTimingReceiveDeltaP99Second = 0;
+  data->networkTimingReceiveDeltaP99Minute = 0;
+  for (TimingHelpers::WindowedHistogram &histogram : g_timingHistograms)
+    histogram.Reset();
+
+  data->rtHeapAllocations = 0;
+  data->rtScratchExhaustions = 0;
+
+  data->recordedFrames = 0;
+  data->recorderDroppedFrames = 0;
+
+  data->latencyGrabToMoveP50Us = 0.0;
+  data->latencyGrabToMoveP99Us = 0.0;
+  data->latencyGrabToMoveMaxUs = 0.0;
+  data->latencyExposureToMoveP99Us = 0.0;
+  data->latencyGrabToPublishP99Us = 0.0;
+  data->latencyGrabToDequeueP99Us = 0.0;
+  data->latencyDequeueToTargetP99Us = 0.0;
+  g_frameTracer.Reset();
+
+  data->positionHistoryMisses = 0;
+
+  data->trackerPositionX = 0.0;
+  data->trackerPositionY = 0.0;
+  data->trackerVelocityX = 0.0;
+  data->trackerVelocityY = 0.0;
+  data->trackerPositionVarianceX = 0.0;
+  data->trackerPositionVarianceY = 0.0;
+  data->trackerCovarianceX = 0.0;
+  data->trackerCovarianceY = 0.0;
+  data->trackerVelocityVarianceX = 0.0;
+  data->trackerVelocityVarianceY = 0.0;
 
   // Enable network timing
   RTMotionControllerGet()->NetworkTimingEnableSet(true);
 
-  // Setup the camera
-  CameraHelpers::ConfigureCamera(g_camera);
-  CameraHelpers::PrimeCamera(g_camera, g_ptrGrabResult);
+  // Setup the frame source (the camera unless configured otherwise)
+  CameraHelpers::FrameSourceSettings frameSourceSettings = CameraHelpers::LoadFrameSourceSettings(FRAME_SOURCE_CONFIG_FILE);
+  g_grabThread.reset();
+  g_frameQueue.reset(); // Before the source its leases belong to
+  g_frameHandoff.reset();
+  g_frameSource = CameraHelpers::CreateFrameSource(frameSourceSettings);
+  g_frameSource->Open();
+  data->frameSource = static_cast<int32_t>(g_frameSource->Type());
+  data->pixelFormat = static_cast<int32_t>(g_frameSource->Format());
+  data->imageDataSize = CameraHelpers::FrameBytes(g_frameSource->Format());
+
+  // Pick the detection built for the camera's size and pixel format, throws if there is none
+  const CameraHelpers::CameraModeInfo cameraMode = g_frameSource->Mode();
+  g_detector = &ImageProcessing::GetDetector(cameraMode);
+  data->imageWidth = static_cast<int>(cameraMode.width);
+  data->imageHeight = static_cast<int>(cameraMode.height);
+
+  // Setup where frames are grabbed: in DetectBall, or on the GrabFrame thread which queues them. The thread starts
+  // at the end, once everything DetectBall needs is set up.
+  if (frameSourceSettings.grabThread)
+    g_frameQueue = std::make_unique<CameraHelpers::FrameQueue>();
+
+  // Setup the camera AOI, moved with the ball by DetectBall or left at the full frame
+  g_aoiTracker.reset();
+  if (frameSourceSettings.trackAoi)
+    g_aoiTracker = std::make_unique<CameraHelpers::AoiTracker>(frameSourceSettings.aoiMargin);
+
+  // Setup how frames reach OutputImage: the grab buffer itself or a copy
+  if (frameSourceSettings.zeroCopyHandoff)
+    g_frameHandoff = std::make_unique<CameraHelpers::FrameHandoff>();
+  else if (!g_frameStorage)
+    g_frameStorage = std::make_shared<FrameStorage>();
   data->cameraReady = true;
 
+  // Setup the detection threads. OpenCV's own pool would start threads on any core, so it only gets the threads the
+  // settings allow; the stripe workers run on the cores reserved for vision.
+  ImageProcessing::DetectionSettings detectionSettings = ImageProcessing::LoadDetectionSettings(DETECTION_CONFIG_FILE);
+  cv::setNumThreads(detectionSettings.opencvThreads);
+  ImageProcessing::SetMinBlobArea(detectionSettings.minBlobArea);
+  ImageProcessing::UseStripeWorkers(nullptr);
+  g_stripeWorkers.reset();
+  if (!detectionSettings.workerCores.empty())
+  {
+    // Workers that did not get their core would share one with the RT tasks, so the search stays on DetectBall
+    try
+    {
+      g_stripeWorkers = std::make_unique<ImageProcessing::StripeWorkers>(detectionSettings.workerCores, detectionSettings.workerPriority);
+      ImageProcessing::UseStripeWorkers(g_stripeWorkers.get());
+      data->detectionStripes = g_stripeWorkers->StripeCount();
+    }
+    catch (const std::exception &e)
+    {
+      std::cerr << "Stripe workers not started, detecting on one stripe: " << e.what() << std::endl;
+    }
+  }
+
+  // Setup the frame recorder
+  g_frameRecorder.reset();
+  RecordingHelpers::RecorderSettings recorderSettings = RecordingHelpers::LoadRecorderSettings(RECORDER_CONFIG_FILE);
+  if (recorderSettings.enabled)
+    g_frameRecorder = std::make_unique<RecordingHelpers::FrameRecorder>(recorderSettings);
+
+  // Setup the preview output for the camera server
+  g_previewPublisher.reset();
+  const PreviewHelpers::PreviewSettings previewSettings = PreviewHelpers::LoadPreviewSettings(PREVIEW_CONFIG_FILE);
+  g_previewPublisher = std::make_unique<PreviewHelpers::PreviewPublisher>(previewSettings);
+
+  // Setup the gRPC stream server. It reads the frame storage on threads of its own, so it needs the copy handoff.
+#if defined(RTTASKS_CAMERA_STREAM_SERVER)
+  g_streamServer.reset();
+  if (!previewSettings.streamAddress.empty())
+  {
+    if (frameSourceSettings.zeroCopyHandoff)
+      std::cerr << "Camera stream server not started, it needs handoff = copy in the frame source settings" << std::endl;
+    else
+      g_streamServer = std::make_unique<PreviewHelpers::CameraStreamServer>(
+          previewSettings.streamAddress, previewSettings.streamMaxClients, previewSettings.jpegQuality, g_frameStorage,
+          [data](const FrameInfo &info) { return StreamStats(data, info); });
+  }
+#else
+  if (!previewSettings.streamAddress.empty())
+    std::cerr << "Camera stream server not started, the task library is built without it (BUILD_CAMERA_STREAM_SERVER)" << std::endl;
+#endif
+
   // Setup the multi-axis
   RTMultiAxisGet(0)->Abort();
   RTMultiAxisGet(0)->ClearFaults();
@@ -98,20 +294,65 @@ RSI_TASK(Initialize)
   data->targetX = RTAxisGet(0)->ActualPositionGet();
   data->targetY = RTAxisGet(1)->ActualPositionGet();
 
+  // Setup how MoveMotors drives the multi-axis. Streamed points respect the axis default velocity and acceleration
+  // unless the motion settings give their own limits.
+  g_motionSettings = MotionHelpers::LoadMotionSettings(MOTION_CONFIG_FILE);
+  g_pvtStreamer.reset();
+  if (g_motionSettings.mode == MotionHelpers::MoveMode::PvtStream)
+  {
+    auto axisLimits = [](int axis, double minPosition, double maxPosition)
+    {
+      return MotionHelpers::AxisLimits{
+          minPosition, maxPosition,
+          g_motionSettings.pvtMaxVelocity > 0.0 ? g_motionSettings.pvtMaxVelocity : RTAxisGet(axis)->DefaultVelocityGet(),
+          g_motionSettings.pvtMaxAcceleration > 0.0 ? g_motionSettings.pvtMaxAcceleration : RTAxisGet(axis)->DefaultAccelerationGet()};
+    };
+    g_pvtStreamer = std::make_unique<MotionHelpers::PvtStreamer>(
+        g_motionSettings, std::array{axisLimits(0, NEG_X_LIMIT, POS_X_LIMIT), axisLimits(1, NEG_Y_LIMIT, POS_Y_LIMIT)});
+    g_pvtStreamer->Reset({RTAxisGet(0)->CommandPositionGet(), RTAxisGet(1)->CommandPositionGet()});
+  }
+  data->moveMode = static_cast<int32_t>(g_motionSettings.mode);
+
+  // Start grabbing on a core of its own, the RT task manager would run a grab task between the others
+  data->framesGrabbedDuringDetect = 0;
+  if (g_frameQueue)
+  {
+    try
+    {
+      g_grabThread = std::make_unique<ThreadHelpers::LoopThread>(frameSourceSettings.grabCore, frameSourceSettings.grabPriority,
+                                                                 [data]() { GrabFrame(data); });
+    }
+    catch (const std::exception &e)
+    {
+      std::cerr << "GrabFrame thread not started, grabbing in DetectBall: " << e.what() << std::endl;
+      g_frameQueue.reset();
+    }
+  }
+
   data->multiAxisReady = true;
   data->initialized = true;
   data->motionEnabled = true;
 }
 
+// Records the axis positions of every sample, so DetectBall can look up where the gimbal was when a frame was exposed.
+RSI_TASK(RecordAxisPositions)
+{
+  if (!data->initialized)
+    return;
+  if (!data->multiAxisReady)
+    return;
+
+  MotionHelpers::AxisSample sample;
+  sample.timeNs = TimingHelpers::NowNs();
+  sample.sampleCounter = RTMotionControllerGet()->SampleCounterGet();
+  sample.x = RTAxisGet(0)->ActualPositionGet();
+  sample.y = RTAxisGet(1)->ActualPositionGet();
+  g_positionHistory.Push(sample);
+}
+
 // Moves the motors based on the target positions.
 RSI_TASK(MoveMotors)
 {
-  // Define limits for the target positions
-  static constexpr double NEG_X_LIMIT = -0.19;
-  static constexpr double POS_X_LIMIT = 0.19;
-  static constexpr double NEG_Y_LIMIT = -0.14;
-  static constexpr double POS_Y_LIMIT = 0.14;
-
   // Check if the system is initialized and motion is enabled
   if (!data->initialized)
     return;
@@ -120,16 +361,36 @@ RSI_TASK(MoveMotors)
   if (!data->multiAxisReady)
     return;
 
-  // Only execute if a new target is set
-  if (!data->newTarget.exchange(false))
-    return;
-
-  // Move the motors to the target positions respecting the limits
   try
   {
+    if (g_pvtStreamer)
+    {
+      // Streaming runs every sample to keep the lookahead queued, a new target only changes where the points head
+      static RmpPvtMultiAxis multiAxis;
+      static uint32_t pendingFrame = 0; // Frame of a target no point has been streamed for yet
+      if (data->newTarget.exchange(false))
+        pendingFrame = g_frameTracer.TargetFrame();
+
+      if (g_pvtStreamer->Step(multiAxis, {data->targetX.load(), data->targetY.load()}) != 0 && pendingFrame != 0)
+      {
+        g_frameTracer.Stamp(pendingFrame, TimingHelpers::FrameStage::MoveIssued);
+        pendingFrame = 0;
+      }
+      data->pvtPointsSent = static_cast<int64_t>(g_pvtStreamer->PointsSent());
+      data->pvtUnderruns = static_cast<int64_t>(g_pvtStreamer->Underruns());
+      return;
+    }
+
+    // Only execute if a new target is set
+    if (!data->newTarget.exchange(false))
+      return;
+    const uint32_t frameNumber = g_frameTracer.TargetFrame(); // Frame the target came from
+
+    // Move the motors to the target positions respecting the limits
     double clampedX = std::clamp(data->targetX.load(), NEG_X_LIMIT, POS_X_LIMIT);
     double clampedY = std::clamp(data->targetY.load(), NEG_Y_LIMIT, POS_Y_LIMIT);
     RTMultiAxisGet(0)->MoveSCurve(std::array{clampedX, clampedY}.data());
+    g_frameTracer.Stamp(frameNumber, TimingHelpers::FrameStage::MoveIssued);
   }
   catch (const RsiError &e)
   {
@@ -145,100 +406,246 @@ RSI_TASK(MoveMotors)
   }
 }
 
-// Processes the image captured by the camera.
-RSI_TASK(DetectBall)
+// Numbers a frame that was just grabbed, takes its timestamps and starts its trace
+void BeginFrame(CameraHelpers::GrabbedFrame &frame)
 {
-  static SharedDataHelpers::SPSCStorageManager frameWriter(g_frameStorage, true);
+  static uint32_t frameNumber = 0;
+  frame.frameNumber = ++frameNumber;
+  frame.grabbedNs = TimingHelpers::NowNs();
+  frame.exposureNs = g_frameSource->LastExposureNs();
+  frame.aoi = g_frameSource->LastAoi();
+  frame.timestampUs = std::chrono::duration_cast<std::chrono::microseconds>(
+                          std::chrono::high_resolution_clock::now().time_since_epoch())
+                          .count();
+  g_frameTracer.Begin(frame.frameNumber, frame.exposureNs, frame.grabbedNs);
+}
 
-  if (!data->initialized)
-    return;
-  if (!data->cameraReady)
-    return;
+// Grabs frames for DetectBall when grab = thread in FRAME_SOURCE_CONFIG_FILE, called in a loop by g_grabThread. On a
+// core of its own it retrieves the next frame while DetectBall still works on the last one, framesGrabbedDuringDetect
+// counts the frames for which that happened.
+void GrabFrame(GlobalData *data)
+{
+  constexpr unsigned int GRAB_TIMEOUT_MS = 10; // Bounds how long stopping the thread waits for a grab
+  constexpr auto IDLE_WAIT = std::chrono::microseconds(100); // While no frame can be taken, well under a frame period
 
-  bool frameGrabbed = false;
+  // Leave new frames with the source while DetectBall has not caught up
+  const uint32_t depth = g_frameQueue->Depth();
+  if (depth == CameraHelpers::FrameQueue::CAPACITY)
+  {
+    std::this_thread::sleep_for(IDLE_WAIT);
+    return;
+  }
 
+  CameraHelpers::GrabbedFrame frame;
   try
   {
-    frameGrabbed = CameraHelpers::TryGrabFrame(g_camera, g_ptrGrabResult, 0);
+    // Replay and synthetic sources return right away without a frame, and every source does while its leases are out
+    if (!g_frameSource->TryLeaseFrame(frame.lease, GRAB_TIMEOUT_MS))
+    {
+      std::this_thread::sleep_for(IDLE_WAIT);
+      return;
+    }
   }
   catch (...)
   {
-    // If an exception occurs during frame grab increment failure count
     data->frameGrabFailures++;
+    std::this_thread::sleep_for(std::chrono::milliseconds(GRAB_TIMEOUT_MS));
     return;
   }
   data->cameraGrabbing = true;
 
-  // If frame grab failed due to a timeout, exit early but do not increment failure count
-  if (!frameGrabbed)
+  BeginFrame(frame);
+  if (g_detecting.load(std::memory_order_relaxed))
+    data->framesGrabbedDuringDetect++;
+  g_frameQueue->TryPush(frame); // Only this thread pushes, so the room seen above is still there
+  if (static_cast<int32_t>(depth + 1) > data->frameQueueDepthMax)
+    data->frameQueueDepthMax = static_cast<int32_t>(depth + 1);
+}
+
+// Processes the image captured by the camera.
+RSI_TASK(DetectBall)
+{
+  // Per-frame scratch memory for the detection path, released at the start of every frame. The edge points of
+  // RefineBall are all it holds; if it ever runs short the coarse circle is used and rtScratchExhaustions counts it.
+  static MemoryHelpers::FrameArena<16 * 1024> frameArena;
+
+  if (!data->initialized)
+    return;
+  if (!data->cameraReady)
     return;
 
-  // Store image data for JSON file - for C# server communication
-  static uint32_t sequenceNumber = 0;
-  sequenceNumber++;
+  frameArena.Reset();
 
-  // Get current frame timestamp
-  auto frameTimestamp = std::chrono::duration_cast<std::chrono::microseconds>(
-                            std::chrono::high_resolution_clock::now().time_since_epoch())
-                            .count();
+  // Counts heap allocations for the rest of the task when the allocation guard is enabled
+  MemoryHelpers::AllocationGuardScope allocationGuard;
+
+  CameraHelpers::GrabbedFrame frame; // The lease keeps the grab buffer while it is queued or handed off
+  const uint8_t *grabbedFrame = nullptr;
+
+  if (g_frameQueue)
+  {
+    // Take the newest frame GrabFrame queued, the older ones go back to the source
+    uint32_t skipped = 0;
+    if (!g_frameQueue->TryPopNewest(frame, skipped))
+      return;
+    data->framesSkipped += skipped;
+    g_frameTracer.Stamp(frame.frameNumber, TimingHelpers::FrameStage::Dequeued);
+    grabbedFrame = frame.lease.Data();
+    g_detecting.store(true, std::memory_order_relaxed);
+  }
+  else
+  {
+    bool frameGrabbed = false;
+    try
+    {
+      if (g_frameHandoff)
+      {
+        frameGrabbed = g_frameSource->TryLeaseFrame(frame.lease, 0);
+        grabbedFrame = frame.lease.Data();
+      }
+      else
+      {
+        frameGrabbed = g_frameSource->TryGrabFrame(grabbedFrame, 0);
+      }
+    }
+    catch (...)
+    {
+      // If an exception occurs during frame grab increment failure count
+      data->frameGrabFailures++;
+      return;
+    }
+    data->cameraGrabbing = true;
+
+    // If frame grab failed due to a timeout, exit early but do not increment failure count
+    if (!frameGrabbed)
+      return;
+    BeginFrame(frame);
+  }
+  const uint32_t sequenceNumber = frame.frameNumber;
+  const int64_t grabbedNs = frame.grabbedNs;
+  const int64_t exposureNs = frame.exposureNs;
 
   // Update image streaming globals
   data->newImageAvailable = true;
-  data->frameTimestamp = frameTimestamp;
-  data->imageWidth = CameraHelpers::IMAGE_WIDTH;
-  data->imageHeight = CameraHelpers::IMAGE_HEIGHT;
+  data->frameTimestamp = frame.timestampUs;
   data->imageSequenceNumber = sequenceNumber;
 
-  // Record the axis positions at the time of frame grab
-  double initialX(RTAxisGet(0)->ActualPositionGet());
-  double initialY(RTAxisGet(1)->ActualPositionGet());
-
-  // Convert the grabbed frame to a CV mat format for processing
-  cv::Mat yuyvFrame = ImageProcessing::WrapYUYVBuffer(static_cast<uint8_t *>(g_ptrGrabResult->GetBuffer()),
-                                                      CameraHelpers::IMAGE_WIDTH,
-                                                      CameraHelpers::IMAGE_HEIGHT);
+  // The axis positions when the frame was exposed, interpolated from the position history. Without an exposure
+  // timestamp, or when the history does not reach back that far, the positions now are the best guess.
+  double initialX(0.0), initialY(0.0);
+  if (exposureNs == 0 || !g_positionHistory.TryInterpolate(exposureNs, initialX, initialY))
+  {
+    if (exposureNs != 0)
+      data->positionHistoryMisses++;
+    initialX = RTAxisGet(0)->ActualPositionGet();
+    initialY = RTAxisGet(1)->ActualPositionGet();
+  }
 
-  // Detect the ball in the YUYV frame
+  // Detect the ball in the YUYV or raw Bayer frame with the detection built for the camera mode, only searching around
+  // the last position while it is tracked
+  const CameraHelpers::PixelFormat pixelFormat = g_frameSource->Format();
+  static ImageProcessing::TrackingState tracking;
+  ImageProcessing::DetectionMode detectionMode = ImageProcessing::DetectionMode::None;
   cv::Vec3f ball(0.0, 0.0, 0.0);
-  bool ballDetected = ImageProcessing::TryDetectBall(yuyvFrame, ball);
+  ImageProcessing::DetectionStageTimes stageTimes;
+  bool ballDetected = g_detector->detect(grabbedFrame, frame.aoi, ball, tracking, detectionMode, frameArena, &stageTimes);
+  g_frameTracer.Stamp(sequenceNumber, TimingHelpers::FrameStage::MaskDone, stageTimes.maskDoneNs);
+  g_frameTracer.Stamp(sequenceNumber, TimingHelpers::FrameStage::FitDone, stageTimes.fitDoneNs);
 
   // Update global data with the detection results
   data->ballCenterX = ball[0];
   data->ballCenterY = ball[1];
   data->ballRadius = ball[2];
   data->ballDetected = ballDetected;
+  data->detectionMode = static_cast<int32_t>(detectionMode);
+
+  // Move the camera AOI with the ball, the source programs it off this thread. The detection searched the frame of the
+  // AOI where it is, so the ball is already in full-frame pixels for the offset below.
+  if (g_aoiTracker)
+    g_frameSource->RequestAoi(g_aoiTracker->Update(ballDetected, ball[0], ball[1], ball[2]));
+  if (frame.aoi.width != static_cast<uint32_t>(data->cameraAoiWidth) || frame.aoi.height != static_cast<uint32_t>(data->cameraAoiHeight))
+  {
+    data->cameraAoiWidth = static_cast<int32_t>(frame.aoi.width);
+    data->cameraAoiHeight = static_cast<int32_t>(frame.aoi.height);
+    data->cameraAoiResizes++;
+  }
+  data->cameraAoiFailures = static_cast<int64_t>(g_frameSource->AoiFailures());
 
   // Calculate confidence based on ball radius (larger = more confident)
   double confidence = ballDetected ? std::min(ball[2] / 50.0, 1.0) : 0.0;
 
-  // Calculate the target positions based on the offsets and the position at the time of frame grab
-  double offsetX(0.0), offsetY(0.0);
+  // Track the ball direction (the pose at exposure plus the ball's offset) and aim where the ball will be once the
+  // move completes. Predicted offsets within the dead band keep the gimbal where it was.
+  static MotionHelpers::TargetTracker targetTracker;
   if (ballDetected)
   {
-    ImageProcessing::CalculateTargetPosition(ball, offsetX, offsetY);
-    data->targetX = initialX + offsetX;
-    data->targetY = initialY + offsetY;
+    constexpr double DEAD_BAND = ImageProcessing::PIXEL_THRESHOLD * -ImageProcessing::MOTOR_UNITS_PER_PIXEL;
+    double offsetX(0.0), offsetY(0.0);
+    g_detector->ballOffset(ball, offsetX, offsetY);
+    targetTracker.Update(exposureNs != 0 ? exposureNs : grabbedNs, initialX + offsetX, initialY + offsetY);
+
+    double predictedX(0.0), predictedY(0.0);
+    targetTracker.PredictTarget(TimingHelpers::NowNs(), predictedX, predictedY);
+    data->targetX = std::abs(predictedX - initialX) > DEAD_BAND ? predictedX : initialX;
+    data->targetY = std::abs(predictedY - initialY) > DEAD_BAND ? predictedY : initialY;
   }
 
-  // Store the YUYV frame and metadata in the shared memory
-  memcpy(frameWriter.data().yuyvData, yuyvFrame.data, sizeof(CameraHelpers::YUYVFrame));
-  frameWriter.data().frameNumber = data->imageSequenceNumber;
-  frameWriter.data().timestamp = static_cast<double>(data->frameTimestamp);
-  frameWriter.data().ballDetected = ballDetected;
-  frameWriter.data().centerX = ball[0];
-  frameWriter.data().centerY = ball[1];
-  frameWriter.data().radius = ball[2];
-  frameWriter.data().targetX = data->targetX;
-  frameWriter.data().targetY = data->targetY;
-  frameWriter.flags() = 1; // indicate new data is available
-  frameWriter.exchange();
+  const MotionHelpers::TrackerState &trackerState = targetTracker.State();
+  data->trackerPositionX = trackerState.axes[0].position;
+  data->trackerPositionY = trackerState.axes[1].position;
+  data->trackerVelocityX = trackerState.axes[0].velocity;
+  data->trackerVelocityY = trackerState.axes[1].velocity;
+  data->trackerPositionVarianceX = trackerState.axes[0].covariance[0][0];
+  data->trackerPositionVarianceY = trackerState.axes[1].covariance[0][0];
+  data->trackerCovarianceX = trackerState.axes[0].covariance[0][1];
+  data->trackerCovarianceY = trackerState.axes[1].covariance[0][1];
+  data->trackerVelocityVarianceX = trackerState.axes[0].covariance[1][1];
+  data->trackerVelocityVarianceY = trackerState.axes[1].covariance[1][1];
+
+  // Detection results that travel with the frame
+  FrameInfo frameInfo;
+  frameInfo.frameNumber = data->imageSequenceNumber;
+  frameInfo.timestamp = static_cast<double>(data->frameTimestamp);
+  frameInfo.ballDetected = ballDetected;
+  frameInfo.centerX = ball[0];
+  frameInfo.centerY = ball[1];
+  frameInfo.radius = ball[2];
+  frameInfo.detectionMode = static_cast<int>(detectionMode);
+  frameInfo.pixelFormat = static_cast<int>(pixelFormat);
+  frameInfo.targetX = data->targetX;
+  frameInfo.targetY = data->targetY;
+
+  // Record the frame before it is handed on, the copy never blocks
+  if (g_frameRecorder)
+  {
+    g_frameRecorder->Append(frameInfo, grabbedFrame, frame.aoi);
+    data->recordedFrames = static_cast<int64_t>(g_frameRecorder->RecordedFrames());
+    data->recorderDroppedFrames = static_cast<int64_t>(g_frameRecorder->DroppedFrames());
+  }
+
+  // Hand the frame to OutputImage: the grab buffer itself, or a full-size copy in the shared memory
+  if (g_frameHandoff)
+  {
+    g_frameHandoff->Publish(std::move(frame.lease), frameInfo, frame.aoi);
+  }
+  else
+  {
+    static SharedDataHelpers::SPMCStorageWriter frameWriter(g_frameStorage);
+    CameraHelpers::ExpandAoiFrame(frameWriter.data().imageData, grabbedFrame, frame.aoi, pixelFormat);
+    frameWriter.data().info = frameInfo;
+    frameWriter.publish();
+  }
 
   // If no ball was detected, increment the failure count
   if (!ballDetected)
   {
     data->ballDetectionFailures++;
   }
+  g_frameTracer.TargetWritten(sequenceNumber);
   data->newTarget = true;
+  data->rtHeapAllocations = static_cast<int64_t>(MemoryHelpers::GuardedAllocationCount());
+  data->rtScratchExhaustions = static_cast<int64_t>(frameArena.Exhaustions());
+  g_detecting.store(false, std::memory_order_relaxed);
 }
 
 // A simple rolling average class to smooth timing metrics
@@ -275,35 +682,11 @@ private:
   double sum;
 };
 
-// Function to convert image data to base64 for JSON embedding
-std::string EncodeBase64(const std::vector<uint8_t> &data)
-{
-  static const std::string chars = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
-  std::string result;
-  int val = 0, valb = -6;
-  for (uint8_t c : data)
-  {
-    val = (val << 8) + c;
-    valb += 8;
-    while (valb >= 0)
-    {
-      result.push_back(chars[(val >> valb) & 0x3F]);
-      valb -= 6;
-    }
-  }
-  if (valb > -6)
-    result.push_back(chars[((val << 8) >> (valb + 8)) & 0x3F]);
-  while (result.size() % 4)
-    result.push_back('=');
-  return result;
-}
-
-// Writes the camera frame data to a JSON file and creates a running flag file
+// Encodes the newest camera frame and publishes it with its detection results for the camera server
 RSI_TASK(OutputImage)
 {
   constexpr int US_PER_SEC = 1000000;
 
-  static SharedDataHelpers::SPSCStorageManager frameReader(g_frameStorage, false);
   static double lastTimeStamp = 0.0;
   static int lastFrameNumber = -1;
   static RollingAverage fpsAverage(30); // 30-sample rolling average for FPS
@@ -311,80 +694,121 @@ RSI_TASK(OutputImage)
   if (!data->initialized)
     return;
 
-  // Check if new image data is available
-  frameReader.exchange();
-  if (frameReader.flags() == 0)
-    return;
+  // Take the newest frame: the grab buffer itself, or the copy in the shared memory
+  CameraHelpers::FrameLease frameLease; // Returns the grab buffer to the frame source when this task is done
+  FrameInfo frameInfo;
+  const uint8_t *imageData = nullptr;
+  if (g_frameHandoff)
+  {
+    CameraHelpers::CameraAoi aoi;
+    if (!g_frameHandoff->TryTake(frameLease, frameInfo, aoi))
+      return;
+    imageData = frameLease.Data();
+
+    // The preview shows full-size frames, the frame of a smaller AOI is put in place in one
+    if (aoi != CameraHelpers::CameraAoi())
+    {
+      static CameraHelpers::YUYVFrame expanded; // The larger format
+      CameraHelpers::ExpandAoiFrame(expanded, imageData, aoi, static_cast<CameraHelpers::PixelFormat>(frameInfo.pixelFormat));
+      imageData = expanded;
+    }
+  }
+  else
+  {
+    static SharedDataHelpers::SPMCStorageReader frameReader(g_frameStorage);
+
+    // The frame stays ours until the next acquire
+    if (!frameReader.acquire())
+      return;
+    frameInfo = frameReader.data().info;
+    imageData = frameReader.data().imageData;
+  }
 
   // Update FPS calculation
   if (lastTimeStamp != 0.0 && lastFrameNumber != -1)
   {
-    double timeDelta = frameReader.data().timestamp - lastTimeStamp;
-    int numImages = frameReader.data().frameNumber - lastFrameNumber;
+    double timeDelta = frameInfo.timestamp - lastTimeStamp;
+    int numImages = frameInfo.frameNumber - lastFrameNumber;
     double fps = numImages * US_PER_SEC / timeDelta;
     data->cameraFPS = fpsAverage.update(fps);
   }
-  lastTimeStamp = frameReader.data().timestamp;
-  lastFrameNumber = frameReader.data().frameNumber;
+  lastTimeStamp = frameInfo.timestamp;
+  lastFrameNumber = frameInfo.frameNumber;
 
   try
   {
-    // Construct cv::Mat from YUYVFrame data in the shared buffer
-    cv::Mat yuyvMat(CameraHelpers::IMAGE_HEIGHT, CameraHelpers::IMAGE_WIDTH, CV_8UC2, (void *)frameReader.data().yuyvData);
-    cv::Mat rgbFrame;
-    cv::cvtColor(yuyvMat, rgbFrame, cv::COLOR_YUV2RGB_YUYV);
-    // Encode as JPEG with quality 80
-    std::vector<uint8_t> jpegBuffer;
-    std::vector<int> jpegParams = {cv::IMWRITE_JPEG_QUALITY, 80};
-    cv::imencode(".jpg", rgbFrame, jpegBuffer, jpegParams);
-
-    // Convert to base64
-    std::string base64Image = EncodeBase64(jpegBuffer);
-
-    // Write JSON with frame data
-    std::ostringstream json;
-    json << "{\n";
-    json << "  \"timestamp\": " << std::fixed << std::setprecision(0) << frameReader.data().timestamp << ",\n";
-    json << "  \"frameNumber\": " << frameReader.data().frameNumber << ",\n";
-    json << "  \"width\": " << CameraHelpers::IMAGE_WIDTH << ",\n";
-    json << "  \"height\": " << CameraHelpers::IMAGE_HEIGHT << ",\n";
-    json << "  \"format\": \"jpeg\",\n";
-    json << "  \"imageData\": \"data:image/jpeg;base64," << base64Image << "\",\n";
-    json << "  \"imageSize\": " << jpegBuffer.size() << ",\n";
-    json << "  \"ballDetected\": " << (frameReader.data().ballDetected ? "true" : "false") << ",\n";
-    json << "  \"centerX\": " << std::fixed << std::setprecision(2) << frameReader.data().centerX << ",\n";
-    json << "  \"centerY\": " << std::fixed << std::setprecision(2) << frameReader.data().centerY << ",\n";
-    json << "  \"radius\": " << std::fixed << std::setprecision(2) << frameReader.data().radius << ",\n";
-    json << "  \"targetX\": " << std::fixed << std::setprecision(2) << frameReader.data().targetX << ",\n";
-    json << "  \"targetY\": " << std::fixed << std::setprecision(2) << frameReader.data().targetY << ",\n";
-    json << "  \"rtTaskRunning\": true\n";
-    json << "}";
-
-    // Write to file atomically
-    std::ofstream dataFile("/tmp/rsi_camera_data.json.tmp");
-    if (dataFile.is_open())
-    {
-      dataFile << json.str();
-      dataFile.close();
-      // Atomic rename to prevent partial reads
-      std::rename("/tmp/rsi_camera_data.json.tmp", "/tmp/rsi_camera_data.json");
-    }
-
-    // Create running flag file
-    std::ofstream flagFile("/tmp/rsi_rt_task_running");
-    if (flagFile.is_open())
-    {
-      flagFile << "1";
-      flagFile.close();
-    }
+    // Encode straight from the YUYV data (Bayer frames are demosaiced first) and publish for the camera server
+    if (g_previewPublisher->Publish(frameInfo, imageData))
+      g_frameTracer.Stamp(static_cast<uint32_t>(frameInfo.frameNumber), TimingHelpers::FrameStage::Published);
   }
   catch (const std::exception &e)
   {
-    std::cerr << "Error writing camera frame JSON: " << e.what() << std::endl;
+    std::cerr << "Error publishing camera frame: " << e.what() << std::endl;
   }
 
-  // Reset flags after writing
-  frameReader.flags() = 0;
+  // Refresh the latency percentiles once a second. Every one scans a whole histogram, which is too slow for the
+  // 1-sample tasks and too much for every preview frame. FrameLatencyPercentileGet reads them on demand.
+  constexpr int64_t REFRESH_NS = 1'000'000'000;
+  static int64_t refreshedSecond = -1;
+  const int64_t second = TimingHelpers::NowNs() / REFRESH_NS;
+  if (second == refreshedSecond)
+    return;
+  refreshedSecond = second;
+
+  constexpr double NS_PER_US = 1000.0;
+  const TimingHelpers::LatencyHistogram &grabToMove = g_frameTracer.Histogram(TimingHelpers::LatencySpan::GrabToMove);
+  data->latencyGrabToMoveP50Us = grabToMove.PercentileNs(50.0) / NS_PER_US;
+  data->latencyGrabToMoveP99Us = grabToMove.PercentileNs(99.0) / NS_PER_US;
+  data->latencyGrabToMoveMaxUs = grabToMove.MaxNs() / NS_PER_US;
+  data->latencyExposureToMoveP99Us = g_frameTracer.Histogram(TimingHelpers::LatencySpan::ExposureToMove).PercentileNs(99.0) / NS_PER_US;
+  data->latencyGrabToPublishP99Us = g_frameTracer.Histogram(TimingHelpers::LatencySpan::GrabToPublish).PercentileNs(99.0) / NS_PER_US;
+  data->latencyGrabToDequeueP99Us = g_frameTracer.Histogram(TimingHelpers::LatencySpan::GrabToDequeue).PercentileNs(99.0) / NS_PER_US;
+  data->latencyDequeueToTargetP99Us = g_frameTracer.Histogram(TimingHelpers::LatencySpan::DequeueToTarget).PercentileNs(99.0) / NS_PER_US;
+}
+
+// Latency percentile (0-100) of a TimingHelpers::LatencySpan in microseconds, for tools that load the task library.
+// 0 while the span has no samples, -1 for an unknown span.
+extern "C" LIBRARY_EXPORT double FrameLatencyPercentileGet(int32_t span, double percentile)
+{
+  if (span < 0 || span >= static_cast<int32_t>(TimingHelpers::LatencySpan::Count))
+    return -1.0;
+  return g_frameTracer.Histogram(static_cast<TimingHelpers::LatencySpan>(span)).PercentileNs(percentile) / 1000.0;
+}
+
+// Number of frames recorded for a TimingHelpers::LatencySpan, -1 for an unknown span
+extern "C" LIBRARY_EXPORT int64_t FrameLatencyCountGet(int32_t span)
+{
+  if (span < 0 || span >= static_cast<int32_t>(TimingHelpers::LatencySpan::Count))
+    return -1;
+  return static_cast<int64_t>(g_frameTracer.Histogram(static_cast<TimingHelpers::LatencySpan>(span)).Count());
+}
+
+// Percentile (0-100) of a TimingHelpers::TimingMetric over a TimingHelpers::HistogramWindow, in the units of the
+// metric. 0 while the window has no samples, -1 for an unknown metric or window.
+extern "C" LIBRARY_EXPORT int64_t TimingMetricPercentileGet(int32_t metric, int32_t window, double percentile)
+{
+  if (metric < 0 || metric >= static_cast<int32_t>(TimingHelpers::TimingMetric::Count) ||
+      window < 0 || window >= static_cast<int32_t>(TimingHelpers::HistogramWindow::Count))
+    return -1;
+  return g_timingHistograms[metric].Percentile(static_cast<TimingHelpers::HistogramWindow>(window), percentile);
+}
+
+// Largest sample of a TimingHelpers::TimingMetric in a TimingHelpers::HistogramWindow, -1 for an unknown metric or window
+extern "C" LIBRARY_EXPORT int64_t TimingMetricMaxGet(int32_t metric, int32_t window)
+{
+  if (metric < 0 || metric >= static_cast<int32_t>(TimingHelpers::TimingMetric::Count) ||
+      window < 0 || window >= static_cast<int32_t>(TimingHelpers::HistogramWindow::Count))
+    return -1;
+  return g_timingHistograms[metric].Max(static_cast<TimingHelpers::HistogramWindow>(window));
+}
+
+// Number of samples of a TimingHelpers::TimingMetric in a TimingHelpers::HistogramWindow, -1 for an unknown metric or window
+extern "C" LIBRARY_EXPORT int64_t TimingMetricCountGet(int32_t metric, int32_t window)
+{
+  if (metric < 0 || metric >= static_cast<int32_t>(TimingHelpers::TimingMetric::Count) ||
+      window < 0 || window >= static_cast<int32_t>(TimingHelpers::HistogramWindow::Count))
+    return -1;
+  return static_cast<int64_t>(g_timingHistograms[metric].Count(static_cast<TimingHelpers::HistogramWindow>(window)));
 }
 
 template <typename T>
@@ -435,4 +859,52 @@ RSI_TASK(RecordTimingMetrics)
   {
     atomic_max(data->networkTimingReceiveDeltaMaxSampleCount, sampleCount);
   }
+
+  // Full distributions for the jitter, not just the worst sample
+  using TimingHelpers::TimingMetric;
+  using TimingHelpers::HistogramWindow;
+  const int64_t nowNs = TimingHelpers::NowNs();
+  auto &histograms = g_timingHistograms;
+  histograms[static_cast<size_t>(TimingMetric::FirmwareTimingDelta)].Record(firmwareTimingDelta, nowNs);
+  histograms[static_cast<size_t>(TimingMetric::NetworkTimingDelta)].Record(networkTimingDelta, nowNs);
+  histograms[static_cast<size_t>(TimingMetric::NetworkTimingReceiveDelta)].Record(networkTimingReceiveDelta, nowNs);
+
+  // Refresh the p99 globals once a second, when the last second is complete, one global per sample. Scanning all the
+  // histograms in one sample would cost more than the task itself.
+  static int64_t publishedSecond = -1;
+  static int nextP99 = 0;
+  constexpr int P99_GLOBALS = 6;
+  const int64_t second = nowNs / TimingHelpers::WindowedHistogram::SLICE_NS;
+  if (second != publishedSecond)
+  {
+    publishedSecond = second;
+    nextP99 = 0;
+  }
+  if (nextP99 == P99_GLOBALS)
+    return;
+  auto p99 = [&](TimingMetric metric, HistogramWindow window)
+  {
+    return static_cast<int32_t>(histograms[static_cast<size_t>(metric)].Percentile(window, 99.0));
+  };
+  switch (nextP99++)
+  {
+  case 0:
+    data->firmwareTimingDeltaP99Second = p99(TimingMetric::FirmwareTimingDelta, HistogramWindow::LastSecond);
+    break;
+  case 1:
+    data->firmwareTimingDeltaP99Minute = p99(TimingMetric::FirmwareTimingDelta, HistogramWindow::LastMinute);
+    break;
+  case 2:
+    data->networkTimingDeltaP99Second = p99(TimingMetric::NetworkTimingDelta, HistogramWindow::LastSecond);
+    break;
+  case 3:
+    data->networkTimingDeltaP99Minute = p99(TimingMetric::NetworkTimingDelta, HistogramWindow::LastMinute);
+    break;
+  case 4:
+    data->networkTimingReceiveDeltaP99Second = p99(TimingMetric::NetworkTimingReceiveDelta, HistogramWindow::LastSecond);
+    break;
+  case 5:
+    data->networkTimingReceiveDeltaP99Minute = p99(TimingMetric::NetworkTimingReceiveDelta, HistogramWindow::LastMinute);
+    break;
+  }
 }
\ No newline at end of file
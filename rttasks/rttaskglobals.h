@@ -66,9 +66,18 @@ namespace RSI
 
         // Camera state
         RSI_GLOBAL(bool, cameraReady);
+        RSI_GLOBAL(int32_t, frameSource); // CameraHelpers::FrameSourceType
+        RSI_GLOBAL(int32_t, pixelFormat); // CameraHelpers::PixelFormat of the frames
         RSI_GLOBAL(bool, cameraGrabbing);
         RSI_GLOBAL(int, frameGrabFailures);
         RSI_GLOBAL(double, cameraFPS);
+        RSI_GLOBAL(int32_t, frameQueueDepthMax); // Most frames seen waiting in the GrabFrame queue
+        RSI_GLOBAL(int64_t, framesSkipped);      // Queued frames DetectBall dropped for a newer one
+        RSI_GLOBAL(int64_t, framesGrabbedDuringDetect); // Frames GrabFrame queued while DetectBall worked on the last one
+        RSI_GLOBAL(int32_t, cameraAoiWidth);     // AOI of the last frame, the full frame unless aoi = track
+        RSI_GLOBAL(int32_t, cameraAoiHeight);
+        RSI_GLOBAL(int64_t, cameraAoiResizes);   // AOI size changes, each restarts grabbing
+        RSI_GLOBAL(int64_t, cameraAoiFailures);  // AOIs the camera could not be given, each is tried again
 
         // Ball detection state
         RSI_GLOBAL(bool, ballDetected);
@@ -76,6 +85,8 @@ namespace RSI
         RSI_GLOBAL(double, ballCenterX);
         RSI_GLOBAL(double, ballCenterY);
         RSI_GLOBAL(double, ballRadius);
+        RSI_GLOBAL(int32_t, detectionMode); // ImageProcessing::DetectionMode of the last search
+        RSI_GLOBAL(int32_t, detectionStripes); // Stripes of a full-frame search, 1 without stripe workers
 
         // Image data for streaming
         RSI_GLOBAL(bool, newImageAvailable);
@@ -93,6 +104,9 @@ namespace RSI
         RSI_GLOBAL(bool, newTarget);
         RSI_GLOBAL(double, targetX);
         RSI_GLOBAL(double, targetY);
+        RSI_GLOBAL(int32_t, moveMode); // MotionHelpers::MoveMode
+        RSI_GLOBAL(int64_t, pvtPointsSent);
+        RSI_GLOBAL(int64_t, pvtUnderruns); // Times the streamed points ran out before the next ones were queued
 
         // Timing Metrics
         RSI_GLOBAL(int32_t, firmwareTimingDeltaMax);
@@ -101,6 +115,47 @@ namespace RSI
         RSI_GLOBAL(int32_t, networkTimingDeltaMaxSampleCount);
         RSI_GLOBAL(int32_t, networkTimingReceiveDeltaMax);
         RSI_GLOBAL(int32_t, networkTimingReceiveDeltaMaxSampleCount);
+        RSI_GLOBAL(int32_t, firmwareTimingDeltaP99Second); // p99 of the last full second, see TimingMetricPercentileGet
+        RSI_GLOBAL(int32_t, firmwareTimingDeltaP99Minute); // p99 of the last minute
+        RSI_GLOBAL(int32_t, networkTimingDeltaP99Second);
+        RSI_GLOBAL(int32_t, networkTimingDeltaP99Minute);
+        RSI_GLOBAL(int32_t, networkTimingReceiveDeltaP99Second);
+        RSI_GLOBAL(int32_t, networkTimingReceiveDeltaP99Minute);
+
+        // Heap allocations seen inside guarded RT sections, only counted in RTTASKS_ALLOCATION_GUARD builds
+        RSI_GLOBAL(int64_t, rtHeapAllocations);
+
+        // Per-frame scratch allocations of DetectBall that found its arena full, since the library loaded
+        RSI_GLOBAL(int64_t, rtScratchExhaustions);
+
+        // Frame recorder, frames accepted and frames dropped because the recorder fell behind
+        RSI_GLOBAL(int64_t, recordedFrames);
+        RSI_GLOBAL(int64_t, recorderDroppedFrames);
+
+        // Frame latency percentiles in microseconds from the frame traces, updated by OutputImage.
+        // Grab to move is camera-to-motion on the host clock, exposure to move adds exposure and transfer.
+        RSI_GLOBAL(double, latencyGrabToMoveP50Us);
+        RSI_GLOBAL(double, latencyGrabToMoveP99Us);
+        RSI_GLOBAL(double, latencyGrabToMoveMaxUs);
+        RSI_GLOBAL(double, latencyExposureToMoveP99Us);
+        RSI_GLOBAL(double, latencyGrabToPublishP99Us);
+        RSI_GLOBAL(double, latencyGrabToDequeueP99Us);   // Wait in the GrabFrame queue
+        RSI_GLOBAL(double, latencyDequeueToTargetP99Us); // DetectBall's work on a queued frame
+
+        // Frames with an exposure timestamp outside of the position history, which used the positions at grab time
+        RSI_GLOBAL(int64_t, positionHistoryMisses);
+
+        // Ball direction estimate of the target tracker in motor units (and per second), with its covariance
+        RSI_GLOBAL(double, trackerPositionX);
+        RSI_GLOBAL(double, trackerPositionY);
+        RSI_GLOBAL(double, trackerVelocityX);
+        RSI_GLOBAL(double, trackerVelocityY);
+        RSI_GLOBAL(double, trackerPositionVarianceX);
+        RSI_GLOBAL(double, trackerPositionVarianceY);
+        RSI_GLOBAL(double, trackerCovarianceX); // Position-velocity covariance
+        RSI_GLOBAL(double, trackerCovarianceY);
+        RSI_GLOBAL(double, trackerVelocityVarianceX);
+        RSI_GLOBAL(double, trackerVelocityVarianceY);
       };
 
       inline constexpr GlobalMetadataMap<RSI::RapidCode::RealTimeTasks::GlobalMaxSize> GlobalMetadata(
@@ -109,9 +164,18 @@ namespace RSI
 
            // Camera state
            REGISTER_GLOBAL(cameraReady),
+           REGISTER_GLOBAL(frameSource),
+           REGISTER_GLOBAL(pixelFormat),
            REGISTER_GLOBAL(cameraGrabbing),
            REGISTER_GLOBAL(frameGrabFailures),
            REGISTER_GLOBAL(cameraFPS),
+           REGISTER_GLOBAL(frameQueueDepthMax),
+           REGISTER_GLOBAL(framesSkipped),
+           REGISTER_GLOBAL(framesGrabbedDuringDetect),
+           REGISTER_GLOBAL(cameraAoiWidth),
+           REGISTER_GLOBAL(cameraAoiHeight),
+           REGISTER_GLOBAL(cameraAoiResizes),
+           REGISTER_GLOBAL(cameraAoiFailures),
 
            // Ball detection state
            REGISTER_GLOBAL(ballDetected),
@@ -119,6 +183,8 @@ namespace RSI
            REGISTER_GLOBAL(ballCenterX),
            REGISTER_GLOBAL(ballCenterY),
            REGISTER_GLOBAL(ballRadius),
+           REGISTER_GLOBAL(detectionMode),
+           REGISTER_GLOBAL(detectionStripes),
 
            // Image streaming state
            REGISTER_GLOBAL(newImageAvailable),
@@ -134,6 +200,9 @@ namespace RSI
            REGISTER_GLOBAL(newTarget),
            REGISTER_GLOBAL(targetX),
            REGISTER_GLOBAL(targetY),
+           REGISTER_GLOBAL(moveMode),
+           REGISTER_GLOBAL(pvtPointsSent),
+           REGISTER_GLOBAL(pvtUnderruns),
 
            // Timing Metrics
            REGISTER_GLOBAL(firmwareTimingDeltaMax),
@@ -141,7 +210,45 @@ namespace RSI
            REGISTER_GLOBAL(networkTimingDeltaMax),
            REGISTER_GLOBAL(networkTimingDeltaMaxSampleCount),
            REGISTER_GLOBAL(networkTimingReceiveDeltaMax),
-           REGISTER_GLOBAL(networkTimingReceiveDeltaMaxSampleCount)});
+           REGISTER_GLOBAL(networkTimingReceiveDeltaMaxSampleCount),
+           REGISTER_GLOBAL(firmwareTimingDeltaP99Second),
+           REGISTER_GLOBAL(firmwareTimingDeltaP99Minute),
+           REGISTER_GLOBAL(networkTimingDeltaP99Second),
+           REGISTER_GLOBAL(networkTimingDeltaP99Minute),
+           REGISTER_GLOBAL(networkTimingReceiveDeltaP99Second),
+           REGISTER_GLOBAL(networkTimingReceiveDeltaP99Minute),
+
+           // Allocation guard
+           REGISTER_GLOBAL(rtHeapAllocations),
+           REGISTER_GLOBAL(rtScratchExhaustions),
+
+           // Frame recorder
+           REGISTER_GLOBAL(recordedFrames),
+           REGISTER_GLOBAL(recorderDroppedFrames),
+
+           // Frame latency
+           REGISTER_GLOBAL(latencyGrabToMoveP50Us),
+           REGISTER_GLOBAL(latencyGrabToMoveP99Us),
+           REGISTER_GLOBAL(latencyGrabToMoveMaxUs),
+           REGISTER_GLOBAL(latencyExposureToMoveP99Us),
+           REGISTER_GLOBAL(latencyGrabToPublishP99Us),
+           REGISTER_GLOBAL(latencyGrabToDequeueP99Us),
+           REGISTER_GLOBAL(latencyDequeueToTargetP99Us),
+
+           // Position history
+           REGISTER_GLOBAL(positionHistoryMisses),
+
+           // Target tracker
+           REGISTER_GLOBAL(trackerPositionX),
+           REGISTER_GLOBAL(trackerPositionY),
+           REGISTER_GLOBAL(trackerVelocityX),
+           REGISTER_GLOBAL(trackerVelocityY),
+           REGISTER_GLOBAL(trackerPositionVarianceX),
+           REGISTER_GLOBAL(trackerPositionVarianceY),
+           REGISTER_GLOBAL(trackerCovarianceX),
+           REGISTER_GLOBAL(trackerCovarianceY),
+           REGISTER_GLOBAL(trackerVelocityVarianceX),
+           REGISTER_GLOBAL(trackerVelocityVarianceY)});
 
       extern "C"
       {
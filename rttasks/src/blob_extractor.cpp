@@ -0,0 +1,260 @@
+#include "blob_extractor.h"
+
+#include <algorithm>
+#include <limits>
+
+namespace ImageProcessing
+{
+  namespace
+  {
+    // Sum of k^2 for 0..n
+    inline int64_t SumOfSquares(int64_t n) { return n * (n + 1) * (2 * n + 1) / 6; }
+  }
+
+  int32_t BlobExtractor::FindRoot(int32_t run)
+  {
+    // Path halving keeps the trees shallow without recursion
+    while (parent_[run] != run)
+    {
+      parent_[run] = parent_[parent_[run]];
+      run = parent_[run];
+    }
+    return run;
+  }
+
+  void BlobExtractor::Union(int32_t a, int32_t b)
+  {
+    // The smaller index always becomes the root, so a root is the first run of its component in scan order
+    a = FindRoot(a);
+    b = FindRoot(b);
+    if (a < b)
+      parent_[b] = a;
+    else if (b < a)
+      parent_[a] = b;
+  }
+
+  int BlobExtractor::Extract(const cv::Mat &mask, int minArea)
+  {
+    ExtractStripe(mask, 0, 0, mask.rows);
+    return MergeStripes(1, minArea);
+  }
+
+  void BlobExtractor::ExtractStripe(const cv::Mat &mask, int stripe, int firstRow, int endRow)
+  {
+    // A row holds at most every other pixel as a run start, so each stripe gets the runs_ its rows can fill and
+    // run indices stay in scan order across stripes
+    const int32_t runsPerRow = (mask.cols + 1) / 2;
+    Stripe &state = stripes_[stripe];
+    state.firstRow = firstRow;
+    state.endRow = endRow;
+    state.runBegin = runsPerRow * firstRow;
+    state.runEnd = state.runBegin;
+    state.overflowed = false;
+    const int32_t runLimit = std::min<int32_t>(MAX_RUNS, runsPerRow * endRow);
+
+    // Single scan over the rows: split each row into runs and join them with the touching runs of the previous row
+    int32_t previousRowStart = state.runBegin;
+    int32_t previousRowEnd = state.runBegin;
+    for (int y = firstRow; y < endRow && !state.overflowed; ++y)
+    {
+      const uchar *const row = mask.ptr<uchar>(y);
+      const int32_t rowStart = state.runEnd;
+      int32_t previous = previousRowStart;
+
+      int x = 0;
+      while (x < mask.cols)
+      {
+        if (row[x] == 0)
+        {
+          ++x;
+          continue;
+        }
+
+        const int xStart = x;
+        while (x < mask.cols && row[x] != 0)
+          ++x;
+
+        if (state.runEnd >= runLimit)
+        {
+          state.overflowed = true;
+          break;
+        }
+        const int32_t current = state.runEnd++;
+        runs_[current] = Run{static_cast<int16_t>(y), static_cast<int16_t>(xStart), static_cast<int16_t>(x - 1)};
+        parent_[current] = current;
+
+        // With 8-connectivity runs touch when they overlap or meet diagonally
+        while (previous < previousRowEnd && runs_[previous].xEnd < xStart - 1)
+          ++previous;
+        for (int32_t p = previous; p < previousRowEnd && runs_[p].xStart <= x; ++p)
+          Union(current, p);
+      }
+
+      previousRowStart = rowStart;
+      previousRowEnd = state.runEnd;
+    }
+  }
+
+  int BlobExtractor::MergeStripes(int stripeCount, int minArea)
+  {
+    blobCount_ = 0;
+    overflowed_ = stripes_[0].overflowed;
+
+    // Join the runs on both sides of every seam, the last row of a stripe with the first row of the next
+    for (int s = 1; s < stripeCount; ++s)
+    {
+      const Stripe &above = stripes_[s - 1];
+      const Stripe &below = stripes_[s];
+      overflowed_ = overflowed_ || below.overflowed;
+
+      int32_t previous = above.runEnd;
+      while (previous > above.runBegin && runs_[previous - 1].y == above.endRow - 1)
+        --previous;
+      for (int32_t current = below.runBegin; current < below.runEnd && runs_[current].y == below.firstRow; ++current)
+      {
+        const Run &run = runs_[current];
+        while (previous < above.runEnd && runs_[previous].xEnd < run.xStart - 1)
+          ++previous;
+        for (int32_t p = previous; p < above.runEnd && runs_[p].xStart <= run.xEnd + 1; ++p)
+          Union(current, p);
+      }
+    }
+
+    // Accumulate the statistics of every component. Roots are visited before the other runs of their component.
+    int componentCount = 0;
+    for (int s = 0; s < stripeCount; ++s)
+    {
+      for (int32_t i = stripes_[s].runBegin; i < stripes_[s].runEnd; ++i)
+      {
+        const int32_t root = FindRoot(i);
+        if (root == i)
+        {
+          if (componentCount == MAX_COMPONENTS)
+          {
+            overflowed_ = true;
+            component_[i] = -1;
+            continue;
+          }
+          components_[componentCount] = Component{0,
+                                                  std::numeric_limits<int16_t>::max(), std::numeric_limits<int16_t>::max(),
+                                                  std::numeric_limits<int16_t>::min(), std::numeric_limits<int16_t>::min(),
+                                                  0, 0, 0, 0, 0, -1};
+          component_[i] = componentCount++;
+        }
+        else
+        {
+          component_[i] = component_[root];
+        }
+
+        if (component_[i] < 0)
+          continue;
+
+        const Run &run = runs_[i];
+        Component &component = components_[component_[i]];
+        const int64_t length = run.xEnd - run.xStart + 1;
+        const int64_t sumX = (int64_t(run.xStart) + run.xEnd) * length / 2;
+        const int64_t sumXX = SumOfSquares(run.xEnd) - SumOfSquares(run.xStart - 1);
+
+        component.area += static_cast<int>(length);
+        component.minX = std::min(component.minX, run.xStart);
+        component.maxX = std::max(component.maxX, run.xEnd);
+        component.minY = std::min(component.minY, run.y);
+        component.maxY = std::max(component.maxY, run.y);
+        component.m10 += sumX;
+        component.m01 += run.y * length;
+        component.m20 += sumXX;
+        component.m11 += run.y * sumX;
+        component.m02 += int64_t(run.y) * run.y * length;
+      }
+    }
+
+    // Keep the components large enough to be a blob, preferring the largest when there are too many
+    std::array<int, MAX_COMPONENTS> candidates;
+    int candidateCount = 0;
+    for (int c = 0; c < componentCount; ++c)
+    {
+      if (components_[c].area >= minArea)
+        candidates[candidateCount++] = c;
+    }
+    if (candidateCount > MAX_BLOBS)
+    {
+      overflowed_ = true;
+      std::nth_element(candidates.begin(), candidates.begin() + MAX_BLOBS, candidates.begin() + candidateCount,
+                       [this](int a, int b) { return components_[a].area > components_[b].area; });
+      candidateCount = MAX_BLOBS;
+    }
+
+    // Every row of a blob contributes up to two outline samples, decimate evenly when that exceeds the sample capacity
+    std::array<int, MAX_BLOBS> sampleStride;
+    std::array<int, MAX_BLOBS> sampleCounter;
+    std::array<Run, MAX_BLOBS> outline; // Outermost pixels of the blob's row being gathered, y = -1 before the first
+    for (int b = 0; b < candidateCount; ++b)
+    {
+      Component &component = components_[candidates[b]];
+      component.blobIndex = b;
+
+      Blob &blob = blobs_[b];
+      blob.area = component.area;
+      blob.bounds = cv::Rect(component.minX, component.minY, component.maxX - component.minX + 1, component.maxY - component.minY + 1);
+      blob.m10 = component.m10;
+      blob.m01 = component.m01;
+      blob.m20 = component.m20;
+      blob.m11 = component.m11;
+      blob.m02 = component.m02;
+      blob.boundaryCount = 0;
+
+      const int rowCount = component.maxY - component.minY + 1;
+      sampleStride[b] = (2 * rowCount + Blob::MAX_BOUNDARY_SAMPLES - 1) / Blob::MAX_BOUNDARY_SAMPLES;
+      sampleCounter[b] = 0;
+      outline[b] = Run{-1, 0, 0};
+    }
+    blobCount_ = candidateCount;
+
+    auto addOutlineSamples = [&](int b)
+    {
+      const Run &row = outline[b];
+      Blob &blob = blobs_[b];
+      const int endCount = row.xStart == row.xEnd ? 1 : 2;
+      for (int end = 0; end < endCount; ++end)
+      {
+        if (sampleCounter[b]++ % sampleStride[b] != 0 || blob.boundaryCount == Blob::MAX_BOUNDARY_SAMPLES)
+          continue;
+        blob.boundary[blob.boundaryCount++] = cv::Point(end == 0 ? row.xStart : row.xEnd, row.y);
+      }
+    };
+
+    // Gather the first and last pixel of every row of the kept blobs. Run ends inside a row border holes or bays,
+    // leaving them out keeps the samples on the outer contour, as findContours with RETR_EXTERNAL gave them.
+    // Runs are in scan order, so a blob's rows come one after the other.
+    for (int s = 0; s < stripeCount; ++s)
+    {
+      for (int32_t i = stripes_[s].runBegin; i < stripes_[s].runEnd; ++i)
+      {
+        if (component_[i] < 0)
+          continue;
+        const int b = components_[component_[i]].blobIndex;
+        if (b < 0)
+          continue;
+
+        const Run &run = runs_[i];
+        if (run.y != outline[b].y)
+        {
+          if (outline[b].y >= 0)
+            addOutlineSamples(b);
+          outline[b] = run;
+        }
+        else
+        {
+          outline[b].xEnd = run.xEnd;
+        }
+      }
+    }
+    for (int b = 0; b < candidateCount; ++b)
+    {
+      if (outline[b].y >= 0)
+        addOutlineSamples(b);
+    }
+
+    return blobCount_;
+  }
+}
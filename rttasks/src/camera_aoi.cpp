@@ -0,0 +1,110 @@
+#include "camera_aoi.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace CameraHelpers
+{
+  namespace
+  {
+    // Start of an AOI of the given size centered on center, aligned down and kept on the sensor
+    uint32_t CenteredOffset(float center, uint32_t size, uint32_t sensorSize)
+    {
+      const float start = std::clamp(center - size / 2.0f, 0.0f, static_cast<float>(sensorSize - size));
+      return static_cast<uint32_t>(start) / AOI_ALIGNMENT * AOI_ALIGNMENT;
+    }
+
+    void BlankRow(uint8_t *row, uint32_t pixels, PixelFormat format)
+    {
+      if (format == PixelFormat::BayerRG8)
+      {
+        std::memset(row, 0, pixels);
+        return;
+      }
+      for (uint32_t pair = 0; pair < pixels / 2; ++pair)
+        std::memcpy(row + pair * 4, AOI_BLANK_YUYV.data(), 4);
+    }
+  }
+
+  CameraAoi CenterAoi(int tier, float x, float y)
+  {
+    const AoiSize &size = AOI_TIERS[tier];
+    CameraAoi aoi;
+    aoi.width = size.width;
+    aoi.height = size.height;
+    aoi.offsetX = CenteredOffset(x, size.width, IMAGE_WIDTH);
+    aoi.offsetY = CenteredOffset(y, size.height, IMAGE_HEIGHT);
+    return aoi;
+  }
+
+  const CameraAoi &AoiTracker::Update(bool ballDetected, float x, float y, float radius)
+  {
+    if (!ballDetected)
+    {
+      tier_ = 0;
+      shrinkFrames_ = 0;
+      current_ = CameraAoi();
+      return current_;
+    }
+
+    // Smallest tier that holds the ball and the margin around it
+    const float needed = 2.0f * (radius + margin_);
+    int fitting = 0;
+    while (fitting + 1 < static_cast<int>(AOI_TIERS.size()) &&
+           AOI_TIERS[fitting + 1].width >= needed && AOI_TIERS[fitting + 1].height >= needed)
+      ++fitting;
+
+    // Grow at once, shrink one tier at a time once the ball has fit for a while, so a size change (which restarts
+    // grabbing) stays rare
+    if (fitting < tier_)
+    {
+      tier_ = fitting;
+      shrinkFrames_ = 0;
+    }
+    else if (fitting > tier_ && ++shrinkFrames_ >= AOI_SHRINK_FRAMES)
+    {
+      tier_++;
+      shrinkFrames_ = 0;
+    }
+    else if (fitting == tier_)
+    {
+      shrinkFrames_ = 0;
+    }
+
+    current_ = CenterAoi(tier_, x, y);
+    return current_;
+  }
+
+  void ExpandAoiFrame(uint8_t *frame, const uint8_t *aoiFrame, const CameraAoi &aoi, PixelFormat format)
+  {
+    if (aoi == CameraAoi())
+    {
+      std::memcpy(frame, aoiFrame, FrameBytes(format));
+      return;
+    }
+
+    const uint32_t bytesPerPixel = BytesPerPixel(format);
+    const size_t aoiRowBytes = aoi.width * bytesPerPixel;
+    for (uint32_t y = 0; y < IMAGE_HEIGHT; ++y)
+    {
+      uint8_t *row = frame + y * IMAGE_WIDTH * bytesPerPixel;
+      if (y < aoi.offsetY || y >= aoi.offsetY + aoi.height)
+      {
+        BlankRow(row, IMAGE_WIDTH, format);
+        continue;
+      }
+      BlankRow(row, aoi.offsetX, format);
+      std::memcpy(row + aoi.offsetX * bytesPerPixel, aoiFrame + (y - aoi.offsetY) * aoiRowBytes, aoiRowBytes);
+      BlankRow(row + (aoi.offsetX + aoi.width) * bytesPerPixel, IMAGE_WIDTH - aoi.offsetX - aoi.width, format);
+    }
+  }
+
+  void CropToAoi(uint8_t *frame, const CameraAoi &aoi, PixelFormat format)
+  {
+    // Every row moves to or before where it was, so the rows still to move are never overwritten
+    const uint32_t bytesPerPixel = BytesPerPixel(format);
+    const size_t aoiRowBytes = aoi.width * bytesPerPixel;
+    for (uint32_t row = 0; row < aoi.height; ++row)
+      std::memmove(frame + row * aoiRowBytes, frame + ((aoi.offsetY + row) * IMAGE_WIDTH + aoi.offsetX) * bytesPerPixel, aoiRowBytes);
+  }
+}
@@ -1,4 +1,5 @@
 #include "camera_helpers.h"
+#include "camera_aoi.h"
 #include <pylon/BaslerUniversalInstantCamera.h>
 #include <pylon/PylonIncludes.h>
 #include <stdexcept>
@@ -10,6 +11,26 @@ using namespace GenApi;
 // ----------- Implementation -----------
 namespace CameraHelpers {
 
+  namespace
+  {
+    // Writes the offset and size of one axis in the order that keeps offset + size on the sensor in between
+    void WriteAoiAxis(INodeMap &nodeMap, const char *offsetNode, const char *sizeNode, uint32_t oldSize, uint32_t offset, uint32_t size)
+    {
+      CIntegerParameter offsetParameter(nodeMap, offsetNode);
+      CIntegerParameter sizeParameter(nodeMap, sizeNode);
+      if (size > oldSize)
+      {
+        offsetParameter.SetValue(offset);
+        sizeParameter.SetValue(size);
+      }
+      else
+      {
+        sizeParameter.SetValue(size);
+        offsetParameter.SetValue(offset);
+      }
+    }
+  }
+
   void ConfigureCamera(CInstantCamera &camera)
   {
     try
@@ -34,6 +55,22 @@ namespace CameraHelpers {
     }
   }
 
+  void SetPixelFormat(CInstantCamera &camera, PixelFormat format)
+  {
+    const char *const name = format == PixelFormat::BayerRG8 ? "BayerRG8" : "YUV422_YUYV_Packed";
+    try
+    {
+      CEnumParameter pixelFormat(camera.GetNodeMap(), "PixelFormat");
+      if (!pixelFormat.CanSetValue(name))
+        throw std::runtime_error(std::string("[CameraHelpers] The camera has no pixel format ") + name + ".");
+      pixelFormat.SetValue(name);
+    }
+    catch (const GenericException &e)
+    {
+      throw std::runtime_error(std::string("[CameraHelpers] Pylon exception while setting the pixel format: ") + e.GetDescription());
+    }
+  }
+
   bool TryGrabFrame(CInstantCamera &camera, CGrabResultPtr &grabResult, unsigned int timeoutMs)
   {
     try
@@ -95,4 +132,75 @@ namespace CameraHelpers {
     }
     throw std::runtime_error("[CameraHelpers] Failed to grab a frame during priming after " + std::to_string(maxRetries) + " retries.");
   }
-} // namespace CameraHelpers
\ No newline at end of file
+
+  bool TryLatchTimestamp(CInstantCamera &camera, int64_t &timestampTicks, double &tickFrequencyHz)
+  {
+    try
+    {
+      INodeMap &nodeMap = camera.GetNodeMap();
+
+      // USB3 Vision cameras count nanoseconds, GigE cameras report their tick frequency
+      CCommandParameter latch(nodeMap, "TimestampLatch");
+      if (latch.IsWritable())
+      {
+        latch.Execute();
+        timestampTicks = CIntegerParameter(nodeMap, "TimestampLatchValue").GetValue();
+        tickFrequencyHz = 1e9;
+        return true;
+      }
+
+      CCommandParameter gevLatch(nodeMap, "GevTimestampControlLatch");
+      if (gevLatch.IsWritable())
+      {
+        gevLatch.Execute();
+        timestampTicks = CIntegerParameter(nodeMap, "GevTimestampValue").GetValue();
+        tickFrequencyHz = static_cast<double>(CIntegerParameter(nodeMap, "GevTimestampTickFrequency").GetValue());
+        return tickFrequencyHz > 0.0;
+      }
+    }
+    catch (const GenericException &)
+    {
+      // Timestamps are optional, the frame traces just lack the exposure stage
+    }
+    return false;
+  }
+
+  void ApplyAoi(CInstantCamera &camera, CameraAoi &applied, const CameraAoi &aoi)
+  {
+    if (aoi == applied)
+      return;
+
+    bool restart = false;
+    try
+    {
+      INodeMap &nodeMap = camera.GetNodeMap();
+      const bool resize = aoi.width != applied.width || aoi.height != applied.height;
+      const bool offsetsWritable = CIntegerParameter(nodeMap, "OffsetX").IsWritable() && CIntegerParameter(nodeMap, "OffsetY").IsWritable();
+      restart = camera.IsGrabbing() && (resize || !offsetsWritable);
+
+      if (restart)
+        camera.StopGrabbing();
+      WriteAoiAxis(nodeMap, "OffsetX", "Width", applied.width, aoi.offsetX, aoi.width);
+      WriteAoiAxis(nodeMap, "OffsetY", "Height", applied.height, aoi.offsetY, aoi.height);
+      applied = aoi;
+      if (restart)
+        camera.StartGrabbing(GrabStrategy_LatestImageOnly);
+    }
+    catch (const GenericException &e)
+    {
+      // Unknown after a failed write, so the next call writes every node. Grabbing must not stay stopped either.
+      applied = CameraAoi{0, 0, 0, 0};
+      const std::string message = std::string("[CameraHelpers] Pylon exception while setting the AOI: ") + e.GetDescription();
+      try
+      {
+        if (restart && !camera.IsGrabbing())
+          camera.StartGrabbing(GrabStrategy_LatestImageOnly);
+      }
+      catch (const GenericException &)
+      {
+        // The grab after this reports the camera's state
+      }
+      throw std::runtime_error(message);
+    }
+  }
+} // namespace CameraHelpers
@@ -0,0 +1,429 @@
+#include "camera_stream_server.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <future>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <grpcpp/grpcpp.h>
+#include <opencv2/opencv.hpp>
+
+#include "camera_streaming.grpc.pb.h"
+#include "image_kernels.h"
+#include "jpeg_encoder.h"
+#include "thread_helpers.h"
+
+namespace PreviewHelpers
+{
+  namespace
+  {
+    using rsi::camera::CameraFrame;
+    using rsi::camera::ImageFormat;
+
+    constexpr auto FRAME_POLL_INTERVAL = std::chrono::milliseconds(2); // How often the frame storage is checked
+    constexpr auto CANCEL_CHECK_INTERVAL = std::chrono::milliseconds(100); // Longest a stream waits before checking its client
+    constexpr auto SHUTDOWN_DEADLINE = std::chrono::seconds(1); // Calls still running then are cancelled
+    constexpr size_t MAX_JPEG_ENCODERS = 8; // Idle JPEG encoders kept, one more starts over
+    constexpr int PNG_COMPRESSION = 1; // zlib level, PNG is lossless and the fastest level keeps up with the camera
+
+    // What requests share: the image format, and the quality for JPEG (0 for the other formats)
+    struct EncodingKey
+    {
+      ImageFormat format;
+      int quality;
+
+      auto operator<=>(const EncodingKey &) const = default;
+    };
+
+    // A frame copied out of the storage, so the reader lets go of its slot at once and calls encode it without the lock
+    struct Snapshot
+    {
+      Frame frame;
+      std::once_flag demosaicOnce;
+      std::unique_ptr<uint8_t[]> demosaiced; // YUYV of a BayerRG8 frame
+
+      // Every format starts from YUYV, a BayerRG8 frame is demosaiced once for all of them
+      const uint8_t *Yuyv()
+      {
+        if (frame.info.pixelFormat != static_cast<int>(CameraHelpers::PixelFormat::BayerRG8))
+          return frame.imageData;
+        std::call_once(demosaicOnce, [this]
+                       {
+                         demosaiced = std::make_unique_for_overwrite<uint8_t[]>(CameraHelpers::IMAGE_SIZE_YUYV);
+                         ImageProcessing::Kernels::BayerToYUYV(frame.imageData, demosaiced.get(),
+                                                               static_cast<int>(CameraHelpers::IMAGE_WIDTH),
+                                                               static_cast<int>(CameraHelpers::IMAGE_HEIGHT));
+                       });
+        return demosaiced.get();
+      }
+    };
+
+    using PendingEncoding = std::shared_future<std::shared_ptr<const CameraFrame>>;
+  }
+
+  struct CameraStreamServer::Server final : public rsi::camera::CameraStreamService::Service
+  {
+    Server(int maxClients, int jpegQuality, std::shared_ptr<FrameStorage> storage, StreamStatsProvider stats)
+        : maxClients(maxClients), jpegQuality(jpegQuality), stats(std::move(stats)), reader(std::move(storage))
+    {
+    }
+
+    // Builds the gRPC server, then takes frames from the storage until Stop
+    void Run(const std::string &address, std::promise<void> &started)
+    {
+      try
+      {
+        grpc::ServerBuilder builder;
+        builder.AddListeningPort(address, grpc::InsecureServerCredentials(), &port);
+        builder.AddChannelArgument(GRPC_ARG_ALLOW_REUSEPORT, 0); // A port in use is an error, not shared
+        builder.RegisterService(this);
+        grpcServer = builder.BuildAndStart();
+        if (!grpcServer || port == 0)
+          throw std::runtime_error("[PreviewHelpers] Failed to start the camera stream server on " + address);
+        started.set_value();
+      }
+      catch (...)
+      {
+        started.set_exception(std::current_exception());
+        return;
+      }
+
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (!stopping)
+        {
+          // The copy is made without the lock, calls only wait for the new frame to be swapped in
+          lock.unlock();
+          std::shared_ptr<Snapshot> taken;
+          if (reader.acquire())
+          {
+            taken = std::make_shared_for_overwrite<Snapshot>();
+            taken->frame = reader.data();
+            reader.release();
+          }
+          lock.lock();
+
+          if (taken)
+          {
+            current = std::move(taken);
+            ++sequence;
+            encodings.clear();
+            newFrame.notify_all();
+          }
+          newFrame.wait_for(lock, FRAME_POLL_INTERVAL, [this] { return stopping; });
+        }
+      }
+
+      grpcServer->Shutdown(std::chrono::system_clock::now() + SHUTDOWN_DEADLINE);
+      grpcServer.reset();
+    }
+
+    void Stop()
+    {
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+      }
+      newFrame.notify_all();
+    }
+
+    grpc::Status StreamCameraFrames(grpc::ServerContext *context, const rsi::camera::StreamRequest *request,
+                                    grpc::ServerWriter<CameraFrame> *writer) override
+    {
+      EncodingKey key;
+      grpc::Status status = ToKey(request->format(), request->compression_quality(), key);
+      if (!status.ok())
+        return status;
+      if (request->max_fps() < 0)
+        return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, "max_fps must not be negative");
+
+      if (clients.fetch_add(1, std::memory_order_relaxed) >= maxClients)
+      {
+        clients.fetch_sub(1, std::memory_order_relaxed);
+        return grpc::Status(grpc::StatusCode::RESOURCE_EXHAUSTED, "Too many camera streams");
+      }
+      status = Stream(context, key, request->max_fps(), writer);
+      clients.fetch_sub(1, std::memory_order_relaxed);
+      return status;
+    }
+
+    grpc::Status GetLatestFrame(grpc::ServerContext *, const rsi::camera::FrameRequest *request,
+                                CameraFrame *response) override
+    {
+      EncodingKey key;
+      grpc::Status status = ToKey(request->format(), request->compression_quality(), key);
+      if (!status.ok())
+        return status;
+
+      try
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (sequence == 0)
+          return grpc::Status(grpc::StatusCode::UNAVAILABLE, "No camera frame yet");
+        response->CopyFrom(*Encoding(lock, key));
+      }
+      catch (const std::exception &e)
+      {
+        return grpc::Status(grpc::StatusCode::INTERNAL, e.what());
+      }
+      sentFrames.fetch_add(1, std::memory_order_relaxed);
+      return grpc::Status::OK;
+    }
+
+    // Format FORMAT_UNKNOWN (the default of the field) is JPEG, quality 0 is jpegQuality
+    grpc::Status ToKey(ImageFormat format, int quality, EncodingKey &key) const
+    {
+      if (format == rsi::camera::FORMAT_UNKNOWN)
+        format = rsi::camera::FORMAT_JPEG;
+      if (!rsi::camera::ImageFormat_IsValid(format))
+        return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, "Unknown image format");
+      if (quality < 0 || quality > 100)
+        return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, "compression_quality must be between 0 and 100");
+
+      key.format = format;
+      key.quality = format == rsi::camera::FORMAT_JPEG ? (quality == 0 ? jpegQuality : quality) : 0;
+      return grpc::Status::OK;
+    }
+
+    // Writes the newest frame whenever there is one and maxFps allows, until the client or the server goes away
+    grpc::Status Stream(grpc::ServerContext *context, const EncodingKey &key, int maxFps,
+                        grpc::ServerWriter<CameraFrame> *writer)
+    {
+      const auto interval = maxFps > 0 ? std::chrono::nanoseconds(1'000'000'000 / maxFps) : std::chrono::nanoseconds(0);
+      auto nextWrite = std::chrono::steady_clock::now();
+      uint64_t written = 0; // Sequence of the last frame written
+
+      while (!context->IsCancelled())
+      {
+        std::shared_ptr<const CameraFrame> frame;
+        try
+        {
+          std::unique_lock<std::mutex> lock(mutex);
+          newFrame.wait_until(lock, nextWrite, [this] { return stopping; });
+          newFrame.wait_for(lock, CANCEL_CHECK_INTERVAL, [this, written] { return stopping || sequence > written; });
+          if (stopping)
+            break;
+          if (sequence == written)
+            continue;
+          written = sequence;
+          frame = Encoding(lock, key);
+        }
+        catch (const std::exception &e)
+        {
+          return grpc::Status(grpc::StatusCode::INTERNAL, e.what());
+        }
+
+        if (!writer->Write(*frame))
+          return grpc::Status::OK; // The client is gone
+        sentFrames.fetch_add(1, std::memory_order_relaxed);
+
+        // Keep to the rate without letting a slow client save up frames to burst later
+        nextWrite = std::max(nextWrite + interval, std::chrono::steady_clock::now());
+      }
+      return stopping ? grpc::Status(grpc::StatusCode::UNAVAILABLE, "Camera stream server stopping") : grpc::Status::OK;
+    }
+
+    // The current frame in the key's encoding. The first call that asks for it encodes it, the others wait for that
+    // encoding. Called with lock held, which is let go of for encoding or waiting and not taken again, so frame intake
+    // and the calls for other encodings go on meanwhile. Throws std::runtime_error if encoding fails.
+    std::shared_ptr<const CameraFrame> Encoding(std::unique_lock<std::mutex> &lock, const EncodingKey &key)
+    {
+      auto found = encodings.find(key);
+      if (found != encodings.end())
+      {
+        const PendingEncoding pending = found->second;
+        lock.unlock();
+        return pending.get();
+      }
+
+      std::promise<std::shared_ptr<const CameraFrame>> promise;
+      encodings.emplace(key, promise.get_future().share());
+      const std::shared_ptr<Snapshot> snapshot = current;
+      lock.unlock();
+      try
+      {
+        std::shared_ptr<const CameraFrame> encoded = Encode(*snapshot, key);
+        promise.set_value(encoded);
+        return encoded;
+      }
+      catch (...)
+      {
+        promise.set_exception(std::current_exception());
+        throw;
+      }
+    }
+
+    std::shared_ptr<const CameraFrame> Encode(Snapshot &snapshot, const EncodingKey &key)
+    {
+      const FrameInfo &info = snapshot.frame.info;
+      auto encoded = std::make_shared<CameraFrame>();
+      encoded->set_timestamp_us(static_cast<int64_t>(info.timestamp));
+      encoded->set_frame_number(info.frameNumber);
+      encoded->set_width(static_cast<int32_t>(CameraHelpers::IMAGE_WIDTH));
+      encoded->set_height(static_cast<int32_t>(CameraHelpers::IMAGE_HEIGHT));
+      encoded->set_format(key.format);
+      EncodeImage(snapshot.Yuyv(), key, *encoded->mutable_image_data());
+
+      rsi::camera::BallDetection *ball = encoded->mutable_ball_detection();
+      ball->set_detected(info.ballDetected);
+      ball->set_center_x(info.centerX);
+      ball->set_center_y(info.centerY);
+      ball->set_radius(info.radius);
+      ball->set_confidence(info.ballDetected ? 1.0 : 0.0); // The detection has no score, a found circle passed its fit
+
+      if (stats)
+      {
+        const StreamFrameStats frameStats = stats(info);
+        rsi::camera::ProcessingStats *processing = encoded->mutable_stats();
+        processing->set_grab_time_ms(frameStats.grabTimeMs);
+        processing->set_process_time_ms(frameStats.processTimeMs);
+        processing->set_grab_failures(frameStats.grabFailures);
+        processing->set_detection_failures(frameStats.detectionFailures);
+      }
+
+      encodedFrames.fetch_add(1, std::memory_order_relaxed);
+      return encoded;
+    }
+
+    void EncodeImage(const uint8_t *yuyv, const EncodingKey &key, std::string &image)
+    {
+      constexpr int width = static_cast<int>(CameraHelpers::IMAGE_WIDTH);
+      constexpr int height = static_cast<int>(CameraHelpers::IMAGE_HEIGHT);
+
+      switch (key.format)
+      {
+      case rsi::camera::FORMAT_YUYV:
+        image.assign(reinterpret_cast<const char *>(yuyv), CameraHelpers::IMAGE_SIZE_YUYV);
+        break;
+      case rsi::camera::FORMAT_GRAYSCALE:
+        image.resize(static_cast<size_t>(width) * height);
+        for (size_t i = 0; i < image.size(); ++i)
+          image[i] = static_cast<char>(yuyv[2 * i]);
+        break;
+      case rsi::camera::FORMAT_RGB:
+      {
+        image.resize(static_cast<size_t>(width) * height * 3);
+        cv::Mat rgb(height, width, CV_8UC3, image.data());
+        cv::cvtColor(cv::Mat(height, width, CV_8UC2, const_cast<uint8_t *>(yuyv)), rgb, cv::COLOR_YUV2RGB_YUYV);
+        break;
+      }
+      case rsi::camera::FORMAT_PNG:
+      {
+        cv::Mat bgr;
+        cv::cvtColor(cv::Mat(height, width, CV_8UC2, const_cast<uint8_t *>(yuyv)), bgr, cv::COLOR_YUV2BGR_YUYV);
+        std::vector<uchar> png;
+        if (!cv::imencode(".png", bgr, png, {cv::IMWRITE_PNG_COMPRESSION, PNG_COMPRESSION}))
+          throw std::runtime_error("[PreviewHelpers] Failed to encode a PNG camera frame.");
+        image.assign(png.begin(), png.end());
+        break;
+      }
+      default:
+      {
+        // Encodings of different frames can run at once, so each takes an encoder of its own
+        std::unique_ptr<JpegEncoder> encoder = TakeJpegEncoder(key.quality);
+        const size_t size = encoder->Encode(yuyv);
+        if (size == 0)
+          throw std::runtime_error("[PreviewHelpers] JPEG camera frame did not fit the encoder.");
+        image.assign(reinterpret_cast<const char *>(encoder->Data()), size);
+        ReturnJpegEncoder(key.quality, std::move(encoder));
+        break;
+      }
+      }
+    }
+
+    std::unique_ptr<JpegEncoder> TakeJpegEncoder(int quality)
+    {
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto found = idleJpegEncoders.find(quality);
+        if (found != idleJpegEncoders.end())
+        {
+          std::unique_ptr<JpegEncoder> encoder = std::move(found->second);
+          idleJpegEncoders.erase(found);
+          return encoder;
+        }
+      }
+      return std::make_unique<JpegEncoder>(quality, false);
+    }
+
+    void ReturnJpegEncoder(int quality, std::unique_ptr<JpegEncoder> encoder)
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (idleJpegEncoders.size() >= MAX_JPEG_ENCODERS)
+        idleJpegEncoders.clear();
+      idleJpegEncoders.emplace(quality, std::move(encoder));
+    }
+
+    const int maxClients;
+    const int jpegQuality;
+    const StreamStatsProvider stats;
+
+    SharedDataHelpers::SPMCStorageReader<std::shared_ptr<FrameStorage>> reader; // Only used on thread
+
+    std::mutex mutex; // Guards everything up to idleJpegEncoders, never held while a frame is copied or encoded
+    std::condition_variable newFrame; // Also signals stopping
+    std::shared_ptr<Snapshot> current; // Frame sequence
+    uint64_t sequence = 0; // Frames taken from the storage
+    bool stopping = false;
+    std::map<EncodingKey, PendingEncoding> encodings; // Of frame sequence, done or under way, shared with the calls
+    std::multimap<int, std::unique_ptr<JpegEncoder>> idleJpegEncoders; // By quality
+
+    std::atomic<int> clients{0};
+    std::atomic<uint64_t> encodedFrames{0};
+    std::atomic<uint64_t> sentFrames{0};
+
+    std::unique_ptr<grpc::Server> grpcServer; // Only used on thread
+    int port = 0;
+    std::thread thread;
+  };
+
+  CameraStreamServer::CameraStreamServer(const std::string &address, int maxClients, int jpegQuality,
+                                         std::shared_ptr<FrameStorage> storage, StreamStatsProvider stats)
+  {
+    if (maxClients < 1)
+      throw std::runtime_error("[PreviewHelpers] The camera stream server needs room for at least one client.");
+    if (!storage)
+      throw std::runtime_error("[PreviewHelpers] The camera stream server reads the frame storage of the copy handoff.");
+    if (jpegQuality < 1 || jpegQuality > 100)
+      throw std::runtime_error("[PreviewHelpers] JPEG quality must be between 1 and 100.");
+
+    server_ = std::make_unique<Server>(maxClients, jpegQuality, std::move(storage), std::move(stats));
+
+    // Created from an RT task, so moved off its cores. Threads gRPC starts inherit this.
+    const cpu_set_t rtCores = ThreadHelpers::CurrentCores();
+    std::promise<void> started;
+    std::future<void> startedFuture = started.get_future();
+    server_->thread = std::thread([this, address, rtCores, started = std::move(started)]() mutable
+                                  {
+                                    ThreadHelpers::MoveToBackground(rtCores);
+                                    server_->Run(address, started);
+                                  });
+    try
+    {
+      startedFuture.get();
+    }
+    catch (...)
+    {
+      server_->thread.join();
+      throw;
+    }
+  }
+
+  CameraStreamServer::~CameraStreamServer()
+  {
+    server_->Stop();
+    server_->thread.join();
+  }
+
+  int CameraStreamServer::Port() const { return server_->port; }
+  int CameraStreamServer::Clients() const { return server_->clients.load(std::memory_order_relaxed); }
+  uint64_t CameraStreamServer::EncodedFrames() const { return server_->encodedFrames.load(std::memory_order_relaxed); }
+  uint64_t CameraStreamServer::SentFrames() const { return server_->sentFrames.load(std::memory_order_relaxed); }
+}
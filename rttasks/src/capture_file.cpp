@@ -0,0 +1,250 @@
+#include "capture_file.h"
+
+#include <algorithm>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace RecordingHelpers
+{
+  namespace
+  {
+    uint64_t RoundUpToPage(uint64_t size)
+    {
+      static const uint64_t pageSize = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+      return (size + pageSize - 1) / pageSize * pageSize;
+    }
+
+    // Layout of a file with slotCount slots, returns the total size
+    uint64_t FileSize(uint64_t slotCount, uint64_t &slotSize, uint64_t &indexOffset, uint64_t &dataOffset)
+    {
+      slotSize = RoundUpToPage(sizeof(Frame));
+      indexOffset = RoundUpToPage(sizeof(CaptureHeader));
+      dataOffset = indexOffset + RoundUpToPage(slotCount * sizeof(CaptureIndexEntry));
+      return dataOffset + slotCount * slotSize;
+    }
+  }
+
+  // ----------- CaptureFileWriter -----------
+
+  CaptureFileWriter::CaptureFileWriter(const std::string &path, uint64_t slotCount)
+  {
+    if (slotCount == 0)
+      throw std::runtime_error("[RecordingHelpers] A capture file needs at least one slot: " + path);
+
+    uint64_t slotSize = 0, indexOffset = 0, dataOffset = 0;
+    const uint64_t fileSize = FileSize(slotCount, slotSize, indexOffset, dataOffset);
+
+    int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+      throw std::runtime_error("[RecordingHelpers] Failed to create capture file: " + path);
+
+    // Reserve the blocks up front so a full disk shows up here and not as SIGBUS on a later write
+    if (posix_fallocate(fd, 0, static_cast<off_t>(fileSize)) != 0)
+    {
+      close(fd);
+      throw std::runtime_error("[RecordingHelpers] Failed to preallocate " + std::to_string(fileSize) + " bytes for capture file: " + path);
+    }
+
+    void *mapping = mmap(nullptr, fileSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED)
+      throw std::runtime_error("[RecordingHelpers] Failed to map capture file: " + path);
+
+    mapping_ = static_cast<uint8_t *>(mapping);
+    mappingSize_ = fileSize;
+
+    // The preallocated file reads as zeros, so every index entry starts out empty
+    header_ = new (mapping_) CaptureHeader{};
+    header_->version = CAPTURE_VERSION;
+    header_->recordSize = sizeof(Frame);
+    header_->imageWidth = CameraHelpers::IMAGE_WIDTH;
+    header_->imageHeight = CameraHelpers::IMAGE_HEIGHT;
+    header_->slotCount = slotCount;
+    header_->slotSize = slotSize;
+    header_->indexOffset = indexOffset;
+    header_->dataOffset = dataOffset;
+    std::memcpy(header_->magic, CAPTURE_MAGIC, sizeof(CAPTURE_MAGIC)); // Last, so a half-written header is not recognized
+  }
+
+  CaptureFileWriter::~CaptureFileWriter()
+  {
+    if (mapping_ == nullptr)
+      return;
+    Sync();
+    munmap(mapping_, mappingSize_);
+  }
+
+  CaptureIndexEntry &CaptureFileWriter::Entry(uint64_t slot) const
+  {
+    return reinterpret_cast<CaptureIndexEntry *>(mapping_ + header_->indexOffset)[slot];
+  }
+
+  void CaptureFileWriter::Append(const Frame &frame)
+  {
+    const uint64_t sequence = header_->appendCount.load(std::memory_order_relaxed) + 1;
+    const uint64_t slot = (sequence - 1) % header_->slotCount;
+    const uint64_t offset = header_->dataOffset + slot * header_->slotSize;
+
+    // Mark the slot as being written, so a reader of a live file can tell a torn frame
+    CaptureIndexEntry &entry = Entry(slot);
+    entry.sequence.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    std::memcpy(mapping_ + offset, &frame, sizeof(Frame));
+    entry.frameNumber = frame.info.frameNumber;
+    entry.timestampUs = static_cast<int64_t>(frame.info.timestamp);
+    entry.offset = offset;
+
+    entry.sequence.store(sequence, std::memory_order_release);
+    header_->appendCount.store(sequence, std::memory_order_release);
+  }
+
+  const Frame *CaptureFileWriter::FrameBySequence(uint64_t sequence) const
+  {
+    if (sequence == 0 || sequence > AppendCount())
+      return nullptr;
+
+    const uint64_t slot = (sequence - 1) % header_->slotCount;
+    if (Entry(slot).sequence.load(std::memory_order_acquire) != sequence)
+      return nullptr;
+    return reinterpret_cast<const Frame *>(mapping_ + header_->dataOffset + slot * header_->slotSize);
+  }
+
+  void CaptureFileWriter::Sync()
+  {
+    msync(mapping_, mappingSize_, MS_SYNC);
+  }
+
+  // ----------- CaptureFileReader -----------
+
+  CaptureFileReader::CaptureFileReader(const std::string &path)
+  {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+      throw std::runtime_error("[RecordingHelpers] Failed to open capture file: " + path);
+
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) != 0 || fileStat.st_size < static_cast<off_t>(sizeof(CaptureHeader)))
+    {
+      close(fd);
+      throw std::runtime_error("[RecordingHelpers] Not a capture file: " + path);
+    }
+
+    // Prefault the whole file, replay reads it from the RT task
+    mappingSize_ = static_cast<size_t>(fileStat.st_size);
+    void *mapping = mmap(nullptr, mappingSize_, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED)
+      throw std::runtime_error("[RecordingHelpers] Failed to map capture file: " + path);
+
+    mapping_ = static_cast<const uint8_t *>(mapping);
+    header_ = reinterpret_cast<const CaptureHeader *>(mapping_);
+
+    uint64_t slotSize = 0, indexOffset = 0, dataOffset = 0;
+    const bool valid = std::memcmp(header_->magic, CAPTURE_MAGIC, sizeof(CAPTURE_MAGIC)) == 0 &&
+                       (header_->version == 1 || header_->version == CAPTURE_VERSION) &&
+                       header_->recordSize == sizeof(Frame) &&
+                       header_->imageWidth == CameraHelpers::IMAGE_WIDTH &&
+                       header_->imageHeight == CameraHelpers::IMAGE_HEIGHT &&
+                       header_->slotCount > 0 &&
+                       FileSize(header_->slotCount, slotSize, indexOffset, dataOffset) <= mappingSize_ &&
+                       header_->slotSize == slotSize && header_->indexOffset == indexOffset && header_->dataOffset == dataOffset;
+    if (!valid)
+    {
+      munmap(const_cast<uint8_t *>(mapping_), mappingSize_);
+      mapping_ = nullptr;
+      throw std::runtime_error("[RecordingHelpers] Capture file has an unsupported or corrupt header: " + path);
+    }
+
+    const uint64_t appendCount = header_->appendCount.load(std::memory_order_acquire);
+    frameCount_ = static_cast<size_t>(std::min(appendCount, header_->slotCount));
+    firstSlot_ = appendCount > header_->slotCount ? appendCount % header_->slotCount : 0;
+
+    // Version 1 left the field as padding
+    if (header_->version >= 2 && frameCount_ > 0)
+    {
+      const int format = FrameAt(0).info.pixelFormat;
+      bool uniform = format == static_cast<int>(CameraHelpers::PixelFormat::YUYV) ||
+                     format == static_cast<int>(CameraHelpers::PixelFormat::BayerRG8);
+      for (size_t i = 1; uniform && i < frameCount_; ++i)
+        uniform = FrameAt(i).info.pixelFormat == format;
+      if (!uniform)
+      {
+        munmap(const_cast<uint8_t *>(mapping_), mappingSize_);
+        mapping_ = nullptr;
+        throw std::runtime_error("[RecordingHelpers] Capture file holds an unknown pixel format or mixes formats: " + path);
+      }
+      format_ = static_cast<CameraHelpers::PixelFormat>(format);
+    }
+  }
+
+  CaptureFileReader::~CaptureFileReader()
+  {
+    if (mapping_ != nullptr)
+      munmap(const_cast<uint8_t *>(mapping_), mappingSize_);
+  }
+
+  bool CaptureFileReader::IsCaptureFile(const std::string &path)
+  {
+    char magic[sizeof(CAPTURE_MAGIC)] = {};
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+      return false;
+    const bool matches = read(fd, magic, sizeof(magic)) == static_cast<ssize_t>(sizeof(magic)) &&
+                         std::memcmp(magic, CAPTURE_MAGIC, sizeof(magic)) == 0;
+    close(fd);
+    return matches;
+  }
+
+  const CaptureIndexEntry &CaptureFileReader::Entry(size_t index) const
+  {
+    const uint64_t slot = (firstSlot_ + index) % header_->slotCount;
+    return reinterpret_cast<const CaptureIndexEntry *>(mapping_ + header_->indexOffset)[slot];
+  }
+
+  const Frame &CaptureFileReader::FrameAt(size_t index) const
+  {
+    const uint64_t slot = (firstSlot_ + index) % header_->slotCount;
+    return *reinterpret_cast<const Frame *>(mapping_ + header_->dataOffset + slot * header_->slotSize);
+  }
+
+  size_t CaptureFileReader::FindTimestamp(int64_t timestampUs) const
+  {
+    size_t first = 0, count = frameCount_;
+    while (count > 0)
+    {
+      const size_t half = count / 2;
+      if (TimestampAt(first + half) < timestampUs)
+      {
+        first += half + 1;
+        count -= half + 1;
+      }
+      else
+        count = half;
+    }
+    return first;
+  }
+
+  size_t CaptureFileReader::FindFrameNumber(int64_t frameNumber) const
+  {
+    size_t first = 0, count = frameCount_;
+    while (count > 0)
+    {
+      const size_t half = count / 2;
+      if (FrameNumberAt(first + half) < frameNumber)
+      {
+        first += half + 1;
+        count -= half + 1;
+      }
+      else
+        count = half;
+    }
+    return first;
+  }
+}
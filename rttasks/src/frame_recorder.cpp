@@ -0,0 +1,174 @@
+#include "frame_recorder.h"
+
+#include <chrono>
+#include <iostream>
+#include <stdexcept>
+
+#include <sys/mman.h>
+
+#include "settings_helpers.h"
+#include "thread_helpers.h"
+
+namespace RecordingHelpers
+{
+  namespace
+  {
+    constexpr auto IDLE_WAIT = std::chrono::milliseconds(5);
+    constexpr uint64_t DRAIN_INTERVAL_FRAMES = 8; // How often a trigger file copy stops to drain the staging ring
+
+  }
+
+  RecorderSettings LoadRecorderSettings(const char *path)
+  {
+    RecorderSettings settings;
+
+    for (const SettingsHelpers::Setting &setting : SettingsHelpers::ReadSettingsFile(path))
+    {
+      if (setting.key == "enabled")
+        settings.enabled = SettingsHelpers::ParseBool(setting);
+      else if (setting.key == "ring_file")
+        settings.ringFile = setting.value;
+      else if (setting.key == "ring_frames")
+        settings.ringFrames = static_cast<uint64_t>(SettingsHelpers::ParseNumber(setting));
+      else if (setting.key == "trigger")
+        settings.trigger = SettingsHelpers::ParseBool(setting);
+      else if (setting.key == "trigger_seconds")
+        settings.triggerSeconds = SettingsHelpers::ParseNumber(setting);
+      else if (setting.key == "trigger_directory")
+        settings.triggerDirectory = setting.value;
+      else
+        throw std::runtime_error("[RecordingHelpers] Unknown recorder setting: " + setting.key);
+    }
+
+    if (settings.ringFrames == 0)
+      throw std::runtime_error("[RecordingHelpers] ring_frames must be at least 1.");
+    if (settings.triggerSeconds <= 0.0)
+      throw std::runtime_error("[RecordingHelpers] trigger_seconds must be positive.");
+
+    return settings;
+  }
+
+  FrameRecorder::FrameRecorder(const RecorderSettings &settings)
+      : settings_(settings),
+        ring_(settings.ringFile, settings.ringFrames),
+        staging_(std::make_unique<Frame[]>(STAGING_SLOTS)) // Zeroed, so every page is already touched
+  {
+    // Keep the staging ring resident so Append never faults. Best effort, it needs a large enough RLIMIT_MEMLOCK.
+    mlock(staging_.get(), STAGING_SLOTS * sizeof(Frame));
+
+    // Created from an RT task, so moved off its cores
+    const cpu_set_t rtCores = ThreadHelpers::CurrentCores();
+    thread_ = std::thread([this, rtCores]()
+                          {
+                            ThreadHelpers::MoveToBackground(rtCores);
+                            Run();
+                          });
+  }
+
+  FrameRecorder::~FrameRecorder()
+  {
+    stop_.store(true, std::memory_order_release);
+    if (thread_.joinable())
+      thread_.join();
+    munlock(staging_.get(), STAGING_SLOTS * sizeof(Frame));
+  }
+
+  void FrameRecorder::Append(const FrameInfo &info, const uint8_t *image, const CameraHelpers::CameraAoi &aoi)
+  {
+    const uint64_t head = stagedHead_.load(std::memory_order_relaxed);
+    if (head - stagedTail_.load(std::memory_order_acquire) == STAGING_SLOTS)
+    {
+      droppedFrames_.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+
+    Frame &staged = staging_[head % STAGING_SLOTS];
+    CameraHelpers::ExpandAoiFrame(staged.imageData, image, aoi, static_cast<CameraHelpers::PixelFormat>(info.pixelFormat));
+    staged.info = info;
+    stagedHead_.store(head + 1, std::memory_order_release);
+
+    // Staged frames go to the ring in order, so the staging count is also the frame's append number in the ring
+    if (settings_.trigger)
+    {
+      if (lastBallDetected_ && !info.ballDetected)
+        lossSequence_.store(head + 1, std::memory_order_release);
+      lastBallDetected_ = info.ballDetected;
+    }
+  }
+
+  bool FrameRecorder::Drain()
+  {
+    uint64_t tail = stagedTail_.load(std::memory_order_relaxed);
+    const uint64_t head = stagedHead_.load(std::memory_order_acquire);
+    if (tail == head)
+      return false;
+
+    for (; tail != head; ++tail)
+    {
+      ring_.Append(staging_[tail % STAGING_SLOTS]);
+      stagedTail_.store(tail + 1, std::memory_order_release);
+    }
+    return true;
+  }
+
+  void FrameRecorder::Run()
+  {
+    while (!stop_.load(std::memory_order_acquire))
+    {
+      const bool drained = Drain();
+
+      uint64_t lossSequence = lossSequence_.load(std::memory_order_acquire);
+      if (lossSequence != 0 && lossSequence <= ring_.AppendCount())
+      {
+        lossSequence_.compare_exchange_strong(lossSequence, 0, std::memory_order_acq_rel);
+        SaveTriggerFile(lossSequence);
+      }
+
+      if (!drained)
+        std::this_thread::sleep_for(IDLE_WAIT);
+    }
+    Drain();
+  }
+
+  void FrameRecorder::SaveTriggerFile(uint64_t lossSequence)
+  {
+    const Frame *lossFrame = ring_.FrameBySequence(lossSequence);
+    if (lossFrame == nullptr)
+      return;
+
+    // One file per triggerSeconds at most, a flickering detection would otherwise save the same frames over and over
+    const int64_t windowUs = static_cast<int64_t>(settings_.triggerSeconds * 1e6);
+    const int64_t lossTimestampUs = static_cast<int64_t>(lossFrame->info.timestamp);
+    if (lastTriggerTimestampUs_ != 0 && lossTimestampUs - lastTriggerTimestampUs_ < windowUs)
+      return;
+    lastTriggerTimestampUs_ = lossTimestampUs;
+
+    uint64_t firstSequence = lossSequence;
+    while (firstSequence > 1)
+    {
+      const Frame *frame = ring_.FrameBySequence(firstSequence - 1);
+      if (frame == nullptr || static_cast<int64_t>(frame->info.timestamp) < lossTimestampUs - windowUs)
+        break;
+      --firstSequence;
+    }
+
+    const std::string path = settings_.triggerDirectory + "/loss-" + std::to_string(lossFrame->info.frameNumber) + ".ldcap";
+    try
+    {
+      CaptureFileWriter triggerFile(path, lossSequence - firstSequence + 1);
+      for (uint64_t sequence = firstSequence; sequence <= lossSequence; ++sequence)
+      {
+        // Keep the staging ring moving during a long copy. Frames overwritten in the ring meanwhile are skipped.
+        if ((sequence - firstSequence) % DRAIN_INTERVAL_FRAMES == 0)
+          Drain();
+
+        if (const Frame *frame = ring_.FrameBySequence(sequence))
+          triggerFile.Append(*frame);
+      }
+    }
+    catch (const std::exception &e)
+    {
+      std::cerr << "[RecordingHelpers] Failed to save trigger file: " << e.what() << std::endl;
+    }
+  }
+}
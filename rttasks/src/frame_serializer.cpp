@@ -0,0 +1,242 @@
+#include "frame_serializer.h"
+
+#include <charconv>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+namespace PreviewHelpers
+{
+  namespace
+  {
+    constexpr char BASE64_CHARS[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  }
+
+  size_t EncodeBase64Scalar(const uint8_t *data, size_t size, char *out)
+  {
+    char *start = out;
+
+    size_t i = 0;
+    for (; i + 3 <= size; i += 3, out += 4)
+    {
+      const uint32_t group = (uint32_t(data[i]) << 16) | (uint32_t(data[i + 1]) << 8) | data[i + 2];
+      out[0] = BASE64_CHARS[group >> 18];
+      out[1] = BASE64_CHARS[(group >> 12) & 0x3F];
+      out[2] = BASE64_CHARS[(group >> 6) & 0x3F];
+      out[3] = BASE64_CHARS[group & 0x3F];
+    }
+
+    // One or two bytes left, padded with '='
+    if (i < size)
+    {
+      const uint32_t group = (uint32_t(data[i]) << 16) | (i + 1 < size ? uint32_t(data[i + 1]) << 8 : 0);
+      out[0] = BASE64_CHARS[group >> 18];
+      out[1] = BASE64_CHARS[(group >> 12) & 0x3F];
+      out[2] = i + 1 < size ? BASE64_CHARS[(group >> 6) & 0x3F] : '=';
+      out[3] = '=';
+      out += 4;
+    }
+
+    return static_cast<size_t>(out - start);
+  }
+
+#if defined(__x86_64__) || defined(__i386__)
+  // Wojciech Muła's vectorized base64: every 32-bit lane takes 3 input bytes, which are split into four 6-bit indices
+  // with multiplies instead of variable shifts. The indices become ASCII by adding an offset looked up per range
+  // (A-Z, a-z, 0-9, '+', '/').
+  namespace
+  {
+    __attribute__((target("ssse3")))
+    inline __m128i SplitIndices(__m128i in)
+    {
+      // Bytes b0 b1 b2 of each group go to a lane as b1 b0 b2 b1, so every index sits within one 16-bit half
+      in = _mm_shuffle_epi8(in, _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+      const __m128i high = _mm_mulhi_epu16(_mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00)), _mm_set1_epi32(0x04000040));
+      const __m128i low = _mm_mullo_epi16(_mm_and_si128(in, _mm_set1_epi32(0x003f03f0)), _mm_set1_epi32(0x01000010));
+      return _mm_or_si128(high, low);
+    }
+
+    __attribute__((target("ssse3")))
+    inline __m128i TranslateIndices(__m128i indices)
+    {
+      // 0-25 -> 13, 26-51 -> 0, 52-61 -> 1-10, 62 -> 11, 63 -> 12
+      const __m128i offsetLut = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                              '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+      __m128i range = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+      const __m128i upper = _mm_cmpgt_epi8(_mm_set1_epi8(26), indices);
+      range = _mm_or_si128(range, _mm_and_si128(upper, _mm_set1_epi8(13)));
+      return _mm_add_epi8(indices, _mm_shuffle_epi8(offsetLut, range));
+    }
+
+    __attribute__((target("avx2")))
+    inline __m256i SplitIndices(__m256i in)
+    {
+      const __m256i order = _mm256_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1,
+                                            10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1);
+      in = _mm256_shuffle_epi8(in, order);
+      const __m256i high = _mm256_mulhi_epu16(_mm256_and_si256(in, _mm256_set1_epi32(0x0fc0fc00)), _mm256_set1_epi32(0x04000040));
+      const __m256i low = _mm256_mullo_epi16(_mm256_and_si256(in, _mm256_set1_epi32(0x003f03f0)), _mm256_set1_epi32(0x01000010));
+      return _mm256_or_si256(high, low);
+    }
+
+    __attribute__((target("avx2")))
+    inline __m256i TranslateIndices(__m256i indices)
+    {
+      const __m256i offsetLut = _mm256_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                                 '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0,
+                                                 'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                                 '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+      __m256i range = _mm256_subs_epu8(indices, _mm256_set1_epi8(51));
+      const __m256i upper = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), indices);
+      range = _mm256_or_si256(range, _mm256_and_si256(upper, _mm256_set1_epi8(13)));
+      return _mm256_add_epi8(indices, _mm256_shuffle_epi8(offsetLut, range));
+    }
+  }
+
+  __attribute__((target("ssse3")))
+  size_t EncodeBase64SSSE3(const uint8_t *data, size_t size, char *out)
+  {
+    // 16-byte loads of which 12 bytes are used, so the last 4 must still be inside the input
+    size_t i = 0;
+    for (; i + 16 <= size; i += 12)
+    {
+      const __m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i / 3 * 4), TranslateIndices(SplitIndices(in)));
+    }
+
+    return i / 3 * 4 + EncodeBase64Scalar(data + i, size - i, out + i / 3 * 4);
+  }
+
+  __attribute__((target("avx2")))
+  size_t EncodeBase64AVX2(const uint8_t *data, size_t size, char *out)
+  {
+    // _mm256_shuffle_epi8 works per 128-bit lane, so each lane is loaded with its own 12 bytes
+    size_t i = 0;
+    for (; i + 28 <= size; i += 24)
+    {
+      const __m128i low = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+      const __m128i high = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i + 12));
+      const __m256i in = _mm256_inserti128_si256(_mm256_castsi128_si256(low), high, 1);
+      _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i / 3 * 4), TranslateIndices(SplitIndices(in)));
+    }
+
+    return i / 3 * 4 + EncodeBase64SSSE3(data + i, size - i, out + i / 3 * 4);
+  }
+#endif
+
+  namespace
+  {
+    struct EncodeBase64Impl
+    {
+      EncodeBase64Fn fn;
+      const char *name;
+    };
+
+    EncodeBase64Impl SelectEncodeBase64()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+      __builtin_cpu_init();
+      if (__builtin_cpu_supports("avx2"))
+        return {EncodeBase64AVX2, "avx2"};
+      if (__builtin_cpu_supports("ssse3"))
+        return {EncodeBase64SSSE3, "ssse3"};
+#endif
+      return {EncodeBase64Scalar, "scalar"};
+    }
+
+    const EncodeBase64Impl g_encodeBase64 = SelectEncodeBase64();
+
+    // Appends to a fixed buffer. Anything that does not fit marks the output as failed instead of truncating it.
+    class JsonWriter
+    {
+    public:
+      JsonWriter(char *out, size_t capacity) : begin_(out), next_(out), end_(out + capacity) {}
+
+      template <size_t N>
+      void Literal(const char (&text)[N]) { Append(text, N - 1); }
+
+      void Append(const char *text, size_t length)
+      {
+        if (!Reserve(length))
+          return;
+        std::memcpy(next_, text, length);
+        next_ += length;
+      }
+
+      template <typename T>
+      void Number(T value) { Converted(std::to_chars(next_, end_, value)); }
+
+      // Same digits as an ostream with std::fixed and std::setprecision(precision)
+      void Fixed(double value, int precision) { Converted(std::to_chars(next_, end_, value, std::chars_format::fixed, precision)); }
+
+      void Base64(const uint8_t *data, size_t size)
+      {
+        if (!Reserve(Base64EncodedSize(size)))
+          return;
+        next_ += g_encodeBase64.fn(data, size, next_);
+      }
+
+      size_t Size() const { return failed_ ? 0 : static_cast<size_t>(next_ - begin_); }
+
+    private:
+      bool Reserve(size_t length)
+      {
+        if (failed_ || length > static_cast<size_t>(end_ - next_))
+          failed_ = true;
+        return !failed_;
+      }
+
+      void Converted(std::to_chars_result result)
+      {
+        if (failed_ || result.ec != std::errc())
+          failed_ = true;
+        else
+          next_ = result.ptr;
+      }
+
+      char *begin_;
+      char *next_;
+      char *end_;
+      bool failed_ = false;
+    };
+  }
+
+  size_t EncodeBase64(const uint8_t *data, size_t size, char *out) { return g_encodeBase64.fn(data, size, out); }
+  const char *EncodeBase64Name() { return g_encodeBase64.name; }
+
+  size_t SerializeFrameJson(const FrameInfo &info, int width, int height, const uint8_t *jpeg, size_t jpegSize,
+                            char *out, size_t capacity)
+  {
+    JsonWriter json(out, capacity);
+    json.Literal("{\n  \"timestamp\": ");
+    json.Fixed(info.timestamp, 0);
+    json.Literal(",\n  \"frameNumber\": ");
+    json.Number(info.frameNumber);
+    json.Literal(",\n  \"width\": ");
+    json.Number(width);
+    json.Literal(",\n  \"height\": ");
+    json.Number(height);
+    json.Literal(",\n  \"format\": \"jpeg\",\n  \"imageData\": \"data:image/jpeg;base64,");
+    json.Base64(jpeg, jpegSize);
+    json.Literal("\",\n  \"imageSize\": ");
+    json.Number(jpegSize);
+    if (info.ballDetected)
+      json.Literal(",\n  \"ballDetected\": true");
+    else
+      json.Literal(",\n  \"ballDetected\": false");
+    json.Literal(",\n  \"centerX\": ");
+    json.Fixed(info.centerX, 2);
+    json.Literal(",\n  \"centerY\": ");
+    json.Fixed(info.centerY, 2);
+    json.Literal(",\n  \"radius\": ");
+    json.Fixed(info.radius, 2);
+    json.Literal(",\n  \"targetX\": ");
+    json.Fixed(info.targetX, 2);
+    json.Literal(",\n  \"targetY\": ");
+    json.Fixed(info.targetY, 2);
+    json.Literal(",\n  \"rtTaskRunning\": true\n}");
+    return json.Size();
+  }
+}
@@ -0,0 +1,701 @@
+#include "frame_source.h"
+
+#include <pylon/PylonIncludes.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <numbers>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "camera_helpers.h"
+#include "capture_file.h"
+#include "frame_trace.h"
+#include "settings_helpers.h"
+#include "thread_helpers.h"
+
+namespace CameraHelpers
+{
+  namespace
+  {
+    using Clock = std::chrono::steady_clock;
+
+    Clock::duration PeriodFromFPS(double fps)
+    {
+      return fps > 0.0 ? std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / fps)) : Clock::duration::zero();
+    }
+
+    // Hands out frame slots on a schedule. A period of 0 makes the next slot ready immediately.
+    class FramePacer
+    {
+    public:
+      void Start() { next_ = Clock::now(); }
+
+      // Returns true when the next frame is due, waiting at most timeoutMs for it. period is the time to the frame after.
+      bool WaitForSlot(unsigned int timeoutMs, Clock::duration period)
+      {
+        Clock::time_point now = Clock::now();
+        if (now < next_)
+        {
+          if (next_ - now > std::chrono::milliseconds(timeoutMs))
+            return false;
+          std::this_thread::sleep_until(next_);
+          now = next_;
+        }
+
+        // Stay on the nominal schedule, but do not try to catch up after falling more than a frame behind
+        next_ += period;
+        if (next_ < now)
+          next_ = now + period;
+        return true;
+      }
+
+    private:
+      Clock::time_point next_;
+    };
+
+    // Grab buffers are handed out as they are. With the AOI tracked they hold only the AOI, which a thread of the
+    // source programs while grabbing goes on, so the grabbing thread never waits for the camera's nodes.
+    class PylonFrameSource : public FrameSource
+    {
+    public:
+      explicit PylonFrameSource(const FrameSourceSettings &settings)
+          : trackAoi_(settings.trackAoi), format_(settings.pixelFormat) {}
+
+      // The AOI thread uses the camera, so it stops first
+      ~PylonFrameSource() override
+      {
+        stopAoiThread_.store(true, std::memory_order_release);
+        if (aoiThread_.joinable())
+          aoiThread_.join();
+      }
+
+      void Open() override
+      {
+        ConfigureCamera(camera_);
+        SetPixelFormat(camera_, format_);
+        if (trackAoi_)
+        {
+          // Start from the full frame, whatever camera.pfs holds
+          appliedAoi_ = CameraAoi{0, 0, 0, 0};
+          ApplyAoi(camera_, appliedAoi_, CameraAoi());
+          RequestAoi(CameraAoi());
+        }
+        PrimeCamera(camera_, grabResult_);
+        const Pylon::EPixelType expected = format_ == PixelFormat::BayerRG8 ? Pylon::PixelType_BayerRG8 : Pylon::PixelType_YUV422_YUYV_Packed;
+        if (grabResult_->GetPixelType() != expected)
+          throw std::runtime_error("[CameraHelpers] The camera delivers another pixel format than the one set.");
+        // With AOI tracking, frames are AOIs of the full frame and detection works in full-frame pixels. Otherwise
+        // frames come at the size camera.pfs sets.
+        if (!trackAoi_)
+          mode_ = CameraModeInfo{grabResult_->GetWidth(), grabResult_->GetHeight(), format_};
+        else
+          mode_ = CameraModeInfo{IMAGE_WIDTH, IMAGE_HEIGHT, format_};
+        LatchClock();
+
+        if (trackAoi_)
+        {
+          // Created from an RT task, so moved off its cores
+          const cpu_set_t rtCores = ThreadHelpers::CurrentCores();
+          aoiThread_ = std::thread([this, rtCores]()
+                                   {
+                                     ThreadHelpers::MoveToBackground(rtCores);
+                                     ProgramAois();
+                                   });
+        }
+      }
+
+      bool TryGrabFrame(const uint8_t *&frame, unsigned int timeoutMs) override
+      {
+        return TryGrab(grabResult_, frame, timeoutMs);
+      }
+
+      FrameSourceType Type() const override { return FrameSourceType::Pylon; }
+
+      PixelFormat Format() const override { return format_; }
+
+      CameraModeInfo Mode() const override { return mode_; }
+
+      int64_t LastExposureNs() const override { return lastExposureNs_; }
+
+      CameraAoi LastAoi() const override { return lastAoi_; }
+
+      CameraAoi ProgrammedAoi() const override { return UnpackAoi(programmedAoi_.load(std::memory_order_acquire)); }
+
+      uint64_t AoiFailures() const override { return aoiFailures_.load(std::memory_order_relaxed); }
+
+    protected:
+      // A leased CGrabResultPtr keeps its buffer out of the camera's pool until it is released
+      bool TryGrabLeased(uint32_t slot, const uint8_t *&frame, unsigned int timeoutMs) override
+      {
+        return TryGrab(leased_[slot], frame, timeoutMs);
+      }
+
+      // Called from the consumer's thread. Releasing a grab result requeues its buffer, which Pylon allows while
+      // another thread retrieves results.
+      void ReleaseLeased(uint32_t slot) override { leased_[slot].Release(); }
+
+    private:
+      bool TryGrab(Pylon::CGrabResultPtr &result, const uint8_t *&frame, unsigned int timeoutMs)
+      {
+        const uint32_t aoiChanges = aoiChanges_.load(std::memory_order_acquire);
+        try
+        {
+          if (!CameraHelpers::TryGrabFrame(camera_, result, timeoutMs))
+          {
+            result.Release();
+            return false;
+          }
+        }
+        catch (const std::exception &)
+        {
+          // A new AOI size stops grabbing, which cancels the frames in flight. That is no failure of the camera.
+          result.Release();
+          if ((aoiChanges & 1) != 0 || aoiChanges_.load(std::memory_order_acquire) != aoiChanges)
+            return false;
+          throw;
+        }
+
+        if (trackAoi_)
+        {
+          // Frames already in flight may still have the AOI before the last change, the grab result tells
+          CameraAoi aoi;
+          aoi.offsetX = result->GetOffsetX();
+          aoi.offsetY = result->GetOffsetY();
+          aoi.width = result->GetWidth();
+          aoi.height = result->GetHeight();
+          if (aoi.offsetX + aoi.width > IMAGE_WIDTH || aoi.offsetY + aoi.height > IMAGE_HEIGHT ||
+              aoi.offsetX % AOI_ALIGNMENT != 0 || aoi.offsetY % AOI_ALIGNMENT != 0 || aoi.width % AOI_ALIGNMENT != 0 ||
+              aoi.height % AOI_ALIGNMENT != 0 || result->GetPayloadSize() < AoiFrameBytes(aoi, format_))
+          {
+            result.Release();
+            throw std::runtime_error("[CameraHelpers] Grabbed AOI is not an aligned AOI of a " + std::to_string(IMAGE_WIDTH) +
+                                     "x" + std::to_string(IMAGE_HEIGHT) + " frame.");
+          }
+          lastAoi_ = aoi;
+        }
+
+        frame = static_cast<const uint8_t *>(result->GetBuffer());
+        lastExposureNs_ = ExposureNs(result->GetTimeStamp(), TimingHelpers::NowNs(), result->GetWidth(), result->GetHeight());
+        return true;
+      }
+
+      // Runs on aoiThread_ at normal priority until the source is destroyed, giving the camera each AOI requested.
+      // Writing the nodes waits for the camera, and a new size stops and restarts grabbing. aoiChanges_ is odd while
+      // that goes on, so the grabbing thread can tell the frames it cancels from failed grabs.
+      void ProgramAois()
+      {
+        constexpr auto IDLE_WAIT = std::chrono::milliseconds(1); // Well under a frame period
+        constexpr auto FAILURE_WAIT = std::chrono::milliseconds(10);
+
+        while (!stopAoiThread_.load(std::memory_order_acquire))
+        {
+          const CameraAoi requested = RequestedAoi();
+          if (requested == appliedAoi_)
+          {
+            std::this_thread::sleep_for(IDLE_WAIT);
+            continue;
+          }
+
+          aoiChanges_.fetch_add(1, std::memory_order_acq_rel);
+          bool failed = false;
+          try
+          {
+            ApplyAoi(camera_, appliedAoi_, requested);
+            programmedAoi_.store(PackAoi(appliedAoi_), std::memory_order_release);
+          }
+          catch (const std::exception &)
+          {
+            // ApplyAoi left grabbing on and forgot the AOI, so the next pass writes every node again
+            aoiFailures_.fetch_add(1, std::memory_order_relaxed);
+            failed = true;
+          }
+          aoiChanges_.fetch_add(1, std::memory_order_acq_rel);
+          if (failed)
+            std::this_thread::sleep_for(FAILURE_WAIT);
+        }
+      }
+
+      // Pairs a reading of the camera's timestamp counter with the host clock, so frame timestamps (taken at exposure
+      // start) map to host time
+      void LatchClock()
+      {
+        const int64_t before = TimingHelpers::NowNs();
+        clockLatched_ = TryLatchTimestamp(camera_, latchTicks_, tickFrequencyHz_);
+        latchHostNs_ = before + (TimingHelpers::NowNs() - before) / 2;
+        driftNs_ = 0;
+        baselines_.fill(DriftBaseline());
+        baseline_ = 0;
+        nextBaseline_ = 0;
+        windowFrames_ = 0;
+        windowMinDelayNs_ = std::numeric_limits<int64_t>::max();
+      }
+
+      // The camera clock drifts from the host clock by its crystal tolerance, tens of microseconds per second. The
+      // shortest delay from exposure to grab over DRIFT_WINDOW frames only changes with that drift, so the mapping is
+      // corrected to keep it where it was in the first window after the latch. The delay also holds the readout and
+      // transfer of the frame, which change with the AOI size (not with its offsets). So each size keeps a baseline of
+      // its own, taken from its first full window, and a size change is never taken for drift.
+      int64_t ExposureNs(uint64_t timestampTicks, int64_t grabbedNs, uint32_t width, uint32_t height)
+      {
+        if (!clockLatched_ || timestampTicks == 0)
+          return 0;
+        const double ticks = static_cast<double>(static_cast<int64_t>(timestampTicks) - latchTicks_);
+        const int64_t exposureNs = latchHostNs_ + driftNs_ + static_cast<int64_t>(ticks * 1e9 / tickFrequencyHz_);
+
+        if (width != baselines_[baseline_].width || height != baselines_[baseline_].height)
+        {
+          // A window only measures frames of one size
+          SelectDriftBaseline(width, height);
+          windowFrames_ = 0;
+          windowMinDelayNs_ = std::numeric_limits<int64_t>::max();
+        }
+
+        windowMinDelayNs_ = std::min(windowMinDelayNs_, grabbedNs - exposureNs);
+        if (++windowFrames_ == DRIFT_WINDOW)
+        {
+          DriftBaseline &baseline = baselines_[baseline_];
+          if (baseline.delayNs < 0)
+            baseline.delayNs = std::max<int64_t>(windowMinDelayNs_, 0);
+          else
+            driftNs_ += windowMinDelayNs_ - baseline.delayNs;
+          windowFrames_ = 0;
+          windowMinDelayNs_ = std::numeric_limits<int64_t>::max();
+        }
+        return exposureNs;
+      }
+
+      // Makes the baseline of the frame size current, replacing the oldest one for a size not seen before
+      void SelectDriftBaseline(uint32_t width, uint32_t height)
+      {
+        for (size_t i = 0; i < baselines_.size(); ++i)
+        {
+          if (baselines_[i].width == width && baselines_[i].height == height)
+          {
+            baseline_ = i;
+            return;
+          }
+        }
+        baseline_ = nextBaseline_;
+        nextBaseline_ = (nextBaseline_ + 1) % baselines_.size();
+        baselines_[baseline_] = DriftBaseline{width, height, -1};
+      }
+
+      static constexpr int DRIFT_WINDOW = 256;
+
+      // Shortest exposure-to-grab delay of the first full window of frames of one size, -1 until there is one
+      struct DriftBaseline
+      {
+        uint32_t width = 0;
+        uint32_t height = 0;
+        int64_t delayNs = -1;
+      };
+
+      Pylon::CInstantCamera camera_;
+      Pylon::CGrabResultPtr grabResult_;
+      std::array<Pylon::CGrabResultPtr, MAX_LEASES> leased_;
+
+      bool trackAoi_;
+      PixelFormat format_;
+      CameraModeInfo mode_;
+      CameraAoi lastAoi_;
+
+      // AOI tracking only. appliedAoi_ belongs to the AOI thread once it runs.
+      CameraAoi appliedAoi_;
+      std::atomic<uint64_t> programmedAoi_{PackAoi(CameraAoi())};
+      std::atomic<uint32_t> aoiChanges_{0}; // Odd while the AOI thread writes the camera's AOI
+      std::atomic<uint64_t> aoiFailures_{0};
+      std::atomic<bool> stopAoiThread_{false};
+      std::thread aoiThread_;
+
+      bool clockLatched_ = false;
+      int64_t latchTicks_ = 0;
+      int64_t latchHostNs_ = 0;
+      double tickFrequencyHz_ = 1e9;
+      int64_t driftNs_ = 0;
+      std::array<DriftBaseline, AOI_TIERS.size()> baselines_; // One per AOI size, the tiers are all there are
+      size_t baseline_ = 0;     // Baseline of the size of the last frame
+      size_t nextBaseline_ = 0; // Baseline a new size replaces
+      int windowFrames_ = 0;
+      int64_t windowMinDelayNs_ = std::numeric_limits<int64_t>::max();
+      int64_t lastExposureNs_ = 0;
+    };
+
+    // Plays a capture file written by the frame recorder, or a raw file of back-to-back frames of the configured format
+    class ReplayFrameSource : public FrameSource
+    {
+    public:
+      explicit ReplayFrameSource(const FrameSourceSettings &settings)
+          : path_(settings.replayFile), loop_(settings.replayLoop), fps_(settings.replayFPS), format_(settings.pixelFormat) {}
+
+      ~ReplayFrameSource() override
+      {
+        if (mapping_ != nullptr)
+          munmap(mapping_, mappingSize_);
+      }
+
+      void Open() override
+      {
+        if (capture_ == nullptr && mapping_ == nullptr)
+        {
+          if (RecordingHelpers::CaptureFileReader::IsCaptureFile(path_))
+            OpenCaptureFile();
+          else
+            OpenRawFile();
+        }
+
+        nextFrame_ = 0;
+        pacer_.Start();
+      }
+
+      bool TryGrabFrame(const uint8_t *&frame, unsigned int timeoutMs) override
+      {
+        return TryGetNextFrame(frame, timeoutMs);
+      }
+
+      FrameSourceType Type() const override { return FrameSourceType::Replay; }
+
+      PixelFormat Format() const override { return format_; }
+
+    protected:
+      // Frames are read straight from the mapping, which outlives every lease
+      bool TryGrabLeased(uint32_t /*slot*/, const uint8_t *&frame, unsigned int timeoutMs) override
+      {
+        return TryGetNextFrame(frame, timeoutMs);
+      }
+
+    private:
+      bool TryGetNextFrame(const uint8_t *&frame, unsigned int timeoutMs)
+      {
+        if (nextFrame_ == frameCount_)
+        {
+          if (!loop_)
+            return false;
+          nextFrame_ = 0;
+        }
+
+        if (!pacer_.WaitForSlot(timeoutMs, PeriodAfter(nextFrame_)))
+          return false;
+
+        frame = capture_ != nullptr ? capture_->FrameAt(nextFrame_).imageData : mapping_ + nextFrame_ * FrameBytes(format_);
+        ++nextFrame_;
+        return true;
+      }
+
+      void OpenCaptureFile()
+      {
+        capture_ = std::make_unique<RecordingHelpers::CaptureFileReader>(path_);
+        frameCount_ = capture_->FrameCount();
+        if (frameCount_ == 0)
+          throw std::runtime_error("[CameraHelpers] Replay file holds no complete frame: " + path_);
+        format_ = capture_->Format();
+      }
+
+      void OpenRawFile()
+      {
+        int fd = open(path_.c_str(), O_RDONLY);
+        if (fd < 0)
+          throw std::runtime_error("[CameraHelpers] Failed to open replay file: " + path_);
+
+        struct stat fileStat;
+        if (fstat(fd, &fileStat) != 0 || fileStat.st_size < static_cast<off_t>(FrameBytes(format_)))
+        {
+          close(fd);
+          throw std::runtime_error("[CameraHelpers] Replay file holds no complete frame: " + path_);
+        }
+
+        // Map and prefault the whole recording so the RT task never takes a page fault on it
+        mappingSize_ = static_cast<size_t>(fileStat.st_size);
+        void *mapping = mmap(nullptr, mappingSize_, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+        close(fd);
+        if (mapping == MAP_FAILED)
+          throw std::runtime_error("[CameraHelpers] Failed to map replay file: " + path_);
+
+        mapping_ = static_cast<uint8_t *>(mapping);
+        madvise(mapping_, mappingSize_, MADV_SEQUENTIAL);
+        frameCount_ = mappingSize_ / FrameBytes(format_);
+      }
+
+      // Time from the given frame to the next: forced, from the recorded timestamps, or RAW_REPLAY_FPS for raw files
+      Clock::duration PeriodAfter(size_t frame) const
+      {
+        if (fps_ >= 0.0)
+          return PeriodFromFPS(fps_);
+        if (capture_ == nullptr)
+          return PeriodFromFPS(RAW_REPLAY_FPS);
+        if (frame + 1 >= frameCount_)
+          return Clock::duration::zero();
+
+        const int64_t deltaUs = capture_->TimestampAt(frame + 1) - capture_->TimestampAt(frame);
+        return std::chrono::microseconds(std::max<int64_t>(deltaUs, 0));
+      }
+
+      static constexpr double RAW_REPLAY_FPS = 30.0;
+
+      std::string path_;
+      bool loop_;
+      double fps_;
+      PixelFormat format_;
+      FramePacer pacer_;
+      std::unique_ptr<RecordingHelpers::CaptureFileReader> capture_;
+      uint8_t *mapping_ = nullptr;
+      size_t mappingSize_ = 0;
+      size_t frameCount_ = 0;
+      size_t nextFrame_ = 0;
+    };
+
+    class SyntheticFrameSource : public FrameSource
+    {
+    public:
+      explicit SyntheticFrameSource(const FrameSourceSettings &settings)
+          : settings_(settings), generator_(settings.syntheticScene), period_(PeriodFromFPS(settings.syntheticFPS)),
+            buffers_(std::make_unique<uint8_t[]>((MAX_LEASES + 1) * FrameBytes(settings.pixelFormat))) {}
+
+      void Open() override
+      {
+        start_ = Clock::now();
+        pacer_.Start();
+      }
+
+      // TryGrabFrame renders into the buffer after the lease buffers
+      bool TryGrabFrame(const uint8_t *&frame, unsigned int timeoutMs) override
+      {
+        return TryRender(MAX_LEASES, frame, timeoutMs);
+      }
+
+      FrameSourceType Type() const override { return FrameSourceType::Synthetic; }
+
+      PixelFormat Format() const override { return settings_.pixelFormat; }
+
+      // The moment the scene is rendered for
+      int64_t LastExposureNs() const override { return lastExposureNs_; }
+
+      CameraAoi LastAoi() const override { return lastAoi_; }
+
+    protected:
+      bool TryGrabLeased(uint32_t slot, const uint8_t *&frame, unsigned int timeoutMs) override
+      {
+        return TryRender(slot, frame, timeoutMs);
+      }
+
+    private:
+      bool TryRender(uint32_t buffer, const uint8_t *&frame, unsigned int timeoutMs)
+      {
+        if (!pacer_.WaitForSlot(timeoutMs, period_))
+          return false;
+
+        // The ball follows a 1:2 Lissajous figure, so it moves in both axes with changing speed and direction
+        const Clock::time_point now = Clock::now();
+        lastExposureNs_ = std::chrono::duration_cast<std::chrono::nanoseconds>(now.time_since_epoch()).count();
+        const double t = std::chrono::duration<double>(now - start_).count();
+        const double phase = 2.0 * std::numbers::pi * t / settings_.syntheticPeriodSeconds;
+        const float ballX = IMAGE_WIDTH / 2.0f + settings_.syntheticAmplitudeX * static_cast<float>(std::sin(phase));
+        const float ballY = IMAGE_HEIGHT / 2.0f + settings_.syntheticAmplitudeY * static_cast<float>(std::sin(2.0 * phase));
+
+        uint8_t *const image = buffers_.get() + buffer * FrameBytes(settings_.pixelFormat);
+        if (settings_.pixelFormat == PixelFormat::BayerRG8)
+          generator_.RenderBayer(image, ballX, ballY);
+        else
+          generator_.Render(image, ballX, ballY);
+
+        // Delivers what the camera would for the AOI, for running AOI tracking without one
+        lastAoi_ = RequestedAoi();
+        if (lastAoi_ != CameraAoi())
+          CropToAoi(image, lastAoi_, settings_.pixelFormat);
+        frame = image;
+        return true;
+      }
+
+      FrameSourceSettings settings_;
+      SyntheticFrameGenerator generator_;
+      Clock::duration period_;
+      FramePacer pacer_;
+      std::unique_ptr<uint8_t[]> buffers_;
+      Clock::time_point start_;
+      int64_t lastExposureNs_ = 0;
+      CameraAoi lastAoi_;
+    };
+  }
+
+  // ----------- FrameLease / FrameSource -----------
+
+  FrameLease &FrameLease::operator=(FrameLease &&other) noexcept
+  {
+    if (this != &other)
+    {
+      Release();
+      source_ = std::exchange(other.source_, nullptr);
+      slot_ = other.slot_;
+      data_ = std::exchange(other.data_, nullptr);
+    }
+    return *this;
+  }
+
+  void FrameLease::Release()
+  {
+    if (source_ == nullptr)
+      return;
+    source_->ReleaseLease(slot_);
+    source_ = nullptr;
+    data_ = nullptr;
+  }
+
+  bool FrameSource::TryLeaseFrame(FrameLease &lease, unsigned int timeoutMs)
+  {
+    lease.Release();
+
+    // Only this thread sets bits, so a slot seen free here stays free
+    const uint32_t leased = leasedSlots_.load(std::memory_order_acquire);
+    uint32_t slot = 0;
+    while (slot < MAX_LEASES && (leased & (1u << slot)) != 0)
+      ++slot;
+    if (slot == MAX_LEASES)
+      return false;
+
+    const uint8_t *frame = nullptr;
+    if (!TryGrabLeased(slot, frame, timeoutMs))
+      return false;
+
+    leasedSlots_.fetch_or(1u << slot, std::memory_order_acq_rel);
+    lease.source_ = this;
+    lease.slot_ = slot;
+    lease.data_ = frame;
+    return true;
+  }
+
+  void FrameSource::ReleaseLease(uint32_t slot)
+  {
+    ReleaseLeased(slot);
+    leasedSlots_.fetch_and(~(1u << slot), std::memory_order_release);
+  }
+
+  // ----------- Settings -----------
+
+  FrameSourceSettings LoadFrameSourceSettings(const char *path)
+  {
+    FrameSourceSettings settings;
+
+    for (const SettingsHelpers::Setting &setting : SettingsHelpers::ReadSettingsFile(path))
+    {
+      const std::string &key = setting.key;
+      const std::string &value = setting.value;
+
+      if (key == "source")
+      {
+        if (value == "pylon")
+          settings.type = FrameSourceType::Pylon;
+        else if (value == "replay")
+          settings.type = FrameSourceType::Replay;
+        else if (value == "synthetic")
+          settings.type = FrameSourceType::Synthetic;
+        else
+          throw std::runtime_error("[CameraHelpers] Unknown frame source: " + value);
+      }
+      else if (key == "handoff")
+      {
+        if (value == "copy")
+          settings.zeroCopyHandoff = false;
+        else if (value == "zero_copy")
+          settings.zeroCopyHandoff = true;
+        else
+          throw std::runtime_error("[CameraHelpers] Unknown frame handoff: " + value);
+      }
+      else if (key == "grab")
+      {
+        if (value == "detect_ball")
+          settings.grabThread = false;
+        else if (value == "thread")
+          settings.grabThread = true;
+        else
+          throw std::runtime_error("[CameraHelpers] Unknown frame grab: " + value);
+      }
+      else if (key == "aoi")
+      {
+        if (value == "full")
+          settings.trackAoi = false;
+        else if (value == "track")
+          settings.trackAoi = true;
+        else
+          throw std::runtime_error("[CameraHelpers] Unknown camera AOI mode: " + value);
+      }
+      else if (key == "pixel_format")
+      {
+        if (value == "yuyv")
+          settings.pixelFormat = PixelFormat::YUYV;
+        else if (value == "bayer_rg8")
+          settings.pixelFormat = PixelFormat::BayerRG8;
+        else
+          throw std::runtime_error("[CameraHelpers] Unknown pixel format: " + value);
+      }
+      else if (key == "grab_core")
+        settings.grabCore = static_cast<int>(SettingsHelpers::ParseNumber(setting));
+      else if (key == "grab_priority")
+        settings.grabPriority = static_cast<int>(SettingsHelpers::ParseNumber(setting));
+      else if (key == "aoi_margin")
+        settings.aoiMargin = static_cast<float>(SettingsHelpers::ParseNumber(setting));
+      else if (key == "replay_file")
+        settings.replayFile = value;
+      else if (key == "replay_fps")
+        settings.replayFPS = value == "recorded" ? -1.0 : SettingsHelpers::ParseNumber(setting);
+      else if (key == "replay_loop")
+        settings.replayLoop = SettingsHelpers::ParseBool(setting);
+      else if (key == "synthetic_fps")
+        settings.syntheticFPS = SettingsHelpers::ParseNumber(setting);
+      else if (key == "synthetic_amplitude_x")
+        settings.syntheticAmplitudeX = static_cast<float>(SettingsHelpers::ParseNumber(setting));
+      else if (key == "synthetic_amplitude_y")
+        settings.syntheticAmplitudeY = static_cast<float>(SettingsHelpers::ParseNumber(setting));
+      else if (key == "synthetic_period")
+        settings.syntheticPeriodSeconds = static_cast<float>(SettingsHelpers::ParseNumber(setting));
+      else if (key == "synthetic_radius")
+        settings.syntheticScene.ballRadius = static_cast<float>(SettingsHelpers::ParseNumber(setting));
+      else if (key == "synthetic_noise")
+        settings.syntheticScene.noiseAmplitude = static_cast<int>(SettingsHelpers::ParseNumber(setting));
+      else if (key == "synthetic_clutter")
+        settings.syntheticScene.clutterCount = static_cast<int>(SettingsHelpers::ParseNumber(setting));
+      else if (key == "synthetic_seed")
+        settings.syntheticScene.seed = static_cast<uint32_t>(SettingsHelpers::ParseNumber(setting));
+      else
+        throw std::runtime_error("[CameraHelpers] Unknown frame source setting: " + key);
+    }
+
+    if (settings.type == FrameSourceType::Replay && settings.replayFile.empty())
+      throw std::runtime_error("[CameraHelpers] The replay frame source needs replay_file.");
+    if (settings.syntheticPeriodSeconds <= 0.0f)
+      throw std::runtime_error("[CameraHelpers] synthetic_period must be positive.");
+    if (settings.aoiMargin < 0.0f)
+      throw std::runtime_error("[CameraHelpers] aoi_margin must not be negative.");
+    if (settings.grabCore >= CPU_SETSIZE)
+      throw std::runtime_error("[CameraHelpers] grab_core is out of range.");
+    if (settings.grabPriority < 0 || settings.grabPriority > sched_get_priority_max(SCHED_FIFO))
+      throw std::runtime_error("[CameraHelpers] grab_priority is out of range.");
+
+    return settings;
+  }
+
+  std::unique_ptr<FrameSource> CreateFrameSource(const FrameSourceSettings &settings)
+  {
+    switch (settings.type)
+    {
+    case FrameSourceType::Replay:
+      return std::make_unique<ReplayFrameSource>(settings);
+    case FrameSourceType::Synthetic:
+      return std::make_unique<SyntheticFrameSource>(settings);
+    case FrameSourceType::Pylon:
+    default:
+      return std::make_unique<PylonFrameSource>(settings);
+    }
+  }
+}
@@ -0,0 +1,198 @@
+#include "frame_trace.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace TimingHelpers
+{
+  namespace
+  {
+    struct SpanStages
+    {
+      FrameStage from;
+      FrameStage to;
+      const char *name;
+    };
+
+    constexpr std::array<SpanStages, static_cast<size_t>(LatencySpan::Count)> SPANS = {{
+        {FrameStage::Exposure, FrameStage::Grabbed, "exposure_to_grab"},
+        {FrameStage::Grabbed, FrameStage::MaskDone, "grab_to_mask"},
+        {FrameStage::MaskDone, FrameStage::FitDone, "mask_to_fit"},
+        {FrameStage::FitDone, FrameStage::TargetWritten, "fit_to_target"},
+        {FrameStage::TargetWritten, FrameStage::MoveIssued, "target_to_move"},
+        {FrameStage::Grabbed, FrameStage::MoveIssued, "grab_to_move"},
+        {FrameStage::Exposure, FrameStage::MoveIssued, "exposure_to_move"},
+        {FrameStage::Grabbed, FrameStage::Published, "grab_to_publish"},
+        {FrameStage::Grabbed, FrameStage::Dequeued, "grab_to_dequeue"},
+        {FrameStage::Dequeued, FrameStage::TargetWritten, "dequeue_to_target"},
+    }};
+
+    constexpr uint64_t SUB_BUCKET_COUNT = uint64_t(1) << LatencyHistogram::SUB_BUCKET_BITS;
+    constexpr uint64_t SUB_BUCKET_HALF_COUNT = SUB_BUCKET_COUNT / 2;
+  }
+
+  const char *LatencySpanName(LatencySpan span)
+  {
+    const size_t index = static_cast<size_t>(span);
+    return index < SPANS.size() ? SPANS[index].name : "unknown";
+  }
+
+  // ----------- LatencyHistogram -----------
+
+  size_t LatencyHistogram::BucketIndex(uint64_t value)
+  {
+    if (value < SUB_BUCKET_COUNT)
+      return static_cast<size_t>(value);
+
+    // Above the exact range, every power of two is split into SUB_BUCKET_HALF_COUNT buckets by its leading bits
+    const int exponent = 63 - __builtin_clzll(value);
+    if (exponent > MAX_EXPONENT)
+      return BUCKET_COUNT - 1;
+    const int shift = exponent - SUB_BUCKET_BITS + 1;
+    return static_cast<size_t>(SUB_BUCKET_COUNT + (exponent - SUB_BUCKET_BITS) * SUB_BUCKET_HALF_COUNT +
+                               ((value >> shift) - SUB_BUCKET_HALF_COUNT));
+  }
+
+  uint64_t LatencyHistogram::BucketHighestValue(size_t index)
+  {
+    if (index < SUB_BUCKET_COUNT)
+      return index;
+
+    const uint64_t offset = index - SUB_BUCKET_COUNT;
+    const int exponent = SUB_BUCKET_BITS + static_cast<int>(offset / SUB_BUCKET_HALF_COUNT);
+    const int shift = exponent - SUB_BUCKET_BITS + 1;
+    const uint64_t leading = SUB_BUCKET_HALF_COUNT + offset % SUB_BUCKET_HALF_COUNT;
+    return ((leading + 1) << shift) - 1;
+  }
+
+  void LatencyHistogram::Record(int64_t valueNs)
+  {
+    const uint64_t value = valueNs > 0 ? static_cast<uint64_t>(valueNs) : 0;
+    buckets_[BucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+
+    int64_t max = max_.load(std::memory_order_relaxed);
+    while (max < static_cast<int64_t>(value) && !max_.compare_exchange_weak(max, static_cast<int64_t>(value), std::memory_order_relaxed))
+    {
+    }
+  }
+
+  void LatencyHistogram::Reset()
+  {
+    for (std::atomic<uint64_t> &bucket : buckets_)
+      bucket.store(0, std::memory_order_relaxed);
+    count_.store(0, std::memory_order_relaxed);
+    max_.store(0, std::memory_order_relaxed);
+  }
+
+  void LatencyHistogram::Subtract(const LatencyHistogram &other)
+  {
+    // The count first, so a concurrent percentile never ranks past the buckets
+    count_.fetch_sub(other.Count(), std::memory_order_relaxed);
+    for (size_t index = 0; index < BUCKET_COUNT; ++index)
+    {
+      const uint64_t samples = other.buckets_[index].load(std::memory_order_relaxed);
+      if (samples != 0)
+        buckets_[index].fetch_sub(samples, std::memory_order_relaxed);
+    }
+  }
+
+  int64_t LatencyHistogram::PercentileNs(double percentile) const
+  {
+    const uint64_t count = Count();
+    if (count == 0)
+      return 0;
+
+    // Rank of the sample, 1-based
+    const double fraction = std::clamp(percentile, 0.0, 100.0) / 100.0;
+    const uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(fraction * static_cast<double>(count))));
+
+    uint64_t seen = 0;
+    for (size_t index = 0; index < BUCKET_COUNT; ++index)
+    {
+      seen += buckets_[index].load(std::memory_order_relaxed);
+      if (seen >= rank)
+        return std::min(static_cast<int64_t>(BucketHighestValue(index)), MaxNs());
+    }
+    return MaxNs();
+  }
+
+  // ----------- FrameTracer -----------
+
+  void FrameTracer::Begin(uint32_t frameNumber, int64_t exposureNs, int64_t grabbedNs)
+  {
+    // Hide the slot while it is reused, so late stamps of the frame it held are dropped
+    Slot &slot = slots_[frameNumber % TRACE_SLOTS];
+    slot.frameNumber.store(0, std::memory_order_release);
+    for (std::atomic<int64_t> &stage : slot.stageNs)
+      stage.store(0, std::memory_order_relaxed);
+    slot.stageNs[static_cast<size_t>(FrameStage::Exposure)].store(exposureNs, std::memory_order_relaxed);
+    slot.stageNs[static_cast<size_t>(FrameStage::Grabbed)].store(grabbedNs, std::memory_order_relaxed);
+    slot.frameNumber.store(frameNumber, std::memory_order_release);
+
+    if (exposureNs != 0)
+      histograms_[static_cast<size_t>(LatencySpan::ExposureToGrab)].Record(grabbedNs - exposureNs);
+  }
+
+  bool FrameTracer::Stamp(uint32_t frameNumber, FrameStage stage, int64_t timeNs)
+  {
+    Slot &slot = slots_[frameNumber % TRACE_SLOTS];
+    if (frameNumber == 0 || slot.frameNumber.load(std::memory_order_acquire) != frameNumber)
+      return false;
+
+    std::atomic<int64_t> &stamp = slot.stageNs[static_cast<size_t>(stage)];
+    int64_t empty = 0;
+    if (!stamp.compare_exchange_strong(empty, timeNs, std::memory_order_acq_rel))
+      return false;
+
+    // Read the span starts before checking that the slot still holds the frame
+    std::array<int64_t, static_cast<size_t>(FrameStage::Count)> stageNs;
+    for (size_t i = 0; i < stageNs.size(); ++i)
+      stageNs[i] = slot.stageNs[i].load(std::memory_order_acquire);
+    if (slot.frameNumber.load(std::memory_order_acquire) != frameNumber)
+    {
+      // Begin took the slot over in the meantime, take the stamp back out of the new frame
+      stamp.compare_exchange_strong(timeNs, 0, std::memory_order_acq_rel);
+      return false;
+    }
+
+    for (size_t span = 0; span < SPANS.size(); ++span)
+    {
+      const int64_t from = stageNs[static_cast<size_t>(SPANS[span].from)];
+      if (SPANS[span].to == stage && from != 0)
+        histograms_[span].Record(timeNs - from);
+    }
+    return true;
+  }
+
+  void FrameTracer::TargetWritten(uint32_t frameNumber, int64_t timeNs)
+  {
+    if (Stamp(frameNumber, FrameStage::TargetWritten, timeNs))
+      targetFrame_.store(frameNumber, std::memory_order_release);
+  }
+
+  bool FrameTracer::TryGetTrace(uint32_t frameNumber, FrameTrace &trace) const
+  {
+    const Slot &slot = slots_[frameNumber % TRACE_SLOTS];
+    if (frameNumber == 0 || slot.frameNumber.load(std::memory_order_acquire) != frameNumber)
+      return false;
+
+    trace.frameNumber = frameNumber;
+    for (size_t i = 0; i < trace.stageNs.size(); ++i)
+      trace.stageNs[i] = slot.stageNs[i].load(std::memory_order_acquire);
+    return slot.frameNumber.load(std::memory_order_acquire) == frameNumber;
+  }
+
+  void FrameTracer::Reset()
+  {
+    for (Slot &slot : slots_)
+    {
+      slot.frameNumber.store(0, std::memory_order_relaxed);
+      for (std::atomic<int64_t> &stage : slot.stageNs)
+        stage.store(0, std::memory_order_relaxed);
+    }
+    for (LatencyHistogram &histogram : histograms_)
+      histogram.Reset();
+    targetFrame_.store(0, std::memory_order_release);
+  }
+}
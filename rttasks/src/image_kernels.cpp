@@ -0,0 +1,386 @@
+#include "image_kernels.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+namespace ImageProcessing::Kernels
+{
+  void ExtractMaskVRowScalar(const uint8_t *yuyvRow, uint8_t *maskRow, int maskWidth, uint8_t threshold)
+  {
+    // Each 4-byte group is Y0 U Y1 V, so the V sample of pixel pair x is byte 4x + 3
+    for (int x = 0; x < maskWidth; ++x)
+    {
+      maskRow[x] = yuyvRow[4 * x + 3] > threshold ? 255 : 0;
+    }
+  }
+
+  void ExtractCoarseMaskVRowScalar(const uint8_t *yuyvRow, uint8_t *maskRow, int maskWidth, uint8_t threshold)
+  {
+    // The V sample of every second pixel pair, byte 3 of each 8-byte group
+    for (int x = 0; x < maskWidth; ++x)
+    {
+      maskRow[x] = yuyvRow[8 * x + 3] > threshold ? 255 : 0;
+    }
+  }
+
+  void ExtractCoarseMaskBayerRowScalar(const uint8_t *topRow, const uint8_t *bottomRow, uint8_t *maskRow, int maskWidth, uint8_t threshold)
+  {
+    // The RGGB cell at the start of each 4-byte group of the two rows
+    for (int x = 0; x < maskWidth; ++x)
+    {
+      const int cell = 4 * x;
+      maskRow[x] = BayerV(topRow[cell], topRow[cell + 1], bottomRow[cell], bottomRow[cell + 1]) > threshold ? 255 : 0;
+    }
+  }
+
+#if defined(__x86_64__) || defined(__i386__)
+  __attribute__((target("sse2")))
+  void ExtractMaskVRowSSE2(const uint8_t *yuyvRow, uint8_t *maskRow, int maskWidth, uint8_t threshold)
+  {
+    const __m128i thresholdVec = _mm_set1_epi32(threshold);
+
+    // 64 input bytes (16 pixel pairs) produce 16 mask bytes per iteration
+    int x = 0;
+    for (; x + 16 <= maskWidth; x += 16)
+    {
+      const __m128i *in = reinterpret_cast<const __m128i *>(yuyvRow + 4 * x);
+
+      // Shifting each 32-bit group right by 24 leaves V as a non-negative int32
+      __m128i m0 = _mm_cmpgt_epi32(_mm_srli_epi32(_mm_loadu_si128(in + 0), 24), thresholdVec);
+      __m128i m1 = _mm_cmpgt_epi32(_mm_srli_epi32(_mm_loadu_si128(in + 1), 24), thresholdVec);
+      __m128i m2 = _mm_cmpgt_epi32(_mm_srli_epi32(_mm_loadu_si128(in + 2), 24), thresholdVec);
+      __m128i m3 = _mm_cmpgt_epi32(_mm_srli_epi32(_mm_loadu_si128(in + 3), 24), thresholdVec);
+
+      // Signed saturating packs keep 0 -> 0x00 and -1 -> 0xFF
+      __m128i m01 = _mm_packs_epi32(m0, m1);
+      __m128i m23 = _mm_packs_epi32(m2, m3);
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(maskRow + x), _mm_packs_epi16(m01, m23));
+    }
+
+    ExtractMaskVRowScalar(yuyvRow + 4 * x, maskRow + x, maskWidth - x, threshold);
+  }
+
+  namespace
+  {
+    // V of four coarse samples from 32 YUYV bytes, as int32 in order. V is byte 3 of each 8-byte group: the first
+    // load's move to bits 0..7 of its 64-bit lanes, the second load's to bits 32..39, and a shuffle puts the four
+    // 32-bit groups in sample order.
+    __attribute__((target("sse2")))
+    inline __m128i CoarseV4(const uint8_t *in)
+    {
+      const __m128i vByte = _mm_set1_epi64x(0xFF000000);
+      const __m128i first = _mm_srli_epi64(_mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(in)), vByte), 24);
+      const __m128i second = _mm_slli_epi64(_mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(in + 16)), vByte), 8);
+      return _mm_shuffle_epi32(_mm_or_si128(first, second), _MM_SHUFFLE(3, 1, 2, 0));
+    }
+
+    // BayerV of four RGGB cells from 16 bytes of each row, as int32 in order. Each 32-bit group holds a cell in its
+    // first two bytes; spreading them to the two 16-bit halves lets madd apply the weights of both at once.
+    __attribute__((target("sse2")))
+    inline __m128i CellV4(const uint8_t *top, const uint8_t *bottom)
+    {
+      const __m128i lowByte = _mm_set1_epi32(0x00FF);
+      const __m128i secondByte = _mm_set1_epi32(0xFF00);
+      const __m128i topWeights = _mm_setr_epi16(256, -107, 256, -107, 256, -107, 256, -107);     // r, g0
+      const __m128i bottomWeights = _mm_setr_epi16(-107, -42, -107, -42, -107, -42, -107, -42); // g1, b
+
+      const __m128i t = _mm_loadu_si128(reinterpret_cast<const __m128i *>(top));
+      const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(bottom));
+      const __m128i tSpread = _mm_or_si128(_mm_and_si128(t, lowByte), _mm_slli_epi32(_mm_and_si128(t, secondByte), 8));
+      const __m128i bSpread = _mm_or_si128(_mm_and_si128(b, lowByte), _mm_slli_epi32(_mm_and_si128(b, secondByte), 8));
+      const __m128i sum = _mm_add_epi32(_mm_madd_epi16(tSpread, topWeights), _mm_madd_epi16(bSpread, bottomWeights));
+      return _mm_add_epi32(_mm_srai_epi32(sum, 9), _mm_set1_epi32(128));
+    }
+
+    // 0xFF or 0x00 bytes, in order, for the 16 int32 samples of m0..m3
+    __attribute__((target("sse2")))
+    inline __m128i PackMask16(__m128i m0, __m128i m1, __m128i m2, __m128i m3)
+    {
+      return _mm_packs_epi16(_mm_packs_epi32(m0, m1), _mm_packs_epi32(m2, m3));
+    }
+  }
+
+  __attribute__((target("sse2")))
+  void ExtractCoarseMaskVRowSSE2(const uint8_t *yuyvRow, uint8_t *maskRow, int maskWidth, uint8_t threshold)
+  {
+    const __m128i thresholdVec = _mm_set1_epi32(threshold);
+
+    // 128 input bytes (16 samples) produce 16 mask bytes per iteration
+    int x = 0;
+    for (; x + 16 <= maskWidth; x += 16)
+    {
+      const uint8_t *in = yuyvRow + 8 * x;
+      __m128i m0 = _mm_cmpgt_epi32(CoarseV4(in + 0), thresholdVec);
+      __m128i m1 = _mm_cmpgt_epi32(CoarseV4(in + 32), thresholdVec);
+      __m128i m2 = _mm_cmpgt_epi32(CoarseV4(in + 64), thresholdVec);
+      __m128i m3 = _mm_cmpgt_epi32(CoarseV4(in + 96), thresholdVec);
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(maskRow + x), PackMask16(m0, m1, m2, m3));
+    }
+
+    ExtractCoarseMaskVRowScalar(yuyvRow + 8 * x, maskRow + x, maskWidth - x, threshold);
+  }
+
+  __attribute__((target("sse2")))
+  void ExtractCoarseMaskBayerRowSSE2(const uint8_t *topRow, const uint8_t *bottomRow, uint8_t *maskRow, int maskWidth, uint8_t threshold)
+  {
+    const __m128i thresholdVec = _mm_set1_epi32(threshold);
+
+    // 64 input bytes of each row (16 cells) produce 16 mask bytes per iteration
+    int x = 0;
+    for (; x + 16 <= maskWidth; x += 16)
+    {
+      const uint8_t *top = topRow + 4 * x;
+      const uint8_t *bottom = bottomRow + 4 * x;
+      __m128i m0 = _mm_cmpgt_epi32(CellV4(top + 0, bottom + 0), thresholdVec);
+      __m128i m1 = _mm_cmpgt_epi32(CellV4(top + 16, bottom + 16), thresholdVec);
+      __m128i m2 = _mm_cmpgt_epi32(CellV4(top + 32, bottom + 32), thresholdVec);
+      __m128i m3 = _mm_cmpgt_epi32(CellV4(top + 48, bottom + 48), thresholdVec);
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(maskRow + x), PackMask16(m0, m1, m2, m3));
+    }
+
+    ExtractCoarseMaskBayerRowScalar(topRow + 4 * x, bottomRow + 4 * x, maskRow + x, maskWidth - x, threshold);
+  }
+
+  __attribute__((target("avx2")))
+  void ExtractMaskVRowAVX2(const uint8_t *yuyvRow, uint8_t *maskRow, int maskWidth, uint8_t threshold)
+  {
+    const __m256i thresholdVec = _mm256_set1_epi32(threshold);
+
+    // The 256-bit packs work per 128-bit lane, this restores sequential order of the 32-bit groups
+    const __m256i laneOrder = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+
+    // 128 input bytes (32 pixel pairs) produce 32 mask bytes per iteration
+    int x = 0;
+    for (; x + 32 <= maskWidth; x += 32)
+    {
+      const __m256i *in = reinterpret_cast<const __m256i *>(yuyvRow + 4 * x);
+
+      __m256i m0 = _mm256_cmpgt_epi32(_mm256_srli_epi32(_mm256_loadu_si256(in + 0), 24), thresholdVec);
+      __m256i m1 = _mm256_cmpgt_epi32(_mm256_srli_epi32(_mm256_loadu_si256(in + 1), 24), thresholdVec);
+      __m256i m2 = _mm256_cmpgt_epi32(_mm256_srli_epi32(_mm256_loadu_si256(in + 2), 24), thresholdVec);
+      __m256i m3 = _mm256_cmpgt_epi32(_mm256_srli_epi32(_mm256_loadu_si256(in + 3), 24), thresholdVec);
+
+      __m256i m01 = _mm256_packs_epi32(m0, m1);
+      __m256i m23 = _mm256_packs_epi32(m2, m3);
+      __m256i packed = _mm256_permutevar8x32_epi32(_mm256_packs_epi16(m01, m23), laneOrder);
+      _mm256_storeu_si256(reinterpret_cast<__m256i *>(maskRow + x), packed);
+    }
+
+    ExtractMaskVRowSSE2(yuyvRow + 4 * x, maskRow + x, maskWidth - x, threshold);
+  }
+
+  namespace
+  {
+    // CoarseV4 on eight samples from 64 YUYV bytes. The or leaves them in 32-bit groups 0, 2, 4, 6, 1, 3, 5, 7.
+    __attribute__((target("avx2")))
+    inline __m256i CoarseV8(const uint8_t *in)
+    {
+      const __m256i vByte = _mm256_set1_epi64x(0xFF000000);
+      const __m256i sampleOrder = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7);
+      const __m256i first = _mm256_srli_epi64(_mm256_and_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(in)), vByte), 24);
+      const __m256i second = _mm256_slli_epi64(_mm256_and_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(in + 32)), vByte), 8);
+      return _mm256_permutevar8x32_epi32(_mm256_or_si256(first, second), sampleOrder);
+    }
+
+    // CellV4 on eight cells from 32 bytes of each row
+    __attribute__((target("avx2")))
+    inline __m256i CellV8(const uint8_t *top, const uint8_t *bottom)
+    {
+      const __m256i lowByte = _mm256_set1_epi32(0x00FF);
+      const __m256i secondByte = _mm256_set1_epi32(0xFF00);
+      const __m256i topWeights = _mm256_setr_epi16(256, -107, 256, -107, 256, -107, 256, -107, 256, -107, 256, -107, 256, -107, 256, -107);
+      const __m256i bottomWeights = _mm256_setr_epi16(-107, -42, -107, -42, -107, -42, -107, -42, -107, -42, -107, -42, -107, -42, -107, -42);
+
+      const __m256i t = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(top));
+      const __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(bottom));
+      const __m256i tSpread = _mm256_or_si256(_mm256_and_si256(t, lowByte), _mm256_slli_epi32(_mm256_and_si256(t, secondByte), 8));
+      const __m256i bSpread = _mm256_or_si256(_mm256_and_si256(b, lowByte), _mm256_slli_epi32(_mm256_and_si256(b, secondByte), 8));
+      const __m256i sum = _mm256_add_epi32(_mm256_madd_epi16(tSpread, topWeights), _mm256_madd_epi16(bSpread, bottomWeights));
+      return _mm256_add_epi32(_mm256_srai_epi32(sum, 9), _mm256_set1_epi32(128));
+    }
+
+    // 0xFF or 0x00 bytes, in order, for the 32 int32 samples of m0..m3. The packs work per 128-bit lane, the
+    // permute restores the order of the 32-bit groups.
+    __attribute__((target("avx2")))
+    inline __m256i PackMask32(__m256i m0, __m256i m1, __m256i m2, __m256i m3)
+    {
+      const __m256i laneOrder = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+      return _mm256_permutevar8x32_epi32(_mm256_packs_epi16(_mm256_packs_epi32(m0, m1), _mm256_packs_epi32(m2, m3)), laneOrder);
+    }
+  }
+
+  __attribute__((target("avx2")))
+  void ExtractCoarseMaskVRowAVX2(const uint8_t *yuyvRow, uint8_t *maskRow, int maskWidth, uint8_t threshold)
+  {
+    const __m256i thresholdVec = _mm256_set1_epi32(threshold);
+
+    // 256 input bytes (32 samples) produce 32 mask bytes per iteration
+    int x = 0;
+    for (; x + 32 <= maskWidth; x += 32)
+    {
+      const uint8_t *in = yuyvRow + 8 * x;
+      __m256i m0 = _mm256_cmpgt_epi32(CoarseV8(in + 0), thresholdVec);
+      __m256i m1 = _mm256_cmpgt_epi32(CoarseV8(in + 64), thresholdVec);
+      __m256i m2 = _mm256_cmpgt_epi32(CoarseV8(in + 128), thresholdVec);
+      __m256i m3 = _mm256_cmpgt_epi32(CoarseV8(in + 192), thresholdVec);
+      _mm256_storeu_si256(reinterpret_cast<__m256i *>(maskRow + x), PackMask32(m0, m1, m2, m3));
+    }
+
+    ExtractCoarseMaskVRowSSE2(yuyvRow + 8 * x, maskRow + x, maskWidth - x, threshold);
+  }
+
+  __attribute__((target("avx2")))
+  void ExtractCoarseMaskBayerRowAVX2(const uint8_t *topRow, const uint8_t *bottomRow, uint8_t *maskRow, int maskWidth, uint8_t threshold)
+  {
+    const __m256i thresholdVec = _mm256_set1_epi32(threshold);
+
+    // 128 input bytes of each row (32 cells) produce 32 mask bytes per iteration
+    int x = 0;
+    for (; x + 32 <= maskWidth; x += 32)
+    {
+      const uint8_t *top = topRow + 4 * x;
+      const uint8_t *bottom = bottomRow + 4 * x;
+      __m256i m0 = _mm256_cmpgt_epi32(CellV8(top + 0, bottom + 0), thresholdVec);
+      __m256i m1 = _mm256_cmpgt_epi32(CellV8(top + 32, bottom + 32), thresholdVec);
+      __m256i m2 = _mm256_cmpgt_epi32(CellV8(top + 64, bottom + 64), thresholdVec);
+      __m256i m3 = _mm256_cmpgt_epi32(CellV8(top + 96, bottom + 96), thresholdVec);
+      _mm256_storeu_si256(reinterpret_cast<__m256i *>(maskRow + x), PackMask32(m0, m1, m2, m3));
+    }
+
+    ExtractCoarseMaskBayerRowSSE2(topRow + 4 * x, bottomRow + 4 * x, maskRow + x, maskWidth - x, threshold);
+  }
+#endif
+
+  namespace
+  {
+    template <bool IsDilate>
+    inline uint8_t Combine(uint8_t a, uint8_t b) { return IsDilate ? std::max(a, b) : std::min(a, b); }
+
+    template <bool IsDilate>
+    void MorphMask(const uint8_t *src, size_t srcStep, uint8_t *dst, size_t dstStep, int width, int height, const MorphShape &shape, uint8_t *scratch)
+    {
+      const int radius = shape.radius;
+      const size_t planeSize = size_t(width) * height;
+
+      // Horizontal pass: one plane per distinct row half-width, each pixel combined with its row neighbours
+      bool widthUsed[MAX_MORPH_RADIUS + 1] = {};
+      for (int i = 0; i <= 2 * radius; ++i)
+      {
+        if (shape.halfWidths[i] >= 0)
+          widthUsed[shape.halfWidths[i]] = true;
+      }
+
+      for (int halfWidth = 0; halfWidth <= radius; ++halfWidth)
+      {
+        if (!widthUsed[halfWidth])
+          continue;
+
+        uint8_t *const plane = scratch + halfWidth * planeSize;
+        for (int y = 0; y < height; ++y)
+        {
+          const uint8_t *const in = src + y * srcStep;
+          uint8_t *const out = plane + size_t(y) * width;
+          std::memcpy(out, in, width);
+          for (int d = 1; d <= halfWidth; ++d)
+          {
+            for (int x = d; x < width; ++x)
+              out[x] = Combine<IsDilate>(out[x], in[x - d]);
+            for (int x = 0; x < width - d; ++x)
+              out[x] = Combine<IsDilate>(out[x], in[x + d]);
+          }
+        }
+      }
+
+      // Vertical pass: combine the planes of the rows covered by the shape. All of src has been read at this point,
+      // so writing dst in place is safe.
+      for (int y = 0; y < height; ++y)
+      {
+        uint8_t *const out = dst + y * dstStep;
+        bool first = true;
+        for (int dy = -radius; dy <= radius; ++dy)
+        {
+          const int halfWidth = shape.halfWidths[dy + radius];
+          const int sourceY = y + dy;
+          if (halfWidth < 0 || sourceY < 0 || sourceY >= height)
+            continue;
+
+          const uint8_t *const in = scratch + halfWidth * planeSize + size_t(sourceY) * width;
+          if (first)
+          {
+            std::memcpy(out, in, width);
+            first = false;
+            continue;
+          }
+          for (int x = 0; x < width; ++x)
+            out[x] = Combine<IsDilate>(out[x], in[x]);
+        }
+      }
+    }
+
+    struct MaskKernels
+    {
+      ExtractMaskVRowFn extractMaskVRow;
+      ExtractCoarseMaskVRowFn extractCoarseMaskVRow;
+      ExtractCoarseMaskBayerRowFn extractCoarseMaskBayerRow;
+      const char *name;
+    };
+
+    MaskKernels SelectMaskKernels()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+      __builtin_cpu_init();
+      if (__builtin_cpu_supports("avx2"))
+        return {ExtractMaskVRowAVX2, ExtractCoarseMaskVRowAVX2, ExtractCoarseMaskBayerRowAVX2, "avx2"};
+      if (__builtin_cpu_supports("sse2"))
+        return {ExtractMaskVRowSSE2, ExtractCoarseMaskVRowSSE2, ExtractCoarseMaskBayerRowSSE2, "sse2"};
+#endif
+      return {ExtractMaskVRowScalar, ExtractCoarseMaskVRowScalar, ExtractCoarseMaskBayerRowScalar, "scalar"};
+    }
+
+    // Resolved during static initialization, so the RT path only pays for an indirect call
+    const MaskKernels g_maskKernels = SelectMaskKernels();
+  }
+
+  ExtractMaskVRowFn ExtractMaskVRow() { return g_maskKernels.extractMaskVRow; }
+  const char *ExtractMaskVRowName() { return g_maskKernels.name; }
+  ExtractCoarseMaskVRowFn ExtractCoarseMaskVRow() { return g_maskKernels.extractCoarseMaskVRow; }
+  ExtractCoarseMaskBayerRowFn ExtractCoarseMaskBayerRow() { return g_maskKernels.extractCoarseMaskBayerRow; }
+
+  void BayerToYUYV(const uint8_t *bayer, uint8_t *yuyv, int width, int height)
+  {
+    for (int y = 0; y < height; y += 2)
+    {
+      const uint8_t *top = bayer + y * width;    // R G R G ...
+      const uint8_t *bottom = top + width;       // G B G B ...
+      uint8_t *topOut = yuyv + y * width * 2;
+      uint8_t *bottomOut = topOut + width * 2;
+      for (int x = 0; x < width; x += 2)
+      {
+        const int r = top[x], g0 = top[x + 1], g1 = bottom[x], b = bottom[x + 1];
+        const uint8_t u = static_cast<uint8_t>(128 + ((-86 * r - 85 * (g0 + g1) + 256 * b) >> 9));
+        const uint8_t v = static_cast<uint8_t>(BayerV(r, g0, g1, b));
+        const uint8_t yTop = static_cast<uint8_t>((77 * r + 150 * g0 + 29 * b) >> 8);
+        const uint8_t yBottom = static_cast<uint8_t>((77 * r + 150 * g1 + 29 * b) >> 8);
+
+        uint8_t *t = topOut + 2 * x;
+        uint8_t *d = bottomOut + 2 * x;
+        t[0] = yTop; t[1] = u; t[2] = yTop; t[3] = v;
+        d[0] = yBottom; d[1] = u; d[2] = yBottom; d[3] = v;
+      }
+    }
+  }
+
+  void ErodeMask(const uint8_t *src, size_t srcStep, uint8_t *dst, size_t dstStep, int width, int height, const MorphShape &shape, uint8_t *scratch)
+  {
+    MorphMask<false>(src, srcStep, dst, dstStep, width, height, shape, scratch);
+  }
+
+  void DilateMask(const uint8_t *src, size_t srcStep, uint8_t *dst, size_t dstStep, int width, int height, const MorphShape &shape, uint8_t *scratch)
+  {
+    MorphMask<true>(src, srcStep, dst, dstStep, width, height, shape, scratch);
+  }
+}
@@ -1,74 +1,195 @@
 #include "image_processing.h"
 
+#include <array>
+#include <algorithm>
+#include <cmath>
+#include <span>
+#include <stdexcept>
+#include <string>
+
 #include <opencv2/opencv.hpp>
 
+#include "blob_extractor.h"
 #include "camera_helpers.h" // For image constants
+#include "frame_trace.h"
+#include "image_kernels.h"
+#include "memory_helpers.h"
+#include "stripe_workers.h"
 
 using namespace cv;
 
 namespace ImageProcessing
 {
-  void SubsampleBayer(const Mat& in, Mat& out)
+  using CameraHelpers::PixelFormat;
+
+  template <typename Mode>
+  void ExtractV(const Mat& in, Mat& out)
   {
-    // Subsample the Bayer image by taking every second 2x2 pixel block
-    for (int y = 0; y < CameraHelpers::IMAGE_HEIGHT; y += 4) {
-      const uchar* const row0 = in.ptr<uchar>(y);
-      const uchar* const row1 = in.ptr<uchar>(y + 1);
+    static_assert(Mode::FORMAT == PixelFormat::YUYV);
 
-      uchar* outRow0 = out.ptr<uchar>(y / 2);
-      uchar* outRow1 = out.ptr<uchar>(y / 2 + 1);
+    // Extract the V channel from a YUV image
+    for (int i = 0; i < Mode::HEIGHT; ++i)
+    {
+      const uchar* const inRow = in.ptr<uchar>(i);    // 2 channels per pixel
+      uchar* outRow = out.ptr<uchar>(i / 2);
 
-      for (int x = 0; x < CameraHelpers::IMAGE_WIDTH; x += 4)
+      for (int j = 0; j < Mode::WIDTH; j += 2)
       {
-        outRow0[x / 2    ] = row0[x    ];
-        outRow0[x / 2 + 1] = row0[x + 1];
-        outRow1[x / 2    ] = row1[x    ];
-        outRow1[x / 2 + 1] = row1[x + 1];
+        outRow[j / 2] = inRow[2 * j + 3];      // channel 1 of pixel j+1 (V)
       }
     }
   }
 
-  void SubsampleYUYV(const Mat& in, Mat& out)
+  void ExtractMaskV(const Mat& in, Mat& out, const Rect& roi)
   {
-    for (int i = 0; i < CameraHelpers::IMAGE_HEIGHT; i += 2)
+    // Fused ExtractV + threshold: reads the V samples straight from the YUYV rows and writes the binary mask.
+    // ExtractV keeps the odd row of each row pair, so only those rows are read. The roi is in mask coordinates.
+    static const Kernels::ExtractMaskVRowFn extractMaskVRow = Kernels::ExtractMaskVRow();
+    constexpr uint8_t THRESHOLD = static_cast<uint8_t>(RED_THRESHOLD);
+
+    for (int y = roi.y; y < roi.y + roi.height; ++y)
     {
-      const uchar* const inRow = in.ptr<uchar>(i);    // 2 channels per pixel
-      uchar* outRow = out.ptr<uchar>(i / 2);          // 3 channels per pixel
+      extractMaskVRow(in.ptr<uchar>(2 * y + 1) + 4 * roi.x, out.ptr<uchar>(y) + roi.x, roi.width, THRESHOLD);
+    }
+  }
+
+  template <typename Mode>
+  void ExtractMaskV(const Mat& in, Mat& out)
+  {
+    static_assert(Mode::FORMAT == PixelFormat::YUYV);
+    ExtractMaskV(in, out, Rect(0, 0, Mode::WIDTH / 2, Mode::HEIGHT / 2));
+  }
+
+  template void ExtractV<YUYVMode>(const Mat& in, Mat& out);
+  template void ExtractMaskV<YUYVMode>(const Mat& in, Mat& out);
 
-      for (int j = 0; j < CameraHelpers::IMAGE_WIDTH; j += 2)
+  namespace
+  {
+    Kernels::MorphShape MakeMorphShape(const Mat& kernel)
+    {
+      // Row half-widths of a symmetric, row-convex structuring element
+      Kernels::MorphShape shape;
+      shape.radius = kernel.rows / 2;
+      for (int y = 0; y < kernel.rows; ++y)
       {
-        outRow[3 * (j / 2)    ] = inRow[2 * j    ];      // channel 0 of pixel j (Y)
-        outRow[3 * (j / 2) + 1] = inRow[2 * j + 1];      // channel 1 of pixel j (U)
-        outRow[3 * (j / 2) + 2] = inRow[2 * j + 3];      // channel 1 of pixel j+1 (V)
+        int count = 0;
+        for (int x = 0; x < kernel.cols; ++x)
+          count += kernel.at<uchar>(y, x) != 0;
+        shape.halfWidths[y] = count > 0 ? (count - 1) / 2 : -1;
       }
+      return shape;
+    }
+
+    // Size of the elliptical structuring element used to clean up the mask, and the one of the same reach in full-resolution
+    // pixels (rounded down to odd) for the coarse mask
+    constexpr int MORPH_KERNEL_SIZE = 7;
+    constexpr int COARSE_MORPH_KERNEL_SIZE = 3;
+
+    // Same structuring elements as MaskV, built when the library loads rather than on the RT path
+    const Kernels::MorphShape g_maskMorphShape = MakeMorphShape(getStructuringElement(MORPH_ELLIPSE, Size(MORPH_KERNEL_SIZE, MORPH_KERNEL_SIZE)));
+    const Kernels::MorphShape g_coarseMorphShape = MakeMorphShape(getStructuringElement(MORPH_ELLIPSE, Size(COARSE_MORPH_KERNEL_SIZE, COARSE_MORPH_KERNEL_SIZE)));
+
+    // Scratch buffer preallocated for the largest mask, so the morphology never allocates
+    uint8_t g_morphScratch[Kernels::MorphScratchSize(CameraHelpers::IMAGE_WIDTH / 2, CameraHelpers::IMAGE_HEIGHT / 2, MORPH_KERNEL_SIZE / 2)];
+
+    void CloseOpen(Mat& mask, const Kernels::MorphShape& shape, uint8_t* scratch = g_morphScratch)
+    {
+      // Close (dilate, erode) then open (erode, dilate), in place.
+      // Pixels outside of a region-of-interest view are ignored, like OpenCV's BORDER_ISOLATED.
+      Kernels::DilateMask(mask.data, mask.step, mask.data, mask.step, mask.cols, mask.rows, shape, scratch);
+      Kernels::ErodeMask(mask.data, mask.step, mask.data, mask.step, mask.cols, mask.rows, shape, scratch);
+      Kernels::ErodeMask(mask.data, mask.step, mask.data, mask.step, mask.cols, mask.rows, shape, scratch);
+      Kernels::DilateMask(mask.data, mask.step, mask.data, mask.step, mask.cols, mask.rows, shape, scratch);
     }
   }
 
-  void ExtractV(const Mat& in, Mat& out)
+  void CloseOpenMask(Mat& mask)
   {
-    // Extract the V channel from a YUV image
-    for (int i = 0; i < CameraHelpers::IMAGE_HEIGHT; ++i)
+    CloseOpen(mask, g_maskMorphShape);
+  }
+
+  // A frame of the mode, or the frame of an AOI of it as the camera delivers it, see Detector
+  template <typename Mode>
+  struct AoiFrame
+  {
+    static constexpr int BYTES_PER_PIXEL = CameraHelpers::BytesPerPixel(Mode::FORMAT);
+
+    const uint8_t* data;
+    CameraHelpers::CameraAoi aoi;
+
+    int RowBytes() const { return static_cast<int>(aoi.width) * BYTES_PER_PIXEL; }
+
+    // Pixel (x, y) of the full frame, which has to be in the AOI
+    const uint8_t* At(int x, int y) const
     {
-      const uchar* const inRow = in.ptr<uchar>(i);    // 2 channels per pixel
-      uchar* outRow = out.ptr<uchar>(i / 2);
+      return data + (y - static_cast<int>(aoi.offsetY)) * RowBytes() + (x - static_cast<int>(aoi.offsetX)) * BYTES_PER_PIXEL;
+    }
+  };
+
+  // Coarse mask of the roi (in coarse mask coordinates) of a frame of the mode, every row DECIMATION apart. Blocks
+  // outside of the AOI of the frame are 0. The row kernels are dispatched like ExtractMaskV's.
+  template <typename Mode>
+  void ExtractCoarseMask(const AoiFrame<Mode>& frame, Mat& out, const Rect& roi)
+  {
+    constexpr int DECIMATION = Mode::DECIMATION;
+    constexpr uint8_t THRESHOLD = static_cast<uint8_t>(RED_THRESHOLD);
+    static_assert(DECIMATION == 4, "The coarse mask kernels sample every fourth pixel");
+    static_assert(CameraHelpers::AOI_ALIGNMENT % DECIMATION == 0, "An AOI has to cover whole coarse pixels");
+    const Rect aoi(static_cast<int>(frame.aoi.offsetX) / DECIMATION, static_cast<int>(frame.aoi.offsetY) / DECIMATION,
+                   static_cast<int>(frame.aoi.width) / DECIMATION, static_cast<int>(frame.aoi.height) / DECIMATION);
+    const Rect inside = roi & aoi;
+    for (int y = roi.y; y < roi.y + roi.height; ++y)
+    {
+      uchar* const row = out.ptr<uchar>(y);
+      if (inside.empty() || y < inside.y || y >= inside.y + inside.height)
+      {
+        std::fill_n(row + roi.x, roi.width, uchar{0});
+        continue;
+      }
+      std::fill(row + roi.x, row + inside.x, uchar{0});
+      std::fill(row + inside.x + inside.width, row + roi.x + roi.width, uchar{0});
 
-      for (int j = 0; j < CameraHelpers::IMAGE_WIDTH; j += 2)
+      if constexpr (Mode::FORMAT == PixelFormat::BayerRG8)
       {
-        outRow[j / 2] = inRow[2 * j + 3];      // channel 1 of pixel j+1 (V)
+        // One RGGB cell per block, thresholded on the cell's V like the YUYV samples
+        static const Kernels::ExtractCoarseMaskBayerRowFn extractRow = Kernels::ExtractCoarseMaskBayerRow();
+        const uchar* const top = frame.At(DECIMATION * inside.x, DECIMATION * y);
+        extractRow(top, top + frame.RowBytes(), row + inside.x, inside.width, THRESHOLD);
+      }
+      else
+      {
+        // The V sample of one pixel pair per block, from the block's second row
+        static const Kernels::ExtractCoarseMaskVRowFn extractRow = Kernels::ExtractCoarseMaskVRow();
+        extractRow(frame.At(DECIMATION * inside.x, DECIMATION * y + 1), row + inside.x, inside.width, THRESHOLD);
       }
     }
   }
 
+  void ExtractCoarseMaskV(const Mat& in, Mat& out, const Rect& roi)
+  {
+    ExtractCoarseMask<YUYVMode>(AoiFrame<YUYVMode>{in.data, CameraHelpers::CameraAoi()}, out, roi);
+  }
+
+  void ExtractCoarseMaskBayer(const Mat& in, Mat& out, const Rect& roi)
+  {
+    ExtractCoarseMask<BayerRG8Mode>(AoiFrame<BayerRG8Mode>{in.data, CameraHelpers::CameraAoi()}, out, roi);
+  }
+
+  void CloseOpenCoarseMask(Mat& mask)
+  {
+    CloseOpen(mask, g_coarseMorphShape);
+  }
+
   void MaskV(const Mat& in, Mat& out)
   {
-    static Mat kernel = getStructuringElement(MORPH_ELLIPSE, Size(7, 7));
+    static Mat kernel = getStructuringElement(MORPH_ELLIPSE, Size(MORPH_KERNEL_SIZE, MORPH_KERNEL_SIZE));
 
     threshold(in, out, RED_THRESHOLD, 255, THRESH_BINARY);
     morphologyEx(out, out, MORPH_CLOSE, kernel);
     morphologyEx(out, out, MORPH_OPEN, kernel);
   }
 
-  double CircleFitError(const std::vector<cv::Point>& pts, const cv::Point2f& center, float radius)
+  double CircleFitError(std::span<const cv::Point> pts, const cv::Point2f& center, float radius)
   {
     double sum = 0.0;
     for (const auto& p : pts) {
@@ -78,13 +199,16 @@ namespace ImageProcessing
     return pts.empty() ? 0.0 : sum / pts.size();
   }
 
-  void FitCircleTaubin(const std::vector<cv::Point> &pts, cv::Point2f &center, float &radius)
+  template <typename PointT>
+  bool FitCircleTaubinPoints(std::span<const PointT> pts, cv::Point2f &center, float &radius)
   {
     // Taubin fit method for circle fitting (Newton-based) : https://people.cas.uab.edu/~mosya/cl/MATLABcircle.html
     constexpr int MAX_ITERS = 10;
     constexpr double EPSILON = 1e-12;
     
     const size_t numPoints = pts.size();
+    if (numPoints < 3)
+      return false;
 
     double sum_x = 0, sum_y = 0;
     for (const auto &p : pts) {
@@ -94,15 +218,10 @@ namespace ImageProcessing
     double mean_x = sum_x / numPoints;
     double mean_y = sum_y /numPoints;
 
-    // Center data
-    std::vector<cv::Point2f> cpts;
-    cpts.reserve(numPoints);
-    for (const auto &p : pts) cpts.emplace_back(p.x - mean_x, p.y - mean_y);
-
-    // Compute moments
+    // Compute moments of the centered data, centering each point as it is read
     double Mxx=0, Myy=0, Mxy=0, Mxz=0, Myz=0, Mzz=0;
-    for (const auto &p : cpts) {
-      double x = p.x, y = p.y;
+    for (const auto &p : pts) {
+      double x = p.x - mean_x, y = p.y - mean_y;
       double z = x*x + y*y;
       Mxx += x*x;
       Myy += y*y;
@@ -119,8 +238,8 @@ namespace ImageProcessing
     double Cov_xy = Mxx*Myy - Mxy*Mxy;
     double A3 = 4*Mz;
     double A2 = -3*Mz*Mz - Mzz;
-    double A1 = Mzz*Mz + 4*Cov_xy*Mz - Mxz*Mxz - Myz*Myz;
-    double A0 = Mxz*Mxz*Myy + Myz*Myz*Mxx - Mzz*Cov_xy - 2*Mxz*Myz*Mxy;
+    double A1 = Mzz*Mz + 4*Cov_xy*Mz - Mxz*Mxz - Myz*Myz - Mz*Mz*Mz;
+    double A0 = Mxz*Mxz*Myy + Myz*Myz*Mxx - Mzz*Cov_xy - 2*Mxz*Myz*Mxy + Mz*Mz*Cov_xy;
     double xnew = 0;
 
     for (int i = 0; i < MAX_ITERS; ++i) {
@@ -131,16 +250,32 @@ namespace ImageProcessing
       if (fabs((xnew - xold)/xnew) < EPSILON) break;
     }
 
-    double det = xnew*xnew + xnew*Mz + Cov_xy;
+    // Points on a line (or all on one spot) leave the system singular, with no circle to report
+    double det = xnew*xnew - xnew*Mz + Cov_xy;
+    if (!(std::abs(det) > EPSILON * Mz * Mz))
+      return false;
     double a = (Mxz*(Myy - xnew) - Myz*Mxy) / det / 2.0;
     double b = (Myz*(Mxx - xnew) - Mxz*Mxy) / det / 2.0;
-    double r = sqrt(a*a + b*b + (Mz + xnew));
+    double r = sqrt(a*a + b*b + Mz);
+    if (!std::isfinite(a) || !std::isfinite(b) || !std::isfinite(r))
+      return false;
 
     center = cv::Point2f(static_cast<float>(a + mean_x), static_cast<float>(b + mean_y));
     radius = static_cast<float>(r);
+    return true;
+  }
+
+  bool FitCircleTaubin(std::span<const cv::Point> pts, cv::Point2f &center, float &radius)
+  {
+    return FitCircleTaubinPoints(pts, center, radius);
   }
 
-  void FitCircleLeastSquares(const std::vector<Point> &contour, Point2f &center, float &radius)
+  bool FitCircleTaubin(std::span<const cv::Point2f> pts, cv::Point2f &center, float &radius)
+  {
+    return FitCircleTaubinPoints(pts, center, radius);
+  }
+
+  bool FitCircleLeastSquares(std::span<const Point> contour, Point2f &center, float &radius)
   {
     /*
     Least Squares Circle Fitting method:
@@ -158,105 +293,532 @@ namespace ImageProcessing
     where:
       A = [x_i, y_i, 1], X = (2a, 2b, c), B = [x_i^2 + y_i^2] 
 
-    We can then solve for X using least squares, which can be done using OpenCV's solve function.
+    We can then solve for X using least squares through the normal equations (A^T * A) * X = A^T * B.
+    A^T * A and A^T * B are only 3x3 and 3x1, so they are accumulated directly in fixed-size matrices and nothing is allocated.
     The solution will give us 2a, 2b, and c, from which we can derive the center (a, b) and radius (r = sqrt(c + a^2 + b^2)).
+    A^T * A is only positive definite when there are three points off a line, which the Cholesky pivots show.
     */
+    if (contour.size() < 3)
+      return false;
+
+    Matx33d AtA = Matx33d::zeros();
+    Matx31d AtB = Matx31d::zeros();
+    for (const auto& point : contour)
+    {
+      const double x = point.x;
+      const double y = point.y;
+      const double z = x * x + y * y;
 
-    // Put the contour points into matrices
-    Mat A(contour.size(), 3, CV_32F);
-    Mat B(contour.size(), 1, CV_32F);
-    Mat X(3, 1, CV_32F);
+      AtA(0, 0) += x * x; AtA(0, 1) += x * y; AtA(0, 2) += x;
+      AtA(1, 1) += y * y; AtA(1, 2) += y;
+      AtA(2, 2) += 1.0;
 
-    // Get raw pointers to the data blocks outside the loop for better performance
-    float* A_data = reinterpret_cast<float*>(A.data);
-    float* B_data = reinterpret_cast<float*>(B.data);
-    const size_t numPoints = contour.size();
+      AtB(0) += x * z;
+      AtB(1) += y * z;
+      AtB(2) += z;
+    }
+    AtA(1, 0) = AtA(0, 1);
+    AtA(2, 0) = AtA(0, 2);
+    AtA(2, 1) = AtA(1, 2);
+
+    // Cholesky factorization A^T * A = L * L^T. A pivot that is not clearly positive means the points are collinear
+    // (or repeated), and the solution would be NaN or meaningless.
+    constexpr double PIVOT_EPSILON = 1e-12;
+    Matx33d L = Matx33d::zeros();
+    for (int j = 0; j < 3; ++j)
+    {
+      double pivot = AtA(j, j);
+      for (int k = 0; k < j; ++k)
+        pivot -= L(j, k) * L(j, k);
+      if (!(pivot > PIVOT_EPSILON * AtA(j, j)))
+        return false;
+      L(j, j) = sqrt(pivot);
+
+      for (int i = j + 1; i < 3; ++i)
+      {
+        double sum = AtA(i, j);
+        for (int k = 0; k < j; ++k)
+          sum -= L(i, k) * L(j, k);
+        L(i, j) = sum / L(j, j);
+      }
+    }
 
-    for (size_t i = 0; i < numPoints; ++i)
+    // Solve L * Y = A^T * B, then L^T * X = Y, and compute the circle parameters
+    Matx31d Y, X;
+    for (int i = 0; i < 3; ++i)
     {
-      const auto& point = contour[i];
+      double sum = AtB(i);
+      for (int k = 0; k < i; ++k)
+        sum -= L(i, k) * Y(k);
+      Y(i) = sum / L(i, i);
+    }
+    for (int i = 2; i >= 0; --i)
+    {
+      double sum = Y(i);
+      for (int k = i + 1; k < 3; ++k)
+        sum -= L(k, i) * X(k);
+      X(i) = sum / L(i, i);
+    }
+
+    const double a = X(0) * 0.5;
+    const double b = X(1) * 0.5;
+    const double rSquared = X(2) + a * a + b * b;
+    if (!(rSquared > 0.0) || !std::isfinite(rSquared))
+      return false;
 
-      A_data[3 * i + 0] = point.x;
-      A_data[3 * i + 1] = point.y;
-      A_data[3 * i + 2] = 1.0f;
+    center.x = static_cast<float>(a);
+    center.y = static_cast<float>(b);
+    radius = static_cast<float>(sqrt(rSquared));
+    return true;
+  }
 
-      B_data[i] = point.x * point.x + point.y * point.y;
+  namespace
+  {
+    // Preallocated once, labeling the mask does not allocate
+    BlobExtractor g_blobs;
+
+    // The most circular of the blobs last labeled by g_blobs
+    bool FindBestBlob(int blobCount, Vec3f &ball)
+    {
+      double minError = MAX_CIRCLE_FIT_ERROR;
+      int bestBlobIndex = -1;
+      for (int i = 0; i < blobCount; ++i)
+      {
+        std::span<const Point> boundary = g_blobs[i].Boundary();
+        Point2f center;
+        float radius;
+        if (!FitCircleTaubin(boundary, center, radius))
+          continue; // Too few points, or all on a line
+        double error = CircleFitError(boundary, center, radius);
+        if (error < minError)
+        {
+          minError = error;
+          bestBlobIndex = i;
+          ball = Vec3f(center.x, center.y, radius);
+        }
+      }
+      if (bestBlobIndex == -1)
+        return false; // No valid blob found
+
+      return true;
     }
-    
-    // Solve the linear system using SVD decomposition and compute the circle parameters
-    solve( A, B, X, cv::DECOMP_SVD );
-    center.x = X.at<float>(0) * 0.5f;
-    center.y = X.at<float>(1) * 0.5f;
-    radius = sqrt( X.at<float>(2) + center.x*center.x + center.y*center.y );
   }
 
-  bool FindBall(const Mat& mask, Vec3f &ball)
+  bool FindBall(const Mat& mask, Vec3f &ball, double minArea)
+  {
+    // Find the most circular blob, that is of a minimum size
+    const int blobCount = g_blobs.Extract(mask, static_cast<int>(minArea));
+    return FindBestBlob(blobCount, ball);
+  }
+
+  namespace
   {
-    constexpr double MIN_AREA = MIN_CONTOUR_AREA / 4.0; // Adjusted for downsampled image
+    // Where the V of an RGGB cell sits, in pixels from its top-left (red) site. V weighs the red site by half, which
+    // pulls the edges it shows from the cell center (0.5) to about a quarter pixel.
+    constexpr float BAYER_V_POSITION = 0.25f;
+
+    // Bilinear V at a full-resolution position of a frame of the mode. YUYV V samples sit at x = 2 * pair + 0.5 of every
+    // row. BayerRG8 frames give one V per RGGB cell, placed at x = 2 * cellX + BAYER_V_POSITION and
+    // y = 2 * cellY + BAYER_V_POSITION. Returns false outside of the AOI of the frame.
+    template <typename Mode>
+    bool SampleV(const AoiFrame<Mode>& frame, float x, float y, float& v)
+    {
+      const int aoiLeft = static_cast<int>(frame.aoi.offsetX);
+      const int aoiTop = static_cast<int>(frame.aoi.offsetY);
+      const int aoiRight = aoiLeft + static_cast<int>(frame.aoi.width);
+      const int aoiBottom = aoiTop + static_cast<int>(frame.aoi.height);
+      if constexpr (Mode::FORMAT == PixelFormat::BayerRG8)
+      {
+        const float cx = (x - BAYER_V_POSITION) * 0.5f;
+        const float cy = (y - BAYER_V_POSITION) * 0.5f;
+        const int cx0 = static_cast<int>(std::floor(cx));
+        const int cy0 = static_cast<int>(std::floor(cy));
+        if (cx0 < aoiLeft / 2 || cy0 < aoiTop / 2 || cx0 + 1 >= aoiRight / 2 || cy0 + 1 >= aoiBottom / 2)
+          return false;
+
+        const int rowBytes = frame.RowBytes();
+        auto cellV = [&](int cellX, int cellY)
+        {
+          const uchar* const top = frame.At(2 * cellX, 2 * cellY);
+          const uchar* const bottom = top + rowBytes;
+          return static_cast<float>(Kernels::BayerV(top[0], top[1], bottom[0], bottom[1]));
+        };
+        const float fx = cx - cx0;
+        const float fy = cy - cy0;
+        const float top = cellV(cx0, cy0) + (cellV(cx0 + 1, cy0) - cellV(cx0, cy0)) * fx;
+        const float bottom = cellV(cx0, cy0 + 1) + (cellV(cx0 + 1, cy0 + 1) - cellV(cx0, cy0 + 1)) * fx;
+        v = top + (bottom - top) * fy;
+      }
+      else
+      {
+        const float u = (x - 0.5f) * 0.5f;
+        const int u0 = static_cast<int>(std::floor(u));
+        const int y0 = static_cast<int>(std::floor(y));
+        if (u0 < aoiLeft / 2 || y0 < aoiTop || u0 + 1 >= aoiRight / 2 || y0 + 1 >= aoiBottom)
+          return false;
+
+        const float fu = u - u0;
+        const float fy = y - y0;
+        const uchar* const row0 = frame.At(2 * u0, y0) + 3;
+        const uchar* const row1 = row0 + frame.RowBytes();
+        const float top = row0[0] + (row0[4] - row0[0]) * fu;
+        const float bottom = row1[0] + (row1[4] - row1[0]) * fu;
+        v = top + (bottom - top) * fy;
+      }
+      return true;
+    }
+
+    std::array<Point2f, REFINE_RAYS> MakeRayDirections()
+    {
+      std::array<Point2f, REFINE_RAYS> directions;
+      for (int ray = 0; ray < REFINE_RAYS; ++ray)
+      {
+        const double angle = 2.0 * std::numbers::pi * ray / REFINE_RAYS;
+        directions[ray] = Point2f(static_cast<float>(std::cos(angle)), static_cast<float>(std::sin(angle)));
+      }
+      return directions;
+    }
 
-    std::vector<std::vector<cv::Point>> contours;
-    std::vector<cv::Vec4i> hierarchy;
-    cv::findContours(mask, contours, hierarchy, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_SIMPLE);
+    // Unit directions of the refinement rays, built when the library loads
+    const std::array<Point2f, REFINE_RAYS> g_rayDirections = MakeRayDirections();
 
-    // Find the most circular contour, that is of a minimum size
-    double minError = MAX_CIRCLE_FIT_ERROR;
-    int bestContourIndex = -1;
-    for (int i = 0; i < contours.size(); ++i)
+    template <typename Mode>
+    bool RefineBall(const AoiFrame<Mode>& frame, const Vec3f& candidate, Vec3f& ball, MemoryHelpers::ScratchArena& arena)
     {
-      const std::vector<Point>& contour = contours[i];
-      if (hierarchy[i][3] != -1) continue; // Skip internal contours
-      if (contour.size() < MIN_AREA) continue; // Filter small contours
+      // Rays start well inside the candidate and end past its edge, the coarse radius is off by up to a coarse pixel
+      constexpr float RAY_STEP = 1.0f;
+      constexpr float EDGE_RESIDUAL = 2.0f; // Edge points further off the first fit are dropped (glints, clutter)
+      const float threshold = static_cast<float>(RED_THRESHOLD);
+      const float innerRadius = 0.5f * candidate[2];
+      const float outerRadius = 1.5f * candidate[2] + 2.0f * Mode::DECIMATION;
+
+      // Without room for the edge points the caller keeps the coarse circle
+      const std::span<Point2f> edgeBuffer = arena.TryAllocate<Point2f>(REFINE_RAYS);
+      if (edgeBuffer.empty())
+        return false;
+      size_t edgeCount = 0;
+      for (int ray = 0; ray < REFINE_RAYS; ++ray)
+      {
+        const float dx = g_rayDirections[ray].x;
+        const float dy = g_rayDirections[ray].y;
+
+        // Walk out to the first inside-to-outside crossing of the threshold
+        float previous = 0.0f;
+        bool inside = false;
+        for (float r = innerRadius; r <= outerRadius; r += RAY_STEP)
+        {
+          float v;
+          if (!SampleV<Mode>(frame, candidate[0] + r * dx, candidate[1] + r * dy, v))
+            break;
+          if (v > threshold)
+          {
+            inside = true;
+          }
+          else if (inside)
+          {
+            const float edge = r - RAY_STEP * (threshold - v) / (previous - v);
+            edgeBuffer[edgeCount++] = Point2f(candidate[0] + edge * dx, candidate[1] + edge * dy);
+            break;
+          }
+          previous = v;
+        }
+      }
+      std::span<Point2f> edges = edgeBuffer.first(edgeCount);
+      if (static_cast<int>(edges.size()) < MIN_REFINE_EDGE_POINTS)
+        return false;
 
       Point2f center;
       float radius;
-      FitCircleTaubin(contour, center, radius);
-      double error = CircleFitError(contour, center, radius);
-      if (error < minError)
+      if (!FitCircleTaubin(std::span<const Point2f>(edges), center, radius))
+        return false;
+
+      // Refit without the edges that do not belong to the circle
+      const auto outliers = std::remove_if(edges.begin(), edges.end(), [&](const Point2f& p) { return std::abs(static_cast<float>(cv::norm(p - center)) - radius) > EDGE_RESIDUAL; });
+      const std::span<Point2f> inliers = edges.first(static_cast<size_t>(outliers - edges.begin()));
+      if (static_cast<int>(inliers.size()) < MIN_REFINE_EDGE_POINTS)
+        return false;
+      if (inliers.size() != edges.size() && !FitCircleTaubin(std::span<const Point2f>(inliers), center, radius))
+        return false;
+
+      // The refined circle has to be the candidate
+      const float shift = static_cast<float>(cv::norm(center - Point2f(candidate[0], candidate[1])));
+      constexpr float DECIMATION = static_cast<float>(Mode::DECIMATION);
+      if (!std::isfinite(radius) || shift > 0.5f * candidate[2] + DECIMATION || std::abs(radius - candidate[2]) > 0.5f * candidate[2] + DECIMATION)
+        return false;
+
+      ball = Vec3f(center.x, center.y, radius);
+      return true;
+    }
+  }
+
+  bool RefineBall(const Mat& frame, const Vec3f& candidate, Vec3f& ball, MemoryHelpers::ScratchArena& arena)
+  {
+    if (frame.type() == CV_8UC1)
+      return RefineBall<BayerRG8Mode>(AoiFrame<BayerRG8Mode>{frame.data, CameraHelpers::CameraAoi()}, candidate, ball, arena);
+    return RefineBall<YUYVMode>(AoiFrame<YUYVMode>{frame.data, CameraHelpers::CameraAoi()}, candidate, ball, arena);
+  }
+
+  namespace
+  {
+    // Set by SetMinBlobArea, in full-resolution pixels
+    double g_minBlobArea = MIN_CONTOUR_AREA;
+
+    // Smallest blob of the coarse mask that can be the ball
+    template <typename Mode>
+    int CoarseMinArea()
+    {
+      return static_cast<int>(g_minBlobArea / (Mode::DECIMATION * Mode::DECIMATION));
+    }
+
+    // Moves a candidate found in the coarse mask at offset into full-resolution pixels and refines it there, keeping the
+    // coarse circle if that fails. Coarse pixels sit on the V samples of odd YUYV rows, or on the V of RGGB cells.
+    template <typename Mode>
+    void RefineCoarseCandidate(const AoiFrame<Mode>& frame, const Vec3f& candidate, const Point& offset, Vec3f& ball,
+                               MemoryHelpers::ScratchArena& arena)
+    {
+      constexpr bool BAYER = Mode::FORMAT == PixelFormat::BayerRG8;
+      constexpr float DECIMATION = static_cast<float>(Mode::DECIMATION);
+      const Vec3f fullResolution(DECIMATION * (candidate[0] + offset.x) + (BAYER ? BAYER_V_POSITION : 0.5f),
+                                 DECIMATION * (candidate[1] + offset.y) + (BAYER ? BAYER_V_POSITION : 1.0f),
+                                 DECIMATION * candidate[2]);
+      ball = fullResolution;
+      RefineBall<Mode>(frame, fullResolution, ball, arena);
+    }
+  }
+
+  template <typename Mode>
+  bool DetectInWindow(const AoiFrame<Mode>& frame, const Rect& window, Vec3f& ball, MemoryHelpers::ScratchArena& arena,
+                      DetectionStageTimes *times = nullptr)
+  {
+    // Static variables to avoid reallocation, one coarse mask per mode
+    static Mat coarse(Mode::COARSE_HEIGHT, Mode::COARSE_WIDTH, CV_8UC1);
+
+    // Only the window (in coarse mask coordinates) is extracted and processed, everything outside of it keeps stale data
+    ExtractCoarseMask<Mode>(frame, coarse, window);
+    Mat mask = coarse(window);
+    CloseOpenCoarseMask(mask);
+    if (times)
+      times->maskDoneNs = TimingHelpers::NowNs();
+
+    Vec3f candidate;
+    const bool found = FindBall(mask, candidate, CoarseMinArea<Mode>());
+    if (found)
+      RefineCoarseCandidate<Mode>(frame, candidate, window.tl(), ball, arena);
+    if (times)
+      times->fitDoneNs = TimingHelpers::NowNs();
+    return found;
+  }
+
+  namespace
+  {
+    // Set by UseStripeWorkers, nullptr searches the full frame on the calling thread
+    StripeWorkers* g_stripeWorkers = nullptr;
+
+    // Coarse mask and morphology scratch of each stripe of the parallel full-frame search, on their own cache lines
+    template <typename Mode>
+    struct alignas(64) StripeBuffers
+    {
+      uint8_t mask[Mode::COARSE_HEIGHT * Mode::COARSE_WIDTH];
+      uint8_t scratch[Kernels::MorphScratchSize(Mode::COARSE_WIDTH, Mode::COARSE_HEIGHT, COARSE_MORPH_KERNEL_SIZE / 2)];
+    };
+    template <typename Mode>
+    StripeBuffers<Mode> g_stripeBuffers[BlobExtractor::MAX_STRIPES];
+
+    // Coarse mask and labeling of one horizontal stripe of the frame, run by StripeWorkers
+    template <typename Mode>
+    void SearchStripe(void* context, int stripe, int stripeCount)
+    {
+      constexpr int COARSE_HEIGHT = Mode::COARSE_HEIGHT;
+      constexpr int COARSE_WIDTH = Mode::COARSE_WIDTH;
+      const AoiFrame<Mode>& frame = *static_cast<const AoiFrame<Mode>*>(context);
+      const int firstRow = COARSE_HEIGHT * stripe / stripeCount;
+      const int endRow = COARSE_HEIGHT * (stripe + 1) / stripeCount;
+
+      // Every morphology pass reaches one kernel radius further, so the stripe's rows come out as in the full mask when
+      // the mask is extracted and cleaned up that far beyond them
+      const int halo = 4 * g_coarseMorphShape.radius;
+      const int haloFirstRow = std::max(0, firstRow - halo);
+      const int haloEndRow = std::min(COARSE_HEIGHT, endRow + halo);
+      const Rect rows(0, haloFirstRow, COARSE_WIDTH, haloEndRow - haloFirstRow);
+
+      StripeBuffers<Mode>& buffers = g_stripeBuffers<Mode>[stripe];
+      Mat coarse(COARSE_HEIGHT, COARSE_WIDTH, CV_8UC1, buffers.mask);
+      ExtractCoarseMask<Mode>(frame, coarse, rows);
+      Mat mask = coarse(rows);
+      CloseOpen(mask, g_coarseMorphShape, buffers.scratch);
+
+      g_blobs.ExtractStripe(coarse, stripe, firstRow, endRow);
+    }
+  }
+
+  template <typename Mode>
+  bool DetectInFullFrame(const AoiFrame<Mode>& frame, Vec3f& ball, MemoryHelpers::ScratchArena& arena, DetectionStageTimes *times)
+  {
+    static_assert(Mode::COARSE_WIDTH <= BlobExtractor::MAX_MASK_WIDTH && Mode::COARSE_HEIGHT <= BlobExtractor::MAX_MASK_HEIGHT);
+
+    if (!g_stripeWorkers || g_stripeWorkers->StripeCount() == 1)
+      return DetectInWindow<Mode>(frame, Rect(0, 0, Mode::COARSE_WIDTH, Mode::COARSE_HEIGHT), ball, arena, times);
+
+    // The stripes are masked and labeled in parallel, then their blobs are joined across the seams
+    g_stripeWorkers->Run(SearchStripe<Mode>, const_cast<AoiFrame<Mode>*>(&frame));
+    const int blobCount = g_blobs.MergeStripes(g_stripeWorkers->StripeCount(), CoarseMinArea<Mode>());
+    if (times)
+      times->maskDoneNs = TimingHelpers::NowNs();
+
+    Vec3f candidate;
+    const bool found = FindBestBlob(blobCount, candidate);
+    if (found)
+      RefineCoarseCandidate<Mode>(frame, candidate, Point(0, 0), ball, arena);
+    if (times)
+      times->fitDoneNs = TimingHelpers::NowNs();
+    return found;
+  }
+
+  void UseStripeWorkers(StripeWorkers* workers)
+  {
+    g_stripeWorkers = workers;
+  }
+
+  void SetMinBlobArea(double area)
+  {
+    g_minBlobArea = area;
+  }
+
+  template <typename Mode>
+  bool DetectBallInFullFrame(const uint8_t* frame, const CameraHelpers::CameraAoi& aoi, Vec3f& ball, MemoryHelpers::ScratchArena& arena)
+  {
+    return DetectInFullFrame<Mode>(AoiFrame<Mode>{frame, aoi}, ball, arena, nullptr);
+  }
+
+  template <typename Mode>
+  bool TryGetTrackingWindow(const TrackingState& tracking, Rect& window)
+  {
+    // Predict the ball position assuming constant velocity since the last detection
+    Vec3f velocity = tracking.hasPrevious ? tracking.last - tracking.previous : Vec3f(0.0f, 0.0f, 0.0f);
+    float steps = static_cast<float>(tracking.misses + 1);
+    float predictedX = tracking.last[0] + velocity[0] * steps;
+    float predictedY = tracking.last[1] + velocity[1] * steps;
+
+    // Size the window from the last radius plus a margin that grows with every miss
+    float halfSize = tracking.last[2] + TRACKING_MOTION_MARGIN * steps;
+
+    // Convert to coarse mask coordinates
+    constexpr float SCALE = static_cast<float>(Mode::DECIMATION);
+    int x0 = static_cast<int>(std::floor((predictedX - halfSize) / SCALE));
+    int y0 = static_cast<int>(std::floor((predictedY - halfSize) / SCALE));
+    int x1 = static_cast<int>(std::ceil((predictedX + halfSize) / SCALE));
+    int y1 = static_cast<int>(std::ceil((predictedY + halfSize) / SCALE));
+
+    // A window touching the frame edge could cut the ball off, so search the full frame instead
+    if (x0 <= 0 || y0 <= 0 || x1 >= Mode::COARSE_WIDTH || y1 >= Mode::COARSE_HEIGHT)
+      return false;
+
+    window = Rect(x0, y0, x1 - x0, y1 - y0);
+    return true;
+  }
+
+  template <typename Mode>
+  bool DetectBall(const uint8_t* data, const CameraHelpers::CameraAoi& aoi, Vec3f& ball, TrackingState& tracking, DetectionMode& mode,
+                  MemoryHelpers::ScratchArena& arena, DetectionStageTimes *times)
+  {
+    const AoiFrame<Mode> frame{data, aoi};
+    Rect window;
+    if (tracking.locked && TryGetTrackingWindow<Mode>(tracking, window))
+    {
+      mode = DetectionMode::Tracking;
+      Vec3f found(0.0f, 0.0f, 0.0f);
+      if (DetectInWindow<Mode>(frame, window, found, arena, times))
+      {
+        ball = found;
+        tracking.previous = tracking.last;
+        tracking.hasPrevious = true;
+        tracking.last = ball;
+        tracking.misses = 0;
+        return true;
+      }
+
+      // Keep searching the (growing) window until too many frames were missed
+      if (++tracking.misses >= TRACKING_MAX_MISSES)
       {
-        minError = error;
-        bestContourIndex = i;
-        ball = Vec3f(center.x, center.y, radius);
+        tracking.locked = false;
+        tracking.hasPrevious = false;
       }
+      return false;
     }
-    if (bestContourIndex == -1)
-      return false; // No valid contour found
-    
-    return true;
+
+    mode = DetectionMode::FullFrame;
+    bool ballFound = DetectInFullFrame<Mode>(frame, ball, arena, times);
+    tracking.hasPrevious = ballFound && tracking.locked;
+    tracking.previous = tracking.last;
+    tracking.last = ball;
+    tracking.locked = ballFound;
+    tracking.misses = 0;
+    return ballFound;
   }
 
-  bool TryDetectBall(const Mat& yuyvFrame, Vec3f& ball)
+  template <typename Mode>
+  void CalculateBallOffset(const Vec3f& ball, double &offsetX, double &offsetY)
   {
-    // Static variables to avoid reallocation
-    static Mat v(CameraHelpers::IMAGE_HEIGHT / 2, CameraHelpers::IMAGE_WIDTH / 2, CV_8UC1);
+    constexpr double CENTER_X = Mode::WIDTH / 2.0;
+    constexpr double CENTER_Y = Mode::HEIGHT / 2.0;
 
-    ExtractV(yuyvFrame, v);
-    MaskV(v, v);
-    bool ballFound = FindBall(v, ball);
+    offsetX = MOTOR_UNITS_PER_PIXEL * (ball[0] - CENTER_X);
+    offsetY = MOTOR_UNITS_PER_PIXEL * (ball[1] - CENTER_Y);
+  }
+
+  template <typename Mode>
+  constexpr Detector MakeDetector()
+  {
+    return Detector{CameraHelpers::ModeInfo<Mode>(), DetectBallInFullFrame<Mode>, DetectBall<Mode>, CalculateBallOffset<Mode>};
+  }
 
-    // Scale the ball coordinates to match the original image size
-    ball *= 2.0f;
+  // The camera modes the pipeline is instantiated for, see YUYVMode
+  constexpr Detector DETECTORS[] = {
+      MakeDetector<YUYVMode>(),
+      MakeDetector<BayerRG8Mode>(),
+  };
 
-    return ballFound;
+  const Detector* FindDetector(const CameraHelpers::CameraModeInfo& mode)
+  {
+    for (const Detector& detector : DETECTORS)
+    {
+      if (detector.mode == mode)
+        return &detector;
+    }
+    return nullptr;
   }
 
-  void CalculateTargetPosition(const Vec3f& ball, double &offsetX, double &offsetY)
+  const Detector& GetDetector(const CameraHelpers::CameraModeInfo& mode)
   {
-    constexpr unsigned int CENTER_X = CameraHelpers::IMAGE_WIDTH / 2;
-    constexpr unsigned int CENTER_Y = CameraHelpers::IMAGE_HEIGHT / 2;
-    constexpr double MOTOR_UNITS_PER_PIXEL = -CameraHelpers::RADIANS_PER_PIXEL / (2.0 * std::numbers::pi);
+    const Detector* detector = FindDetector(mode);
+    if (detector == nullptr)
+      throw std::runtime_error("[ImageProcessing] No detection is built for " + std::to_string(mode.width) + "x" +
+                               std::to_string(mode.height) + (mode.format == PixelFormat::BayerRG8 ? " BayerRG8" : " YUYV") + " frames.");
+    return *detector;
+  }
 
-    // Calculate the offset from the center of the image
-    int pixelOffsetX = static_cast<int>(ball[0]) - CENTER_X;
-    int pixelOffsetY = static_cast<int>(ball[1]) - CENTER_Y;
+  namespace
+  {
+    CameraHelpers::CameraModeInfo ModeOf(const Mat& frame)
+    {
+      return CameraHelpers::CameraModeInfo{static_cast<uint32_t>(frame.cols), static_cast<uint32_t>(frame.rows),
+                                           frame.type() == CV_8UC1 ? PixelFormat::BayerRG8 : PixelFormat::YUYV};
+    }
+  }
 
-    if (std::abs(pixelOffsetX) > PIXEL_THRESHOLD)
-      offsetX = MOTOR_UNITS_PER_PIXEL * pixelOffsetX;
-    else
-      offsetX = 0.0;
-    
-    if (std::abs(pixelOffsetY) > PIXEL_THRESHOLD)
-      offsetY = MOTOR_UNITS_PER_PIXEL * pixelOffsetY;
-    else
-      offsetY = 0.0;
+  bool TryDetectBall(const Mat& frame, Vec3f& ball, MemoryHelpers::ScratchArena& arena)
+  {
+    return GetDetector(ModeOf(frame)).detectFullFrame(frame.data, CameraHelpers::CameraAoi(), ball, arena);
+  }
+
+  bool TryDetectBall(const Mat& frame, Vec3f& ball, TrackingState& tracking, DetectionMode& mode, MemoryHelpers::ScratchArena& arena,
+                     DetectionStageTimes *times)
+  {
+    return GetDetector(ModeOf(frame)).detect(frame.data, CameraHelpers::CameraAoi(), ball, tracking, mode, arena, times);
+  }
+
+  void CalculateBallOffset(const Vec3f& ball, double &offsetX, double &offsetY)
+  {
+    CalculateBallOffset<YUYVMode>(ball, offsetX, offsetY);
   }
 } // namespace ImageProcessing
@@ -0,0 +1,215 @@
+#include "jpeg_encoder.h"
+
+#include <algorithm>
+#include <csetjmp>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+
+#include <jpeglib.h>
+
+#include "camera_helpers.h"
+
+namespace PreviewHelpers
+{
+  namespace
+  {
+    // Larger than any JPEG of a full frame at the highest quality
+    constexpr size_t OUTPUT_BUFFER_SIZE = CameraHelpers::IMAGE_SIZE_YUYV + 64 * 1024;
+
+    // libjpeg's default error handler calls exit(). Jump back to the encoder instead, exceptions must not cross libjpeg.
+    struct ErrorManager
+    {
+      jpeg_error_mgr manager;
+      std::jmp_buf jump;
+    };
+
+    [[noreturn]] void ErrorExit(j_common_ptr cinfo)
+    {
+      std::longjmp(reinterpret_cast<ErrorManager *>(cinfo->err)->jump, 1);
+    }
+  }
+
+  struct JpegEncoder::Compressor
+  {
+    jpeg_compress_struct cinfo;
+    ErrorManager error;
+    jpeg_destination_mgr destination;
+
+    // Preallocated output buffer. Encode can also write into a buffer of the caller. A JPEG that does not fit wraps
+    // around and is reported as overflow.
+    std::unique_ptr<uint8_t[]> output = std::make_unique<uint8_t[]>(OUTPUT_BUFFER_SIZE);
+    uint8_t *target = nullptr;
+    size_t capacity = 0;
+    size_t outputSize = 0;
+    bool overflow = false;
+
+    // One MCU row (DCTSIZE image rows) of the Y, Cb and Cr planes for jpeg_write_raw_data
+    std::unique_ptr<uint8_t[]> planes;
+    JSAMPROW rows[3][DCTSIZE];
+    JSAMPARRAY components[3] = {rows[0], rows[1], rows[2]};
+
+    std::string ErrorMessage()
+    {
+      char message[JMSG_LENGTH_MAX];
+      (*error.manager.format_message)(reinterpret_cast<j_common_ptr>(&cinfo), message);
+      return message;
+    }
+
+    static void InitDestination(j_compress_ptr cinfo)
+    {
+      Compressor *compressor = static_cast<Compressor *>(cinfo->client_data);
+      compressor->destination.next_output_byte = compressor->target;
+      compressor->destination.free_in_buffer = compressor->capacity;
+      compressor->overflow = false;
+    }
+
+    static boolean EmptyOutputBuffer(j_compress_ptr cinfo)
+    {
+      Compressor *compressor = static_cast<Compressor *>(cinfo->client_data);
+      compressor->overflow = true;
+      compressor->destination.next_output_byte = compressor->target;
+      compressor->destination.free_in_buffer = compressor->capacity;
+      return TRUE;
+    }
+
+    static void TermDestination(j_compress_ptr cinfo)
+    {
+      Compressor *compressor = static_cast<Compressor *>(cinfo->client_data);
+      compressor->outputSize = compressor->capacity - compressor->destination.free_in_buffer;
+    }
+  };
+
+  JpegEncoder::JpegEncoder(int quality, bool downscale)
+      : compressor_(std::make_unique<Compressor>()),
+        width_(static_cast<int>(downscale ? CameraHelpers::IMAGE_WIDTH / 2 : CameraHelpers::IMAGE_WIDTH)),
+        height_(static_cast<int>(downscale ? CameraHelpers::IMAGE_HEIGHT / 2 : CameraHelpers::IMAGE_HEIGHT))
+  {
+    if (quality < 1 || quality > 100)
+      throw std::runtime_error("[PreviewHelpers] JPEG quality must be between 1 and 100.");
+
+    Compressor &c = *compressor_;
+    c.cinfo.err = jpeg_std_error(&c.error.manager);
+    c.error.manager.error_exit = ErrorExit;
+    if (setjmp(c.error.jump))
+    {
+      const std::string message = c.ErrorMessage();
+      jpeg_destroy_compress(&c.cinfo);
+      throw std::runtime_error("[PreviewHelpers] Failed to set up the JPEG encoder: " + message);
+    }
+
+    jpeg_create_compress(&c.cinfo);
+    c.cinfo.client_data = &c;
+    c.destination.init_destination = Compressor::InitDestination;
+    c.destination.empty_output_buffer = Compressor::EmptyOutputBuffer;
+    c.destination.term_destination = Compressor::TermDestination;
+    c.cinfo.dest = &c.destination;
+
+    // YCbCr 4:2:2 as delivered by the camera: full-width Y, half-width Cb and Cr on every row
+    c.cinfo.image_width = static_cast<JDIMENSION>(width_);
+    c.cinfo.image_height = static_cast<JDIMENSION>(height_);
+    c.cinfo.input_components = 3;
+    c.cinfo.in_color_space = JCS_YCbCr;
+    jpeg_set_defaults(&c.cinfo);
+    jpeg_set_colorspace(&c.cinfo, JCS_YCbCr);
+    jpeg_set_quality(&c.cinfo, quality, TRUE);
+    c.cinfo.raw_data_in = TRUE;
+    c.cinfo.dct_method = JDCT_IFAST;
+    c.cinfo.comp_info[0].h_samp_factor = 2;
+    c.cinfo.comp_info[0].v_samp_factor = 1;
+    for (int component = 1; component < 3; ++component)
+    {
+      c.cinfo.comp_info[component].h_samp_factor = 1;
+      c.cinfo.comp_info[component].v_samp_factor = 1;
+    }
+
+    // libjpeg reads whole DCT blocks, so the plane rows are padded to a multiple of 2 * DCTSIZE pixels
+    const size_t yStride = (static_cast<size_t>(width_) + 2 * DCTSIZE - 1) / (2 * DCTSIZE) * (2 * DCTSIZE);
+    const size_t chromaStride = yStride / 2;
+    c.planes = std::make_unique<uint8_t[]>(DCTSIZE * (yStride + 2 * chromaStride));
+    for (int row = 0; row < DCTSIZE; ++row)
+    {
+      c.rows[0][row] = c.planes.get() + row * yStride;
+      c.rows[1][row] = c.planes.get() + DCTSIZE * yStride + row * chromaStride;
+      c.rows[2][row] = c.planes.get() + DCTSIZE * (yStride + chromaStride) + row * chromaStride;
+    }
+  }
+
+  JpegEncoder::~JpegEncoder()
+  {
+    jpeg_destroy_compress(&compressor_->cinfo);
+  }
+
+  const uint8_t *JpegEncoder::Data() const
+  {
+    return compressor_->output.get();
+  }
+
+  size_t JpegEncoder::Encode(const uint8_t *yuyvFrame)
+  {
+    return Encode(yuyvFrame, compressor_->output.get(), OUTPUT_BUFFER_SIZE);
+  }
+
+  size_t JpegEncoder::Encode(const uint8_t *yuyvFrame, uint8_t *output, size_t capacity)
+  {
+    constexpr size_t SOURCE_STRIDE = CameraHelpers::IMAGE_WIDTH * 2;
+    const bool downscale = width_ != static_cast<int>(CameraHelpers::IMAGE_WIDTH);
+
+    Compressor &c = *compressor_;
+    c.target = output;
+    c.capacity = capacity;
+    if (setjmp(c.error.jump))
+    {
+      const std::string message = c.ErrorMessage();
+      jpeg_abort_compress(&c.cinfo);
+      throw std::runtime_error("[PreviewHelpers] JPEG encoding failed: " + message);
+    }
+
+    jpeg_start_compress(&c.cinfo, TRUE);
+    for (int firstRow = 0; firstRow < height_; firstRow += DCTSIZE)
+    {
+      for (int row = 0; row < DCTSIZE; ++row)
+      {
+        // Rows past the bottom repeat the last one
+        const int outputRow = std::min(firstRow + row, height_ - 1);
+        uint8_t *y = c.rows[0][row];
+        uint8_t *cb = c.rows[1][row];
+        uint8_t *cr = c.rows[2][row];
+
+        if (!downscale)
+        {
+          // Y0 U Y1 V: two luma samples and one chroma pair per 4 bytes
+          const uint8_t *source = yuyvFrame + outputRow * SOURCE_STRIDE;
+          for (int x = 0; x < width_ / 2; ++x, source += 4)
+          {
+            y[2 * x] = source[0];
+            cb[x] = source[1];
+            y[2 * x + 1] = source[2];
+            cr[x] = source[3];
+          }
+        }
+        else
+        {
+          // Average 2x2 luma samples, and 2x2 chroma pairs (4 bytes apart) for every output chroma sample
+          const uint8_t *top = yuyvFrame + 2 * outputRow * SOURCE_STRIDE;
+          const uint8_t *bottom = top + SOURCE_STRIDE;
+          for (int x = 0; x < width_; ++x)
+          {
+            const int i = 4 * x;
+            y[x] = static_cast<uint8_t>((top[i] + top[i + 2] + bottom[i] + bottom[i + 2] + 2) >> 2);
+          }
+          for (int x = 0; x < width_ / 2; ++x)
+          {
+            const int i = 8 * x;
+            cb[x] = static_cast<uint8_t>((top[i + 1] + top[i + 5] + bottom[i + 1] + bottom[i + 5] + 2) >> 2);
+            cr[x] = static_cast<uint8_t>((top[i + 3] + top[i + 7] + bottom[i + 3] + bottom[i + 7] + 2) >> 2);
+          }
+        }
+      }
+      jpeg_write_raw_data(&c.cinfo, c.components, DCTSIZE);
+    }
+    jpeg_finish_compress(&c.cinfo);
+
+    return c.overflow ? 0 : c.outputSize;
+  }
+}
@@ -0,0 +1,76 @@
+#include "position_history.h"
+
+namespace MotionHelpers
+{
+  namespace
+  {
+    // Samples the reader stays away from the writer, so the one it reads is not overwritten during the read
+    constexpr uint64_t WRITER_MARGIN = 16;
+  }
+
+  void PositionHistory::Push(const AxisSample &sample)
+  {
+    const uint64_t index = pushCount_.load(std::memory_order_relaxed);
+    Entry &entry = entries_[index % CAPACITY];
+
+    entry.sequence.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    entry.timeNs.store(sample.timeNs, std::memory_order_relaxed);
+    entry.sampleCounter.store(sample.sampleCounter, std::memory_order_relaxed);
+    entry.x.store(sample.x, std::memory_order_relaxed);
+    entry.y.store(sample.y, std::memory_order_relaxed);
+    entry.sequence.store(index + 1, std::memory_order_release);
+
+    pushCount_.store(index + 1, std::memory_order_release);
+  }
+
+  bool PositionHistory::TryRead(uint64_t index, AxisSample &sample) const
+  {
+    const Entry &entry = entries_[index % CAPACITY];
+    if (entry.sequence.load(std::memory_order_acquire) != index + 1)
+      return false;
+
+    sample.timeNs = entry.timeNs.load(std::memory_order_relaxed);
+    sample.sampleCounter = entry.sampleCounter.load(std::memory_order_relaxed);
+    sample.x = entry.x.load(std::memory_order_relaxed);
+    sample.y = entry.y.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return entry.sequence.load(std::memory_order_relaxed) == index + 1;
+  }
+
+  bool PositionHistory::TryInterpolate(int64_t timeNs, double &x, double &y) const
+  {
+    const uint64_t count = PushCount();
+    if (count == 0)
+      return false;
+
+    AxisSample after;
+    if (!TryRead(count - 1, after))
+      return false;
+    if (timeNs >= after.timeNs)
+    {
+      x = after.x;
+      y = after.y;
+      return true;
+    }
+
+    // Walk back from the newest sample to the one at or before timeNs, usually a few samples for a camera exposure
+    const uint64_t oldest = count > CAPACITY - WRITER_MARGIN ? count - (CAPACITY - WRITER_MARGIN) : 0;
+    for (uint64_t index = count - 1; index-- > oldest;)
+    {
+      AxisSample before;
+      if (!TryRead(index, before))
+        return false;
+      if (before.timeNs <= timeNs)
+      {
+        const int64_t span = after.timeNs - before.timeNs;
+        const double t = span > 0 ? static_cast<double>(timeNs - before.timeNs) / static_cast<double>(span) : 0.0;
+        x = before.x + (after.x - before.x) * t;
+        y = before.y + (after.y - before.y) * t;
+        return true;
+      }
+      after = before;
+    }
+    return false;
+  }
+}
@@ -0,0 +1,152 @@
+#include "preview_output.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "frame_serializer.h"
+#include "image_kernels.h"
+#include "settings_helpers.h"
+
+namespace PreviewHelpers
+{
+  namespace
+  {
+    constexpr const char *JSON_FILE_PATH = "/tmp/rsi_camera_data.json";
+    constexpr const char *JSON_TEMP_FILE_PATH = "/tmp/rsi_camera_data.json.tmp";
+    constexpr const char *RUNNING_FLAG_FILE_PATH = "/tmp/rsi_rt_task_running";
+
+    // Replaces the file contents with data. Returns false if the file could not be written completely.
+    bool WriteFile(const char *path, const char *data, size_t size)
+    {
+      const int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+      if (fd == -1)
+        return false;
+
+      while (size > 0)
+      {
+        const ssize_t written = write(fd, data, size);
+        if (written == -1 && errno == EINTR)
+          continue;
+        if (written <= 0)
+        {
+          close(fd);
+          return false;
+        }
+        data += written;
+        size -= static_cast<size_t>(written);
+      }
+      return close(fd) == 0;
+    }
+  }
+
+  PreviewSettings LoadPreviewSettings(const char *path)
+  {
+    PreviewSettings settings;
+
+    for (const SettingsHelpers::Setting &setting : SettingsHelpers::ReadSettingsFile(path))
+    {
+      if (setting.key == "transport")
+      {
+        if (setting.value == "shared_memory")
+          settings.transport = PreviewTransport::SharedMemory;
+        else if (setting.value == "json_file")
+          settings.transport = PreviewTransport::JsonFile;
+        else
+          throw std::runtime_error("[PreviewHelpers] Invalid preview transport: " + setting.value);
+      }
+      else if (setting.key == "jpeg_quality")
+        settings.jpegQuality = static_cast<int>(SettingsHelpers::ParseNumber(setting));
+      else if (setting.key == "downscale")
+        settings.downscale = SettingsHelpers::ParseBool(setting);
+      else if (setting.key == "stream_address")
+        settings.streamAddress = setting.value;
+      else if (setting.key == "stream_max_clients")
+        settings.streamMaxClients = static_cast<int>(SettingsHelpers::ParseNumber(setting));
+      else
+        throw std::runtime_error("[PreviewHelpers] Unknown preview setting: " + setting.key);
+    }
+
+    if (settings.streamMaxClients < 1)
+      throw std::runtime_error("[PreviewHelpers] stream_max_clients must be at least 1.");
+
+    return settings;
+  }
+
+  PreviewPublisher::PreviewPublisher(const PreviewSettings &settings)
+      : settings_(settings),
+        encoder_(settings.jpegQuality, settings.downscale),
+        demosaiced_(std::make_unique<uint8_t[]>(CameraHelpers::IMAGE_SIZE_YUYV))
+  {
+    if (settings_.transport == PreviewTransport::SharedMemory)
+    {
+      transport_ = std::make_unique<SharedDataHelpers::SharedMemorySPSCStorage<FrameTransportFrame>>(
+          FRAME_TRANSPORT_NAME, true, FRAME_TRANSPORT_VERSION);
+    }
+    else
+    {
+      // Same JPEG size limit as a transport slot
+      json_ = std::make_unique<char[]>(FrameJsonSizeBound(FRAME_TRANSPORT_MAX_IMAGE_SIZE));
+    }
+  }
+
+  bool PreviewPublisher::Publish(const FrameInfo &info, const uint8_t *image)
+  {
+    const uint8_t *yuyvFrame = image;
+    if (info.pixelFormat == static_cast<int>(CameraHelpers::PixelFormat::BayerRG8))
+    {
+      ImageProcessing::Kernels::BayerToYUYV(image, demosaiced_.get(), CameraHelpers::IMAGE_WIDTH, CameraHelpers::IMAGE_HEIGHT);
+      yuyvFrame = demosaiced_.get();
+    }
+
+    if (!transport_)
+    {
+      const size_t jpegSize = encoder_.Encode(yuyvFrame);
+      return jpegSize != 0 && WriteJsonFile(info, encoder_.Data(), jpegSize);
+    }
+
+    // Encode straight into the transport slot
+    FrameTransportFrame &frame = transport_->data();
+    const size_t jpegSize = encoder_.Encode(yuyvFrame, frame.image, sizeof(frame.image));
+    if (jpegSize == 0)
+      return false;
+
+    frame.frameNumber = info.frameNumber;
+    frame.timestampUs = static_cast<int64_t>(info.timestamp);
+    frame.targetX = info.targetX;
+    frame.targetY = info.targetY;
+    frame.centerX = info.centerX;
+    frame.centerY = info.centerY;
+    frame.radius = info.radius;
+    frame.ballDetected = info.ballDetected ? 1 : 0;
+    frame.detectionMode = info.detectionMode;
+    frame.format = FRAME_TRANSPORT_FORMAT_JPEG;
+    frame.imageSize = static_cast<uint32_t>(jpegSize);
+    frame.width = static_cast<uint16_t>(encoder_.Width());
+    frame.height = static_cast<uint16_t>(encoder_.Height());
+    transport_->flags() = 1; // indicate new data is available
+    transport_->exchange();
+    return true;
+  }
+
+  bool PreviewPublisher::WriteJsonFile(const FrameInfo &info, const uint8_t *jpeg, size_t jpegSize)
+  {
+    const size_t jsonSize = SerializeFrameJson(info, encoder_.Width(), encoder_.Height(), jpeg, jpegSize,
+                                               json_.get(), FrameJsonSizeBound(FRAME_TRANSPORT_MAX_IMAGE_SIZE));
+    if (jsonSize == 0)
+      return false;
+
+    // Write to a temporary file and rename it, so the camera server never reads a partial frame
+    if (!WriteFile(JSON_TEMP_FILE_PATH, json_.get(), jsonSize))
+      return false;
+    std::rename(JSON_TEMP_FILE_PATH, JSON_FILE_PATH);
+
+    // Create running flag file
+    WriteFile(RUNNING_FLAG_FILE_PATH, "1", 1);
+    return true;
+  }
+}
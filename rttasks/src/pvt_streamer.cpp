@@ -0,0 +1,156 @@
+#include "pvt_streamer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+
+#include "settings_helpers.h"
+
+namespace MotionHelpers
+{
+  namespace
+  {
+    // Advances one axis by a point of dt seconds towards target: as fast as the velocity limit allows while still able
+    // to stop on the target at the acceleration limit. Lands on the target at rest once it is within one point.
+    void NextAxisPoint(double &position, double &velocity, double target, const AxisLimits &limits, double dt)
+    {
+      const double a = limits.maxAcceleration;
+      const double error = target - position;
+
+      // Close enough to stop on the target within this point
+      if (std::abs(error) <= 0.5 * std::abs(velocity) * dt + 0.5 * a * dt * dt && std::abs(velocity) <= a * dt)
+      {
+        position = target;
+        velocity = 0.0;
+        return;
+      }
+
+      // Fastest speed at the end of this point from which the axis still stops on the target, given the distance
+      // this point covers on the way: v^2 / 2a <= distance - (speed + v) dt / 2
+      const double direction = error >= 0.0 ? 1.0 : -1.0;
+      const double reach = std::abs(error) - 0.5 * velocity * direction * dt;
+      const double stopSpeed = reach > 0.0 ? std::sqrt(0.25 * a * a * dt * dt + 2.0 * a * reach) - 0.5 * a * dt : 0.0;
+      const double desired = direction * std::min(limits.maxVelocity, stopSpeed);
+      const double next = velocity + std::clamp(desired - velocity, -a * dt, a * dt);
+      position += 0.5 * (velocity + next) * dt;
+      velocity = next;
+
+      // Overshooting a target changed under way must not take the axis past its limits
+      if (position < limits.minPosition || position > limits.maxPosition)
+      {
+        position = std::clamp(position, limits.minPosition, limits.maxPosition);
+        velocity = 0.0;
+      }
+    }
+  }
+
+  MotionSettings LoadMotionSettings(const char *path)
+  {
+    MotionSettings settings;
+
+    for (const SettingsHelpers::Setting &setting : SettingsHelpers::ReadSettingsFile(path))
+    {
+      if (setting.key == "mode")
+      {
+        if (setting.value == "scurve")
+          settings.mode = MoveMode::SCurve;
+        else if (setting.value == "pvt_stream")
+          settings.mode = MoveMode::PvtStream;
+        else
+          throw std::runtime_error("[MotionHelpers] Invalid move mode: " + setting.value);
+      }
+      else if (setting.key == "pvt_point_seconds")
+        settings.pvtPointSeconds = SettingsHelpers::ParseNumber(setting);
+      else if (setting.key == "pvt_lookahead_points")
+        settings.pvtLookaheadPoints = static_cast<uint32_t>(SettingsHelpers::ParseNumber(setting));
+      else if (setting.key == "pvt_max_velocity")
+        settings.pvtMaxVelocity = SettingsHelpers::ParseNumber(setting);
+      else if (setting.key == "pvt_max_acceleration")
+        settings.pvtMaxAcceleration = SettingsHelpers::ParseNumber(setting);
+      else
+        throw std::runtime_error("[MotionHelpers] Unknown motion setting: " + setting.key);
+    }
+
+    if (settings.pvtPointSeconds <= 0.0)
+      throw std::runtime_error("[MotionHelpers] pvt_point_seconds must be positive.");
+    if (settings.pvtLookaheadPoints == 0 || settings.pvtLookaheadPoints > PvtStreamer::MAX_POINTS_PER_STEP)
+      throw std::runtime_error("[MotionHelpers] pvt_lookahead_points must be between 1 and " +
+                               std::to_string(PvtStreamer::MAX_POINTS_PER_STEP) + ".");
+    if (settings.pvtMaxVelocity < 0.0 || settings.pvtMaxAcceleration < 0.0)
+      throw std::runtime_error("[MotionHelpers] pvt_max_velocity and pvt_max_acceleration must not be negative.");
+
+    return settings;
+  }
+
+  // ----------- PvtStreamer -----------
+
+  PvtStreamer::PvtStreamer(const MotionSettings &settings, const std::array<AxisLimits, AXIS_COUNT> &limits)
+      : settings_(settings), limits_(limits)
+  {
+    for (const AxisLimits &axis : limits_)
+    {
+      if (axis.maxVelocity <= 0.0 || axis.maxAcceleration <= 0.0 || axis.minPosition > axis.maxPosition)
+        throw std::runtime_error("[MotionHelpers] Invalid axis limits for PVT streaming.");
+    }
+  }
+
+  void PvtStreamer::Reset(const std::array<double, AXIS_COUNT> &positions)
+  {
+    position_ = positions;
+    velocity_ = {};
+    streaming_ = false;
+  }
+
+  uint32_t PvtStreamer::Step(PvtMultiAxis &multiAxis, const std::array<double, AXIS_COUNT> &target)
+  {
+    std::array<double, AXIS_COUNT> clamped;
+    bool atTarget = true;
+    for (int axis = 0; axis < AXIS_COUNT; ++axis)
+    {
+      clamped[axis] = std::clamp(target[axis], limits_[axis].minPosition, limits_[axis].maxPosition);
+      atTarget = atTarget && position_[axis] == clamped[axis] && velocity_[axis] == 0.0;
+    }
+
+    const int32_t remaining = multiAxis.PointsRemaining();
+    if (streaming_ && remaining == 0)
+    {
+      // The controller stopped the motion at the last point
+      underruns_++;
+      streaming_ = false;
+      velocity_ = {};
+    }
+
+    // Wait for the final points of the last motion before starting the next one
+    if (!streaming_ && (atTarget || remaining > 0))
+      return 0;
+    if (remaining >= static_cast<int32_t>(settings_.pvtLookaheadPoints))
+      return 0;
+
+    double positions[MAX_POINTS_PER_STEP * AXIS_COUNT];
+    double velocities[MAX_POINTS_PER_STEP * AXIS_COUNT];
+    double times[MAX_POINTS_PER_STEP];
+    const uint32_t wanted = settings_.pvtLookaheadPoints - static_cast<uint32_t>(remaining);
+
+    uint32_t count = 0;
+    bool settled = false;
+    while (count < wanted && !settled)
+    {
+      settled = true;
+      for (int axis = 0; axis < AXIS_COUNT; ++axis)
+      {
+        NextAxisPoint(position_[axis], velocity_[axis], clamped[axis], limits_[axis], settings_.pvtPointSeconds);
+        positions[count * AXIS_COUNT + axis] = position_[axis];
+        velocities[count * AXIS_COUNT + axis] = velocity_[axis];
+        settled = settled && position_[axis] == clamped[axis] && velocity_[axis] == 0.0;
+      }
+      times[count] = settings_.pvtPointSeconds;
+      count++;
+    }
+
+    multiAxis.MovePVT(positions, velocities, times, static_cast<int32_t>(count), settled);
+    streaming_ = !settled;
+    pointsSent_ += count;
+    return count;
+  }
+}
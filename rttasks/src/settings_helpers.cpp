@@ -0,0 +1,72 @@
+#include "settings_helpers.h"
+
+#include <fstream>
+#include <stdexcept>
+
+namespace SettingsHelpers
+{
+  namespace
+  {
+    std::string Trim(const std::string &text)
+    {
+      const size_t first = text.find_first_not_of(" \t\r");
+      if (first == std::string::npos)
+        return "";
+      const size_t last = text.find_last_not_of(" \t\r");
+      return text.substr(first, last - first + 1);
+    }
+
+    [[noreturn]] void ThrowInvalidValue(const Setting &setting)
+    {
+      throw std::runtime_error("[SettingsHelpers] Invalid value for setting " + setting.key + ": " + setting.value);
+    }
+  }
+
+  std::vector<Setting> ReadSettingsFile(const char *path)
+  {
+    std::vector<Setting> settings;
+
+    std::ifstream file(path);
+    if (!file.is_open())
+      return settings;
+
+    std::string line;
+    while (std::getline(file, line))
+    {
+      line = Trim(line.substr(0, line.find('#')));
+      if (line.empty())
+        continue;
+
+      const size_t equals = line.find('=');
+      if (equals == std::string::npos)
+        throw std::runtime_error(std::string("[SettingsHelpers] Expected key=value in ") + path + ": " + line);
+
+      settings.push_back({Trim(line.substr(0, equals)), Trim(line.substr(equals + 1))});
+    }
+    return settings;
+  }
+
+  double ParseNumber(const Setting &setting)
+  {
+    try
+    {
+      size_t parsed = 0;
+      double number = std::stod(setting.value, &parsed);
+      if (parsed == setting.value.size())
+        return number;
+    }
+    catch (const std::exception &)
+    {
+    }
+    ThrowInvalidValue(setting);
+  }
+
+  bool ParseBool(const Setting &setting)
+  {
+    if (setting.value == "true" || setting.value == "1")
+      return true;
+    if (setting.value == "false" || setting.value == "0")
+      return false;
+    ThrowInvalidValue(setting);
+  }
+}
@@ -0,0 +1,205 @@
+#include "stripe_workers.h"
+
+#include <climits>
+#include <stdexcept>
+#include <string>
+
+#include <linux/futex.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "settings_helpers.h"
+#include "thread_helpers.h"
+
+namespace ImageProcessing
+{
+  namespace
+  {
+    // Sleeping workers wait on generation_ itself
+    static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t) && std::atomic<uint32_t>::is_always_lock_free);
+
+    // Spins before a waiting thread starts yielding its core, a detection frame is well within it
+    constexpr int SPINS_BEFORE_YIELD = 1 << 16;
+
+    inline void CpuRelax()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+      __builtin_ia32_pause();
+#elif defined(__aarch64__)
+      asm volatile("yield");
+#endif
+    }
+
+    // Waits for done() with a spin, yielding after SPINS_BEFORE_YIELD tries in case the core is shared after all
+    template <typename Done>
+    void SpinUntil(Done done)
+    {
+      for (int spins = 0; !done(); ++spins)
+      {
+        if (spins < SPINS_BEFORE_YIELD)
+          CpuRelax();
+        else
+          std::this_thread::yield();
+      }
+    }
+
+    std::vector<int> ParseCoreList(const SettingsHelpers::Setting &setting)
+    {
+      std::vector<int> cores;
+      size_t start = 0;
+      while (start < setting.value.size())
+      {
+        size_t end = setting.value.find(',', start);
+        if (end == std::string::npos)
+          end = setting.value.size();
+
+        std::string item = setting.value.substr(start, end - start);
+        std::erase(item, ' ');
+        const double core = SettingsHelpers::ParseNumber({setting.key, item});
+        if (core < 0 || core >= CPU_SETSIZE || core != static_cast<int>(core))
+          throw std::runtime_error("[ImageProcessing] Invalid core in " + setting.key + ": " + item);
+        cores.push_back(static_cast<int>(core));
+        start = end + 1;
+      }
+      return cores;
+    }
+  }
+
+  DetectionSettings LoadDetectionSettings(const char *path)
+  {
+    DetectionSettings settings;
+
+    for (const SettingsHelpers::Setting &setting : SettingsHelpers::ReadSettingsFile(path))
+    {
+      if (setting.key == "worker_cores")
+        settings.workerCores = ParseCoreList(setting);
+      else if (setting.key == "worker_priority")
+        settings.workerPriority = static_cast<int>(SettingsHelpers::ParseNumber(setting));
+      else if (setting.key == "opencv_threads")
+        settings.opencvThreads = static_cast<int>(SettingsHelpers::ParseNumber(setting));
+      else if (setting.key == "min_blob_area")
+        settings.minBlobArea = SettingsHelpers::ParseNumber(setting);
+      else
+        throw std::runtime_error("[ImageProcessing] Unknown detection setting: " + setting.key);
+    }
+
+    if (settings.workerCores.size() > static_cast<size_t>(StripeWorkers::MAX_WORKERS))
+      throw std::runtime_error("[ImageProcessing] worker_cores lists more than " + std::to_string(StripeWorkers::MAX_WORKERS) + " cores.");
+    if (settings.workerPriority < 0 || settings.workerPriority > sched_get_priority_max(SCHED_FIFO))
+      throw std::runtime_error("[ImageProcessing] worker_priority is out of range.");
+    if (settings.opencvThreads < 0)
+      throw std::runtime_error("[ImageProcessing] opencv_threads must not be negative.");
+    if (settings.minBlobArea < 0)
+      throw std::runtime_error("[ImageProcessing] min_blob_area must not be negative.");
+
+    return settings;
+  }
+
+  StripeWorkers::StripeWorkers(const std::vector<int> &cores, int priority)
+      : stripeCount_(static_cast<int>(cores.size()) + 1)
+  {
+    if (cores.size() > static_cast<size_t>(MAX_WORKERS))
+      throw std::runtime_error("[ImageProcessing] Too many stripe workers.");
+
+    // Each worker reports whether it could be pinned before the first job can reach it
+    std::vector<std::string> errors(cores.size());
+    std::latch pinned(static_cast<std::ptrdiff_t>(cores.size()));
+    threads_.reserve(cores.size());
+    for (size_t i = 0; i < cores.size(); ++i)
+    {
+      const int stripe = static_cast<int>(i) + 1;
+      const int core = cores[i];
+      threads_.emplace_back([this, stripe, core, priority, &error = errors[i], &pinned]() { Work(stripe, core, priority, error, pinned); });
+    }
+    pinned.wait();
+
+    for (size_t i = 0; i < errors.size(); ++i)
+    {
+      if (!errors[i].empty())
+      {
+        Stop();
+        throw std::runtime_error("[ImageProcessing] The stripe worker of core " + std::to_string(cores[i]) + " " + errors[i]);
+      }
+    }
+  }
+
+  StripeWorkers::~StripeWorkers()
+  {
+    Stop();
+  }
+
+  void StripeWorkers::Stop()
+  {
+    stop_.store(true, std::memory_order_seq_cst);
+    Wake();
+    for (std::thread &thread : threads_)
+    {
+      if (thread.joinable())
+        thread.join();
+    }
+  }
+
+  void StripeWorkers::Wake()
+  {
+    // Like the SPMC storage's Notify: without sleeping workers this is two atomic operations and no syscall
+    generation_.fetch_add(1, std::memory_order_seq_cst);
+    if (sleepers_.load(std::memory_order_seq_cst) != 0)
+      syscall(SYS_futex, reinterpret_cast<uint32_t *>(&generation_), FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+  }
+
+  void StripeWorkers::Run(Job job, void *context)
+  {
+    const int stripeCount = StripeCount();
+    if (stripeCount > 1)
+    {
+      job_ = job;
+      context_ = context;
+      pending_.store(stripeCount - 1, std::memory_order_relaxed);
+      Wake();
+    }
+
+    job(context, 0, stripeCount);
+
+    SpinUntil([this]() { return pending_.load(std::memory_order_acquire) == 0; });
+  }
+
+  void StripeWorkers::WaitForJob(uint32_t seen)
+  {
+    // Spin while frames keep coming, checking the clock every SPINS_PER_CLOCK_CHECK tries
+    constexpr int SPINS_PER_CLOCK_CHECK = 1024;
+    const auto sleepAt = std::chrono::steady_clock::now() + SPIN_BEFORE_SLEEP;
+    for (int spins = 1; generation_.load(std::memory_order_acquire) == seen; ++spins)
+    {
+      CpuRelax();
+      if (spins % SPINS_PER_CLOCK_CHECK == 0 && std::chrono::steady_clock::now() >= sleepAt)
+      {
+        // Then sleep until Wake, which only makes the syscall while someone sleeps
+        sleepers_.fetch_add(1, std::memory_order_seq_cst);
+        while (generation_.load(std::memory_order_seq_cst) == seen)
+          syscall(SYS_futex, reinterpret_cast<uint32_t *>(&generation_), FUTEX_WAIT_PRIVATE, seen, nullptr, nullptr, 0);
+        sleepers_.fetch_sub(1, std::memory_order_relaxed);
+        return;
+      }
+    }
+  }
+
+  void StripeWorkers::Work(int stripe, int core, int priority, std::string &error, std::latch &pinned)
+  {
+    // The constructor stops the pool if any worker fails, without running a job
+    error = ThreadHelpers::PinCurrentThread(core, priority);
+    pinned.count_down();
+
+    uint32_t seen = 0;
+    while (true)
+    {
+      WaitForJob(seen);
+      if (stop_.load(std::memory_order_acquire))
+        return;
+
+      seen = generation_.load(std::memory_order_acquire);
+      job_(context_, stripe, stripeCount_);
+      pending_.fetch_sub(1, std::memory_order_release);
+    }
+  }
+}
@@ -0,0 +1,157 @@
+#include "synthetic_frames.h"
+
+#include <algorithm>
+
+#include "camera_helpers.h" // For image constants
+
+namespace CameraHelpers
+{
+  namespace
+  {
+    // Scene colors as YUV, chroma is centered on 128. The ball and clutter are well above RED_THRESHOLD in V.
+    constexpr uint8_t BACKGROUND_Y = 110, BACKGROUND_U = 128, BACKGROUND_V = 120;
+    constexpr uint8_t RED_Y = 80, RED_U = 100, RED_V = 210;
+
+    // The same colors as RGB, for the Bayer mosaic
+    constexpr uint8_t BACKGROUND_R = 99, BACKGROUND_G = 116, BACKGROUND_B = 110;
+    constexpr uint8_t RED_R = 195, RED_G = 31, RED_B = 30;
+
+    constexpr int FRAME_WIDTH = static_cast<int>(IMAGE_WIDTH);
+    constexpr int FRAME_HEIGHT = static_cast<int>(IMAGE_HEIGHT);
+
+    inline void FillPairs(uint8_t *row, int firstPair, int lastPair, uint8_t y, uint8_t u, uint8_t v)
+    {
+      for (int pair = firstPair; pair <= lastPair; ++pair)
+      {
+        uint8_t *p = row + 4 * pair;
+        p[0] = y;
+        p[1] = u;
+        p[2] = y;
+        p[3] = v;
+      }
+    }
+
+    // Pixels firstX to lastX of row y of an RGGB mosaic
+    inline void FillBayer(uint8_t *row, int y, int firstX, int lastX, uint8_t r, uint8_t g, uint8_t b)
+    {
+      const uint8_t even = (y % 2 == 0) ? r : g;
+      const uint8_t odd = (y % 2 == 0) ? g : b;
+      for (int x = firstX; x <= lastX; ++x)
+        row[x] = (x % 2 == 0) ? even : odd;
+    }
+
+    inline uint8_t AddNoise(uint8_t value, int noise) { return static_cast<uint8_t>(std::clamp(value + noise, 0, 255)); }
+  }
+
+  SyntheticFrameGenerator::SyntheticFrameGenerator(const SyntheticSceneSettings &settings)
+      : settings_(settings), randomState_(settings.seed != 0 ? settings.seed : 1)
+  {
+    // Clutter is a fixed layout of thin bars and small squares, red like the ball but never round
+    clutterCount_ = std::clamp(settings_.clutterCount, 0, MAX_CLUTTER);
+    for (int i = 0; i < clutterCount_; ++i)
+    {
+      int width = 8 + static_cast<int>(NextRandom() % 72);
+      int height = (NextRandom() % 2) ? std::max(2, width / 6) : std::max(2, width / 2);
+      if (NextRandom() % 2)
+        std::swap(width, height);
+      clutter_[i] = ClutterRect{static_cast<int>(NextRandom() % (FRAME_WIDTH - width)),
+                                static_cast<int>(NextRandom() % (FRAME_HEIGHT - height)),
+                                width, height};
+    }
+  }
+
+  uint32_t SyntheticFrameGenerator::NextRandom()
+  {
+    // xorshift32, cheap enough to draw noise for every pixel pair
+    uint32_t x = randomState_;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    randomState_ = x;
+    return x;
+  }
+
+  template <typename Fill>
+  void SyntheticFrameGenerator::ForEachRedRun(float ballX, float ballY, bool pairs, Fill fill) const
+  {
+    // Clutter, drawn under the ball
+    for (int i = 0; i < clutterCount_; ++i)
+    {
+      const ClutterRect &rect = clutter_[i];
+      for (int y = rect.y; y < rect.y + rect.height; ++y)
+        fill(y, rect.x, rect.x + rect.width - 1);
+    }
+
+    // Ball, a pixel (or pair) is inside when its center is
+    const float radius = settings_.ballRadius;
+    const int step = pairs ? 2 : 1;
+    const float centerOffset = pairs ? 0.5f : 0.0f;
+    const int firstRow = std::max(0, static_cast<int>(ballY - radius));
+    const int lastRow = std::min(FRAME_HEIGHT - 1, static_cast<int>(ballY + radius) + 1);
+    for (int y = firstRow; y <= lastRow; ++y)
+    {
+      const float dy = y - ballY;
+      const float halfChord2 = radius * radius - dy * dy;
+      if (halfChord2 < 0.0f)
+        continue;
+
+      const int first = std::max(0, static_cast<int>((ballX - radius) / step) - 1);
+      const int last = std::min(FRAME_WIDTH / step - 1, static_cast<int>((ballX + radius) / step) + 1);
+      for (int unit = first; unit <= last; ++unit)
+      {
+        const float dx = step * unit + centerOffset - ballX;
+        if (dx * dx <= halfChord2)
+          fill(y, step * unit, step * unit + step - 1);
+      }
+    }
+  }
+
+  void SyntheticFrameGenerator::Render(uint8_t *yuyvFrame, float ballX, float ballY)
+  {
+    constexpr int ROW_BYTES = FRAME_WIDTH * 2;
+    constexpr int LAST_PAIR = FRAME_WIDTH / 2 - 1;
+
+    // Background
+    for (int y = 0; y < FRAME_HEIGHT; ++y)
+      FillPairs(yuyvFrame + y * ROW_BYTES, 0, LAST_PAIR, BACKGROUND_Y, BACKGROUND_U, BACKGROUND_V);
+
+    ForEachRedRun(ballX, ballY, true, [&](int y, int firstX, int lastX)
+                  { FillPairs(yuyvFrame + y * ROW_BYTES, firstX / 2, lastX / 2, RED_Y, RED_U, RED_V); });
+
+    // Sensor noise on the luma and V samples
+    const int amplitude = std::max(0, settings_.noiseAmplitude);
+    if (amplitude == 0)
+      return;
+    const uint32_t span = 2 * amplitude + 1;
+    for (int i = 0; i < FRAME_WIDTH * FRAME_HEIGHT / 2; ++i)
+    {
+      uint8_t *p = yuyvFrame + 4 * i;
+      const uint32_t random = NextRandom();
+      p[0] = AddNoise(p[0], static_cast<int>((random & 0xFF) % span) - amplitude);
+      p[2] = AddNoise(p[2], static_cast<int>(((random >> 8) & 0xFF) % span) - amplitude);
+      p[3] = AddNoise(p[3], static_cast<int>(((random >> 16) & 0xFF) % span) - amplitude);
+    }
+  }
+
+  void SyntheticFrameGenerator::RenderBayer(uint8_t *bayerFrame, float ballX, float ballY)
+  {
+    for (int y = 0; y < FRAME_HEIGHT; ++y)
+      FillBayer(bayerFrame + y * FRAME_WIDTH, y, 0, FRAME_WIDTH - 1, BACKGROUND_R, BACKGROUND_G, BACKGROUND_B);
+
+    ForEachRedRun(ballX, ballY, false, [&](int y, int firstX, int lastX)
+                  { FillBayer(bayerFrame + y * FRAME_WIDTH, y, firstX, lastX, RED_R, RED_G, RED_B); });
+
+    // Sensor noise, a byte of randomness per site
+    const int amplitude = std::max(0, settings_.noiseAmplitude);
+    if (amplitude == 0)
+      return;
+    const uint32_t span = 2 * amplitude + 1;
+    for (int i = 0; i < FRAME_WIDTH * FRAME_HEIGHT / 4; ++i)
+    {
+      uint8_t *p = bayerFrame + 4 * i;
+      const uint32_t random = NextRandom();
+      for (int site = 0; site < 4; ++site)
+        p[site] = AddNoise(p[site], static_cast<int>(((random >> (8 * site)) & 0xFF) % span) - amplitude);
+    }
+  }
+}
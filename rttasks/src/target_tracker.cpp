@@ -0,0 +1,113 @@
+#include "target_tracker.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace MotionHelpers
+{
+  namespace
+  {
+    // Propagates an axis estimate by dt seconds under white-noise acceleration of spectral density q
+    void PredictAxis(AxisEstimate &axis, double dt, double q)
+    {
+      double(&p)[2][2] = axis.covariance;
+      axis.position += axis.velocity * dt;
+
+      // P = F P F' + Q with F = [1 dt; 0 1] and Q = q [dt^3/3 dt^2/2; dt^2/2 dt]
+      const double p00 = p[0][0] + dt * (p[1][0] + p[0][1]) + dt * dt * p[1][1] + q * dt * dt * dt / 3.0;
+      const double p01 = p[0][1] + dt * p[1][1] + q * dt * dt / 2.0;
+      const double p11 = p[1][1] + q * dt;
+      p[0][0] = p00;
+      p[0][1] = p01;
+      p[1][0] = p01;
+      p[1][1] = p11;
+    }
+
+    // Standard Kalman update of the position measurement z with variance r. Returns the squared innovation in units of
+    // its variance.
+    double UpdateAxis(AxisEstimate &axis, double z, double r)
+    {
+      double(&p)[2][2] = axis.covariance;
+      const double innovation = z - axis.position;
+      const double s = p[0][0] + r;
+      const double k0 = p[0][0] / s;
+      const double k1 = p[1][0] / s;
+
+      axis.position += k0 * innovation;
+      axis.velocity += k1 * innovation;
+
+      // P = (I - K H) P, kept symmetric
+      const double p00 = (1.0 - k0) * p[0][0];
+      const double p01 = (1.0 - k0) * p[0][1];
+      const double p11 = p[1][1] - k1 * p[0][1];
+      p[0][0] = p00;
+      p[0][1] = p01;
+      p[1][0] = p01;
+      p[1][1] = p11;
+
+      return innovation * innovation / s;
+    }
+
+    void StartAxis(AxisEstimate &axis, double z, double r, double velocityVariance)
+    {
+      axis.position = z;
+      axis.velocity = 0.0;
+      axis.covariance[0][0] = r;
+      axis.covariance[0][1] = 0.0;
+      axis.covariance[1][0] = 0.0;
+      axis.covariance[1][1] = velocityVariance;
+    }
+  }
+
+  void TargetTracker::Update(int64_t timeNs, double x, double y)
+  {
+    const double r = settings_.measurementNoise * settings_.measurementNoise;
+    const double dt = (timeNs - state_.timeNs) * 1e-9;
+
+    bool restart = !state_.initialized || dt > settings_.resetAfterSeconds || dt < 0.0;
+    if (!restart)
+    {
+      AxisEstimate predicted[2] = {state_.axes[0], state_.axes[1]};
+      PredictAxis(predicted[0], dt, settings_.accelerationNoise);
+      PredictAxis(predicted[1], dt, settings_.accelerationNoise);
+
+      // Reject the track rather than the measurement: a jump this large means the ball was lost or another blob won
+      const double gate = settings_.gateSigma * settings_.gateSigma;
+      const double z[2] = {x, y};
+      for (int axis = 0; axis < 2 && !restart; ++axis)
+      {
+        const double innovation = z[axis] - predicted[axis].position;
+        restart = innovation * innovation > gate * (predicted[axis].covariance[0][0] + r);
+      }
+
+      if (!restart)
+      {
+        UpdateAxis(predicted[0], x, r);
+        UpdateAxis(predicted[1], y, r);
+        state_.axes[0] = predicted[0];
+        state_.axes[1] = predicted[1];
+      }
+    }
+
+    if (restart)
+    {
+      // Unknown velocity: allow for a ball crossing the field of view in a fraction of a second
+      constexpr double START_VELOCITY_VARIANCE = 1.0;
+      StartAxis(state_.axes[0], x, r, START_VELOCITY_VARIANCE);
+      StartAxis(state_.axes[1], y, r, START_VELOCITY_VARIANCE);
+      state_.initialized = true;
+    }
+    state_.timeNs = timeNs;
+  }
+
+  bool TargetTracker::Predict(int64_t timeNs, double &x, double &y) const
+  {
+    if (!state_.initialized)
+      return false;
+
+    const double dt = std::clamp((timeNs - state_.timeNs) * 1e-9, 0.0, settings_.maxPredictionSeconds);
+    x = state_.axes[0].position + state_.axes[0].velocity * dt;
+    y = state_.axes[1].position + state_.axes[1].velocity * dt;
+    return true;
+  }
+}
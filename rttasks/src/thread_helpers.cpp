@@ -0,0 +1,93 @@
+#include "thread_helpers.h"
+
+#include <cstring>
+#include <latch>
+#include <stdexcept>
+
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+namespace ThreadHelpers
+{
+  std::string PinCurrentThread(int core, int priority)
+  {
+    sched_param param{};
+    param.sched_priority = priority;
+    int result = pthread_setschedparam(pthread_self(), priority > 0 ? SCHED_FIFO : SCHED_OTHER, &param);
+    if (result != 0)
+      return "could not set priority " + std::to_string(priority) + ": " + std::strerror(result);
+
+    if (core < 0)
+      return {};
+    cpu_set_t cores;
+    CPU_ZERO(&cores);
+    CPU_SET(core, &cores);
+    result = pthread_setaffinity_np(pthread_self(), sizeof(cores), &cores);
+    if (result != 0)
+      return "could not be moved to core " + std::to_string(core) + ": " + std::strerror(result);
+    return {};
+  }
+
+  void MoveToBackground(const cpu_set_t &rtCores)
+  {
+    sched_param param{};
+    pthread_setschedparam(pthread_self(), SCHED_OTHER, &param);
+    setpriority(PRIO_PROCESS, 0, 10);
+
+    cpu_set_t otherCores;
+    CPU_ZERO(&otherCores);
+    const long coreCount = sysconf(_SC_NPROCESSORS_ONLN);
+    for (long core = 0; core < coreCount && core < CPU_SETSIZE; ++core)
+    {
+      if (!CPU_ISSET(core, &rtCores))
+        CPU_SET(core, &otherCores);
+    }
+    if (CPU_COUNT(&otherCores) > 0)
+      pthread_setaffinity_np(pthread_self(), sizeof(otherCores), &otherCores);
+  }
+
+  cpu_set_t CurrentCores()
+  {
+    cpu_set_t cores;
+    CPU_ZERO(&cores);
+    pthread_getaffinity_np(pthread_self(), sizeof(cores), &cores);
+    return cores;
+  }
+
+  LoopThread::LoopThread(int core, int priority, std::function<void()> step)
+  {
+    std::string error;
+    std::latch pinned(1);
+    thread_ = std::thread([this, core, priority, step = std::move(step), &error, &pinned]()
+                          {
+                            error = PinCurrentThread(core, priority);
+                            const bool failed = !error.empty();
+                            pinned.count_down(); // error and pinned are gone after this
+                            if (failed)
+                              return;
+                            while (!stop_.load(std::memory_order_acquire))
+                              step();
+                          });
+    pinned.wait();
+
+    if (!error.empty())
+    {
+      thread_.join();
+      throw std::runtime_error("[ThreadHelpers] Thread " + error);
+    }
+  }
+
+  LoopThread::~LoopThread()
+  {
+    Stop();
+  }
+
+  void LoopThread::Stop()
+  {
+    stop_.store(true, std::memory_order_release);
+    if (thread_.joinable())
+      thread_.join();
+  }
+}
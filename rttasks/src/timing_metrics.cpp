@@ -0,0 +1,247 @@
+#include "timing_metrics.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace TimingHelpers
+{
+  namespace
+  {
+    constexpr std::array<const char *, static_cast<size_t>(TimingMetric::Count)> METRIC_NAMES = {
+        "firmware_timing_delta",
+        "network_timing_delta",
+        "network_timing_receive_delta",
+    };
+
+    constexpr uint64_t SUB_BUCKET_COUNT = uint64_t(1) << DeltaHistogram::SUB_BUCKET_BITS;
+    constexpr uint64_t SUB_BUCKET_HALF_COUNT = SUB_BUCKET_COUNT / 2;
+  }
+
+  const char *TimingMetricName(TimingMetric metric)
+  {
+    const size_t index = static_cast<size_t>(metric);
+    return index < METRIC_NAMES.size() ? METRIC_NAMES[index] : "unknown";
+  }
+
+  // ----------- DeltaHistogram -----------
+
+  size_t DeltaHistogram::BucketIndex(uint64_t value)
+  {
+    if (value < SUB_BUCKET_COUNT)
+      return static_cast<size_t>(value);
+
+    // Above the exact range, every power of two is split into SUB_BUCKET_HALF_COUNT buckets by its leading bits
+    const int exponent = 63 - __builtin_clzll(value);
+    if (exponent > MAX_EXPONENT)
+      return BUCKET_COUNT - 1;
+    const int shift = exponent - SUB_BUCKET_BITS + 1;
+    return static_cast<size_t>(SUB_BUCKET_COUNT + (exponent - SUB_BUCKET_BITS) * SUB_BUCKET_HALF_COUNT +
+                               ((value >> shift) - SUB_BUCKET_HALF_COUNT));
+  }
+
+  uint64_t DeltaHistogram::BucketHighestValue(size_t index)
+  {
+    if (index < SUB_BUCKET_COUNT)
+      return index;
+
+    const uint64_t offset = index - SUB_BUCKET_COUNT;
+    const int exponent = SUB_BUCKET_BITS + static_cast<int>(offset / SUB_BUCKET_HALF_COUNT);
+    const int shift = exponent - SUB_BUCKET_BITS + 1;
+    const uint64_t leading = SUB_BUCKET_HALF_COUNT + offset % SUB_BUCKET_HALF_COUNT;
+    return ((leading + 1) << shift) - 1;
+  }
+
+  void DeltaHistogram::Record(int64_t value)
+  {
+    const uint64_t sample = value > 0 ? static_cast<uint64_t>(value) : 0;
+    buckets_[BucketIndex(sample)].fetch_add(1, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+
+    int64_t max = max_.load(std::memory_order_relaxed);
+    while (max < static_cast<int64_t>(sample) && !max_.compare_exchange_weak(max, static_cast<int64_t>(sample), std::memory_order_relaxed))
+    {
+    }
+  }
+
+  void DeltaHistogram::Reset()
+  {
+    for (std::atomic<uint64_t> &bucket : buckets_)
+      bucket.store(0, std::memory_order_relaxed);
+    count_.store(0, std::memory_order_relaxed);
+    max_.store(0, std::memory_order_relaxed);
+  }
+
+  void DeltaHistogram::Retire(DeltaHistogram &sum, size_t first, size_t last)
+  {
+    for (size_t index = first; index < last; ++index)
+    {
+      const uint64_t samples = buckets_[index].load(std::memory_order_relaxed);
+      if (samples == 0)
+        continue;
+
+      // The counts first, so a concurrent percentile never ranks past the buckets
+      sum.count_.fetch_sub(samples, std::memory_order_relaxed);
+      count_.fetch_sub(samples, std::memory_order_relaxed);
+      sum.buckets_[index].fetch_sub(samples, std::memory_order_relaxed);
+      buckets_[index].store(0, std::memory_order_relaxed);
+    }
+    if (last == BUCKET_COUNT)
+      max_.store(0, std::memory_order_relaxed);
+  }
+
+  int64_t DeltaHistogram::Percentile(double percentile) const
+  {
+    const uint64_t count = Count();
+    if (count == 0)
+      return 0;
+
+    // Rank of the sample, 1-based
+    const double fraction = std::clamp(percentile, 0.0, 100.0) / 100.0;
+    const uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(fraction * static_cast<double>(count))));
+
+    uint64_t seen = 0;
+    for (size_t index = 0; index < BUCKET_COUNT; ++index)
+    {
+      seen += buckets_[index].load(std::memory_order_relaxed);
+      if (seen >= rank)
+        return std::min(static_cast<int64_t>(BucketHighestValue(index)), Max());
+    }
+    return Max();
+  }
+
+  // ----------- WindowedHistogram -----------
+
+  void WindowedHistogram::Record(int64_t value, int64_t nowNs)
+  {
+    const int64_t second = nowNs / SLICE_NS;
+    const int64_t current = currentSecond_.load(std::memory_order_relaxed);
+    if (second > current)
+    {
+      // The slice that left the minute a second ago holds the slot of this second. With samples all through that
+      // second it is out already, this only finishes it when they were few.
+      Retire(DeltaHistogram::BUCKET_COUNT);
+
+      // Slices of the seconds that start. Those still holding an older second did not retire because no samples came
+      // for a while, take them out of the minute at once.
+      for (int64_t start = std::max(current + 1, second - SLICES + 2); start <= second; ++start)
+      {
+        Slice &slice = slices_[start % SLICES];
+        if (slice.second.load(std::memory_order_relaxed) >= 0)
+        {
+          slice.second.store(-1, std::memory_order_release);
+          retiring_ = &slice;
+          retired_ = 0;
+          Retire(DeltaHistogram::BUCKET_COUNT);
+        }
+        slice.second.store(start, std::memory_order_release);
+      }
+
+      // The second that left the minute now is taken out of it over the next Record calls
+      Slice &leaving = slices_[(second + 1) % SLICES];
+      if (leaving.second.load(std::memory_order_relaxed) >= 0)
+      {
+        leaving.second.store(-1, std::memory_order_release);
+        retiring_ = &leaving;
+        retired_ = 0;
+      }
+      currentSecond_.store(second, std::memory_order_release);
+    }
+
+    slices_[std::max(second, current) % SLICES].histogram.Record(value);
+    minute_.Record(value);
+    lifetime_.Record(value);
+    Retire(RETIRE_BUCKETS);
+  }
+
+  void WindowedHistogram::Retire(size_t buckets)
+  {
+    if (retiring_ == nullptr)
+      return;
+
+    const size_t last = std::min(retired_ + buckets, DeltaHistogram::BUCKET_COUNT);
+    retiring_->histogram.Retire(minute_, retired_, last);
+    retired_ = last;
+    if (retired_ == DeltaHistogram::BUCKET_COUNT)
+      retiring_ = nullptr;
+  }
+
+  const WindowedHistogram::Slice *WindowedHistogram::LastSecond() const
+  {
+    const int64_t last = currentSecond_.load(std::memory_order_acquire) - 1;
+    if (last < 0)
+      return nullptr;
+    const Slice &slice = slices_[last % SLICES];
+    return slice.second.load(std::memory_order_acquire) == last ? &slice : nullptr;
+  }
+
+  int64_t WindowedHistogram::Percentile(HistogramWindow window, double percentile) const
+  {
+    switch (window)
+    {
+    case HistogramWindow::LastSecond:
+    {
+      const Slice *slice = LastSecond();
+      return slice != nullptr ? slice->histogram.Percentile(percentile) : 0;
+    }
+    case HistogramWindow::LastMinute:
+      return minute_.Percentile(percentile);
+    default:
+      return lifetime_.Percentile(percentile);
+    }
+  }
+
+  uint64_t WindowedHistogram::Count(HistogramWindow window) const
+  {
+    switch (window)
+    {
+    case HistogramWindow::LastSecond:
+    {
+      const Slice *slice = LastSecond();
+      return slice != nullptr ? slice->histogram.Count() : 0;
+    }
+    case HistogramWindow::LastMinute:
+      return minute_.Count();
+    default:
+      return lifetime_.Count();
+    }
+  }
+
+  int64_t WindowedHistogram::Max(HistogramWindow window) const
+  {
+    switch (window)
+    {
+    case HistogramWindow::LastSecond:
+    {
+      const Slice *slice = LastSecond();
+      return slice != nullptr ? slice->histogram.Max() : 0;
+    }
+    case HistogramWindow::LastMinute:
+    {
+      // The minute's own maximum never comes down, so take it from the slices
+      int64_t max = 0;
+      for (const Slice &slice : slices_)
+      {
+        if (slice.second.load(std::memory_order_acquire) >= 0)
+          max = std::max(max, slice.histogram.Max());
+      }
+      return max;
+    }
+    default:
+      return lifetime_.Max();
+    }
+  }
+
+  void WindowedHistogram::Reset()
+  {
+    for (Slice &slice : slices_)
+    {
+      slice.second.store(-1, std::memory_order_relaxed);
+      slice.histogram.Reset();
+    }
+    minute_.Reset();
+    lifetime_.Reset();
+    currentSecond_.store(-1, std::memory_order_release);
+    retiring_ = nullptr;
+    retired_ = 0;
+  }
+}
@@ -61,6 +61,9 @@ SCRIPT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
 CAMERA_DIR="$(cd "$SCRIPT_DIR/../servers/camera" && pwd)"
 cd "$CAMERA_DIR"
 
+# libFrameTransportReader is built next to the RTTask library, it lets the server read frames from shared memory
+export LD_LIBRARY_PATH="${RMP_DIR:-/rsi}${LD_LIBRARY_PATH:+:$LD_LIBRARY_PATH}"
+
 # Run HttpCameraServer.cs with .NET 10 app-style execution
 echo "🟢 Starting HTTP Camera Server (dotnet run HttpCameraServer.cs)..."
 echo
@@ -2,10 +2,12 @@
 
 using System;
 using System.Collections.Generic;
+using System.Diagnostics;
 using System.IO;
 using System.Net;
 using System.Net.NetworkInformation;
 using System.Net.Sockets;
+using System.Runtime.InteropServices;
 using System.Threading;
 using System.Threading.Tasks;
 using System.Linq;
@@ -19,8 +21,23 @@ using Newtonsoft.Json;
 var shutdown = false;
 var exitCode = 0;
 
-// RT Task communication via shared data files
+// RT Task communication via the shared memory frame transport (libFrameTransportReader),
+// or the shared data file when OutputImage is configured with transport = json_file
+const string FRAME_TRANSPORT_NAME = "/laser_demo_frames";
 const string DATA_FILE_PATH = "/tmp/rsi_camera_data.json";
+const int FRAME_TRANSPORT_RETRY_MS = 500; // How often the frame transport thread looks for a missing segment
+const int FRAME_TRANSPORT_WAIT_MS = 100; // Longest the frame transport thread sleeps between takes
+const int FRAME_TRANSPORT_POLL_MS = 10; // Take interval with an older reader library that cannot wait
+const int RT_TASK_STALE_MS = 2000; // Without a new frame for this long, the RT tasks count as not running
+var frameTransportReader = IntPtr.Zero; // Only used on the frame transport thread
+var frameTransportSupported = true; // Cleared when the reader library cannot be loaded
+
+// The newest frame the frame transport thread took, guarded by frameLock. Served until OutputImage publishes a newer one.
+var frameLock = new object();
+SharedMemoryFrame? latestSharedMemoryFrame = null;
+long latestSharedMemoryFrameTicks = 0; // Stopwatch timestamp of when it was taken
+// Completed when the next frame is taken, for requests waiting for it
+var nextSharedMemoryFrame = new TaskCompletionSource(TaskCreationOptions.RunContinuationsAsynchronously);
 
 // Declare httpListener so it's in scope for all handlers
 HttpListener? httpListener = null;
@@ -142,9 +159,141 @@ try
         return addresses.ToArray();
     }
 
+    // Takes every frame OutputImage publishes, on a thread of its own that is the only user of the reader. Requests only
+    // read the frame it keeps, so none of them waits for another.
+    void RunFrameTransport()
+    {
+        var canWait = true;
+        while (!shutdown && frameTransportSupported)
+        {
+            try
+            {
+                if (frameTransportReader == IntPtr.Zero)
+                {
+                    frameTransportReader = FrameTransportNative.Open(FRAME_TRANSPORT_NAME);
+                    if (frameTransportReader == IntPtr.Zero)
+                    {
+                        Thread.Sleep(FRAME_TRANSPORT_RETRY_MS);
+                        continue;
+                    }
+                }
+
+                if (!TakeSharedMemoryFrame())
+                    continue;
+
+                if (canWait)
+                {
+                    try
+                    {
+                        FrameTransportNative.Wait(frameTransportReader, FRAME_TRANSPORT_WAIT_MS);
+                    }
+                    catch (EntryPointNotFoundException)
+                    {
+                        canWait = false; // An older reader library without the wakeup, poll instead
+                    }
+                }
+                else
+                {
+                    Thread.Sleep(FRAME_TRANSPORT_POLL_MS);
+                }
+            }
+            catch (Exception ex) when (ex is DllNotFoundException || ex is EntryPointNotFoundException)
+            {
+                Console.WriteLine($"Frame transport reader not available, reading {DATA_FILE_PATH} instead: {ex.Message}");
+                frameTransportSupported = false;
+            }
+        }
+    }
+
+    // Function to take the newest frame from the RT tasks' shared memory into latestSharedMemoryFrame. Returns false
+    // when the segment was closed and the reader with it.
+    bool TakeSharedMemoryFrame()
+    {
+        var result = FrameTransportNative.Take(frameTransportReader, out var framePtr);
+        if (result == FrameTransportNative.CLOSED)
+        {
+            // The RT tasks stopped or restarted, open the new segment
+            FrameTransportNative.Close(frameTransportReader);
+            frameTransportReader = IntPtr.Zero;
+            lock (frameLock)
+                latestSharedMemoryFrame = null;
+            return false;
+        }
+        if (result != FrameTransportNative.NEW_FRAME)
+            return true;
+
+        // The frame is only valid until the next take, copy it out
+        var info = Marshal.PtrToStructure<FrameTransportFrameInfo>(framePtr);
+        var imageBytes = new byte[info.ImageSize];
+        Marshal.Copy(framePtr + FrameTransportNative.IMAGE_OFFSET, imageBytes, 0, imageBytes.Length);
+
+        TaskCompletionSource taken;
+        lock (frameLock)
+        {
+            latestSharedMemoryFrame = new SharedMemoryFrame(info, imageBytes);
+            latestSharedMemoryFrameTicks = Stopwatch.GetTimestamp();
+            taken = nextSharedMemoryFrame;
+            nextSharedMemoryFrame = new TaskCompletionSource(TaskCreationOptions.RunContinuationsAsynchronously);
+        }
+        taken.SetResult();
+        return true;
+    }
+
+    // Function to get the newest frame from the RT tasks' shared memory, null when it is not available. A writer that
+    // died leaves its segment behind with the last frame in it, so rtTaskRunning only holds while frames keep coming.
+    object? GetCameraDataFromSharedMemory()
+    {
+        SharedMemoryFrame? frame;
+        long takenTicks;
+        lock (frameLock)
+        {
+            frame = latestSharedMemoryFrame;
+            takenTicks = latestSharedMemoryFrameTicks;
+        }
+        if (frame == null)
+            return null;
+
+        var info = frame.Info;
+        return new
+        {
+            timestamp = info.TimestampUs,
+            frameNumber = info.FrameNumber,
+            width = info.Width,
+            height = info.Height,
+            format = "jpeg",
+            imageData = $"data:image/jpeg;base64,{Convert.ToBase64String(frame.Image)}",
+            imageSize = info.ImageSize,
+            ballDetected = info.BallDetected != 0,
+            centerX = Math.Round(info.CenterX, 2),
+            centerY = Math.Round(info.CenterY, 2),
+            radius = Math.Round(info.Radius, 2),
+            targetX = Math.Round(info.TargetX, 2),
+            targetY = Math.Round(info.TargetY, 2),
+            rtTaskRunning = Stopwatch.GetElapsedTime(takenTicks).TotalMilliseconds < RT_TASK_STALE_MS
+        };
+    }
+
+    // Function to wait until the frame transport thread takes a frame newer than the one served now, at most timeoutMs.
+    // Returns at once when the shared memory transport is not in use.
+    async Task WaitForSharedMemoryFrame(int timeoutMs)
+    {
+        Task next;
+        lock (frameLock)
+        {
+            if (!frameTransportSupported || latestSharedMemoryFrame == null)
+                return;
+            next = nextSharedMemoryFrame.Task;
+        }
+        await Task.WhenAny(next, Task.Delay(timeoutMs));
+    }
+
     // Function to read camera data from RT tasks
     object GetCameraDataFromRTTasks()
     {
+        var sharedMemoryFrame = GetCameraDataFromSharedMemory();
+        if (sharedMemoryFrame != null)
+            return sharedMemoryFrame;
+
         try
         {
             if (File.Exists(DATA_FILE_PATH))
@@ -173,6 +322,9 @@ try
         };
     }
 
+    // Start taking frames from the RT tasks' shared memory
+    new Thread(RunFrameTransport) { IsBackground = true, Name = "FrameTransport" }.Start();
+
     // Start HTTP request handling task
     var httpTask = Task.Run(async () =>
     {
@@ -181,46 +333,65 @@ try
             try
             {
                 var context = await httpListener.GetContextAsync();
-                var response = context.Response;
-                var url = context.Request.Url?.AbsolutePath ?? "";
 
-                Console.WriteLine($"Request: {url}");
+                // Each request runs on its own, so a frame request waiting for the next frame holds up no other
+                _ = Task.Run(() => HandleRequest(context));
+            }
+            catch (Exception ex) when (!shutdown)
+            {
+                Console.WriteLine($"HTTP request error: {ex.Message}");
+            }
+        }
+    });
 
-                if (url == "/camera/frame")
-                {
-                    // Get data from RT tasks via shared data file
-                    var frameData = GetCameraDataFromRTTasks();
+    async Task HandleRequest(HttpListenerContext context)
+    {
+        try
+        {
+            var response = context.Response;
+            var url = context.Request.Url?.AbsolutePath ?? "";
 
-                    var json = JsonConvert.SerializeObject(frameData, Formatting.Indented);
-                    var buffer = System.Text.Encoding.UTF8.GetBytes(json);
+            Console.WriteLine($"Request: {url}");
 
-                    response.ContentType = "application/json";
-                    response.ContentLength64 = buffer.Length;
-                    await response.OutputStream.WriteAsync(buffer, 0, buffer.Length);
-                }
-                else if (url == "/status")
-                {
-                    var buffer = System.Text.Encoding.UTF8.GetBytes("OK");
-                    response.ContentType = "text/plain";
-                    response.ContentLength64 = buffer.Length;
-                    await response.OutputStream.WriteAsync(buffer, 0, buffer.Length);
-                }
-                else
-                {
-                    response.StatusCode = 404;
-                    var error = System.Text.Encoding.UTF8.GetBytes("Not Found");
-                    response.ContentLength64 = error.Length;
-                    await response.OutputStream.WriteAsync(error, 0, error.Length);
-                }
+            if (url == "/camera/frame")
+            {
+                // With ?waitMs=N, hold the request until a newer frame is published (at most N ms) instead of
+                // answering with the frame already served
+                if (int.TryParse(context.Request.QueryString["waitMs"], out var waitMs) && waitMs > 0)
+                    await WaitForSharedMemoryFrame(Math.Min(waitMs, 1000));
 
-                response.Close();
+                // Get data from RT tasks via shared memory or the shared data file
+                var frameData = GetCameraDataFromRTTasks();
+
+                var json = JsonConvert.SerializeObject(frameData, Formatting.Indented);
+                var buffer = System.Text.Encoding.UTF8.GetBytes(json);
+
+                response.ContentType = "application/json";
+                response.ContentLength64 = buffer.Length;
+                await response.OutputStream.WriteAsync(buffer, 0, buffer.Length);
             }
-            catch (Exception ex) when (!shutdown)
+            else if (url == "/status")
             {
-                Console.WriteLine($"HTTP request error: {ex.Message}");
+                var buffer = System.Text.Encoding.UTF8.GetBytes("OK");
+                response.ContentType = "text/plain";
+                response.ContentLength64 = buffer.Length;
+                await response.OutputStream.WriteAsync(buffer, 0, buffer.Length);
+            }
+            else
+            {
+                response.StatusCode = 404;
+                var error = System.Text.Encoding.UTF8.GetBytes("Not Found");
+                response.ContentLength64 = error.Length;
+                await response.OutputStream.WriteAsync(error, 0, error.Length);
             }
+
+            response.Close();
         }
-    });
+        catch (Exception ex) when (!shutdown)
+        {
+            Console.WriteLine($"HTTP request error: {ex.Message}");
+        }
+    }
 
     // Main monitoring loop
     while (!shutdown)
@@ -253,3 +424,46 @@ Console.WriteLine($"Exit Code: {exitCode}");
 Console.WriteLine($"Ended at: {DateTime.Now:yyyy-MM-dd HH:mm:ss}");
 
 Environment.Exit(exitCode);
+
+// Reader API of libFrameTransportReader (rttasks/include/frame_transport.h)
+static class FrameTransportNative
+{
+    public const int CLOSED = -1;
+    public const int NO_FRAME = 0;
+    public const int NEW_FRAME = 1;
+    public const int IMAGE_OFFSET = 64; // The image follows the 64-byte metadata block
+
+    [DllImport("FrameTransportReader", EntryPoint = "frame_transport_open")]
+    public static extern IntPtr Open(string name);
+
+    [DllImport("FrameTransportReader", EntryPoint = "frame_transport_take")]
+    public static extern int Take(IntPtr reader, out IntPtr frame);
+
+    [DllImport("FrameTransportReader", EntryPoint = "frame_transport_wait")]
+    public static extern int Wait(IntPtr reader, uint timeoutMs);
+
+    [DllImport("FrameTransportReader", EntryPoint = "frame_transport_close")]
+    public static extern void Close(IntPtr reader);
+}
+
+// A frame taken from the frame transport, copied out of the segment
+record SharedMemoryFrame(FrameTransportFrameInfo Info, byte[] Image);
+
+// Metadata block of FrameTransportFrame
+[StructLayout(LayoutKind.Sequential)]
+struct FrameTransportFrameInfo
+{
+    public long FrameNumber;
+    public long TimestampUs;
+    public double TargetX;
+    public double TargetY;
+    public float CenterX;
+    public float CenterY;
+    public float Radius;
+    public int BallDetected;
+    public int DetectionMode;
+    public uint Format;
+    public uint ImageSize;
+    public ushort Width;
+    public ushort Height;
+}
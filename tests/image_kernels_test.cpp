@@ -0,0 +1,156 @@
+// Runs every dispatch level of the SIMD mask kernels (the half-resolution YUYV and the coarse YUYV and BayerRG8 row
+// kernels) the running CPU supports over random frames and compares the masks byte for byte with the scalar kernel.
+// The widths cover every remainder of the vector widths, the rows start at every alignment, and the bytes after the
+// mask row must be left alone. Exits with 1 on the first mismatch.
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "image_kernels.h"
+
+using namespace ImageProcessing::Kernels;
+
+namespace
+{
+  // A mask row kernel behind one signature. The one-row kernels ignore bottomRow.
+  using RowKernel = void (*)(const uint8_t *topRow, const uint8_t *bottomRow, uint8_t *maskRow, int maskWidth, uint8_t threshold);
+
+  template <ExtractMaskVRowFn Fn>
+  void OneRow(const uint8_t *topRow, const uint8_t *, uint8_t *maskRow, int maskWidth, uint8_t threshold)
+  {
+    Fn(topRow, maskRow, maskWidth, threshold);
+  }
+
+  template <ExtractCoarseMaskBayerRowFn Fn>
+  void TwoRows(const uint8_t *topRow, const uint8_t *bottomRow, uint8_t *maskRow, int maskWidth, uint8_t threshold)
+  {
+    Fn(topRow, bottomRow, maskRow, maskWidth, threshold);
+  }
+
+  // The kernels, the input bytes each reads per mask byte and whether they threshold BayerV of two rows
+  struct Kernel
+  {
+    const char *name;
+    int bytesPerSample;
+    bool bayer;
+    RowKernel scalar;
+    RowKernel sse2;
+    RowKernel avx2;
+  };
+
+  const Kernel KERNELS[] = {
+      {"ExtractMaskVRow", 4, false, OneRow<ExtractMaskVRowScalar>, OneRow<ExtractMaskVRowSSE2>, OneRow<ExtractMaskVRowAVX2>},
+      {"ExtractCoarseMaskVRow", 8, false, OneRow<ExtractCoarseMaskVRowScalar>, OneRow<ExtractCoarseMaskVRowSSE2>,
+       OneRow<ExtractCoarseMaskVRowAVX2>},
+      {"ExtractCoarseMaskBayerRow", 4, true, TwoRows<ExtractCoarseMaskBayerRowScalar>, TwoRows<ExtractCoarseMaskBayerRowSSE2>,
+       TwoRows<ExtractCoarseMaskBayerRowAVX2>},
+  };
+
+  struct Level
+  {
+    const char *name;
+    RowKernel fn;
+    bool supported;
+  };
+
+  std::vector<Level> Levels(const Kernel &kernel)
+  {
+    std::vector<Level> levels = {{"scalar", kernel.scalar, true}};
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    levels.push_back({"sse2", kernel.sse2, static_cast<bool>(__builtin_cpu_supports("sse2"))});
+    levels.push_back({"avx2", kernel.avx2, static_cast<bool>(__builtin_cpu_supports("avx2"))});
+#endif
+    return levels;
+  }
+
+  constexpr uint8_t GUARD = 0xA5; // Fills the mask rows, so bytes the kernel should not touch can be checked
+  constexpr int GUARD_BYTES = 64;
+
+  // Masks every row of a random frame maskWidth samples wide, with the first row offset bytes into the buffer. Row y
+  // and row y + 1 are the top and bottom rows of the two-row kernels.
+  bool CheckFrame(const Kernel &kernel, const Level &level, std::mt19937 &rng, int maskWidth, int height, int offset,
+                  uint8_t threshold)
+  {
+    const size_t rowBytes = size_t(kernel.bytesPerSample) * maskWidth;
+    std::vector<uint8_t> frame(offset + rowBytes * (height + 1));
+    for (uint8_t &byte : frame)
+      byte = static_cast<uint8_t>(rng());
+
+    // Thresholds at the ends and right around the random samples, where an off-by-one compare would show
+    if (maskWidth > 0 && rng() % 2)
+    {
+      const uint8_t *cell = frame.data() + offset;
+      threshold = kernel.bayer ? static_cast<uint8_t>(BayerV(cell[0], cell[1], cell[rowBytes], cell[rowBytes + 1])) : cell[3];
+    }
+
+    std::vector<uint8_t> expected(maskWidth + GUARD_BYTES, GUARD);
+    std::vector<uint8_t> actual(maskWidth + GUARD_BYTES, GUARD);
+    for (int y = 0; y < height; ++y)
+    {
+      const uint8_t *row = frame.data() + offset + y * rowBytes;
+      kernel.scalar(row, row + rowBytes, expected.data(), maskWidth, threshold);
+      level.fn(row, row + rowBytes, actual.data(), maskWidth, threshold);
+      if (std::memcmp(expected.data(), actual.data(), expected.size()) != 0)
+      {
+        int x = 0;
+        while (expected[x] == actual[x])
+          ++x;
+        std::printf("FAIL %s %s: width %d, offset %d, threshold %d, row %d differs at byte %d (%d, scalar %d)\n",
+                    kernel.name, level.name, maskWidth, offset, threshold, y, x, actual[x], expected[x]);
+        return false;
+      }
+    }
+    return true;
+  }
+}
+
+int main()
+{
+  std::mt19937 rng(1);
+  const uint8_t thresholds[] = {0, 1, 127, 128, 150, 254, 255};
+  int checked = 0;
+
+  for (const Kernel &kernel : KERNELS)
+  {
+    for (const Level &level : Levels(kernel))
+    {
+      if (!level.supported)
+      {
+        std::printf("%-26s %-8s not supported by this CPU, skipped\n", kernel.name, level.name);
+        continue;
+      }
+
+      // Widths 0..129 cover every remainder of the 16 and 32 sample loops, 320 and 160 are the half- and
+      // quarter-resolution masks of a frame
+      int frames = 0;
+      for (int maskWidth = 0; maskWidth <= 129; ++maskWidth)
+      {
+        for (int offset = 0; offset < 4; ++offset)
+        {
+          for (uint8_t threshold : thresholds)
+          {
+            if (!CheckFrame(kernel, level, rng, maskWidth, 3, offset, threshold))
+              return 1;
+            ++frames;
+          }
+        }
+      }
+      for (uint8_t threshold : thresholds)
+      {
+        if (!CheckFrame(kernel, level, rng, 320, 240, 0, threshold) || !CheckFrame(kernel, level, rng, 160, 120, 0, threshold))
+          return 1;
+        frames += 2;
+      }
+
+      std::printf("%-26s %-8s %d frames bit-exact with scalar\n", kernel.name, level.name, frames);
+      ++checked;
+    }
+  }
+
+  std::printf("Dispatched: %s, %d kernel levels checked\n", ExtractMaskVRowName(), checked);
+  return 0;
+}
@@ -0,0 +1,277 @@
+// Drives a PvtStreamer every sample against a mock of the multi-axis frame buffer, like MoveMotors does with RMP's
+// MultiAxis. The streamed points must keep to the velocity and acceleration limits on the way to a target and settle on
+// it, the frame buffer must never overflow, the stream must never run out of points while the target changes every
+// sample, and targets past the position limits must be clamped to them. Exits with 1 on a failure.
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+#include "pvt_streamer.h"
+
+using namespace MotionHelpers;
+
+namespace
+{
+  using Axes = std::array<double, PvtStreamer::AXIS_COUNT>;
+
+  constexpr double SAMPLE_RATE = 1000.0;
+  constexpr uint32_t LOOKAHEAD_POINTS = 4;
+  constexpr uint32_t FRAME_BUFFER_SIZE = LOOKAHEAD_POINTS; // Any point queued past the lookahead overflows
+  constexpr double TOLERANCE = 1e-9;
+
+  constexpr AxisLimits LIMITS = {-10.0, 10.0, 20.0, 400.0};
+
+  // Stand-in for the multi-axis: a frame buffer of frameBufferSize points executed at sampleRate when Advance is called.
+  // Like the controller, it throws std::runtime_error when the buffer overflows or when a motion is started while a
+  // final one is still executing, and stops with an underrun when a stream runs out of points.
+  class MockMultiAxis : public PvtMultiAxis
+  {
+  public:
+    struct Point
+    {
+      Axes position;
+      Axes velocity;
+      double time;
+    };
+
+    MockMultiAxis(uint32_t frameBufferSize, double sampleRate, const Axes &positions)
+        : frameBufferSize_(frameBufferSize), samplePeriod_(1.0 / sampleRate)
+    {
+      start_.position = positions;
+      start_.velocity = {};
+      start_.time = 0.0;
+    }
+
+    void MovePVT(const double *positions, const double *velocities, const double *times, int32_t pointCount, bool final) override
+    {
+      if (!queue_.empty() && final_)
+        throw std::runtime_error("MovePVT while a final motion is executing");
+      if (queue_.size() + static_cast<size_t>(pointCount) > frameBufferSize_)
+        throw std::runtime_error("frame buffer overflow");
+
+      if (queue_.empty())
+      {
+        motions_++;
+        elapsed_ = 0.0;
+      }
+      for (int32_t i = 0; i < pointCount; ++i)
+      {
+        Point point;
+        for (int axis = 0; axis < PvtStreamer::AXIS_COUNT; ++axis)
+        {
+          point.position[axis] = positions[i * PvtStreamer::AXIS_COUNT + axis];
+          point.velocity[axis] = velocities[i * PvtStreamer::AXIS_COUNT + axis];
+        }
+        point.time = times[i];
+        queue_.push_back(point);
+        history_.push_back(point);
+      }
+      final_ = final;
+    }
+
+    int32_t PointsRemaining() override { return static_cast<int32_t>(queue_.size()); }
+
+    // Executes one controller sample
+    void Advance()
+    {
+      if (queue_.empty())
+        return;
+
+      elapsed_ += samplePeriod_;
+      while (!queue_.empty() && elapsed_ >= queue_.front().time - 1e-12)
+      {
+        elapsed_ -= queue_.front().time;
+        start_ = queue_.front();
+        queue_.pop_front();
+      }
+
+      if (queue_.empty())
+      {
+        elapsed_ = 0.0;
+        if (!final_)
+        {
+          // Out of points mid-stream, the controller stops at the last one
+          underruns_++;
+          start_.velocity = {};
+          final_ = true;
+        }
+      }
+    }
+
+    // Commanded position, a cubic Hermite in the executing point like the controller interpolates
+    double Position(int axis) const
+    {
+      if (queue_.empty())
+        return start_.position[axis];
+
+      const Point &end = queue_.front();
+      const double t = end.time;
+      const double s = elapsed_ / t;
+      const double h00 = 2 * s * s * s - 3 * s * s + 1;
+      const double h10 = s * s * s - 2 * s * s + s;
+      const double h01 = -2 * s * s * s + 3 * s * s;
+      const double h11 = s * s * s - s * s;
+      return h00 * start_.position[axis] + h10 * t * start_.velocity[axis] + h01 * end.position[axis] + h11 * t * end.velocity[axis];
+    }
+
+    bool Moving() const { return !queue_.empty(); }
+    uint32_t Motions() const { return motions_; }     // Motions started
+    uint32_t Underruns() const { return underruns_; } // Streams that ran out of points
+    const std::vector<Point> &History() const { return history_; } // Every point appended
+
+  private:
+    uint32_t frameBufferSize_;
+    double samplePeriod_;
+    Point start_;             // State at the start of the executing point
+    std::deque<Point> queue_; // The executing point first
+    double elapsed_ = 0.0;    // Time into the executing point
+    bool final_ = true;
+    uint32_t motions_ = 0;
+    uint32_t underruns_ = 0;
+    std::vector<Point> history_;
+  };
+
+  MotionSettings Settings()
+  {
+    MotionSettings settings;
+    settings.mode = MoveMode::PvtStream;
+    settings.pvtPointSeconds = 1.0 / SAMPLE_RATE;
+    settings.pvtLookaheadPoints = LOOKAHEAD_POINTS;
+    return settings;
+  }
+
+  // Checks every appended point against the limits, starting at rest. Acceleration is only checked when
+  // asked, a target changed under way may have to stop an axis hard at a position limit.
+  bool WithinLimits(const char *name, const MockMultiAxis &multiAxis, bool checkAcceleration)
+  {
+    const double dt = 1.0 / SAMPLE_RATE;
+    Axes velocity = {};
+    for (const MockMultiAxis::Point &point : multiAxis.History())
+    {
+      for (int axis = 0; axis < PvtStreamer::AXIS_COUNT; ++axis)
+      {
+        if (point.position[axis] < LIMITS.minPosition - TOLERANCE || point.position[axis] > LIMITS.maxPosition + TOLERANCE)
+        {
+          std::printf("FAIL: %s: axis %d streamed to %g, past the position limits\n", name, axis, point.position[axis]);
+          return false;
+        }
+        if (std::abs(point.velocity[axis]) > LIMITS.maxVelocity + TOLERANCE)
+        {
+          std::printf("FAIL: %s: axis %d streamed at %g, past the velocity limit\n", name, axis, point.velocity[axis]);
+          return false;
+        }
+        const double acceleration = (point.velocity[axis] - velocity[axis]) / dt;
+        if (checkAcceleration && std::abs(acceleration) > LIMITS.maxAcceleration * (1.0 + TOLERANCE))
+        {
+          std::printf("FAIL: %s: axis %d streamed at %g/s^2, past the acceleration limit\n", name, axis, acceleration);
+          return false;
+        }
+        velocity[axis] = point.velocity[axis];
+      }
+    }
+    return true;
+  }
+
+  // Streams towards a fixed target until the axes stop, expecting them on expected within maxSamples
+  bool Settle(const char *name, const Axes &start, const Axes &target, const Axes &expected, uint32_t maxSamples)
+  {
+    PvtStreamer streamer(Settings(), {LIMITS, LIMITS});
+    MockMultiAxis multiAxis(FRAME_BUFFER_SIZE, SAMPLE_RATE, start);
+    streamer.Reset(start);
+
+    uint32_t samples = 0;
+    try
+    {
+      do
+      {
+        streamer.Step(multiAxis, target);
+        multiAxis.Advance();
+        samples++;
+      } while ((multiAxis.Moving() || streamer.Streaming()) && samples < maxSamples);
+    }
+    catch (const std::runtime_error &e)
+    {
+      std::printf("FAIL: %s: %s after %u samples\n", name, e.what(), samples);
+      return false;
+    }
+
+    bool passed = WithinLimits(name, multiAxis, true);
+    for (int axis = 0; axis < PvtStreamer::AXIS_COUNT; ++axis)
+    {
+      if (multiAxis.Moving() || std::abs(multiAxis.Position(axis) - expected[axis]) > TOLERANCE)
+      {
+        std::printf("FAIL: %s: axis %d at %g after %u samples, expected to settle on %g\n", name, axis,
+                    multiAxis.Position(axis), samples, expected[axis]);
+        passed = false;
+      }
+    }
+    if (multiAxis.Motions() != 1 || multiAxis.Underruns() != 0 || streamer.Underruns() != 0)
+    {
+      std::printf("FAIL: %s: %u motions and %u underruns, expected one motion without underruns\n", name,
+                  multiAxis.Motions(), multiAxis.Underruns());
+      passed = false;
+    }
+    if (passed)
+      std::printf("%s: settled in %u samples, %zu points\n", name, samples, multiAxis.History().size());
+    return passed;
+  }
+
+  // Moves the target to a random position every sample, which keeps the stream going the whole time
+  bool FollowMovingTarget(uint32_t samples)
+  {
+    const Axes start = {0.0, 0.0};
+    PvtStreamer streamer(Settings(), {LIMITS, LIMITS});
+    MockMultiAxis multiAxis(FRAME_BUFFER_SIZE, SAMPLE_RATE, start);
+    streamer.Reset(start);
+
+    std::mt19937 random(1);
+    std::uniform_real_distribution<double> position(LIMITS.minPosition, LIMITS.maxPosition);
+    try
+    {
+      for (uint32_t sample = 0; sample < samples; ++sample)
+      {
+        streamer.Step(multiAxis, {position(random), position(random)});
+        multiAxis.Advance();
+      }
+    }
+    catch (const std::runtime_error &e)
+    {
+      std::printf("FAIL: moving target: %s\n", e.what());
+      return false;
+    }
+
+    bool passed = WithinLimits("moving target", multiAxis, false);
+    if (multiAxis.Underruns() != 0 || streamer.Underruns() != 0)
+    {
+      std::printf("FAIL: moving target: the stream ran out of points %u times (%llu seen by the streamer)\n",
+                  multiAxis.Underruns(), static_cast<unsigned long long>(streamer.Underruns()));
+      passed = false;
+    }
+    if (passed)
+      std::printf("moving target: %llu points over %u samples without underruns\n",
+                  static_cast<unsigned long long>(streamer.PointsSent()), samples);
+    return passed;
+  }
+}
+
+int main()
+{
+  bool passed = true;
+
+  // 5 units at 20 units/s and 400 units/s^2 take 0.3 s
+  passed = Settle("settle", {0.0, 0.0}, {5.0, -2.0}, {5.0, -2.0}, 1000) && passed;
+  passed = Settle("short move", {1.0, 1.0}, {1.001, 0.999}, {1.001, 0.999}, 100) && passed;
+  passed = Settle("clamped", {0.0, 0.0}, {25.0, -40.0}, {LIMITS.maxPosition, LIMITS.minPosition}, 2000) && passed;
+  passed = FollowMovingTarget(20000) && passed;
+
+  if (passed)
+    std::printf("Streamed within the limits, settled and clamped, no overflow or underrun\n");
+  return passed ? 0 : 1;
+}
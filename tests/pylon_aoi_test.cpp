@@ -0,0 +1,179 @@
+// Moves the AOI of the Pylon frame source around on the Pylon camera emulator (PYLON_CAMEMU) while grabbing, the way
+// AOI tracking does: new offsets, new sizes (which restart grabbing) and back to the full frame, with frames leased
+// across the changes. Every requested AOI has to be programmed off the grabbing thread and arrive with the frames, no
+// grab may fail and the grabbing thread may never wait for the camera's nodes. The emulator's features are saved to
+// CONFIG_FILE first, which the source loads like camera.pfs. Exits with 77 (skipped) without an emulator or a pixel
+// format the detection takes, 1 on the first failure.
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+#include <pylon/PylonIncludes.h>
+
+#include "camera_aoi.h"
+#include "camera_helpers.h"
+#include "frame_source.h"
+
+using namespace CameraHelpers;
+
+namespace
+{
+  constexpr int SKIPPED = 77;
+  constexpr unsigned int GRAB_TIMEOUT_MS = 10; // GrabFrame's
+  constexpr auto AOI_DEADLINE = std::chrono::seconds(5); // For a requested AOI to arrive with the frames
+  constexpr auto LONGEST_GRAB = std::chrono::milliseconds(100); // Well over the timeout, well under an AOI restart
+
+  using Clock = std::chrono::steady_clock;
+
+  // Saves the emulator's features where ConfigureCamera loads camera.pfs from. False without an emulator.
+  bool SaveEmulatorFeatures()
+  {
+    try
+    {
+      Pylon::CInstantCamera camera(Pylon::CTlFactory::GetInstance().CreateFirstDevice());
+      camera.Open();
+      Pylon::CFeaturePersistence::Save(CONFIG_FILE, &camera.GetNodeMap());
+      camera.Close();
+      return true;
+    }
+    catch (const Pylon::GenericException &e)
+    {
+      std::printf("No camera emulator: %s\n", e.GetDescription());
+      return false;
+    }
+  }
+
+  // An AOI tracking source in the first pixel format the emulator has, nullptr if it has neither
+  std::unique_ptr<FrameSource> OpenSource()
+  {
+    for (PixelFormat format : {PixelFormat::BayerRG8, PixelFormat::YUYV})
+    {
+      FrameSourceSettings settings;
+      settings.type = FrameSourceType::Pylon;
+      settings.trackAoi = true;
+      settings.pixelFormat = format;
+      std::unique_ptr<FrameSource> source = CreateFrameSource(settings);
+      try
+      {
+        source->Open();
+        std::printf("Emulator opened in %s\n", format == PixelFormat::BayerRG8 ? "BayerRG8" : "YUYV");
+        return source;
+      }
+      catch (const std::runtime_error &e)
+      {
+        std::printf("%s\n", e.what());
+      }
+    }
+    return nullptr;
+  }
+
+  // Grabs until a frame comes with aoi, leasing every second frame and holding up to two leases, so grab buffers are
+  // out while grabbing restarts. Fails on a grab error, a grab that waited for the camera or when aoi does not arrive
+  // in time. The source checks that every frame holds an aligned AOI of the full frame.
+  bool GrabUntil(FrameSource &source, const CameraAoi &aoi, std::vector<FrameLease> &leases)
+  {
+    const Clock::time_point deadline = Clock::now() + AOI_DEADLINE;
+    int frames = 0;
+    while (Clock::now() < deadline)
+    {
+      const Clock::time_point start = Clock::now();
+      bool grabbed = false;
+      try
+      {
+        if (frames % 2 == 0)
+        {
+          FrameLease lease;
+          grabbed = source.TryLeaseFrame(lease, GRAB_TIMEOUT_MS);
+          if (grabbed)
+          {
+            if (leases.size() == 2)
+              leases.erase(leases.begin());
+            leases.push_back(std::move(lease));
+          }
+        }
+        else
+        {
+          const uint8_t *frame = nullptr;
+          grabbed = source.TryGrabFrame(frame, GRAB_TIMEOUT_MS);
+        }
+      }
+      catch (const std::runtime_error &e)
+      {
+        std::printf("FAIL: grab failed while moving the AOI: %s\n", e.what());
+        return false;
+      }
+
+      const Clock::duration took = Clock::now() - start;
+      if (took > LONGEST_GRAB)
+      {
+        std::printf("FAIL: a grab took %lld ms, it waited for the AOI to be programmed\n",
+                    static_cast<long long>(std::chrono::duration_cast<std::chrono::milliseconds>(took).count()));
+        return false;
+      }
+      if (!grabbed)
+        continue;
+      ++frames;
+
+      if (source.LastAoi() == aoi)
+      {
+        if (source.ProgrammedAoi() != aoi)
+        {
+          std::printf("FAIL: frames come with the requested AOI, but another one is reported programmed\n");
+          return false;
+        }
+        std::printf("%ux%u AOI at (%u, %u) after %d frames\n", aoi.width, aoi.height, aoi.offsetX, aoi.offsetY, frames);
+        return true;
+      }
+    }
+    std::printf("FAIL: the %ux%u AOI at (%u, %u) did not arrive within %lld s\n", aoi.width, aoi.height, aoi.offsetX,
+                aoi.offsetY, static_cast<long long>(std::chrono::duration_cast<std::chrono::seconds>(AOI_DEADLINE).count()));
+    return false;
+  }
+}
+
+int main()
+{
+  setenv("PYLON_CAMEMU", "1", 0);
+  Pylon::PylonAutoInitTerm pylon;
+
+  if (!SaveEmulatorFeatures())
+    return SKIPPED;
+  std::unique_ptr<FrameSource> source = OpenSource();
+  if (!source)
+    return SKIPPED;
+
+  // Offsets within a size are written while grabbing, every size change restarts it
+  const std::vector<CameraAoi> aois = {
+      CameraAoi(),
+      CenterAoi(1, 200.0f, 150.0f),
+      CenterAoi(1, 420.0f, 300.0f),
+      CenterAoi(2, 420.0f, 300.0f),
+      CenterAoi(2, 100.0f, 400.0f),
+      CenterAoi(1, 320.0f, 240.0f),
+      CameraAoi(),
+      CenterAoi(2, 600.0f, 40.0f),
+      CameraAoi(),
+  };
+
+  std::vector<FrameLease> leases;
+  for (const CameraAoi &aoi : aois)
+  {
+    source->RequestAoi(aoi);
+    if (!GrabUntil(*source, aoi, leases))
+      return 1;
+  }
+  leases.clear();
+
+  if (source->AoiFailures() != 0)
+  {
+    std::printf("FAIL: %llu AOIs could not be programmed\n", static_cast<unsigned long long>(source->AoiFailures()));
+    return 1;
+  }
+  std::printf("Every AOI was programmed off the grabbing thread and came with the frames\n");
+  return 0;
+}
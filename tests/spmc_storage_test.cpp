@@ -0,0 +1,155 @@
+// Runs an SPMCStorage, the storage behind the frame handoff, with as many readers as it takes, each holding its element
+// for a random while and dropping it now and then, while the writer publishes as fast as it can and a second writer
+// carries on after the first. Every element is filled with its publication number, so a reader that sees another number
+// in it read a slot the writer was filling. Readers must also never go back to an older publication, and one reader
+// more than the limit must be refused. Build with TESTS_TSAN to run it under ThreadSanitizer. Exits with 1 on a
+// failure.
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "shared_data_helpers.h"
+
+using namespace SharedDataHelpers;
+
+namespace
+{
+  constexpr uint32_t READERS = 5;
+  constexpr uint64_t PUBLICATIONS = 100000; // By the first writer
+  constexpr uint64_t CARRIED_ON = 1000;     // By the second one
+  constexpr uint32_t MAX_HOLD_YIELDS = 50;  // A reader yields up to this often while holding an element
+
+  // 2 KiB over many cache lines, so an element the writer refills while it is read shows
+  struct Element
+  {
+    uint64_t words[256];
+  };
+
+  using Storage = SPMCStorage<Element, READERS>;
+  using Reader = SPMCStorageReader<std::shared_ptr<Storage>>;
+  using Writer = SPMCStorageWriter<std::shared_ptr<Storage>>;
+
+  struct ReaderCounts
+  {
+    std::atomic<uint64_t> taken{0};
+    std::atomic<uint64_t> torn{0};
+    std::atomic<uint64_t> backwards{0};
+  };
+
+  void Read(const std::shared_ptr<Storage> &storage, const std::atomic<bool> &done, uint32_t seed, ReaderCounts &counts)
+  {
+    Reader reader(storage);
+    std::mt19937 random(seed);
+    uint64_t last = 0;
+    for (;;)
+    {
+      const bool finished = done.load(std::memory_order_acquire);
+      if (!reader.acquire())
+      {
+        if (finished)
+          return;
+        std::this_thread::yield();
+        continue;
+      }
+
+      const uint64_t publication = reader.publication();
+      if (publication <= last)
+        counts.backwards.fetch_add(1, std::memory_order_relaxed);
+      last = publication;
+
+      // Hold the element while the writer moves on, then check it is still the one taken
+      for (uint32_t i = random() % MAX_HOLD_YIELDS; i > 0; --i)
+        std::this_thread::yield();
+      for (uint64_t word : reader.data().words)
+      {
+        if (word != publication)
+        {
+          counts.torn.fetch_add(1, std::memory_order_relaxed);
+          break;
+        }
+      }
+      counts.taken.fetch_add(1, std::memory_order_relaxed);
+
+      if (random() % 4 == 0)
+        reader.release();
+    }
+  }
+
+  void Publish(const std::shared_ptr<Storage> &storage, uint64_t count)
+  {
+    Writer writer(storage);
+    for (uint64_t i = 0; i < count; ++i)
+    {
+      const uint64_t publication = writer.publications() + 1;
+      for (uint64_t &word : writer.data().words)
+        word = publication;
+      writer.publish();
+      std::this_thread::yield();
+    }
+  }
+}
+
+int main()
+{
+  const std::shared_ptr<Storage> storage = std::make_shared<Storage>();
+  std::atomic<bool> done{false};
+  ReaderCounts counts;
+
+  std::vector<std::thread> readers;
+  for (uint32_t i = 0; i < READERS; ++i)
+    readers.emplace_back(Read, std::cref(storage), std::cref(done), i, std::ref(counts));
+
+  Publish(storage, PUBLICATIONS);
+  Publish(storage, CARRIED_ON);
+  done.store(true, std::memory_order_release);
+  for (std::thread &reader : readers)
+    reader.join();
+
+  bool passed = true;
+  std::printf("%llu elements taken by %u readers of %llu published\n", static_cast<unsigned long long>(counts.taken.load()),
+              READERS, static_cast<unsigned long long>(PUBLICATIONS + CARRIED_ON));
+  if (counts.torn.load() != 0)
+  {
+    std::printf("FAIL: %llu elements changed while a reader held them\n", static_cast<unsigned long long>(counts.torn.load()));
+    passed = false;
+  }
+  if (counts.backwards.load() != 0)
+  {
+    std::printf("FAIL: readers went back to an older publication %llu times\n",
+                static_cast<unsigned long long>(counts.backwards.load()));
+    passed = false;
+  }
+  if (counts.taken.load() == 0)
+  {
+    std::printf("FAIL: no reader took an element\n");
+    passed = false;
+  }
+
+  // The storage has a slot for each of READERS readers, one more has to be refused
+  std::vector<std::unique_ptr<Reader>> attached;
+  try
+  {
+    for (uint32_t i = 0; i <= READERS; ++i)
+      attached.push_back(std::make_unique<Reader>(storage));
+    std::printf("FAIL: reader %u of %u was attached\n", READERS + 1, READERS);
+    passed = false;
+  }
+  catch (const std::runtime_error &e)
+  {
+    if (attached.size() != READERS)
+    {
+      std::printf("FAIL: only %zu readers were attached: %s\n", attached.size(), e.what());
+      passed = false;
+    }
+  }
+
+  if (passed)
+    std::printf("No torn or older elements, reader limit kept\n");
+  return passed ? 0 : 1;
+}
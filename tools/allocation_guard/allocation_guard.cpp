@@ -0,0 +1,98 @@
+// RTAllocationGuard: heap allocation guard for the RT tasks.
+//
+// Preload this library into the RTTaskManager (LD_PRELOAD=libRTAllocationGuard.so) together with an RTTaskFunctions
+// built with -DRTTASKS_ALLOCATION_GUARD=COUNT or TRAP. It replaces the C allocation functions, so allocations made by
+// any library (libstdc++, OpenCV, Pylon) are seen. While a thread is inside a MemoryHelpers::AllocationGuardScope
+// every allocation is counted, and with ALLOCATION_GUARD_TRAP the process stops with SIGTRAP at the offending call.
+
+#include <atomic>
+#include <csignal>
+#include <cstddef>
+#include <cstdint>
+#include <cerrno>
+#include <unistd.h>
+
+// glibc's own allocator entry points, used to forward without dlsym (which can allocate)
+extern "C"
+{
+  void *__libc_malloc(size_t size);
+  void *__libc_calloc(size_t count, size_t size);
+  void *__libc_realloc(void *ptr, size_t size);
+  void *__libc_memalign(size_t alignment, size_t size);
+  void __libc_free(void *ptr);
+}
+
+namespace
+{
+  // initial-exec TLS never allocates on first access, which matters inside malloc
+  __thread int g_guardDepth __attribute__((tls_model("initial-exec"))) = 0;
+  std::atomic<uint64_t> g_guardedAllocations{0};
+
+  inline void CheckAllocation()
+  {
+    if (g_guardDepth == 0)
+      return;
+
+    g_guardedAllocations.fetch_add(1, std::memory_order_relaxed);
+#if defined(ALLOCATION_GUARD_TRAP)
+    static constexpr char MESSAGE[] = "[RTAllocationGuard] Heap allocation inside a guarded RT section\n";
+    ssize_t ignored = write(STDERR_FILENO, MESSAGE, sizeof(MESSAGE) - 1);
+    (void)ignored;
+    raise(SIGTRAP);
+#endif
+  }
+}
+
+extern "C"
+{
+  __attribute__((visibility("default"))) void RTAllocationGuardEnter() { ++g_guardDepth; }
+  __attribute__((visibility("default"))) void RTAllocationGuardExit() { --g_guardDepth; }
+  __attribute__((visibility("default"))) uint64_t RTAllocationGuardCount() { return g_guardedAllocations.load(std::memory_order_relaxed); }
+
+  __attribute__((visibility("default"))) void *malloc(size_t size)
+  {
+    CheckAllocation();
+    return __libc_malloc(size);
+  }
+
+  __attribute__((visibility("default"))) void *calloc(size_t count, size_t size)
+  {
+    CheckAllocation();
+    return __libc_calloc(count, size);
+  }
+
+  __attribute__((visibility("default"))) void *realloc(void *ptr, size_t size)
+  {
+    CheckAllocation();
+    return __libc_realloc(ptr, size);
+  }
+
+  __attribute__((visibility("default"))) void *memalign(size_t alignment, size_t size)
+  {
+    CheckAllocation();
+    return __libc_memalign(alignment, size);
+  }
+
+  __attribute__((visibility("default"))) void *aligned_alloc(size_t alignment, size_t size)
+  {
+    CheckAllocation();
+    return __libc_memalign(alignment, size);
+  }
+
+  __attribute__((visibility("default"))) int posix_memalign(void **ptr, size_t alignment, size_t size)
+  {
+    CheckAllocation();
+    if (alignment % sizeof(void *) != 0 || (alignment & (alignment - 1)) != 0)
+      return EINVAL;
+    void *result = __libc_memalign(alignment, size);
+    if (result == nullptr)
+      return ENOMEM;
+    *ptr = result;
+    return 0;
+  }
+
+  __attribute__((visibility("default"))) void free(void *ptr)
+  {
+    __libc_free(ptr);
+  }
+}
@@ -0,0 +1,206 @@
+// Reader side of the frame transport (frame_transport.h) for processes outside the RTTaskManager, such as the camera
+// server. Follows the triple buffer protocol of shared_memory_layout.h.
+
+#define _GNU_SOURCE // kill, shm_open, syscall
+
+#include "frame_transport.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#define CACHE_LINE 64u
+#define ROUND_UP(size) (((size) + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE)
+
+struct FrameTransportReader
+{
+  int fd; // Kept open to notice when the writer unlinks the segment
+  uint8_t *segment;
+  size_t size;
+  SharedMemorySPSCHeader *header;
+  uint32_t index;
+  uint32_t seenSequence; // publishSequence at the last take
+};
+
+static const FrameTransportFrame *Slot(const FrameTransportReader *reader, uint32_t index)
+{
+  return (const FrameTransportFrame *)(reader->segment + reader->header->elementOffset + index * reader->header->elementStride);
+}
+
+static int ValidHeader(const SharedMemorySPSCHeader *header, size_t size)
+{
+  return memcmp(header->magic, SHM_SPSC_MAGIC, sizeof(header->magic)) == 0 &&
+         header->layoutVersion == SHM_SPSC_LAYOUT_VERSION &&
+         header->payloadVersion == FRAME_TRANSPORT_VERSION &&
+         header->headerSize == sizeof(SharedMemorySPSCHeader) &&
+         header->elementSize == sizeof(FrameTransportFrame) &&
+         header->elementOffset == ROUND_UP(sizeof(SharedMemorySPSCHeader)) &&
+         header->elementStride == ROUND_UP(sizeof(FrameTransportFrame)) &&
+         size >= header->elementOffset + SHM_SPSC_SLOTS * header->elementStride;
+}
+
+// Takes the reader role, also from a reader that exited without detaching
+static int ClaimReader(SharedMemorySPSCHeader *header)
+{
+  int32_t expected = 0;
+  const int32_t self = (int32_t)getpid();
+  if (__atomic_compare_exchange_n(&header->readerPid, &expected, self, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+    return 1;
+  if (kill(expected, 0) == -1 && errno == ESRCH)
+    return __atomic_compare_exchange_n(&header->readerPid, &expected, self, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+  return 0;
+}
+
+FrameTransportReader *frame_transport_open(const char *name)
+{
+  const int fd = shm_open(name, O_RDWR, 0);
+  if (fd == -1)
+    return NULL;
+
+  struct stat segmentStat;
+  if (fstat(fd, &segmentStat) == -1 || (size_t)segmentStat.st_size < sizeof(SharedMemorySPSCHeader))
+  {
+    close(fd);
+    errno = EINVAL;
+    return NULL;
+  }
+
+  const size_t size = (size_t)segmentStat.st_size;
+  void *mapping = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (mapping == MAP_FAILED)
+  {
+    close(fd);
+    return NULL;
+  }
+
+  SharedMemorySPSCHeader *header = (SharedMemorySPSCHeader *)mapping;
+  if (!ValidHeader(header, size))
+  {
+    munmap(mapping, size);
+    close(fd);
+    errno = EPROTO;
+    return NULL;
+  }
+  if (!ClaimReader(header))
+  {
+    munmap(mapping, size);
+    close(fd);
+    errno = EBUSY;
+    return NULL;
+  }
+
+  // Our slot is the one the writer and spare do not hold. Equal indices mean the writer is between its exchange and
+  // the writerIndex store.
+  uint32_t writer = 0, spare = 0;
+  for (int attempt = 0; attempt < 1000 && writer == spare; ++attempt)
+  {
+    writer = __atomic_load_n(&header->writerIndex, __ATOMIC_ACQUIRE);
+    spare = __atomic_load_n(&header->spareIndex, __ATOMIC_ACQUIRE);
+  }
+  if (writer == spare || writer >= SHM_SPSC_SLOTS || spare >= SHM_SPSC_SLOTS)
+  {
+    __atomic_store_n(&header->readerPid, 0, __ATOMIC_RELEASE);
+    munmap(mapping, size);
+    close(fd);
+    errno = EPROTO;
+    return NULL;
+  }
+
+  FrameTransportReader *reader = calloc(1, sizeof(FrameTransportReader));
+  if (reader == NULL)
+  {
+    __atomic_store_n(&header->readerPid, 0, __ATOMIC_RELEASE);
+    munmap(mapping, size);
+    close(fd);
+    return NULL;
+  }
+  reader->fd = fd;
+  reader->segment = (uint8_t *)mapping;
+  reader->size = size;
+  reader->header = header;
+  reader->index = SHM_SPSC_SLOTS - writer - spare;
+  reader->seenSequence = __atomic_load_n(&header->publishSequence, __ATOMIC_ACQUIRE);
+  return reader;
+}
+
+int frame_transport_take(FrameTransportReader *reader, const FrameTransportFrame **frame)
+{
+  SharedMemorySPSCHeader *header = reader->header;
+
+  // Read before the exchange, so the last frame published before the writer closed is still picked up
+  const uint32_t closed = __atomic_load_n(&header->closed, __ATOMIC_ACQUIRE);
+
+  reader->seenSequence = __atomic_load_n(&header->publishSequence, __ATOMIC_ACQUIRE);
+  reader->index = __atomic_exchange_n(&header->spareIndex, reader->index, __ATOMIC_ACQ_REL);
+  if (header->flags[reader->index] != 0)
+  {
+    header->flags[reader->index] = 0;
+    *frame = Slot(reader, reader->index);
+    return FRAME_TRANSPORT_NEW_FRAME;
+  }
+  if (closed != 0)
+    return FRAME_TRANSPORT_CLOSED;
+
+  // A writer that exited without closing is noticed when its replacement unlinks the segment
+  struct stat segmentStat;
+  if (__atomic_load_n(&header->closed, __ATOMIC_ACQUIRE) == 0 &&
+      (fstat(reader->fd, &segmentStat) == -1 || segmentStat.st_nlink == 0))
+    return FRAME_TRANSPORT_CLOSED;
+  return FRAME_TRANSPORT_NO_FRAME;
+}
+
+int frame_transport_wait(FrameTransportReader *reader, unsigned int timeoutMs)
+{
+  SharedMemorySPSCHeader *header = reader->header;
+  struct timespec now, deadline;
+  clock_gettime(CLOCK_MONOTONIC, &deadline);
+  deadline.tv_sec += timeoutMs / 1000;
+  deadline.tv_nsec += (long)(timeoutMs % 1000) * 1000000L;
+  if (deadline.tv_nsec >= 1000000000L)
+  {
+    deadline.tv_sec++;
+    deadline.tv_nsec -= 1000000000L;
+  }
+
+  // The writer only makes the wake syscall while waiters is nonzero, see shared_memory_layout.h
+  __atomic_fetch_add(&header->waiters, 1, __ATOMIC_SEQ_CST);
+  int result = FRAME_TRANSPORT_NEW_FRAME;
+  while (__atomic_load_n(&header->publishSequence, __ATOMIC_SEQ_CST) == reader->seenSequence)
+  {
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    struct timespec timeout = {deadline.tv_sec - now.tv_sec, deadline.tv_nsec - now.tv_nsec};
+    if (timeout.tv_nsec < 0)
+    {
+      timeout.tv_sec--;
+      timeout.tv_nsec += 1000000000L;
+    }
+    if (timeout.tv_sec < 0)
+    {
+      result = FRAME_TRANSPORT_NO_FRAME;
+      break;
+    }
+    syscall(SYS_futex, &header->publishSequence, FUTEX_WAIT, reader->seenSequence, &timeout, NULL, 0);
+  }
+  __atomic_fetch_sub(&header->waiters, 1, __ATOMIC_RELAXED);
+  return result;
+}
+
+void frame_transport_close(FrameTransportReader *reader)
+{
+  if (reader == NULL)
+    return;
+
+  int32_t self = (int32_t)getpid();
+  __atomic_compare_exchange_n(&reader->header->readerPid, &self, 0, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+  munmap(reader->segment, reader->size);
+  close(reader->fd);
+  free(reader);
+}